@@ -0,0 +1,275 @@
+/*
+\file	BMA180Acquisition.h
+\version	1.0.0
+\purpose	Interrupt-paced BMA180 sampling into a timestamped lock-free ring.
+\compiler	Arduino 1.0.1
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the 
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+/*	Usage:
+		BMA180AccelerometerSPI						accel(9);
+		SPSCRingBuffer<BMA180Sample, 32>			ring;
+		BMA180AcquisitionT<BMA180AccelerometerSPI>	acq(accel, ring);
+
+		acq.beginDataReadyInterrupt(0);		// BMA180 INT wired to external interrupt 0, or
+		acq.beginTimer(1000);				// Timer1, one sample per millisecond, or
+		acq.beginTimer();					// Timer1 at the accelerometer's data rate (samplePeriodMicros())
+											// (Timer1 pacing needs #include <BMA180Timer1.h>, see there)
+
+		loop():
+			acq.service();
+			BMA180Sample aBatch[8];
+			unsigned char n = acq.read(aBatch, 8);
+
+	Each interrupt takes one burst read (readAccelerationXYZ), timestamps it with micros() and pushes it into the ring.
+	If the main loop is in the middle of an SPI transaction when the interrupt comes, the sample is deferred: it is
+	posted as a bus request and taken at the next service point, between asynchronous transactions or by service()
+	(or SPIExternalDevice::spiServiceRequests()), whichever comes first.  So call service() at least once per sample
+	period.  The accelerometer's bus priority (spiSetPriority()) decides whether it goes before or after other
+	deferred work.  A deferred sample keeps the time of its interrupt, not the time it was read.
+	If the ring is full, the sample is dropped and counted as an overrun.  If the next interrupt comes while a sample
+	is still deferred, the two become one sample, with the later time, and the other one is counted as missed.	*/
+
+#ifndef BMA180ACQUISITION_H_INCLUDED
+#define BMA180ACQUISITION_H_INCLUDED
+
+#include <Arduino.h>
+#include <SPIExternalDevice.h>
+#include <SPSCRingBuffer.h>
+#include "BMA180SPI.h"
+
+
+struct BMA180Sample
+{
+	unsigned long			iMicros;	// micros() when the interrupt came
+	BMA180AccelerationXYZ	accel;
+};
+
+
+// Timer1 in CTC mode, shared by all acquisition objects.  Only one of them can use it at a time.
+// Defined, with its ISR, in the BMA180Timer1 library.
+class BMA180AcquisitionTimer
+{
+public:
+	static bool begin(unsigned long iPeriodMicros, void (*pfnTick)());	// false if the period is out of range for Timer1
+	static void end();
+};
+
+
+template<class Accelerometer>
+class BMA180AcquisitionT
+{
+public:
+	BMA180AcquisitionT(Accelerometer& accel, SPSCRing<BMA180Sample>& ring);
+
+	void beginDataReadyInterrupt(unsigned char iExtInterrupt);	// paced by the BMA180 new-data interrupt
+	bool beginTimer(unsigned long iPeriodMicros);				// paced by Timer1
+	bool beginTimer()	{ return beginTimer(m_accel.samplePeriodMicros()); }	// one sample per conversion
+	void end();
+
+	unsigned char read(BMA180Sample* pSamples, unsigned char iMaxCount);	// Consumer side.  Drains up to iMaxCount samples.
+	unsigned char available() const	{ return m_ring.available(); }
+	void service();						// Call from the main loop.  Takes a sample that the ISR had to defer.
+
+	void sampleFromISR();				// Producer side.  Called from the ISR.
+
+	unsigned int overruns();			// samples dropped because the ring was full
+	unsigned int deferrals();			// samples that were taken late because the bus was busy
+	unsigned int missed();				// interrupts that came while the previous sample was still deferred
+
+private:
+	static void interruptTrampoline();
+	static void requestService(void* pContext);
+	void takePendingSample();
+	static BMA180AcquisitionT*	s_pInstance;
+
+	Accelerometer&				m_accel;
+	SPSCRing<BMA180Sample>&		m_ring;
+	unsigned char				m_iExtInterrupt;
+	void						(*m_pfnTimerEnd)();	// set while Timer1 paces; only beginTimer() refers to BMA180AcquisitionTimer
+	volatile bool				m_bPending;
+	volatile unsigned long		m_iPendingMicros;	// when the interrupt of the pending sample came
+	SPIExternalDevice::BusRequest	m_request;		// posts the deferred sample to the bus arbiter
+	volatile unsigned int		m_iOverruns;
+	volatile unsigned int		m_iDeferrals;
+	volatile unsigned int		m_iMissed;
+
+	static const unsigned char NO_INTERRUPT = 0xFF;
+};
+
+
+template<class Accelerometer>
+BMA180AcquisitionT<Accelerometer>* BMA180AcquisitionT<Accelerometer>::s_pInstance = 0;
+
+template<class Accelerometer>
+const unsigned char BMA180AcquisitionT<Accelerometer>::NO_INTERRUPT;
+
+
+template<class Accelerometer>
+BMA180AcquisitionT<Accelerometer>::BMA180AcquisitionT(Accelerometer& accel, SPSCRing<BMA180Sample>& ring)
+	: m_accel(accel)
+	, m_ring(ring)
+	, m_iExtInterrupt(NO_INTERRUPT)
+	, m_pfnTimerEnd(0)
+	, m_bPending(false)
+	, m_iOverruns(0)
+	, m_iDeferrals(0)
+	, m_iMissed(0)
+{
+}
+
+
+template<class Accelerometer>
+void BMA180AcquisitionT<Accelerometer>::beginDataReadyInterrupt(unsigned char iExtInterrupt)
+// PRECONDITIONS:	SPI master on the AVR has been initialized
+{
+	end();
+	s_pInstance = this;
+	m_iExtInterrupt = iExtInterrupt;
+	m_accel.enableNewDataInterrupt(true);
+	::attachInterrupt(iExtInterrupt, interruptTrampoline, RISING);
+}
+
+
+template<class Accelerometer>
+bool BMA180AcquisitionT<Accelerometer>::beginTimer(unsigned long iPeriodMicros)
+{
+	end();
+	s_pInstance = this;
+	if (!BMA180AcquisitionTimer::begin(iPeriodMicros, interruptTrampoline))
+		return false;
+	m_pfnTimerEnd = BMA180AcquisitionTimer::end;
+	return true;
+}
+
+
+template<class Accelerometer>
+void BMA180AcquisitionT<Accelerometer>::end()
+{
+	if (m_iExtInterrupt != NO_INTERRUPT)
+	{
+		::detachInterrupt(m_iExtInterrupt);
+		m_accel.enableNewDataInterrupt(false);
+		m_iExtInterrupt = NO_INTERRUPT;
+	}
+	if (m_pfnTimerEnd)
+	{
+		m_pfnTimerEnd();
+		m_pfnTimerEnd = 0;
+	}
+	m_bPending = false;
+	if (s_pInstance == this)
+		s_pInstance = 0;
+}
+
+
+template<class Accelerometer>
+void BMA180AcquisitionT<Accelerometer>::interruptTrampoline()
+{
+	if (s_pInstance)
+		s_pInstance->sampleFromISR();
+}
+
+
+template<class Accelerometer>
+void BMA180AcquisitionT<Accelerometer>::sampleFromISR()
+// PRECONDITIONS:	interrupts disabled (ISR context)
+{
+	if (m_bPending)
+		++m_iMissed;			// the deferred sample hasn't been taken yet.  This interrupt takes its place.
+	m_iPendingMicros = micros();
+	m_bPending = true;
+	takePendingSample();
+}
+
+
+template<class Accelerometer>
+void BMA180AcquisitionT<Accelerometer>::takePendingSample()
+// PRECONDITIONS:	interrupts disabled, m_bPending
+{
+	if (SPIExternalDevice::spiBusBusy())
+	{
+		// the main loop is in the middle of a transaction.  The sample is taken at the next service point.
+		m_accel.spiPostRequest(&m_request, requestService, this);
+		return;
+	}
+	m_bPending = false;
+
+	BMA180Sample sample;
+	sample.iMicros = m_iPendingMicros;
+	sample.accel = m_accel.readAccelerationXYZ();
+	if (!m_ring.push(sample))
+		++m_iOverruns;
+}
+
+
+template<class Accelerometer>
+void BMA180AcquisitionT<Accelerometer>::service()
+{
+	if (!m_bPending)
+		return;
+
+	byte oldSREG = SREG;
+	cli();	// the ISR must not sample at the same time
+	requestService(this);
+	SREG = oldSREG;
+}
+
+
+template<class Accelerometer>
+void BMA180AcquisitionT<Accelerometer>::requestService(void* pContext)
+// PRECONDITIONS:	interrupts disabled
+{
+	BMA180AcquisitionT* pAcquisition = static_cast<BMA180AcquisitionT*>(pContext);
+	if (pAcquisition->m_bPending)
+	{
+		++pAcquisition->m_iDeferrals;
+		pAcquisition->takePendingSample();
+	}
+}
+
+
+template<class Accelerometer>
+unsigned char BMA180AcquisitionT<Accelerometer>::read(BMA180Sample* pSamples, unsigned char iMaxCount)
+{
+	return m_ring.pop(pSamples, iMaxCount);
+}
+
+
+template<class Accelerometer>
+unsigned int BMA180AcquisitionT<Accelerometer>::overruns()
+{
+	byte oldSREG = SREG;
+	cli();	// 16-bit counter written by the ISR
+	unsigned int iCount = m_iOverruns;
+	SREG = oldSREG;
+	return iCount;
+}
+
+
+template<class Accelerometer>
+unsigned int BMA180AcquisitionT<Accelerometer>::deferrals()
+{
+	byte oldSREG = SREG;
+	cli();
+	unsigned int iCount = m_iDeferrals;
+	SREG = oldSREG;
+	return iCount;
+}
+
+
+template<class Accelerometer>
+unsigned int BMA180AcquisitionT<Accelerometer>::missed()
+{
+	byte oldSREG = SREG;
+	cli();
+	unsigned int iCount = m_iMissed;
+	SREG = oldSREG;
+	return iCount;
+}
+
+
+#endif
@@ -0,0 +1,320 @@
+/*
+\file	BMA180Array.h
+\version	1.0.0
+\purpose	Several BMA180s on one SPI bus, read back to back in one sweep into a structure-of-arrays sample block.
+\compiler	Arduino 1.0.1
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+/*	Usage:
+		BMA180AccelerometerSPI		accel0(9, SPIExternalDevice::DIV2), accel1(8, SPIExternalDevice::DIV2), accel2(7, SPIExternalDevice::DIV2);
+		BMA180AccelerometerSPI*		apSensors[3] = { &accel0, &accel1, &accel2 };
+		BMA180ArrayT<BMA180AccelerometerSPI, 3>	array(apSensors);
+		BMA180ArrayBlockBuffer<3, 32>			block;		// 32 sweeps of 3 sensors
+
+		array.configure(BMA180AccelerometerSPI::RANGE_2G, BMA180AccelerometerSPI::BW_1200HZ, BMA180AccelerometerSPI::MODE_LOW_NOISE);
+
+		loop(), or a timer ISR (see below):
+			array.sample(block);
+			if (block.full())
+			{
+				analyse(block.x(0), block.x(1), ...);	// one contiguous series per sensor and axis
+				block.clear();
+			}
+
+	A sweep is one burst per sensor (readBurst of the 6 data registers), back to back with interrupts disabled, so that
+	nothing gets in between the sensors.  Give all sensors the same SPI mode and clock: the bus is then configured by the
+	first burst and the others only toggle their CS_n (sharedBusConfiguration()).  The raw bytes are converted after the
+	sweep, with interrupts enabled again.
+
+	Timing: micros() is taken when the sweep starts and when it ends.  The bursts are all the same length, so sensor i
+	was read at start + spread * (2i + 1) / (2 * sensors), the middle of its burst, and lags sensor 0 by spread * i / sensors.
+	Stamping every burst would cost a micros() call per sensor, about as long as a burst at DIV2, and micros() only
+	counts in 4 us steps on a 16 MHz AVR.
+
+	sample() doesn't wait for a busy bus.  From an ISR it returns false if the main loop is in a transaction; retry, or
+	defer it as BMA180AcquisitionT does.
+
+	With sample(block) in an ISR, the block is shared with the main loop the way SPSCRing shares its buffer: the ISR
+	only ever writes the sweep at count() and then publishes it by incrementing the count, a volatile single byte that
+	the main loop reads atomically.  Sweeps below count() stay as they are until clear().  A full block isn't written
+	at all, so the main loop analyses it once full() is true and then calls clear().  The statistics of BMA180ArrayT are
+	16 and 32 bits wide, so their accessors read them with interrupts disabled.	*/
+
+#ifndef BMA180ARRAY_H_INCLUDED
+#define BMA180ARRAY_H_INCLUDED
+
+#include <Arduino.h>
+#include <SPIExternalDevice.h>
+#include "BMA180SPI.h"
+
+
+// Samples of several sensors, structure of arrays: for every sensor and axis, the samples of consecutive sweeps
+// are contiguous.  Plus the start and spread of every sweep, from which the time of each sensor's sample follows.
+class BMA180ArrayBlock
+{
+public:
+	unsigned char sensors() const	{ return m_iSensors; }
+	unsigned char capacity() const	{ return m_iCapacity; }		// sweeps
+	unsigned char count() const		{ return m_iCount; }		// sweeps in the block.  One byte: atomic, also when sample() runs in an ISR.
+	bool full() const				{ return m_iCount == m_iCapacity; }
+	void clear()					{ m_iCount = 0; }			// the ISR doesn't touch a full block, so clearing one is safe
+
+	const signed int* x(unsigned char iSensor) const	{ return m_pX + (unsigned int)iSensor * m_iCapacity; }	// count() samples, oldest first
+	const signed int* y(unsigned char iSensor) const	{ return m_pY + (unsigned int)iSensor * m_iCapacity; }
+	const signed int* z(unsigned char iSensor) const	{ return m_pZ + (unsigned int)iSensor * m_iCapacity; }
+
+	unsigned long sweepMicros(unsigned char iSweep) const	{ return m_pMicros[iSweep]; }	// micros() when the first burst began
+	unsigned int spreadMicros(unsigned char iSweep) const	{ return m_pSpread[iSweep]; }	// from the first burst to the end of the last
+
+	unsigned int skewMicros(unsigned char iSensor, unsigned char iSweep) const	// behind sensor 0
+		{ return (unsigned int)((unsigned long)m_pSpread[iSweep] * iSensor / m_iSensors); }
+	unsigned long micros(unsigned char iSensor, unsigned char iSweep) const		// middle of the sensor's burst
+		{ return m_pMicros[iSweep] + ((unsigned long)m_pSpread[iSweep] * (2 * iSensor + 1)) / (2 * m_iSensors); }
+
+protected:
+	BMA180ArrayBlock(signed int* pX, signed int* pY, signed int* pZ, unsigned long* pMicros, unsigned int* pSpread,
+	                 unsigned char iSensors, unsigned char iCapacity)
+		: m_pX(pX), m_pY(pY), m_pZ(pZ), m_pMicros(pMicros), m_pSpread(pSpread)
+		, m_iSensors(iSensors), m_iCapacity(iCapacity), m_iCount(0) {}
+
+private:
+	template<class Accelerometer, unsigned char COUNT> friend class BMA180ArrayT;
+
+	signed int*		m_pX;		// [sensor][sweep]
+	signed int*		m_pY;
+	signed int*		m_pZ;
+	unsigned long*	m_pMicros;	// [sweep]
+	unsigned int*	m_pSpread;	// [sweep]
+
+	const unsigned char		m_iSensors;
+	const unsigned char		m_iCapacity;
+	volatile unsigned char	m_iCount;	// written by sample(), possibly in an ISR
+};
+
+
+// Block with its storage: (6 * SENSORS + 6) bytes per sweep.
+template<unsigned char SENSORS, unsigned char SAMPLES>
+class BMA180ArrayBlockBuffer : public BMA180ArrayBlock
+{
+public:
+	BMA180ArrayBlockBuffer() : BMA180ArrayBlock(&m_aX[0][0], &m_aY[0][0], &m_aZ[0][0], m_aMicros, m_aSpread, SENSORS, SAMPLES) {}
+
+private:
+	typedef char SensorsAndSamplesMustNotBeZero[(SENSORS != 0 && SAMPLES != 0) ? 1 : -1];
+
+	signed int		m_aX[SENSORS][SAMPLES];
+	signed int		m_aY[SENSORS][SAMPLES];
+	signed int		m_aZ[SENSORS][SAMPLES];
+	unsigned long	m_aMicros[SAMPLES];
+	unsigned int	m_aSpread[SAMPLES];
+};
+
+
+template<class Accelerometer, unsigned char COUNT>
+class BMA180ArrayT
+{
+public:
+	BMA180ArrayT(Accelerometer* const* apSensors);	// COUNT sensors, in the order they are read
+
+	unsigned char count() const						{ return COUNT; }
+	Accelerometer& sensor(unsigned char iSensor)	{ return *m_apSensors[iSensor]; }
+
+	void configure(typename Accelerometer::Range iRange, typename Accelerometer::Bandwidth iBandwidth, typename Accelerometer::Mode iMode);	// every sensor alike
+	void setResolution(typename Accelerometer::Resolution iResolution);
+	bool sharedBusConfiguration() const;	// all sensors have the same SPI mode and clock, so a sweep configures the bus once
+
+	bool sample(BMA180ArrayBlock& block);	// one sweep into the next sweep of the block.  false if the block is full,
+											// is for another number of sensors, or the bus is busy.
+	bool sample(BMA180AccelerationXYZ* aAccel, unsigned long& iMicros, unsigned int& iSpreadMicros);	// one sweep, COUNT samples
+
+	unsigned long sweeps() const;
+	unsigned int lastSpreadMicros() const;
+	unsigned int maxSpreadMicros() const;	// worst alignment since resetStats()
+	unsigned int busyRefusals() const;		// sample() found the bus busy
+	void resetStats();
+
+private:
+	bool sweep(unsigned long& iMicros, unsigned int& iSpreadMicros);	// raw bytes into m_aRaw
+
+	Accelerometer*	m_apSensors[COUNT];
+	byte			m_aRaw[COUNT][6];	// x_lsb, x_msb, y_lsb, y_msb, z_lsb, z_msb of every sensor
+
+	// written by sample(), possibly in an ISR
+	volatile unsigned long	m_iSweeps;
+	volatile unsigned int	m_iLastSpread;
+	volatile unsigned int	m_iMaxSpread;
+	volatile unsigned int	m_iBusyRefusals;
+
+	typedef char CountMustNotBeZero[(COUNT != 0) ? 1 : -1];
+};
+
+
+template<class Accelerometer, unsigned char COUNT>
+BMA180ArrayT<Accelerometer, COUNT>::BMA180ArrayT(Accelerometer* const* apSensors)
+	: m_iSweeps(0)
+	, m_iLastSpread(0)
+	, m_iMaxSpread(0)
+	, m_iBusyRefusals(0)
+{
+	for (unsigned char i = 0; i < COUNT; ++i)
+		m_apSensors[i] = apSensors[i];
+}
+
+
+template<class Accelerometer, unsigned char COUNT>
+void BMA180ArrayT<Accelerometer, COUNT>::configure(typename Accelerometer::Range iRange, typename Accelerometer::Bandwidth iBandwidth,
+                                                   typename Accelerometer::Mode iMode)
+// Same bandwidth, so the same data rate and filter delay: the sensors' samples line up in time as well as in the sweep.
+{
+	for (unsigned char i = 0; i < COUNT; ++i)
+		m_apSensors[i]->configure(iRange, iBandwidth, iMode);
+}
+
+
+template<class Accelerometer, unsigned char COUNT>
+void BMA180ArrayT<Accelerometer, COUNT>::setResolution(typename Accelerometer::Resolution iResolution)
+{
+	for (unsigned char i = 0; i < COUNT; ++i)
+		m_apSensors[i]->setResolution(iResolution);
+}
+
+
+template<class Accelerometer, unsigned char COUNT>
+bool BMA180ArrayT<Accelerometer, COUNT>::sharedBusConfiguration() const
+{
+	for (unsigned char i = 1; i < COUNT; ++i)
+	{
+		if (!m_apSensors[i]->spiSameConfiguration(*m_apSensors[0]))
+			return false;
+	}
+	return true;
+}
+
+
+template<class Accelerometer, unsigned char COUNT>
+bool BMA180ArrayT<Accelerometer, COUNT>::sweep(unsigned long& iMicros, unsigned int& iSpreadMicros)
+// PURPOSE:		Burst-read the data registers of all sensors back to back, with nothing in between.
+// PRECONDITIONS:	SPI master on the AVR has been initialized
+{
+	byte oldSREG = SREG;
+	cli();
+	if (SPIExternalDevice::spiBusBusy())
+	{
+		SREG = oldSREG;
+		++m_iBusyRefusals;
+		return false;
+	}
+
+	unsigned long iStart = ::micros();
+	for (unsigned char i = 0; i < COUNT; ++i)
+		m_apSensors[i]->readBurst(Accelerometer::REG_ACC_LSB, m_aRaw[i], sizeof(m_aRaw[i]));
+	unsigned long iEnd = ::micros();
+	SREG = oldSREG;
+
+	iMicros = iStart;
+	iSpreadMicros = (unsigned int)(iEnd - iStart);
+	++m_iSweeps;
+	m_iLastSpread = iSpreadMicros;
+	if (iSpreadMicros > m_iMaxSpread)
+		m_iMaxSpread = iSpreadMicros;
+	return true;
+}
+
+
+template<class Accelerometer, unsigned char COUNT>
+bool BMA180ArrayT<Accelerometer, COUNT>::sample(BMA180ArrayBlock& block)
+{
+	if (block.full() || block.sensors() != COUNT)
+		return false;
+
+	unsigned char iSweep = block.m_iCount;
+	if (!sweep(block.m_pMicros[iSweep], block.m_pSpread[iSweep]))
+		return false;
+
+	for (unsigned char i = 0; i < COUNT; ++i)
+	{
+		BMA180AccelerationXYZ accel = m_apSensors[i]->toAccelerationXYZ(m_aRaw[i]);
+		unsigned int iAt = (unsigned int)i * block.m_iCapacity + iSweep;
+		block.m_pX[iAt] = accel.x;
+		block.m_pY[iAt] = accel.y;
+		block.m_pZ[iAt] = accel.z;
+	}
+	block.m_iCount = iSweep + 1;
+	return true;
+}
+
+
+template<class Accelerometer, unsigned char COUNT>
+bool BMA180ArrayT<Accelerometer, COUNT>::sample(BMA180AccelerationXYZ* aAccel, unsigned long& iMicros, unsigned int& iSpreadMicros)
+{
+	if (!sweep(iMicros, iSpreadMicros))
+		return false;
+
+	for (unsigned char i = 0; i < COUNT; ++i)
+		aAccel[i] = m_apSensors[i]->toAccelerationXYZ(m_aRaw[i]);
+	return true;
+}
+
+
+template<class Accelerometer, unsigned char COUNT>
+unsigned long BMA180ArrayT<Accelerometer, COUNT>::sweeps() const
+{
+	byte oldSREG = SREG;
+	cli();	// 32-bit counter, sample() may run in an ISR
+	unsigned long iSweeps = m_iSweeps;
+	SREG = oldSREG;
+	return iSweeps;
+}
+
+
+template<class Accelerometer, unsigned char COUNT>
+unsigned int BMA180ArrayT<Accelerometer, COUNT>::lastSpreadMicros() const
+{
+	byte oldSREG = SREG;
+	cli();
+	unsigned int iSpread = m_iLastSpread;
+	SREG = oldSREG;
+	return iSpread;
+}
+
+
+template<class Accelerometer, unsigned char COUNT>
+unsigned int BMA180ArrayT<Accelerometer, COUNT>::maxSpreadMicros() const
+{
+	byte oldSREG = SREG;
+	cli();
+	unsigned int iSpread = m_iMaxSpread;
+	SREG = oldSREG;
+	return iSpread;
+}
+
+
+template<class Accelerometer, unsigned char COUNT>
+unsigned int BMA180ArrayT<Accelerometer, COUNT>::busyRefusals() const
+{
+	byte oldSREG = SREG;
+	cli();
+	unsigned int iCount = m_iBusyRefusals;
+	SREG = oldSREG;
+	return iCount;
+}
+
+
+template<class Accelerometer, unsigned char COUNT>
+void BMA180ArrayT<Accelerometer, COUNT>::resetStats()
+{
+	byte oldSREG = SREG;
+	cli();
+	m_iSweeps = 0;
+	m_iLastSpread = 0;
+	m_iMaxSpread = 0;
+	m_iBusyRefusals = 0;
+	SREG = oldSREG;
+}
+
+
+#endif
@@ -0,0 +1,395 @@
+/*
+\file	BMA180Codec.cpp
+\version	1.0.0
+\purpose	Packs blocks of BMA180 XYZ samples into radio payloads, bit-packed or delta coded, and unpacks them again.
+\compiler	Arduino 1.0.1 (encoder and decoder), g++ on the gateway (decoder)
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+#include <Arduino.h>
+#include "BMA180Codec.h"
+
+
+const unsigned char BMA180SampleEncoder::HEADER_SIZE;
+const unsigned char BMA180SampleEncoder::GROUP;
+const unsigned char BMA180SampleEncoder::VERSION;
+const unsigned char BMA180SampleDecoder::MAX_SAMPLES;
+
+static const unsigned char VALUE_BITS = 14;
+static const unsigned char WIDTH_BITS = 4;
+static const unsigned char COUNT_MAX = 255;
+
+
+static unsigned int zigzag(int iDelta)
+// PURPOSE:		0, -1, 1, -2, ... to 0, 1, 2, 3, ...  |iDelta| < 2^14, so the result fits 15 bits.
+{
+	return (iDelta >= 0) ? (unsigned int)iDelta << 1 : ((unsigned int)(-iDelta) << 1) - 1;
+}
+
+
+static int unzigzag(unsigned int iValue)
+{
+	return (iValue & 1) ? -(int)((iValue + 1) >> 1) : (int)(iValue >> 1);
+}
+
+
+//	--- BMA180SampleEncoder ---
+
+BMA180SampleEncoder::BMA180SampleEncoder(unsigned char* pPacket, unsigned char iSize, unsigned char iStream, Coding iCoding)
+	: m_pPacket(pPacket), m_iSize(iSize), m_iStream(iStream), m_iCoding(iCoding), m_iSequence(0), m_iPeriodMicros(0),
+	  m_iBitPos(0), m_iCount(0), m_iLength(0), m_bReady(false), m_iGroupCount(0), m_iGroupMicros(0), m_iSamples(0), m_iBytes(0)
+{
+}
+
+
+unsigned char BMA180SampleEncoder::add(const BMA180AccelerationXYZ* pSamples, unsigned char iCount, unsigned long iFirstMicros)
+{
+	unsigned char i = 0;
+	for ( ; i < iCount && !m_bReady; ++i)
+	{
+		Axes sample;
+		sample.a[0] = clamp14(pSamples[i].x);
+		sample.a[1] = clamp14(pSamples[i].y);
+		sample.a[2] = clamp14(pSamples[i].z);
+		addSample(sample, iFirstMicros + (unsigned long)i * m_iPeriodMicros);
+	}
+	return i;
+}
+
+
+bool BMA180SampleEncoder::addSample(const Axes& sample, unsigned long iMicros)
+// PURPOSE:		Always takes the sample.  Returns true if it closed the packet; what didn't fit is then carried over.
+{
+	if (m_iBitPos == 0)
+	{
+		startPacket(sample, iMicros);
+		return false;
+	}
+
+	if (m_iGroupCount == 0)
+		m_iGroupMicros = iMicros;
+	m_aGroup[m_iGroupCount++] = sample;
+
+	unsigned char iGroupSize = (m_iCoding == CODING_DELTA) ? GROUP : 1;
+	if (m_iGroupCount < iGroupSize)
+		return false;
+	if (writeGroup() == 0)
+		return false;
+	closePacket();
+	return true;
+}
+
+
+bool BMA180SampleEncoder::flush()
+{
+	if (m_bReady)
+		return true;
+	if (m_iBitPos == 0)
+		return false;
+
+	if (m_iGroupCount)
+		writeGroup();
+	closePacket();		// what didn't fit is carried over; the next flush() sends it
+	return true;
+}
+
+
+void BMA180SampleEncoder::nextPacket()
+{
+	if (!m_bReady)
+		return;
+	m_bReady = false;
+	m_iBitPos = 0;
+	m_iCount = 0;
+	if (m_iGroupCount == 0)
+		return;
+
+	// The carried-over group starts the new packet: its first sample in full, the rest wait for the group to fill.
+	startPacket(m_aGroup[0], m_iGroupMicros);
+	--m_iGroupCount;
+	for (unsigned char i = 0; i < m_iGroupCount; ++i)
+		m_aGroup[i] = m_aGroup[i + 1];
+	m_iGroupMicros += m_iPeriodMicros;
+}
+
+
+unsigned char BMA180SampleEncoder::writeGroup()
+// PURPOSE:		Writes as much of m_aGroup[0 .. m_iGroupCount-1] as fits the current packet and keeps the rest in m_aGroup.
+//				Returns the number of samples left over.  A shorter delta group can only be the last one of a packet, so
+//				the caller closes the packet when that isn't 0.
+{
+	unsigned char iCount = m_iGroupCount;
+	if (iCount > COUNT_MAX - m_iCount)
+		iCount = COUNT_MAX - m_iCount;
+	unsigned int iRoom = (unsigned int)m_iSize * 8 - m_iBitPos;
+
+	if (m_iCoding == CODING_PACKED)
+	{
+		if (iCount > iRoom / (3 * VALUE_BITS))
+			iCount = (unsigned char)(iRoom / (3 * VALUE_BITS));
+		for (unsigned char i = 0; i < iCount; ++i)
+			for (unsigned char iAxis = 0; iAxis < 3; ++iAxis)
+				putBits((unsigned int)m_aGroup[i].a[iAxis] & 0x3FFF, VALUE_BITS);
+		if (iCount)
+			m_previous = m_aGroup[iCount - 1];
+		return dropFromGroup(iCount);
+	}
+
+	// One width per axis, from the largest difference in the group.  The longest prefix of the group that fits.
+	unsigned char aWidth[3] = { 0, 0, 0 };
+	unsigned int aMax[3] = { 0, 0, 0 };
+	unsigned char n = 0;
+	for ( ; n < iCount; ++n)
+	{
+		unsigned char aNext[3];
+		unsigned int iBits = 3 * WIDTH_BITS;
+		for (unsigned char iAxis = 0; iAxis < 3; ++iAxis)
+		{
+			int iPrevious = (n == 0) ? m_previous.a[iAxis] : m_aGroup[n - 1].a[iAxis];
+			unsigned int iZigzag = zigzag(m_aGroup[n].a[iAxis] - iPrevious);
+			if (iZigzag > aMax[iAxis])
+				aMax[iAxis] = iZigzag;
+			aNext[iAxis] = widthOf(aMax[iAxis]);
+			iBits += (unsigned int)(n + 1) * aNext[iAxis];
+		}
+		if (iRoom < iBits)
+			break;
+		for (unsigned char iAxis = 0; iAxis < 3; ++iAxis)
+			aWidth[iAxis] = aNext[iAxis];
+	}
+	if (n == 0)
+		return dropFromGroup(0);
+
+	for (unsigned char iAxis = 0; iAxis < 3; ++iAxis)
+		putBits(aWidth[iAxis], WIDTH_BITS);
+	for (unsigned char i = 0; i < n; ++i)
+	{
+		for (unsigned char iAxis = 0; iAxis < 3; ++iAxis)
+		{
+			putBits(zigzag(m_aGroup[i].a[iAxis] - m_previous.a[iAxis]), aWidth[iAxis]);
+			m_previous.a[iAxis] = m_aGroup[i].a[iAxis];
+		}
+	}
+	return dropFromGroup(n);
+}
+
+
+unsigned char BMA180SampleEncoder::dropFromGroup(unsigned char iWritten)
+// PURPOSE:		The first iWritten samples of the group are in the packet.  Moves the rest to the front.
+{
+	m_iCount += iWritten;
+	m_iGroupCount -= iWritten;
+	for (unsigned char i = 0; i < m_iGroupCount; ++i)
+		m_aGroup[i] = m_aGroup[i + iWritten];
+	m_iGroupMicros += (unsigned long)iWritten * m_iPeriodMicros;
+	return m_iGroupCount;
+}
+
+
+void BMA180SampleEncoder::startPacket(const Axes& first, unsigned long iMicros)
+{
+	m_pPacket[0] = m_iStream;
+	m_pPacket[1] = (VERSION << 4) | m_iCoding;
+	m_pPacket[2] = m_iSequence;
+	m_pPacket[3] = (unsigned char)iMicros;
+	m_pPacket[4] = (unsigned char)(iMicros >> 8);
+	m_pPacket[5] = (unsigned char)(iMicros >> 16);
+	m_pPacket[6] = (unsigned char)(iMicros >> 24);
+	m_pPacket[7] = (unsigned char)m_iPeriodMicros;
+	m_pPacket[8] = (unsigned char)(m_iPeriodMicros >> 8);
+	m_pPacket[9] = 0;	// count, set by closePacket()
+	m_iBitPos = HEADER_SIZE * 8;
+
+	for (unsigned char iAxis = 0; iAxis < 3; ++iAxis)
+		putBits((unsigned int)first.a[iAxis] & 0x3FFF, VALUE_BITS);
+	m_previous = first;
+	m_iCount = 1;
+}
+
+
+void BMA180SampleEncoder::closePacket()
+{
+	m_pPacket[9] = m_iCount;
+	m_iLength = (unsigned char)((m_iBitPos + 7) >> 3);
+	m_bReady = true;
+	++m_iSequence;
+	m_iSamples += m_iCount;
+	m_iBytes += m_iLength;
+}
+
+
+void BMA180SampleEncoder::putBits(unsigned int iValue, unsigned char iBits)
+// PRECONDITIONS:	iBits <= 15, and they fit the packet
+{
+	while (iBits)
+	{
+		unsigned char iFree = 8 - (m_iBitPos & 7);
+		unsigned char n = (iBits < iFree) ? iBits : iFree;
+		unsigned char b = (unsigned char)(iValue >> (iBits - n)) & ((1 << n) - 1);
+		unsigned char* p = m_pPacket + (m_iBitPos >> 3);
+		if (iFree == 8)
+			*p = 0;		// first bits of this byte: clears what the last packet left
+		*p |= b << (iFree - n);
+		m_iBitPos += n;
+		iBits -= n;
+	}
+}
+
+
+int BMA180SampleEncoder::clamp14(int iValue)
+{
+	if (iValue > 8191)
+		return 8191;
+	if (iValue < -8192)
+		return -8192;
+	return iValue;
+}
+
+
+unsigned char BMA180SampleEncoder::widthOf(unsigned int iZigzag)
+{
+	unsigned char iWidth = 0;
+	while (iZigzag)
+	{
+		++iWidth;
+		iZigzag >>= 1;
+	}
+	return iWidth;
+}
+
+
+//	--- BMA180SampleDecoder ---
+
+void BMA180SampleDecoder::reset()
+{
+	m_bSynced = false;
+	m_iStream = 0;
+	m_iNextSequence = 0;
+	m_iPackets = 0;
+	m_iLost = 0;
+	m_iBad = 0;
+}
+
+
+unsigned char BMA180SampleDecoder::decode(const unsigned char* pPacket, unsigned char iLength, BMA180PacketInfo& info,
+                                          BMA180AccelerationXYZ* pOut, unsigned char iMaxSamples)
+{
+	const unsigned char HEADER_SIZE = BMA180SampleEncoder::HEADER_SIZE;
+	if (iLength < HEADER_SIZE || (pPacket[1] >> 4) != BMA180SampleEncoder::VERSION || (pPacket[1] & 0x0F) > BMA180SampleEncoder::CODING_DELTA || pPacket[9] == 0)
+	{
+		++m_iBad;
+		return 0;
+	}
+
+	info.iStream = pPacket[0];
+	info.iCoding = pPacket[1] & 0x0F;
+	info.iSequence = pPacket[2];
+	info.iFirstMicros = (unsigned long)pPacket[3] | ((unsigned long)pPacket[4] << 8) | ((unsigned long)pPacket[5] << 16) | ((unsigned long)pPacket[6] << 24);
+	info.iPeriodMicros = pPacket[7] | ((unsigned int)pPacket[8] << 8);
+	info.iCount = pPacket[9];
+
+	m_pData = pPacket;
+	m_iBitPos = HEADER_SIZE * 8;
+	m_iBitEnd = (unsigned int)iLength * 8;
+	unsigned char iOut = 0;
+	if (!unpack(info, pOut, iMaxSamples, iOut))
+	{
+		++m_iBad;
+		return 0;
+	}
+
+	if (m_bSynced && info.iStream == m_iStream)
+		m_iLost += (unsigned char)(info.iSequence - m_iNextSequence);
+	m_bSynced = true;
+	m_iStream = info.iStream;
+	m_iNextSequence = info.iSequence + 1;
+	++m_iPackets;
+	return iOut;
+}
+
+
+bool BMA180SampleDecoder::unpack(const BMA180PacketInfo& info, BMA180AccelerationXYZ* pOut, unsigned char iMaxSamples, unsigned char& iOut)
+// PURPOSE:		Reads the bit stream after the header.  false if the packet ends early.
+{
+	int aValue[3];
+	unsigned int iBits;
+	for (unsigned char iAxis = 0; iAxis < 3; ++iAxis)
+	{
+		if (!getBits(VALUE_BITS, iBits))
+			return false;
+		aValue[iAxis] = signExtend14(iBits);
+	}
+	store(aValue, pOut, iMaxSamples, iOut);
+
+	for (unsigned char iDone = 1; iDone < info.iCount; )
+	{
+		unsigned char iGroup = 1;
+		unsigned char aWidth[3] = { VALUE_BITS, VALUE_BITS, VALUE_BITS };
+		if (info.iCoding == BMA180SampleEncoder::CODING_DELTA)
+		{
+			iGroup = info.iCount - iDone;
+			if (iGroup > BMA180SampleEncoder::GROUP)
+				iGroup = BMA180SampleEncoder::GROUP;
+			for (unsigned char iAxis = 0; iAxis < 3; ++iAxis)
+			{
+				if (!getBits(WIDTH_BITS, iBits))
+					return false;
+				aWidth[iAxis] = (unsigned char)iBits;
+			}
+		}
+
+		for (unsigned char i = 0; i < iGroup; ++i)
+		{
+			for (unsigned char iAxis = 0; iAxis < 3; ++iAxis)
+			{
+				if (!getBits(aWidth[iAxis], iBits))
+					return false;
+				if (info.iCoding == BMA180SampleEncoder::CODING_DELTA)
+					aValue[iAxis] += unzigzag(iBits);
+				else
+					aValue[iAxis] = signExtend14(iBits);
+			}
+			store(aValue, pOut, iMaxSamples, iOut);
+		}
+		iDone += iGroup;
+	}
+	return true;
+}
+
+
+void BMA180SampleDecoder::store(const int* aValue, BMA180AccelerationXYZ* pOut, unsigned char iMaxSamples, unsigned char& iOut)
+{
+	if (iOut >= iMaxSamples)
+		return;
+	pOut[iOut].x = aValue[0];
+	pOut[iOut].y = aValue[1];
+	pOut[iOut].z = aValue[2];
+	++iOut;
+}
+
+
+bool BMA180SampleDecoder::getBits(unsigned char iBits, unsigned int& iValue)
+{
+	if (m_iBitPos + iBits > m_iBitEnd)
+		return false;
+	iValue = 0;
+	while (iBits)
+	{
+		unsigned char iLeft = 8 - (m_iBitPos & 7);
+		unsigned char n = (iBits < iLeft) ? iBits : iLeft;
+		unsigned char b = (m_pData[m_iBitPos >> 3] >> (iLeft - n)) & ((1 << n) - 1);
+		iValue = (iValue << n) | b;
+		m_iBitPos += n;
+		iBits -= n;
+	}
+	return true;
+}
+
+
+int BMA180SampleDecoder::signExtend14(unsigned int iValue)
+{
+	return (iValue & 0x2000) ? (int)(iValue & 0x1FFF) - 0x2000 : (int)(iValue & 0x1FFF);
+}
@@ -0,0 +1,182 @@
+/*
+\file	BMA180Codec.h
+\version	1.0.0
+\purpose	Packs blocks of BMA180 XYZ samples into radio payloads, bit-packed or delta coded, and unpacks them again.
+\compiler	Arduino 1.0.1 (encoder and decoder), g++ on the gateway (decoder)
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+/*	Usage, sensor node:
+		BMA180SampleEncoderBuffer<61>	encoder(1, BMA180SampleEncoder::CODING_DELTA);	// stream 1, 61-byte payloads
+		encoder.setSamplePeriod(accel.samplePeriodMicros());
+
+		loop():
+			const BMA180AccelerationXYZ* p = aBlock;			// e.g. the output of a BMA180FilterChain
+			while (iCount)
+			{
+				unsigned char n = encoder.add(p, iCount, iFirstMicros);
+				p += n;  iCount -= n;  iFirstMicros += n * iPeriod;
+				if (encoder.packetReady())
+				{
+					radio.queuePacket(encoder.packet(), encoder.packetLength());
+					encoder.nextPacket();
+				}
+			}
+
+	Gateway:
+		BMA180SampleDecoder		decoder;
+		BMA180PacketInfo		info;
+		BMA180AccelerationXYZ	aSamples[BMA180SampleDecoder::MAX_SAMPLES];
+		unsigned char n = decoder.decode(aPayload, iLength, info, aSamples, BMA180SampleDecoder::MAX_SAMPLES);
+
+	Packet layout, multi-byte fields little-endian:
+		0		stream id
+		1		version (7:4) and coding (3:0)
+		2		sequence number, wraps
+		3..6	micros() of the first sample
+		7..8	sample period, us
+		9		number of samples
+		10..	bit stream, MSB first, padded with zeros to a whole byte
+
+	CODING_PACKED: every sample is x, y, z as 14-bit two's complement, 42 bits.
+	CODING_DELTA: the first sample as in CODING_PACKED, then groups of GROUP samples (the last one may be shorter: it is
+	cut to what still fits the packet, and the rest of it starts the next packet).
+	A group starts with a 4-bit width per axis, then for each sample the x, y, z differences to the previous sample,
+	zigzag coded (0, -1, 1, -2, ... as 0, 1, 2, 3, ...) in that many bits.  A width of 0 means the axis didn't change.
+
+	Every packet starts from a full sample, so a lost packet doesn't affect the others.  Values are clamped to 14 bits.
+	Both sides run in bounded time per sample and don't allocate.	*/
+
+#ifndef BMA180CODEC_H_INCLUDED
+#define BMA180CODEC_H_INCLUDED
+
+#include <Arduino.h>
+#include "BMA180SPI.h"
+
+
+struct BMA180PacketInfo		// header of a packet, from BMA180SampleDecoder::decode()
+{
+	unsigned char	iStream;
+	unsigned char	iCoding;
+	unsigned char	iSequence;
+	unsigned long	iFirstMicros;	// sample i was taken at iFirstMicros + i * iPeriodMicros
+	unsigned int	iPeriodMicros;
+	unsigned char	iCount;
+};
+
+
+class BMA180SampleEncoder
+{
+public:
+	enum Coding	{ CODING_PACKED = 0, CODING_DELTA = 1 };
+
+	static const unsigned char HEADER_SIZE = 10;
+	static const unsigned char GROUP = 8;			// samples per delta group
+	static const unsigned char VERSION = 1;
+
+	void setSamplePeriod(unsigned int iMicros)	{ m_iPeriodMicros = iMicros; }
+
+	// Adds up to iCount samples, taken at iFirstMicros, iFirstMicros + period, ...  Returns the number taken.
+	// Fewer than iCount when a packet has filled up: send it, call nextPacket() and add the rest.
+	unsigned char add(const BMA180AccelerationXYZ* pSamples, unsigned char iCount, unsigned long iFirstMicros);
+	bool flush();						// Closes the current packet even if it isn't full.  true if a packet is ready:
+										// while (encoder.flush()) { send; encoder.nextPacket(); }
+
+	bool packetReady() const			{ return m_bReady; }
+	const unsigned char* packet() const	{ return m_pPacket; }
+	unsigned char packetLength() const	{ return m_iLength; }
+	void nextPacket();					// The ready packet has been sent.  Starts the next one with the samples carried over.
+
+	unsigned long samplesEncoded() const	{ return m_iSamples; }	// in packets handed out
+	unsigned long bytesEncoded() const		{ return m_iBytes; }
+
+protected:
+	BMA180SampleEncoder(unsigned char* pPacket, unsigned char iSize, unsigned char iStream, Coding iCoding);
+
+private:
+	struct Axes	{ int a[3]; };
+
+	bool addSample(const Axes& sample, unsigned long iMicros);
+	unsigned char writeGroup();					// as much of the group as fits.  Returns the samples left over.
+	unsigned char dropFromGroup(unsigned char iWritten);
+	void startPacket(const Axes& first, unsigned long iMicros);
+	void closePacket();
+	void putBits(unsigned int iValue, unsigned char iBits);
+	static int clamp14(int iValue);
+	static unsigned char widthOf(unsigned int iZigzag);
+
+	unsigned char*	m_pPacket;
+	unsigned char	m_iSize;
+	unsigned char	m_iStream;
+	unsigned char	m_iCoding;
+	unsigned char	m_iSequence;
+	unsigned int	m_iPeriodMicros;
+
+	unsigned int	m_iBitPos;		// next bit to write, from the start of the packet
+	unsigned char	m_iCount;		// samples in the current packet, group not included
+	unsigned char	m_iLength;		// of the ready packet
+	bool			m_bReady;
+	Axes			m_previous;		// last sample written
+
+	Axes			m_aGroup[GROUP];	// delta coding: samples waiting for their group to fill
+	unsigned char	m_iGroupCount;
+	unsigned long	m_iGroupMicros;	// time of m_aGroup[0]
+
+	unsigned long	m_iSamples;
+	unsigned long	m_iBytes;
+};
+
+
+// Encoder with its packet buffer.  SIZE is the payload size, 61 to fit the CC2500 RX FIFO with the status bytes.
+template<unsigned char SIZE>
+class BMA180SampleEncoderBuffer : public BMA180SampleEncoder
+{
+public:
+	BMA180SampleEncoderBuffer(unsigned char iStream, Coding iCoding) : BMA180SampleEncoder(m_aStorage, SIZE, iStream, iCoding) {}
+
+private:
+	typedef char SizeMustHoldHeaderAndOneSample[(SIZE >= HEADER_SIZE + 6) ? 1 : -1];
+
+	unsigned char	m_aStorage[SIZE];
+};
+
+
+class BMA180SampleDecoder
+{
+public:
+	BMA180SampleDecoder()	{ reset(); }
+	void reset();
+
+	static const unsigned char MAX_SAMPLES = 255;
+
+	// Unpacks one packet.  Returns the number of samples written to pOut, 0 if the packet is malformed.
+	// Samples beyond iMaxSamples are dropped.
+	unsigned char decode(const unsigned char* pPacket, unsigned char iLength, BMA180PacketInfo& info,
+	                     BMA180AccelerationXYZ* pOut, unsigned char iMaxSamples);
+
+	unsigned long packets() const		{ return m_iPackets; }
+	unsigned long lostPackets() const	{ return m_iLost; }		// sequence gaps.  Use one decoder per stream.
+	unsigned long badPackets() const	{ return m_iBad; }
+
+private:
+	bool unpack(const BMA180PacketInfo& info, BMA180AccelerationXYZ* pOut, unsigned char iMaxSamples, unsigned char& iOut);
+	static void store(const int* aValue, BMA180AccelerationXYZ* pOut, unsigned char iMaxSamples, unsigned char& iOut);
+	bool getBits(unsigned char iBits, unsigned int& iValue);
+	static int signExtend14(unsigned int iValue);
+
+	const unsigned char*	m_pData;
+	unsigned int			m_iBitPos;
+	unsigned int			m_iBitEnd;
+
+	bool			m_bSynced;
+	unsigned char	m_iStream;
+	unsigned char	m_iNextSequence;
+	unsigned long	m_iPackets;
+	unsigned long	m_iLost;
+	unsigned long	m_iBad;
+};
+
+#endif
@@ -0,0 +1,109 @@
+/*
+\file	BMA180Filters.cpp
+\version	1.0.0
+\purpose	Allocation-free fixed-point filter and decimation stages for blocks of BMA180 XYZ samples.
+\compiler	Arduino 1.0.1
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the 
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+/* References
+[1]  R. Bristow-Johnson, "Cookbook formulae for audio EQ biquad filter coefficients".
+*/
+
+#include <Arduino.h>
+#include <math.h>
+#include "BMA180Filters.h"
+
+
+const unsigned char BMA180Biquad::Q;
+
+
+BMA180Biquad::BMA180Biquad()
+{
+	setCoefficients(1 << Q, 0, 0, 0, 0);	// pass-through
+}
+
+
+void BMA180Biquad::reset()
+{
+	for (byte i = 0; i < 3; ++i)
+		m_aX1[i] = m_aX2[i] = m_aY1[i] = m_aY2[i] = 0;
+}
+
+
+void BMA180Biquad::designLowPass(float fCutoff, float fSampleRate, float fQ)
+// See [1]
+{
+	float w0 = 2.0f * M_PI * fCutoff / fSampleRate;
+	float cosw0 = cos(w0);
+	float alpha = sin(w0) / (2.0f * fQ);
+
+	setFromFloat((1.0f - cosw0) / 2.0f, 1.0f - cosw0, (1.0f - cosw0) / 2.0f,
+	             1.0f + alpha, -2.0f * cosw0, 1.0f - alpha);
+}
+
+
+void BMA180Biquad::designHighPass(float fCutoff, float fSampleRate, float fQ)
+// See [1]
+{
+	float w0 = 2.0f * M_PI * fCutoff / fSampleRate;
+	float cosw0 = cos(w0);
+	float alpha = sin(w0) / (2.0f * fQ);
+
+	setFromFloat((1.0f + cosw0) / 2.0f, -(1.0f + cosw0), (1.0f + cosw0) / 2.0f,
+	             1.0f + alpha, -2.0f * cosw0, 1.0f - alpha);
+}
+
+
+void BMA180Biquad::setCoefficients(int b0, int b1, int b2, int a1, int a2)
+{
+	m_b0 = b0;	m_b1 = b1;	m_b2 = b2;
+	m_a1 = a1;	m_a2 = a2;
+	reset();
+}
+
+
+void BMA180Biquad::setFromFloat(float b0, float b1, float b2, float a0, float a1, float a2)
+{
+	setCoefficients(toQ14(b0 / a0), toQ14(b1 / a0), toQ14(b2 / a0), toQ14(a1 / a0), toQ14(a2 / a0));
+}
+
+
+int BMA180Biquad::toQ14(float f)
+// Q14 covers [-2, 2).  Coefficients of a stable biquad are inside that range, except b1 of a low-pass right at Nyquist.
+{
+	long i = (long)floor(f * (1L << Q) + 0.5f);
+	if (i > 32767L)		i = 32767L;
+	if (i < -32768L)	i = -32768L;
+	return (int)i;
+}
+
+
+unsigned char BMA180Biquad::process(const BMA180AccelerationXYZ* pIn, unsigned char iCount, BMA180AccelerationXYZ* pOut)
+// y = b0*x + b1*x1 + b2*x2 - a1*y1 - a2*y2, in a 32-bit accumulator
+{
+	for (unsigned char n = 0; n < iCount; ++n)
+	{
+		int in[3], out[3];
+		bma180Unpack(pIn[n], in);
+		for (unsigned char i = 0; i < 3; ++i)
+		{
+			int x = in[i];
+			long acc = (long)m_b0 * x + (long)m_b1 * m_aX1[i] + (long)m_b2 * m_aX2[i]
+			         - (long)m_a1 * m_aY1[i] - (long)m_a2 * m_aY2[i];
+			acc += 1L << (Q - 1);		// round
+			long y = acc >> Q;
+			if (y > 32767L)		y = 32767L;
+			if (y < -32768L)	y = -32768L;
+
+			m_aX2[i] = m_aX1[i];	m_aX1[i] = x;
+			m_aY2[i] = m_aY1[i];	m_aY1[i] = (int)y;
+			out[i] = (int)y;
+		}
+		bma180Pack(out, pOut[n]);
+	}
+	return iCount;
+}
@@ -0,0 +1,300 @@
+/*
+\file	BMA180Filters.h
+\version	1.0.0
+\purpose	Allocation-free fixed-point filter and decimation stages for blocks of BMA180 XYZ samples.
+\compiler	Arduino 1.0.1
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the 
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+/*	Every XYZ -> XYZ stage has the same block interface:
+		unsigned char process(const BMA180AccelerationXYZ* pIn, unsigned char iCount, BMA180AccelerationXYZ* pOut);
+	It returns the number of output samples, which is never more than iCount, so pIn and pOut may be the same buffer.
+	Stages compose with BMA180FilterChain:
+
+		BMA180Biquad						lowPass;		// anti-alias
+		BMA180CICDecimator<4, 2>			decimate;		// 4x down
+		BMA180FilterChain<BMA180Biquad, BMA180CICDecimator<4, 2> >	chain(lowPass, decimate);
+		BMA180WindowStats<32>				stats;
+
+		lowPass.designLowPass(100.0, 1200.0);
+		unsigned char n = chain.process(aBlock, iCount, aBlock);
+		BMA180WindowStatsResult result;
+		if (stats.process(aBlock, n, &result)) ...
+
+	All arithmetic is 16/32-bit integer, and the work per sample doesn't depend on the data, so a stage runs in bounded
+	cycles on AVR.  Only BMA180Biquad::design...() uses floating point, once, when the filter is set up.	*/
+
+#ifndef BMA180FILTERS_H_INCLUDED
+#define BMA180FILTERS_H_INCLUDED
+
+#include <Arduino.h>
+#include "BMA180SPI.h"
+
+
+// Moving average over N samples.  N is a power of two, so the division is a shift.
+template<unsigned char N>
+class BMA180MovingAverage
+{
+public:
+	BMA180MovingAverage()	{ reset(); }
+	void reset();
+	unsigned char process(const BMA180AccelerationXYZ* pIn, unsigned char iCount, BMA180AccelerationXYZ* pOut);
+
+private:
+	typedef char NMustBeAPowerOfTwo[(N != 0 && (N & (N - 1)) == 0) ? 1 : -1];
+
+	static unsigned char log2N()	{ unsigned char i = 0;  while ((1u << i) < N) ++i;  return i; }	// folded at compile time
+
+	BMA180AccelerationXYZ	m_aHistory[N];
+	long					m_aSum[3];
+	unsigned char			m_iIndex;
+};
+
+
+// Biquad IIR section, direct form I, Q14 coefficients.  Coefficients come from the RBJ cookbook formulas.
+class BMA180Biquad
+{
+public:
+	BMA180Biquad();
+	void reset();
+	void designLowPass(float fCutoff, float fSampleRate, float fQ = 0.7071f);
+	void designHighPass(float fCutoff, float fSampleRate, float fQ = 0.7071f);
+	void setCoefficients(int b0, int b1, int b2, int a1, int a2);	// Q14, a0 normalized to 1
+	unsigned char process(const BMA180AccelerationXYZ* pIn, unsigned char iCount, BMA180AccelerationXYZ* pOut);
+
+	static const unsigned char Q = 14;
+
+private:
+	void setFromFloat(float b0, float b1, float b2, float a0, float a1, float a2);
+	static int toQ14(float f);
+
+	int		m_b0, m_b1, m_b2, m_a1, m_a2;
+	int		m_aX1[3], m_aX2[3], m_aY1[3], m_aY2[3];
+};
+
+
+// log2 of a power of two, at compile time
+template<unsigned char X>
+struct BMA180Log2	{ enum { VALUE = 1 + BMA180Log2<X / 2>::VALUE }; };
+template<>
+struct BMA180Log2<1>	{ enum { VALUE = 0 }; };
+template<>
+struct BMA180Log2<0>	{ enum { VALUE = 0 }; };	// ends the recursion; R = 0 is refused below
+
+
+// CIC decimator, R x decimation with STAGES integrator/comb pairs (differential delay 1).
+// R is a power of two, so the gain R^STAGES is removed with a shift.  Each stage adds log2(R) bits to the 14-bit
+// samples, and all of them have to fit in the 32-bit integrators: 14 + STAGES * log2(R) <= 32.  So <16, 4> is the
+// most there is at four stages, and <64, 3> at three.
+template<unsigned char R, unsigned char STAGES>
+class BMA180CICDecimator
+{
+public:
+	BMA180CICDecimator()	{ reset(); }
+	void reset();
+	unsigned char process(const BMA180AccelerationXYZ* pIn, unsigned char iCount, BMA180AccelerationXYZ* pOut);
+
+private:
+	typedef char RMustBeAPowerOfTwo[(R > 1 && (R & (R - 1)) == 0) ? 1 : -1];
+	typedef char GainMustFitIn32Bits[(STAGES > 0 && 14 + STAGES * BMA180Log2<R>::VALUE <= 32) ? 1 : -1];
+
+	static const unsigned char GAIN_SHIFT = STAGES * BMA180Log2<R>::VALUE;
+
+	// Integrators wrap around.  That is fine for a CIC, as long as the arithmetic is modular, hence unsigned.
+	unsigned long	m_aIntegrator[STAGES][3];
+	unsigned long	m_aComb[STAGES][3];
+	unsigned char	m_iPhase;
+};
+
+
+struct BMA180WindowStatsResult
+{
+	BMA180AccelerationXYZ	rms;
+	BMA180AccelerationXYZ	peak;		// largest magnitude
+};
+
+
+// RMS and peak per axis over consecutive windows of N samples.  One result per completed window.
+template<unsigned char N>
+class BMA180WindowStats
+{
+public:
+	BMA180WindowStats()	{ reset(); }
+	void reset();
+	unsigned char process(const BMA180AccelerationXYZ* pIn, unsigned char iCount, BMA180WindowStatsResult* pOut);
+
+	static unsigned int isqrt(unsigned long x);		// 16 iterations, whatever x is
+
+private:
+	typedef char WindowMustFitIn32Bits[(N != 0 && N <= 32) ? 1 : -1];	// 32 * 8192^2 < 2^32
+
+	unsigned long	m_aSumSquares[3];
+	int				m_aPeak[3];
+	unsigned char	m_iCount;
+};
+
+
+// Two XYZ -> XYZ stages in sequence.  Chains nest: BMA180FilterChain< BMA180FilterChain<A, B>, C >
+template<class A, class B>
+class BMA180FilterChain
+{
+public:
+	BMA180FilterChain(A& first, B& second) : m_first(first), m_second(second) {}
+	unsigned char process(const BMA180AccelerationXYZ* pIn, unsigned char iCount, BMA180AccelerationXYZ* pOut)
+	{
+		unsigned char n = m_first.process(pIn, iCount, pOut);
+		return m_second.process(pOut, n, pOut);
+	}
+
+private:
+	A&	m_first;
+	B&	m_second;
+};
+
+
+// The sample structs are packed, so the per-axis loops below work on an int[3] copy
+inline void bma180Unpack(const BMA180AccelerationXYZ& s, int a[3])	{ a[0] = s.x;  a[1] = s.y;  a[2] = s.z; }
+inline void bma180Pack(const int a[3], BMA180AccelerationXYZ& s)	{ s.x = a[0];  s.y = a[1];  s.z = a[2]; }
+
+
+template<unsigned char N>
+void BMA180MovingAverage<N>::reset()
+{
+	memset(m_aHistory, 0, sizeof(m_aHistory));
+	m_aSum[0] = m_aSum[1] = m_aSum[2] = 0;
+	m_iIndex = 0;
+}
+
+
+template<unsigned char N>
+unsigned char BMA180MovingAverage<N>::process(const BMA180AccelerationXYZ* pIn, unsigned char iCount, BMA180AccelerationXYZ* pOut)
+{
+	for (unsigned char n = 0; n < iCount; ++n)
+	{
+		int in[3], oldest[3], out[3];
+		bma180Unpack(pIn[n], in);
+		bma180Unpack(m_aHistory[m_iIndex], oldest);
+		for (unsigned char i = 0; i < 3; ++i)
+		{
+			m_aSum[i] += in[i] - oldest[i];
+			out[i] = (int)(m_aSum[i] >> log2N());
+		}
+		bma180Pack(in, m_aHistory[m_iIndex]);
+		bma180Pack(out, pOut[n]);
+		m_iIndex = (m_iIndex + 1) & (N - 1);
+	}
+	return iCount;
+}
+
+
+template<unsigned char R, unsigned char STAGES>
+void BMA180CICDecimator<R, STAGES>::reset()
+{
+	memset(m_aIntegrator, 0, sizeof(m_aIntegrator));
+	memset(m_aComb, 0, sizeof(m_aComb));
+	m_iPhase = 0;
+}
+
+
+template<unsigned char R, unsigned char STAGES>
+unsigned char BMA180CICDecimator<R, STAGES>::process(const BMA180AccelerationXYZ* pIn, unsigned char iCount, BMA180AccelerationXYZ* pOut)
+{
+	unsigned char iOut = 0;
+	for (unsigned char n = 0; n < iCount; ++n)
+	{
+		int in[3];
+		bma180Unpack(pIn[n], in);
+		for (unsigned char i = 0; i < 3; ++i)
+		{
+			unsigned long acc = (unsigned long)(long)in[i];
+			for (unsigned char s = 0; s < STAGES; ++s)
+				acc = m_aIntegrator[s][i] += acc;
+		}
+
+		if (++m_iPhase < R)
+			continue;
+		m_iPhase = 0;
+
+		int out[3];
+		for (unsigned char i = 0; i < 3; ++i)
+		{
+			unsigned long acc = m_aIntegrator[STAGES - 1][i];
+			for (unsigned char s = 0; s < STAGES; ++s)
+			{
+				unsigned long delayed = m_aComb[s][i];
+				m_aComb[s][i] = acc;
+				acc -= delayed;
+			}
+			out[i] = (int)((long)acc >> GAIN_SHIFT);
+		}
+		bma180Pack(out, pOut[iOut++]);
+	}
+	return iOut;
+}
+
+
+template<unsigned char N>
+void BMA180WindowStats<N>::reset()
+{
+	m_aSumSquares[0] = m_aSumSquares[1] = m_aSumSquares[2] = 0;
+	m_aPeak[0] = m_aPeak[1] = m_aPeak[2] = 0;
+	m_iCount = 0;
+}
+
+
+template<unsigned char N>
+unsigned char BMA180WindowStats<N>::process(const BMA180AccelerationXYZ* pIn, unsigned char iCount, BMA180WindowStatsResult* pOut)
+{
+	unsigned char iOut = 0;
+	for (unsigned char n = 0; n < iCount; ++n)
+	{
+		int in[3];
+		bma180Unpack(pIn[n], in);
+		for (unsigned char i = 0; i < 3; ++i)
+		{
+			int v = in[i];
+			int mag = (v < 0) ? -v : v;
+			m_aSumSquares[i] += (unsigned long)((long)v * v);
+			if (mag > m_aPeak[i])
+				m_aPeak[i] = mag;
+		}
+
+		if (++m_iCount < N)
+			continue;
+
+		int rms[3];
+		for (unsigned char i = 0; i < 3; ++i)
+			rms[i] = isqrt(m_aSumSquares[i] / N);
+		bma180Pack(rms, pOut[iOut].rms);
+		bma180Pack(m_aPeak, pOut[iOut].peak);
+		++iOut;
+		reset();
+	}
+	return iOut;
+}
+
+
+template<unsigned char N>
+unsigned int BMA180WindowStats<N>::isqrt(unsigned long x)
+{
+	unsigned long root = 0;
+	unsigned long bit = 1UL << 30;
+	for (unsigned char i = 0; i < 16; ++i)
+	{
+		if (x >= root + bit)
+		{
+			x -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+			root >>= 1;
+		bit >>= 2;
+	}
+	return (unsigned int)root;
+}
+
+
+#endif
@@ -16,30 +16,61 @@ published by the Free Software Foundation.
 #ifndef BMA180SPI_H_INCLUDED
 #define BMA180SPI_H_INCLUDED
 
+#include <Arduino.h>
+#include <SPIExternalDevice.h>
 
-class BMA180AccelerometerSPI : public SPIExternalDevice
+
+struct BMA180AccelerationXYZ	// One coherent sample of all three axes, 14-bit signed (12-bit with RESOLUTION_12BIT)
 {
-public:
-	BMA180AccelerometerSPI(
-		unsigned char pinCS_n, 
-		SPIExternalDevice::SPIClockDiv iSPIClockDiv = SPIExternalDevice::DIV4);
+	signed int x;
+	signed int y;
+	signed int z;
+} __attribute__((packed));
 
-	~BMA180AccelerometerSPI();
+struct BMA180AccelerationXYZT	// Same, plus the raw temperature register (signed, 0.5 K/LSB)
+{
+	signed int x;
+	signed int y;
+	signed int z;
+	signed char temperature;
+} __attribute__((packed));
+
+
+/*	The driver is a template on the SPI external device underneath it.
+	BMA180AccelerometerSPI (below) runs on SPIExternalDevice with the CS_n pin and clock chosen at run time.
+	For fixed wiring use a compile-time device, e.g.  BMA180AccelerometerT< SPIDevice<9, SPIExternalDevice::MODE0, SPIExternalDevice::DIV2> >  */
+template<class Device>
+class BMA180AccelerometerT : public Device
+{
+public:
+	BMA180AccelerometerT();		// for compile-time devices, which know their own configuration
+	~BMA180AccelerometerT();
 
 	byte readByte(byte iRegAddr);
 	void writeByte(byte iRegAddr, byte iNewRegContents);
 
+	void readBurst(byte iRegAddr, byte* pData, byte iLength);	// Consecutive registers in one transaction, using the address auto-increment
+
 	enum Axes	{ X_AXIS = 0, Y_AXIS = 1, Z_AXIS = 2 };
 
+	typedef BMA180AccelerationXYZ	AccelerationXYZ;
+	typedef BMA180AccelerationXYZT	AccelerationXYZT;
+
 	enum Registers		// addresses of the internal registers inside BMA180
 	{
+		REG_IMAGE_LAST		= 0x3B,		// last register of the EEPROM image block
+		REG_OFFSET_LSB1		= 0x35,		// range<3:1>, smp_skip<0>
 		REG_GAIN_T			= 0x31,
+		REG_TCO_Z			= 0x30,		// mode_config<1:0>
 		REG_SLOPE_TH		= 0x2B,
 		REG_TAPSENS_TH		= 0x28,
 		REG_HIGH_DUR		= 0x27,
 		CTRL_REG3			= 0x21,
+		REG_BW_TCS			= 0x20,		// bw<7:4>
+		REG_IMAGE_FIRST		= 0x20,		// first register of the EEPROM image block
 		SOFT_RESET			= 0x10,
 		CTRL_REG0			= 0x0D,
+		REG_TEMP			= 0x08,
 		REG_ACC_MSB			= 0x03,
 		REG_ACC_LSB			= 0x02,
 		REG_CHIP_MODEL_ID	= 0x00
@@ -50,6 +81,7 @@ public:
 		REG_BIT_EE_W			= 4,
 		REG_BIT_DIS_I2C			= 0,
 		REG_BIT_RESET_INT		= 6,
+		REG_BIT_UPDATE_IMAGE	= 5,
 		
 		REG_BIT_LOW_INT			= 4,
 		REG_BIT_TAPSENSE_INT	= 3,
@@ -60,15 +92,508 @@ public:
 	/* TODO:	Bit is always in the same register.  It makes sense to combine them in a structure.
 				typedef struct {Register r, Bit b} RegisterBit;  const RegisterBit = {REG_HIGH_DUR, REG_BIT_DIS_I2C};  */
 
+	// Measurement settings.  See 7.7 in [1].
+	enum Range			// full scale, +-
+	{
+		RANGE_1G = 0, RANGE_1_5G = 1, RANGE_2G = 2, RANGE_3G = 3, RANGE_4G = 4, RANGE_8G = 5, RANGE_16G = 6
+	};
+	enum Bandwidth		// digital filter.  The output data rate is twice the bandwidth; 2400 Hz for the high-pass and band-pass settings.
+	{
+		BW_10HZ = 0, BW_20HZ = 1, BW_40HZ = 2, BW_75HZ = 3, BW_150HZ = 4, BW_300HZ = 5, BW_600HZ = 6, BW_1200HZ = 7,
+		BW_HIGH_PASS_1HZ = 8, BW_BAND_PASS_0_2_300HZ = 9
+	};
+	enum Mode			// mode_config: noise vs. current consumption
+	{
+		MODE_LOW_NOISE = 0, MODE_ULTRA_LOW_NOISE = 1, MODE_LOW_NOISE_REDUCED_POWER = 2, MODE_LOW_POWER = 3
+	};
+	enum Resolution		// bits in the readings, by how far the left-justified register pair is shifted
+	{
+		RESOLUTION_14BIT = 2, RESOLUTION_12BIT = 4
+	};
+
+	void setRange(Range iRange);			// the image registers are unlocked (ee_w) for the write and locked again
+	void setBandwidth(Bandwidth iBandwidth);
+	void setMode(Mode iMode);
+	void configure(Range iRange, Bandwidth iBandwidth, Mode iMode);	// all three with one unlock
+	void setResolution(Resolution iResolution)	{ m_iResolution = iResolution; }	// in the driver: 12-bit drops the two lowest bits
+	void loadSettings();					// re-read range, bandwidth and mode from the chip.  softReset() does it.
+
+	Range range() const				{ return (Range)m_iRange; }
+	Bandwidth bandwidth() const		{ return (Bandwidth)m_iBandwidth; }
+	Mode mode() const				{ return (Mode)m_iMode; }
+	Resolution resolution() const	{ return (Resolution)m_iResolution; }
+	unsigned int sampleRateHz() const;			// output data rate of the bandwidth setting
+	unsigned long samplePeriodMicros() const;	// 1 / sampleRateHz(), rounded.  For pacing and sizing buffers.
+	unsigned int resolutionMicroG() const;		// one LSB of the readings at the current range and resolution
+
 	void writeRegisterBit(Registers iRegAddr, RegisterBits iBitNumber, bool bBitValue);
+	void writeRegisterField(byte iRegAddr, byte iFieldMask, byte iFieldValue);	// iFieldValue is already shifted into the mask position
 	signed int readAcceleration(byte iAxis);
+	AccelerationXYZ readAccelerationXYZ();		// All three axes in one transaction.  Replaces 3 calls to readAcceleration().
+	AccelerationXYZT readAccelerationXYZT();	// All three axes and temperature in one transaction
+	AccelerationXYZ toAccelerationXYZ(const byte* aRaw) const;	// The 6 registers from REG_ACC_LSB, read with readBurst(), as readAccelerationXYZ() converts them
 	void resetInterrupt();
-	void softReset();
+	void enableNewDataInterrupt(bool bEnable);	// INT pin pulses when a new sample is ready
+	void softReset();						// waits SOFT_RESET_MICROS, reloads shadow registers and settings even on a timeout.  Without blocking:
+	bool beginSoftReset(unsigned long iTimeoutMicros = 50000);	// sends the reset command.  false if a reset is running already.
+	SPIExternalDevice::PollStatus pollSoftReset();	// POLL_DONE when the chip answers with CHIP_MODEL_ID again, reloaded as softReset().  Not on POLL_TIMEOUT.
+
+	static const unsigned long SOFT_RESET_MICROS = 10000;	// before the chip is asked
 	
 	static const byte CHIP_MODEL_ID = 0x03;		// Value of chip model ID, which is hard-wired in the silicon.  It can be used for checking the SPI wiring.
 
+	// Shadow registers (opt-in).  A copy of CTRL_REG0 and of the image block REG_IMAGE_FIRST..REG_IMAGE_LAST is kept in RAM,
+	// so that bit and field updates cost a single write instead of a read-modify-write.
+	// The caller provides the storage, so sensors that don't use the shadow don't pay for it in SRAM.
+	static const byte SHADOW_SIZE = 1 + (REG_IMAGE_LAST - REG_IMAGE_FIRST + 1);
+
+	void enableShadowRegisters(byte* pShadow);	// pShadow points to SHADOW_SIZE bytes.  Call after softReset().
+	void disableShadowRegisters()	{ m_pShadow = 0; }
+	void syncShadowRegisters();					// re-read the shadowed registers from the chip
+	bool verifyShadowRegisters();				// false if the chip doesn't match the shadow.  The shadow is left unchanged.
+	byte readRegisterCached(byte iRegAddr);		// from the shadow when the register is shadowed, from the chip otherwise
+
 protected:
+	BMA180AccelerometerT(unsigned char pinCS_n, SPIExternalDevice::SPIClockDiv iSPIClockDiv);	// for run-time configured devices
+
+	using Device::spiTransactionBegin;
+	using Device::spiTransactionEnd;
+	using Device::spiTransfer;
+	using Device::spiReadBlock;
+	using Device::spiWriteBlock;
+	using Device::spiTransferBlock;
+
+	static signed int toAcceleration(byte cLSByte, byte cMSByte, byte iShift);	// left-justified register pair to signed value
+	void writeImageField(byte iRegAddr, byte iFieldMask, byte iFieldValue);	// writeRegisterField() with the ee_w unlock around it
+
+	static const byte BW_MASK = 0xF0;			// REG_BW_TCS
+	static const byte RANGE_MASK = 0x0E;		// REG_OFFSET_LSB1
+	static const byte RANGE_SHIFT = 1;
+	static const byte MODE_CONFIG_MASK = 0x03;	// REG_TCO_Z
+
+	byte* shadowOf(byte iRegAddr);	// location of the register in the shadow, NULL if it isn't shadowed
+
+	static const byte CTRL_REG0_STROBES = _BV(REG_BIT_RESET_INT) | _BV(REG_BIT_UPDATE_IMAGE);	// self-clearing bits, never kept in the shadow
+
+	byte*	m_pShadow;		// CTRL_REG0, then REG_IMAGE_FIRST..REG_IMAGE_LAST.  NULL when the shadow is disabled.
+
+	byte	m_iRange;		// settings as last written or read
+	byte	m_iBandwidth;
+	byte	m_iMode;
+	byte	m_iResolution;
+
+	bool			m_bResetting;		// beginSoftReset() .. pollSoftReset() done
+	unsigned long	m_iResetStart;		// micros() of the reset command
+	unsigned long	m_iResetTimeout;
+
 	static const byte RW_FLAG = 7;		// R/W# flag.  Set for reading, clear for writing.  7th bit, don't confuse with flag
 };
 
+
+class BMA180AccelerometerSPI : public BMA180AccelerometerT<SPIExternalDevice>
+{
+public:
+	BMA180AccelerometerSPI(
+		unsigned char pinCS_n, 
+		SPIExternalDevice::SPIClockDiv iSPIClockDiv = SPIExternalDevice::DIV4);
+};
+
+
+template<class Device>
+const byte BMA180AccelerometerT<Device>::CHIP_MODEL_ID;
+
+template<class Device>
+const byte BMA180AccelerometerT<Device>::RW_FLAG;
+
+template<class Device>
+const byte BMA180AccelerometerT<Device>::SHADOW_SIZE;
+
+template<class Device>
+const byte BMA180AccelerometerT<Device>::CTRL_REG0_STROBES;
+
+template<class Device>
+const byte BMA180AccelerometerT<Device>::BW_MASK;
+
+template<class Device>
+const byte BMA180AccelerometerT<Device>::RANGE_MASK;
+
+template<class Device>
+const byte BMA180AccelerometerT<Device>::RANGE_SHIFT;
+
+template<class Device>
+const byte BMA180AccelerometerT<Device>::MODE_CONFIG_MASK;
+
+template<class Device>
+const unsigned long BMA180AccelerometerT<Device>::SOFT_RESET_MICROS;
+
+
+template<class Device>
+BMA180AccelerometerT<Device>::BMA180AccelerometerT()
+	: Device()
+	, m_pShadow(0)
+	, m_iRange(RANGE_2G)		// EEPROM defaults as shipped
+	, m_iBandwidth(BW_150HZ)
+	, m_iMode(MODE_LOW_NOISE)
+	, m_iResolution(RESOLUTION_14BIT)
+	, m_bResetting(false)
+	, m_iResetStart(0)
+	, m_iResetTimeout(0)
+{
+}
+
+template<class Device>
+BMA180AccelerometerT<Device>::BMA180AccelerometerT(unsigned char pinCS_n, SPIExternalDevice::SPIClockDiv iSPIClockDiv)
+	: Device(
+		pinCS_n,
+		SPIExternalDevice::MODE0,		// Ch. 8.4.1 in [1] suggests SPI mode 2.  But mode 2 didn't work for me.  Mode 0 works.
+		iSPIClockDiv)
+	, m_pShadow(0)
+	, m_iRange(RANGE_2G)		// EEPROM defaults as shipped
+	, m_iBandwidth(BW_150HZ)
+	, m_iMode(MODE_LOW_NOISE)
+	, m_iResolution(RESOLUTION_14BIT)
+	, m_bResetting(false)
+	, m_iResetStart(0)
+	, m_iResetTimeout(0)
+{
+}
+
+template<class Device>
+BMA180AccelerometerT<Device>::~BMA180AccelerometerT()
+{
+}
+
+
+template<class Device>
+byte BMA180AccelerometerT<Device>::readByte(byte iRegAddr)
+{
+	byte aBytes[2] = { (byte)(_BV(RW_FLAG) | iRegAddr), 0x55 };	// 0x55 is an arbitrary dummy
+
+	spiTransactionBegin();
+	spiTransferBlock(aBytes, aBytes, 2);	// one spidev message on Linux boards
+	spiTransactionEnd();
+
+	return aBytes[1];
+}
+
+
+template<class Device>
+void BMA180AccelerometerT<Device>::writeByte(byte iRegAddr, byte iNewRegContents)
+{
+	byte aBytes[2] = { iRegAddr, iNewRegContents };
+
+	spiTransactionBegin();
+	spiWriteBlock(aBytes, 2);
+	spiTransactionEnd();
+
+	byte* pShadow = shadowOf(iRegAddr);
+	if (pShadow)
+		*pShadow = (iRegAddr == CTRL_REG0) ? (iNewRegContents & ~CTRL_REG0_STROBES) : iNewRegContents;
+}
+
+
+template<class Device>
+void BMA180AccelerometerT<Device>::readBurst(byte iRegAddr, byte* pData, byte iLength)
+// PURPOSE:		Read iLength consecutive registers starting at iRegAddr.  BMA180 auto-increments the address while CS_n is held low.
+// PRECONDITIONS:	SPI master on the AVR has been initialized
+{
+	byte iHeader = _BV(RW_FLAG) | iRegAddr;
+
+	spiTransactionBegin();
+	spiWriteBlock(&iHeader, 1);	// header and data go out as one spidev message
+	spiReadBlock(pData, iLength, 0x55);	// 0x55 is an arbitrary dummy
+	spiTransactionEnd();
+}
+
+
+template<class Device>
+void BMA180AccelerometerT<Device>::writeRegisterBit(Registers iRegAddr, RegisterBits iBitNumber, bool bBitValue)
+// PURPOSE:		Modify the bit in the BMA180 register.  Read-modify-write, or a single write when the register is shadowed.
+// PRECONDITIONS:	SPI master on the AVR has been initialized
+{
+	writeRegisterField(iRegAddr, _BV(iBitNumber), (bBitValue) ? _BV(iBitNumber) : 0);
+}
+
+
+template<class Device>
+void BMA180AccelerometerT<Device>::writeRegisterField(byte iRegAddr, byte iFieldMask, byte iFieldValue)
+// PURPOSE:		Modify the bits under iFieldMask in the BMA180 register.  Read-modify-write, or a single write when the register is shadowed.
+// PRECONDITIONS:	SPI master on the AVR has been initialized
+{
+	byte	iRegVal;
+
+	iRegVal = readRegisterCached(iRegAddr);
+	iRegVal = (iRegVal & ~iFieldMask) | (iFieldValue & iFieldMask);
+	writeByte(iRegAddr, iRegVal);
+}
+
+
+template<class Device>
+void BMA180AccelerometerT<Device>::enableShadowRegisters(byte* pShadow)
+// PRECONDITIONS:	SPI master on the AVR has been initialized.  pShadow points to SHADOW_SIZE bytes.
+{
+	m_pShadow = pShadow;
+	syncShadowRegisters();
+}
+
+
+template<class Device>
+void BMA180AccelerometerT<Device>::syncShadowRegisters()
+{
+	if (!m_pShadow)
+		return;
+
+	m_pShadow[0] = readByte(CTRL_REG0) & ~CTRL_REG0_STROBES;
+	readBurst(REG_IMAGE_FIRST, m_pShadow + 1, SHADOW_SIZE - 1);
+}
+
+
+template<class Device>
+bool BMA180AccelerometerT<Device>::verifyShadowRegisters()
+{
+	if (!m_pShadow)
+		return true;
+
+	if ((readByte(CTRL_REG0) & ~CTRL_REG0_STROBES) != m_pShadow[0])
+		return false;
+
+	byte aChip[SHADOW_SIZE - 1];
+	readBurst(REG_IMAGE_FIRST, aChip, sizeof(aChip));
+	return memcmp(aChip, m_pShadow + 1, sizeof(aChip)) == 0;
+}
+
+
+template<class Device>
+byte BMA180AccelerometerT<Device>::readRegisterCached(byte iRegAddr)
+{
+	byte* pShadow = shadowOf(iRegAddr);
+	return (pShadow) ? *pShadow : readByte(iRegAddr);
+}
+
+
+template<class Device>
+byte* BMA180AccelerometerT<Device>::shadowOf(byte iRegAddr)
+{
+	if (!m_pShadow)
+		return 0;
+	if (iRegAddr == CTRL_REG0)
+		return m_pShadow;
+	if (iRegAddr >= REG_IMAGE_FIRST && iRegAddr <= REG_IMAGE_LAST)
+		return m_pShadow + 1 + (iRegAddr - REG_IMAGE_FIRST);
+	return 0;
+}
+
+
+template<class Device>
+int BMA180AccelerometerT<Device>::readAcceleration(byte iAxis)
+{
+	byte cLSByte = readByte(REG_ACC_LSB + 2*iAxis);
+	byte cMSByte = readByte(REG_ACC_MSB + 2*iAxis);
+
+	//* <debug/> */ Serial.print(cMSByte);   Serial.print(" ");
+	
+	return toAcceleration(cLSByte, cMSByte, m_iResolution);
+}
+
+
+template<class Device>
+typename BMA180AccelerometerT<Device>::AccelerationXYZ BMA180AccelerometerT<Device>::readAccelerationXYZ()
+// PURPOSE:		Read X, Y, Z in a single transaction.  LSB and MSB of all axes come from the same conversion.
+{
+	byte aRaw[6];	// x_lsb, x_msb, y_lsb, y_msb, z_lsb, z_msb
+	readBurst(REG_ACC_LSB, aRaw, sizeof(aRaw));
+	return toAccelerationXYZ(aRaw);
+}
+
+
+template<class Device>
+typename BMA180AccelerometerT<Device>::AccelerationXYZ BMA180AccelerometerT<Device>::toAccelerationXYZ(const byte* aRaw) const
+{
+	AccelerationXYZ accel;
+	accel.x = toAcceleration(aRaw[0], aRaw[1], m_iResolution);
+	accel.y = toAcceleration(aRaw[2], aRaw[3], m_iResolution);
+	accel.z = toAcceleration(aRaw[4], aRaw[5], m_iResolution);
+	return accel;
+}
+
+
+template<class Device>
+typename BMA180AccelerometerT<Device>::AccelerationXYZT BMA180AccelerometerT<Device>::readAccelerationXYZT()
+// PURPOSE:		Read X, Y, Z and temperature in a single transaction.  REG_TEMP directly follows the Z MSB.
+{
+	byte aRaw[7];	// x_lsb, x_msb, y_lsb, y_msb, z_lsb, z_msb, temp
+	readBurst(REG_ACC_LSB, aRaw, sizeof(aRaw));
+
+	AccelerationXYZT accel;
+	accel.x = toAcceleration(aRaw[0], aRaw[1], m_iResolution);
+	accel.y = toAcceleration(aRaw[2], aRaw[3], m_iResolution);
+	accel.z = toAcceleration(aRaw[4], aRaw[5], m_iResolution);
+	accel.temperature = (signed char)aRaw[6];
+	return accel;
+}
+
+
+template<class Device>
+int BMA180AccelerometerT<Device>::toAcceleration(byte cLSByte, byte cMSByte, byte iShift)
+// Bits 1:0 of the LSB are the new_data flag and an unused bit.  The arithmetic shift keeps the sign.
+{
+	int16_t iAccel = (int16_t)(((uint16_t)cMSByte << 8) | cLSByte);
+	return iAccel >> iShift;
+}
+
+
+template<class Device>
+void BMA180AccelerometerT<Device>::resetInterrupt()
+{
+	writeRegisterBit(CTRL_REG0, REG_BIT_RESET_INT, 1);
+}
+
+
+template<class Device>
+void BMA180AccelerometerT<Device>::enableNewDataInterrupt(bool bEnable)
+{
+	writeImageField(CTRL_REG3, _BV(REG_BIT_NEW_DATA_INT), (bEnable) ? _BV(REG_BIT_NEW_DATA_INT) : 0);
+}
+
+
+template<class Device>
+void BMA180AccelerometerT<Device>::writeImageField(byte iRegAddr, byte iFieldMask, byte iFieldValue)
+// The image block is write-protected unless ee_w is set.  Only the image changes; the EEPROM is written through 0x40.. .
+{
+	writeRegisterBit(CTRL_REG0, REG_BIT_EE_W, 1);
+	writeRegisterField(iRegAddr, iFieldMask, iFieldValue);
+	writeRegisterBit(CTRL_REG0, REG_BIT_EE_W, 0);
+}
+
+
+template<class Device>
+void BMA180AccelerometerT<Device>::setRange(Range iRange)
+{
+	writeImageField(REG_OFFSET_LSB1, RANGE_MASK, iRange << RANGE_SHIFT);
+	m_iRange = iRange;
+}
+
+
+template<class Device>
+void BMA180AccelerometerT<Device>::setBandwidth(Bandwidth iBandwidth)
+{
+	writeImageField(REG_BW_TCS, BW_MASK, iBandwidth << 4);
+	m_iBandwidth = iBandwidth;
+}
+
+
+template<class Device>
+void BMA180AccelerometerT<Device>::setMode(Mode iMode)
+{
+	writeImageField(REG_TCO_Z, MODE_CONFIG_MASK, iMode);
+	m_iMode = iMode;
+}
+
+
+template<class Device>
+void BMA180AccelerometerT<Device>::configure(Range iRange, Bandwidth iBandwidth, Mode iMode)
+{
+	writeRegisterBit(CTRL_REG0, REG_BIT_EE_W, 1);
+	writeRegisterField(REG_BW_TCS, BW_MASK, iBandwidth << 4);
+	writeRegisterField(REG_TCO_Z, MODE_CONFIG_MASK, iMode);
+	writeRegisterField(REG_OFFSET_LSB1, RANGE_MASK, iRange << RANGE_SHIFT);
+	writeRegisterBit(CTRL_REG0, REG_BIT_EE_W, 0);
+	m_iRange = iRange;
+	m_iBandwidth = iBandwidth;
+	m_iMode = iMode;
+}
+
+
+template<class Device>
+void BMA180AccelerometerT<Device>::loadSettings()
+{
+	m_iBandwidth = readRegisterCached(REG_BW_TCS) >> 4;
+	m_iMode = readRegisterCached(REG_TCO_Z) & MODE_CONFIG_MASK;
+	m_iRange = (readRegisterCached(REG_OFFSET_LSB1) & RANGE_MASK) >> RANGE_SHIFT;
+}
+
+
+template<class Device>
+unsigned int BMA180AccelerometerT<Device>::sampleRateHz() const
+// Data rate is twice the filter bandwidth.  See 7.7.1 in [1].
+{
+	static const unsigned int aBandwidthHz[8] = { 10, 20, 40, 75, 150, 300, 600, 1200 };
+	return 2 * ((m_iBandwidth < 8) ? aBandwidthHz[m_iBandwidth] : 1200);
+}
+
+
+template<class Device>
+unsigned long BMA180AccelerometerT<Device>::samplePeriodMicros() const
+{
+	unsigned int iRate = sampleRateHz();
+	return (1000000UL + iRate / 2) / iRate;
+}
+
+
+template<class Device>
+unsigned int BMA180AccelerometerT<Device>::resolutionMicroG() const
+// Full scale 2 * range over 2^14 (or 2^12) counts.  The +-1.5 g range is the odd one out.
+{
+	static const unsigned int aRangeMilliG[7] = { 1000, 1500, 2000, 3000, 4000, 8000, 16000 };
+	unsigned long iSpan = 2000UL * aRangeMilliG[(m_iRange < 7) ? m_iRange : 6];	// micro-g
+	byte iBits = 16 - m_iResolution;
+	return (unsigned int)((iSpan + (1UL << (iBits - 1))) >> iBits);
+}
+
+
+template<class Device>
+void BMA180AccelerometerT<Device>::softReset()
+{
+	m_bResetting = false;
+	beginSoftReset();
+	delay(SOFT_RESET_MICROS / 1000);
+	SPIExternalDevice::PollStatus status;
+	while ((status = pollSoftReset()) == SPIExternalDevice::POLL_BUSY) {;}
+	if (status == SPIExternalDevice::POLL_TIMEOUT)
+	{
+		syncShadowRegisters();	// unconditional, as it always was: what the chip answers now is all there is
+		loadSettings();
+	}
+}
+
+
+template<class Device>
+bool BMA180AccelerometerT<Device>::beginSoftReset(unsigned long iTimeoutMicros)
+// See 7.10.6
+{
+	if (m_bResetting)
+		return false;
+	const byte SOFT_RESET_CODE = 0xB6;
+	writeByte(SOFT_RESET, SOFT_RESET_CODE);
+	m_bResetting = true;
+	m_iResetStart = micros();
+	m_iResetTimeout = iTimeoutMicros;
+	return true;
+}
+
+
+template<class Device>
+SPIExternalDevice::PollStatus BMA180AccelerometerT<Device>::pollSoftReset()
+{
+	if (!m_bResetting)
+		return SPIExternalDevice::POLL_IDLE;
+	unsigned long iElapsed = micros() - m_iResetStart;
+	if (iElapsed < SOFT_RESET_MICROS)
+		return SPIExternalDevice::POLL_BUSY;
+
+	if (readByte(REG_CHIP_MODEL_ID) == CHIP_MODEL_ID)
+	{
+		m_bResetting = false;
+		syncShadowRegisters();	// the reset reloaded the image from EEPROM
+		loadSettings();
+		return SPIExternalDevice::POLL_DONE;
+	}
+	if (iElapsed > m_iResetTimeout)
+	{
+		m_bResetting = false;
+		return SPIExternalDevice::POLL_TIMEOUT;
+	}
+	return SPIExternalDevice::POLL_BUSY;
+}
+
 #endif
\ No newline at end of file
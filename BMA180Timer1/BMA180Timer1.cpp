@@ -0,0 +1,63 @@
+/*
+\file	BMA180Timer1.cpp
+\version	1.0.0
+\purpose	Timer1 pacing for BMA180AcquisitionT::beginTimer().
+\compiler	Arduino 1.0.1
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the 
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+/*	Arduino 1.0.x links every object file of a library that a sketch includes, whether anything in it is used or
+	not, so an ISR can't be left to the linker to drop.  That is why this is a library of its own: the Timer1 ISR
+	is only built into sketches that #include <BMA180Timer1.h>.	*/
+
+#include <Arduino.h>
+#include "BMA180Timer1.h"
+
+
+static void (* volatile s_pfnTimerTick)() = 0;
+
+
+bool BMA180AcquisitionTimer::begin(unsigned long iPeriodMicros, void (*pfnTick)())
+// PURPOSE:		Timer1 in CTC mode, interrupt on compare match A.  Picks the smallest prescaler that fits the period.
+{
+	static const unsigned int aPrescalers[] = { 1, 8, 64, 256, 1024 };
+	static const byte aClockSelect[] = { _BV(CS10), _BV(CS11), _BV(CS11) | _BV(CS10), _BV(CS12), _BV(CS12) | _BV(CS10) };
+
+	unsigned long iCyclesPerMicro = F_CPU / 1000000UL;
+	for (byte i = 0; i < sizeof(aPrescalers) / sizeof(aPrescalers[0]); ++i)
+	{
+		unsigned long iTicks = iPeriodMicros * iCyclesPerMicro / aPrescalers[i];
+		if (iTicks == 0 || iTicks > 65536UL)
+			continue;
+
+		byte oldSREG = SREG;
+		cli();
+		s_pfnTimerTick = pfnTick;
+		TCCR1A = 0;
+		TCCR1B = _BV(WGM12) | aClockSelect[i];	// CTC, TOP = OCR1A
+		OCR1A = (unsigned int)(iTicks - 1);
+		TCNT1 = 0;
+		TIMSK1 |= _BV(OCIE1A);
+		SREG = oldSREG;
+		return true;
+	}
+	return false;
+}
+
+
+void BMA180AcquisitionTimer::end()
+{
+	TIMSK1 &= ~_BV(OCIE1A);
+	TCCR1B = 0;		// timer stopped
+	s_pfnTimerTick = 0;
+}
+
+
+ISR(TIMER1_COMPA_vect)
+{
+	if (s_pfnTimerTick)
+		s_pfnTimerTick();
+}
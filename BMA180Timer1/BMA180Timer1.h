@@ -0,0 +1,26 @@
+/*
+\file	BMA180Timer1.h
+\version	1.0.0
+\purpose	Timer1 pacing for BMA180AcquisitionT::beginTimer().
+\compiler	Arduino 1.0.1
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the 
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+/*	Usage:
+		#include <BMA180Timer1.h>		// in the sketch, next to <BMA180Acquisition.h>
+
+		acq.beginTimer(1000);
+
+	BMA180AcquisitionTimer is declared in BMA180Acquisition.h and defined here, together with ISR(TIMER1_COMPA_vect).
+	Sketches that don't include this header don't get the ISR, and are free to use Timer1 for something else
+	(e.g. Servo).  Calling beginTimer() without it fails to link with an undefined BMA180AcquisitionTimer::begin().	*/
+
+#ifndef BMA180TIMER1_H_INCLUDED
+#define BMA180TIMER1_H_INCLUDED
+
+#include <BMA180Acquisition.h>
+
+#endif
@@ -2,15 +2,10 @@
  *  \file    CC2500.cpp
  *  \version 1.1
  *  \date    Dec 23, 2011
-<<<<<<< HEAD
- *  \author  Nick Alexeev reconvolution@gmail.com.  Based on George Mathijssen, george.knutsel@gmail.com
- *	\purpose Low level library for CC2500.  Anaren A2500R24A was used as the test hardware, although the library is generic.
-=======
  *	\purpose Low level library for CC2500.  Anaren A2500R24A was used as the test hardware, although the library is generic.
  *	\compiler	Arduino 1.0.1
  *  \author  Nick Alexeev reconvolution@gmail.com.  Based on George Mathijssen, george.knutsel@gmail.com
  *
->>>>>>> refactoring.  new driver for BMA180.
  *  
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -34,225 +29,110 @@
 [1]	CC2500 datasheet.  Texas Instruments SWRS040C.
 */
 
-<<<<<<< HEAD
-#include "CC2500.h"
-#include <inttypes.h>
-#include "Arduino.h"	// Arduino compiler 1.0 uses "Arduino.h" instead of "WConstants.h" or "wiring.h"
-
-CC2500xcvr::CC2500xcvr(unsigned char pinCS, unsigned char pinSCK, unsigned char pinMOSI, unsigned char pinMISO)
-    : m_pinCS(pinCS)
-    , m_pinSCK(pinSCK)
-    , m_pinMOSI(pinMOSI)
-    , m_pinMISO(pinMISO)
-{
-}
-
-CC2500xcvr::~CC2500xcvr()
-{
-}
-
-void CC2500xcvr::init()
-{
-    // setup pin mode
-    pinMode(m_pinMOSI, OUTPUT);
-    pinMode(m_pinMISO, INPUT);
-    pinMode(m_pinSCK, OUTPUT);
-    pinMode(m_pinCS, OUTPUT);
-
-    // disable device
-    digitalWrite(m_pinCS, HIGH);
-
-    // setup SPI control register: SPCR = 01010000
-    // interrupt disabled, spi enabled, msb 1st, master, clk low when idle,
-    // sample on rising edge of clk, system clock rate fastest
-    SPCR = (1<<SPE) | (1<<MSTR);
-
-    // clear data registers
-    byte clr = SPSR;
-    clr = SPDR;
-=======
 #include <Arduino.h>	// Arduino compiler 1.0 uses "Arduino.h" instead of "WConstants.h" or "wiring.h"
 #include <SPIExternalDevice.h>
 #include "CC2500.h"
 
 
 CC2500xcvr::CC2500xcvr(unsigned char pinCS_n, SPIClockDiv iSPIClockDiv)
-	: SPIExternalDevice(
-		pinCS_n, 
-		SPIExternalDevice::MODE0,		// sclk low when idle (CPOL=0), sample on rising edge of sclk (CPHA=0).  This is  SPI Mode 0.
-		iSPIClockDiv)
+	: CC2500xcvrT<SPIExternalDevice>(pinCS_n, iSPIClockDiv)
 {
 }
 
-CC2500xcvr::~CC2500xcvr()
-{
->>>>>>> refactoring.  new driver for BMA180.
-}
 
-void CC2500xcvr::reset()
-// REFERENCES:	19.1.2 "Manual Reset" in [1]
+static unsigned long dutyPpm(unsigned long iOnMicros, unsigned long iPeriodMicros)
+// PURPOSE:		iOnMicros * 10^6 / iPeriodMicros, rounded, for iOnMicros < iPeriodMicros.  Long division, one decimal digit
+//				at a time, so that neither floating-point nor 64-bit code is linked.
 {
-    // enable device
-<<<<<<< HEAD
-    digitalWrite(m_pinCS, LOW);
-    delayMicroseconds(1);
-
-    // disable device and wait at least 40 microseconds
-    digitalWrite(m_pinCS, HIGH);
-    delayMicroseconds(41);
-
-    // enable device
-    digitalWrite(m_pinCS, LOW);
-
-    // wait for device
-    while (digitalRead(m_pinMISO) == HIGH) {
-    };
-
-    // send reset command (SRES)
-    spiTransfer(0x30);
-
-    // disable device
-    digitalWrite(m_pinCS, HIGH);
-=======
-    digitalWrite(m_pinCS_n, LOW);
-    delayMicroseconds(1);
-
-    // disable device and wait at least 40 microseconds
-    digitalWrite(m_pinCS_n, HIGH);
-    delayMicroseconds(41);
-    
-	spiTransactionBegin();	// enable device
-    spiTransfer(0x30);	// send reset command (SRES)
-    spiTransactionEnd(); 	// disable device
-}
-
-void CC2500xcvr::spiTransactionBegin()
-{
-	SPIExternalDevice::spiTransactionBegin();
-	while ( digitalRead(MISO) == HIGH ) {;}	// wait for device
->>>>>>> refactoring.  new driver for BMA180.
+	unsigned long iPpm = 0;
+	for (unsigned char i = 0; i < 6; ++i)
+	{
+		// ten times the remainder, one addition at a time: it doesn't fit in 32 bits for intervals over 7 minutes
+		unsigned long iRemainder = 0;
+		unsigned char iDigit = 0;
+		for (unsigned char k = 0; k < 10; ++k)
+		{
+			if (iRemainder >= iPeriodMicros - iOnMicros)
+			{
+				iRemainder -= iPeriodMicros - iOnMicros;
+				++iDigit;
+			}
+			else
+				iRemainder += iOnMicros;
+		}
+		iPpm = iPpm * 10 + iDigit;
+		iOnMicros = iRemainder;
+	}
+	return (iOnMicros >= iPeriodMicros - iOnMicros) ? iPpm + 1 : iPpm;
 }
 
-unsigned char CC2500xcvr::sendByte(unsigned char data)
-{
-<<<<<<< HEAD
-    // enable device
-    digitalWrite(m_pinCS, LOW);
-
-    // wait for device
-    while (digitalRead(m_pinMISO) == HIGH) {
-    };
-
-    // send byte
-    unsigned char result = spiTransfer(data);
 
-    // disable device
-    digitalWrite(m_pinCS, HIGH);
-
-    // return result
-=======
-    spiTransactionBegin();	// enable device
-    unsigned char result = spiTransfer(data);	// send byte
-    spiTransactionEnd(); 	// disable device
->>>>>>> refactoring.  new driver for BMA180.
-    return result;
-}
-
-unsigned char CC2500xcvr::sendCommand(unsigned char command, unsigned char data)
+bool cc2500WorTiming(unsigned long iIntervalMs, unsigned long iListenMicros, CC2500WorTiming& timing)
+// REFERENCES:	19.5 "Wake On Radio (WOR)" and MCSM2 in [1]
 {
-<<<<<<< HEAD
-    // enable device
-    digitalWrite(m_pinCS, LOW);
-
-    // wait for device
-    while (digitalRead(m_pinMISO) == HIGH) {
-    };
-
-    // send command byte
-    spiTransfer(command);
+	if (iIntervalMs == 0 || iIntervalMs > 3600000UL)
+		return false;
 
-    // send data byte
-    unsigned char result = spiTransfer(data);
-
-    // disable device
-    digitalWrite(m_pinCS, HIGH);
-
-    // return result
-    return result;
-=======
-	spiTransactionBegin();	// enable device
-    spiTransfer(command);	// send command byte
-    unsigned char result = spiTransfer(data);	// send data byte
-    spiTransactionEnd(); 	// disable device
-    return result;		// return result
->>>>>>> refactoring.  new driver for BMA180.
+	// t_Event0 = 750 / fXOSC * EVENT0 * 2^(5 * WOR_RES).  At 26 MHz and WOR_RES = 0, 1 ms is 104/3 EVENT0 steps.
+	unsigned char iWorRes = 0;
+	unsigned long iEvent0;
+	for (;;)
+	{
+		unsigned long iDivisor = 3UL << (5 * iWorRes);
+		iEvent0 = (iIntervalMs * 104 + iDivisor / 2) / iDivisor;
+		if (iEvent0 <= 0xFFFF)
+			break;
+		++iWorRes;
+	}
+	if (iEvent0 == 0)
+		iEvent0 = 1;
+
+	unsigned long iSteps = iEvent0 << (5 * iWorRes);		// 750/26 us each
+	unsigned long iIntervalMicros = iSteps / 26 * 750 + (iSteps % 26) * 750 / 26;
+
+	// RX timeout = EVENT0 * C(RX_TIME, WOR_RES) us.  104 * C(0, WOR_RES) is 375, 1875, 3375, 4875.  Each RX_TIME step halves it.
+	const unsigned long iTimeout0 = iEvent0 * (375 + 1500UL * iWorRes);		// times 104
+	if (iTimeout0 / 104 < iListenMicros)
+		return false;
+	unsigned char iRxTime = 0;
+	while (iRxTime < 6 && (iTimeout0 >> (iRxTime + 1)) / 104 >= iListenMicros)
+		++iRxTime;
+	unsigned long iListenProgrammed = (iTimeout0 >> iRxTime) / 104;
+
+	const unsigned long iEvent1Micros = 1385;	// 48 RC periods (WORCTRL.EVENT1 = 7) of 750/26 us
+	if (iEvent1Micros + iListenProgrammed >= iIntervalMicros)
+		return false;	// the radio would never sleep
+
+	timing.iEvent0 = (unsigned int)iEvent0;
+	timing.iWorRes = iWorRes;
+	timing.iRxTime = iRxTime;
+	timing.iIntervalMicros = iIntervalMicros;
+	timing.iListenMicros = iListenProgrammed;
+	timing.iDutyPpm = dutyPpm(iEvent1Micros + iListenProgrammed, iIntervalMicros);
+	timing.iLatencyMicros = iIntervalMicros + iEvent1Micros;
+	return true;
 }
 
-unsigned char CC2500xcvr::sendStrobeCommand(unsigned char command)
-{
-<<<<<<< HEAD
-    // send command
-    return sendByte(command);
-=======
-    return sendByte(command);	// send command
->>>>>>> refactoring.  new driver for BMA180.
-}
 
-unsigned char CC2500xcvr::sendBurstCommand(unsigned char command, unsigned char* data, unsigned char length)
+unsigned char cc2500QuietestChannels(const signed char* aRssiDbm, unsigned char iCount, unsigned char iGuard,
+                                     unsigned char* aPick, unsigned char iPick)
+// PURPOSE:		Greedy: the quietest entry that is far enough from the ones picked so far, until iPick or no entry is left.
 {
-<<<<<<< HEAD
-    // enable device
-    digitalWrite(m_pinCS, LOW);
-
-    // wait for device
-    while (digitalRead(m_pinMISO) == HIGH) {
-    };
-
-    // send command byte
-    spiTransfer(command);			    // this is a burst command
-
-    unsigned char result = 0;
-
-    // send/recv data bytes
-    for (int i=0; i<length; ++i) {
-=======
-    spiTransactionBegin();	// enable device
-
-    // send command byte
-    spiTransfer(command);			    // this is a burst command
-    unsigned char result = 0;
-
-    // send/recv data bytes
-    for (int i=0; i<length; ++i)
+	unsigned char n = 0;
+	while (n < iPick)
 	{
->>>>>>> refactoring.  new driver for BMA180.
-        result = spiTransfer(data[i]);	// send
-        data[i] = result;				// receive into the same buffer
-    }
-
-<<<<<<< HEAD
-    // disable device
-    digitalWrite(m_pinCS, HIGH);
-
-    // return result
-    return result;
+		short iBest = -1;
+		for (unsigned char i = 0; i < iCount; ++i)
+		{
+			bool bFree = true;
+			for (unsigned char k = 0; k < n && bFree; ++k)
+				bFree = ((i > aPick[k]) ? (i - aPick[k]) : (aPick[k] - i)) > iGuard;
+			if (bFree && (iBest < 0 || aRssiDbm[i] < aRssiDbm[iBest]))
+				iBest = i;
+		}
+		if (iBest < 0)
+			break;
+		aPick[n++] = (unsigned char)iBest;
+	}
+	return n;
 }
-
-unsigned char CC2500xcvr::spiTransfer(volatile unsigned char data)
-{
-    // start transmission
-    SPDR = data;
-
-    // wait for end of transmission
-    while (!(SPSR & (1<<SPIF))) {
-    };
-
-    // return received byte
-    return SPDR;
-}
-=======
-    spiTransactionEnd(); 	// disable device
-    return result;	// return result
-}
-
->>>>>>> refactoring.  new driver for BMA180.
@@ -27,15 +27,13 @@
 [1]	CC2500 datasheet.  Texas Instruments SWRS040C.
 */
 
-<<<<<<< HEAD
-#ifndef CC2500_H_
-#define CC2500_H_
-
-#include <inttypes.h>
-=======
 #ifndef CC2500_H_INCLUDED
 #define CC2500_H_INCLUDED
->>>>>>> refactoring.  new driver for BMA180.
+
+#include <Arduino.h>
+#include <SPIExternalDevice.h>
+#include <SPSCRingBuffer.h>
+#include <PacketPool.h>
 
 // configuration registers, see page 59 of datasheet
 #define CC2500_REG_IOCFG2       0x00    // GDO2 output pin configuration.  See ch. 29 in CC2500 datasheet.
@@ -85,6 +83,7 @@
 #define CC2500_REG_TEST2        0x2C    // Various test settings
 #define CC2500_REG_TEST1        0x2D    // Various test settings
 #define CC2500_REG_TEST0        0x2E    // Various test settings
+#define CC2500_CONFIG_SIZE      (CC2500_REG_TEST0 - CC2500_REG_IOCFG2 + 1)    // Configuration registers IOCFG2..TEST0, one contiguous burst
                                        
 // status registers, see page 60 of datasheet
 #define CC2500_REG_PARTNUM      0x30    // Chip ID
@@ -104,6 +103,8 @@
 #define CC2500_REG_PATABLE      0x3E    // PA control settings table
 #define CC2500_REG_TXFIFO       0x3F    // Transmit FIFO; Single access is +0x00, burst is +0x40
 #define CC2500_REG_RXFIFO       0x3F    // Receive FIFO; Single access is +0x80, burst is +0xC0
+#define CC2500_PATABLE_SIZE     8       // PA control settings table, bytes
+#define CC2500_FLASH_CHUNK      24      // PROGMEM tables are copied to RAM this many bytes at a time, one SPI block each
 
 // command strobe registers, see page 58 of datasheet
 #define CC2500_CMD_SRES         0x30    // Reset chip
@@ -129,8 +130,152 @@
 
 // register bit masks
 #define	CC2500_GDOx_INV			0x40	// when set, GDOx outputs are active low.  See 3.21 in [1].
+#define CC2500_FIFOTHR_MASK     0x0F    // FIFOTHR.FIFO_THR
+#define CC2500_PKTCTRL1_APPEND_STATUS   0x04    // RSSI and LQI/CRC_OK are appended to received packets
+#define CC2500_NUM_BYTES_MASK   0x7F    // TXBYTES/RXBYTES: number of bytes in the FIFO
+#define CC2500_FIFO_UNDERFLOW   0x80    // TXBYTES: TX FIFO underflow
+#define CC2500_FIFO_OVERFLOW    0x80    // RXBYTES: RX FIFO overflow
+#define CC2500_LQI_CRC_OK       0x80    // second appended status byte: CRC OK
+#define CC2500_MARCSTATE_MASK   0x1F
+#define CC2500_STATUS_CHIP_RDYn 0x80    // chip status byte: crystal not running / regulator not settled.  See 10.1 in [1].
+#define CC2500_STATUS_STATE     0x70    // chip status byte: main state machine mode
+#define CC2500_STATUS_FIFO      0x0F    // chip status byte: bytes in RX FIFO (read access) or free in TX FIFO (write access), saturates at 15
+#define CC2500_MCSM2_RX_TIME_RSSI   0x10    // end the RX timeout early when there is no carrier
+#define CC2500_MCSM2_RX_TIME        0x07    // RX timeout relative to Event 0.  7 means no timeout.
+#define CC2500_MCSM1_RXOFF_MODE     0x0C    // state after a packet has been received
+#define CC2500_MCSM1_TXOFF_MODE     0x03    // state after a packet has been sent
+#define CC2500_MDMCFG2_MANCHESTER_EN    0x08    // Manchester coding: two chips per bit
+#define CC2500_MCSM0_FS_AUTOCAL     0x30    // when the synthesizer calibrates by itself.  0: only on SCAL.
+#define CC2500_WORCTRL_RC_PD        0x80    // RC oscillator powered down.  WOR needs it running.
+#define CC2500_WORCTRL_EVENT1       0x70    // Event 0 to RX: crystal start-up time
+#define CC2500_WORCTRL_RC_CAL       0x08    // RC oscillator calibration
+#define CC2500_WORCTRL_WOR_RES      0x03    // Event 0 resolution
 
 // register values
+#define CC2500_GDO_RX_FIFO_THR              0x00    // IOCFGx: asserts when RX FIFO is at or above the threshold.  See table 33 in [1].
+#define CC2500_GDO_TX_FIFO_THR              0x02    // IOCFGx: asserts when TX FIFO is at or above the threshold, de-asserts below
+#define CC2500_GDO_SYNC_WORD                0x06    // IOCFGx: asserts on sync word, de-asserts at the end of the packet
+#define CC2500_TXOFF_TX                     0x02    // MCSM1.TXOFF_MODE: start the next packet
+#define CC2500_AUTOCAL_FROM_IDLE            0x10    // MCSM0.FS_AUTOCAL: calibrate when going from IDLE to RX or TX
+#define CC2500_RSSI_OFFSET                  72      // dB, 250 and 500 kBaud.  71 at 2.4 kBaud, 69 at 10 kBaud.  See "RSSI" in [1].
+#define CC2500_RSSI_NONE                    (-128)  // dBm, "no reading yet" for the scan arrays
+#define CC2500_STATE_IDLE                   0x00    // chip status byte STATE field, unshifted
+#define CC2500_STATE_RX                     0x10
+#define CC2500_STATE_TX                     0x20
+#define CC2500_STATE_FSTXON                 0x30
+#define CC2500_STATE_CALIBRATE              0x40
+#define CC2500_STATE_SETTLING               0x50
+#define CC2500_STATE_RXFIFO_OVERFLOW        0x60
+#define CC2500_STATE_TXFIFO_UNDERFLOW       0x70
+#define CC2500_MARCSTATE_IDLE               0x01
+#define CC2500_MARCSTATE_VCOON_MC           0x03    // VCOON_MC..ENDCAL: waking up, calibrating and settling on the way to RX/TX
+#define CC2500_MARCSTATE_ENDCAL             0x0C
+#define CC2500_MARCSTATE_RX                 0x0D
+#define CC2500_MARCSTATE_RXFIFO_OVERFLOW    0x11
+#define CC2500_MARCSTATE_TX                 0x13
+#define CC2500_MARCSTATE_TX_END             0x14
+#define CC2500_MARCSTATE_TXFIFO_UNDERFLOW   0x16
+
+
+/*! \brief Radio profile: a complete register set for one data rate / channel plan.
+ *
+ * Both tables live in flash (PROGMEM), e.g. as exported from SmartRF Studio:
+ *
+ *     const unsigned char PROGMEM g_aRegs250k[CC2500_CONFIG_SIZE] = { 0x29, 0x2E, 0x06, ... };	// IOCFG2..TEST0
+ *     const unsigned char PROGMEM g_aPA250k[] = { 0xFF };
+ *     const CC2500Profile g_profile250k = { g_aRegs250k, g_aPA250k, sizeof(g_aPA250k) };
+ */
+struct CC2500Profile
+{
+	const unsigned char*	pRegisters;		// CC2500_CONFIG_SIZE bytes for IOCFG2..TEST0, in PROGMEM
+	const unsigned char*	pPATable;		// PATABLE contents, in PROGMEM.  May be NULL.
+	unsigned char			iPATableLength;	// 1..CC2500_PATABLE_SIZE
+};
+
+
+/*! \brief Status bytes appended to a received packet (PKTCTRL1.APPEND_STATUS).
+ */
+struct CC2500RxStatus
+{
+	signed char		iRSSI;		// raw RSSI, 0.5 dB steps, without the data-rate dependent offset.  CC2500xcvrT::rssiDbm() converts it.
+	unsigned char	iLQI;		// link quality indicator, 7 bits
+	bool			bCRCOK;		// CRC of the packet was OK
+};
+
+
+/*! \brief Streaming transmit figures, from CC2500xcvrT::txStats().
+ *
+ * A stream runs from the STX that starts it to the end of the packet after which the queue was
+ * empty. iUtilizationPermille compares the bytes sent with what the configured data rate could
+ * have carried in that time; preamble, sync word, CRC and the gaps between streams' packets are
+ * the difference.
+ */
+struct CC2500TxStats
+{
+	unsigned long	iPackets;				// packets sent
+	unsigned long	iBytes;					// length bytes and payload of the packets sent
+	unsigned int	iUnderflows;			// TX FIFO underflows
+	unsigned int	iDropped;				// packets lost to the underflows
+	unsigned long	iActiveMicros;			// time in streams
+	unsigned int	iUtilizationPermille;	// iBytes at the data rate, relative to iActiveMicros
+};
+
+
+/*! \brief One channel of a hop set: the channel number and its synthesizer calibration.
+ *
+ * The caller owns the array and fills in iChannel; CC2500xcvrT::beginHopping() fills in the rest.
+ */
+struct CC2500HopChannel
+{
+	unsigned char	iChannel;		// CHANNR
+	unsigned char	aFscal[3];		// FSCAL3, FSCAL2, FSCAL1 as the calibration left them
+};
+
+
+/*! \brief Wake-on-Radio settings and what they cost, from cc2500WorTiming().
+ *
+ * Event 0 wakes the radio every iIntervalMicros. It starts the crystal (Event 1, about 1.4 ms) and
+ * listens for iListenMicros. Without a sync word it goes back to SLEEP. A sender has to repeat the
+ * packet (or keep the preamble going) for iLatencyMicros to be sure that one of the windows hears it.
+ */
+struct CC2500WorTiming
+{
+	unsigned int	iEvent0;			// WOREVT1:WOREVT0
+	unsigned char	iWorRes;			// WORCTRL.WOR_RES
+	unsigned char	iRxTime;			// MCSM2.RX_TIME
+	unsigned long	iIntervalMicros;	// Event 0 period as programmed
+	unsigned long	iListenMicros;		// RX timeout as programmed
+	unsigned long	iDutyPpm;			// crystal start-up and RX per interval, parts per million.  Add 721 us per calibration.
+	unsigned long	iLatencyMicros;		// worst case from the start of a transmission until a window hears it
+};
+
+/*!
+ * Works out the Wake-on-Radio registers for a wake interval and a listen window (26 MHz crystal).
+ * WOR_RES is the finest resolution that reaches the interval; the RX timeout is the shortest one
+ * that is at least the listen window. The window can't be longer than 12.5% of the interval at
+ * WOR_RES = 0, and less at coarser resolutions. Make it long enough for the preamble and sync word.
+ *
+ * \param[in] iIntervalMs Wake interval, 1 ms to 1 hour.
+ * \param[in] iListenMicros Minimum listen window.
+ * \param[out] timing Settings for CC2500xcvrT::beginWakeOnRadio() and the resulting figures.
+ * \return false if the combination isn't possible.
+ */
+bool cc2500WorTiming(unsigned long iIntervalMs, unsigned long iListenMicros, CC2500WorTiming& timing);
+
+/*!
+ * Picks the quietest entries of a scan (CC2500xcvrT::scanChannels() or scanHopSet()), quietest
+ * first. Each pick is more than iGuard entries away from the ones before, so that one wide
+ * interferer (a Wi-Fi channel is 20 MHz) doesn't leave all picks next to each other.
+ *
+ * \param[in] aRssiDbm Scan results.
+ * \param[in] iCount Number of entries.
+ * \param[in] iGuard Entries to keep free on both sides of a pick. 0: only distinct entries.
+ * \param[out] aPick Indexes into aRssiDbm.
+ * \param[in] iPick Size of aPick.
+ * \return Number of entries picked. Less than iPick when the guard leaves no more room.
+ */
+unsigned char cc2500QuietestChannels(const signed char* aRssiDbm, unsigned char iCount, unsigned char iGuard,
+                                     unsigned char* aPick, unsigned char iPick);
 
 
 /*! \brief Class for interfacing with the Chipcon TI CC2500.
@@ -142,84 +287,117 @@
  * - Datasheet (cc2500.pdf)
  * - Errata (swrz002d.pdf)
  * - SPI access (swra112b.pdf)
+ *
+ * The driver is a template on the SPI external device underneath it. CC2500xcvr (below) runs on
+ * SPIExternalDevice with the CS pin and clock chosen at run time. For fixed wiring use a compile-time
+ * device, e.g. CC2500xcvrT< SPIDevice<10, SPIExternalDevice::MODE0, SPIExternalDevice::DIV2> >.
  */
-<<<<<<< HEAD
-class CC2500xcvr
+template<class Device>
+class CC2500xcvrT : public Device
 {
-private:
+public:
+
+	static const unsigned short FIFO_SIZE = 64;
+
+	enum PacketResult
+	{
+		PACKET_OK = 0,
+		PACKET_NONE,		// receivePacket(): nothing in the RX FIFO
+		PACKET_TIMEOUT,
+		PACKET_TOO_LONG,	// receivePacket(): the packet doesn't fit in the caller's buffer.  It was flushed.
+		PACKET_OVERFLOW,	// RX FIFO overflowed.  It was flushed.
+		PACKET_UNDERFLOW,	// TX FIFO underflowed.  It was flushed.
+		PACKET_CRC_ERROR	// receivePacket(): the packet was delivered, but its CRC was bad
+	};
     /*!
-     * Number of the slave select (CS) pin.
+     * Constructor for compile-time devices, which know their own configuration.
      */
-    unsigned char m_pinCS;
+	CC2500xcvrT();
 
     /*!
-     * Number of the clock (SCK) pin.
+     * Destructor.
      */
-    unsigned char m_pinSCK;
+    ~CC2500xcvrT();
 
     /*!
-     * Number of the master output, slave input (MOSI) pin.
+     * Resets the CC2500 using SPI. Resetting the CC2500 is done by toggling the CS pin in a
+     * specific pattern and sending the strobe command SRES.
+     *
+     * See SPI access document, page 9
      */
-    unsigned char m_pinMOSI;
+    void reset();
+
+	void spiTransactionBegin();		// Actions needed for beginning a transaction.  Overrrides parent and calls it internally.
+
+	static const unsigned int READY_SPINS_MAX = 4096;	// chip ready wait of spiTransactionBegin(), several ms on the ATmega328P
 
     /*!
-     * Number of the master input, slave output (MISO) pin.
+     * Times spiTransactionBegin() gave up waiting for CHIP_RDYn: no chip, or it didn't come out of reset or SLEEP.
+     * The transaction went ahead anyway; chipReady() of its status byte tells.
      */
-    unsigned char m_pinMISO;
+    unsigned int readyTimeouts() const { return m_iReadyTimeouts; }
 
-=======
-class CC2500xcvr : public SPIExternalDevice
-{
->>>>>>> refactoring.  new driver for BMA180.
-public:
+    /*!
+     * Non-blocking reset(). Pulses CS_n and returns; poll() keeps CS_n high for 41 us, sends SRES
+     * and waits for CHIP_RDYn. Don't use the radio otherwise until poll() has returned POLL_DONE or
+     * POLL_TIMEOUT; abortOperation() gives up.
+     *
+     * \param[in] iTimeoutMicros poll() returns POLL_TIMEOUT if the chip isn't ready by then.
+     * \return false if another operation is running.
+     */
+    bool beginReset(unsigned long iTimeoutMicros = 10000);
 
-	static const unsigned short FIFO_SIZE = 64;
     /*!
-     * Constructor.
+     * Non-blocking SCAL: SIDLE and SCAL, then poll() waits for IDLE (721 us nominal).
      *
-     * \param[in] pinCS Pin number of slave select, default is 10.
-     * \param[in] pinSCK Pin number of clock, default is 13 (Arduino standard).
-     * \param[in] pinMOSI Pin number of master output slave input, default is 11 (Arduino standard).
-     * \param[in] pinMISO Pin number of master input slave output, default is 12 (Arduino standard).
-     */
-<<<<<<< HEAD
-    CC2500xcvr(unsigned char pinCS = 10,
-           unsigned char pinSCK = 13,
-           unsigned char pinMOSI = 11,
-           unsigned char pinMISO = 12);
-=======
-	CC2500xcvr(
-		unsigned char pinCS_n, 
-		SPIExternalDevice::SPIClockDiv iSPIClockDiv = SPIExternalDevice::DIV4);
->>>>>>> refactoring.  new driver for BMA180.
+     * \return false if another operation is running.
+     */
+    bool beginCalibrate(unsigned long iTimeoutMicros = 2000);
 
     /*!
-     * Destructor.
+     * Non-blocking state transition: sends the strobe, then poll() waits until the STATE field of the
+     * chip status is iState, e.g. CC2500_CMD_SRX and CC2500_STATE_RX (calibration included with FS_AUTOCAL).
+     *
+     * \param[in] command Strobe command.
+     * \param[in] iState CC2500_STATE_xxx to wait for.
+     * \return false if another operation is running.
      */
-    ~CC2500xcvr();
+    bool beginStrobe(unsigned char command, unsigned char iState, unsigned long iTimeoutMicros = 2000);
 
     /*!
-<<<<<<< HEAD
-     * Initializes the CC2500 by setting the pin modes and disabling the device (slave select is
-     * set to high). Also sets up the arduino SPI control register (SPCR).
+     * Non-blocking recalibrateHopChannel(). When poll() returns POLL_DONE the cached values are
+     * updated and the radio is in IDLE on the current hop channel.
+     *
+     * \return false if another operation is running, or there is no such hop channel.
      */
-    void init();
+    bool beginRecalibrateHopChannel(unsigned char iIndex, unsigned long iTimeoutMicros = 2000);
 
     /*!
-=======
->>>>>>> refactoring.  new driver for BMA180.
-     * Resets the CC2500 using SPI. Resetting the CC2500 is done by toggling the CS pin in a
-     * specific pattern and sending the strobe command SRES.
+     * Non-blocking serviceHopCalibration(): starts the recalibration of the next channel of the
+     * round when one is due. Finish it with poll().
      *
-     * See SPI access document, page 9
+     * \return true if a recalibration was started.
      */
-    void reset();
+    bool beginHopCalibrationService(unsigned long iPeriodMs);
 
-<<<<<<< HEAD
-=======
-	void spiTransactionBegin();		// Actions needed for beginning a transaction.  Overrrides parent and calls it internally.
+    /*!
+     * Moves the operation started by a begin...() call on. Never waits; each call is at most a short
+     * transaction. Call it from the main loop, between sampling and radio service.
+     *
+     * \return POLL_BUSY while it runs, POLL_DONE or POLL_TIMEOUT once when it ends, POLL_IDLE otherwise.
+     */
+    SPIExternalDevice::PollStatus poll();
+
+    /*!
+     * An operation is running.
+     */
+    bool operationBusy() const { return m_iOp != OP_NONE; }
+
+    /*!
+     * Drops the running operation. The radio is left wherever it got to.
+     */
+    void abortOperation() { m_iOp = OP_NONE; }
 
->>>>>>> refactoring.  new driver for BMA180.
     /*!
      * Sends a byte of data to the CC2500 using SPI. The received byte is returned.
      *
@@ -264,18 +442,2219 @@ public:
     unsigned char sendBurstCommand(unsigned char command,
                                    unsigned char* data,
                                    unsigned char length);
-<<<<<<< HEAD
 
-protected:
     /*!
-     * Transfers a byte of data using the Arduino SPI registers.
+     * Sends a burst command with separate transmit and receive buffers, so the data to send is
+     * not overwritten. The burst bit (0x40) in the command must be set.
      *
-     * \param[in] data Byte of data to send.
-     * \return Received byte.
+     * \param[in] command Burst command.  Calling code should add 0x40.
+     * \param[in] txData Data bytes to send.
+     * \param[out] rxData Received bytes, may be the same buffer as txData.
+     * \param[in] length Number of data bytes.
      */
-    unsigned char spiTransfer(volatile unsigned char data);
-=======
->>>>>>> refactoring.  new driver for BMA180.
-};
+    void sendBurstCommand(unsigned char command, const unsigned char* txData, unsigned char* rxData, unsigned char length);
+
+    /*!
+     * Writes consecutive registers (or the PATABLE, or the TX FIFO) in one burst. The received
+     * bytes are not stored.
+     *
+     * \param[in] address First register. The burst bit is added here.
+     */
+    void writeBurst(unsigned char address, const unsigned char* data, unsigned char length);
+
+    /*!
+     * Reads consecutive registers (or the RX FIFO) in one burst.
+     *
+     * \param[in] address First register. The read and burst bits are added here.
+     */
+    void readBurst(unsigned char address, unsigned char* data, unsigned char length);
+
+    /*!
+     * Uploads a complete radio profile: SIDLE, then one burst for IOCFG2..TEST0 and one burst for
+     * PATABLE. Optionally reads the configuration back in one more burst.
+     *
+     * \param[in] profile Register tables in PROGMEM.
+     * \param[in] bVerify Read back and compare the configuration registers.
+     * \return false if the read back didn't match.
+     */
+    bool configure(const CC2500Profile& profile, bool bVerify = true);
+
+    /*!
+     * Writes all configuration registers, IOCFG2..TEST0, in one burst.
+     *
+     * \param[in] pRegisters CC2500_CONFIG_SIZE bytes in PROGMEM.
+     */
+    void writeConfiguration(const unsigned char* pRegisters);
+
+    /*!
+     * Writes the PA table in one burst.
+     *
+     * \param[in] pPATable PA table in PROGMEM.
+     * \param[in] length Number of entries, up to CC2500_PATABLE_SIZE.
+     */
+    void writePATable(const unsigned char* pPATable, unsigned char length);
+
+    /*!
+     * Reads all configuration registers back in one burst and compares them with the table.
+     *
+     * \param[in] pRegisters CC2500_CONFIG_SIZE bytes in PROGMEM.
+     * \return true if all registers match.
+     */
+    bool verifyConfiguration(const unsigned char* pRegisters);
+
+    /*!
+     * Reads a status register (PARTNUM..RXBYTES). These need the burst bit set. Per errata, the
+     * register is read repeatedly in one transaction until two consecutive reads agree.
+     *
+     * Before reading RXBYTES/TXBYTES/MARCSTATE, check whether the cached chip status byte
+     * already answers the question.
+     *
+     * \param[in] address Status register address.
+     * \return Register contents.
+     */
+    unsigned char readStatusRegister(unsigned char address);
+
+    /*!
+     * The chip status byte returned by the header byte of the last access. Every access through
+     * this driver updates it, so it usually saves a separate status register read.
+     */
+    unsigned char chipStatus() const { return m_iChipStatus; }
+
+    /*!
+     * STATE field of the cached chip status byte, one of CC2500_STATE_xxx.
+     */
+    unsigned char statusState() const { return m_iChipStatus & CC2500_STATUS_STATE; }
+
+    /*!
+     * FIFO_BYTES_AVAILABLE of the cached chip status byte: bytes in the RX FIFO if the last
+     * access was a read (statusIsRxFifo()), free bytes in the TX FIFO otherwise. 15 means 15 or more.
+     */
+    unsigned char statusFifoBytes() const { return m_iChipStatus & CC2500_STATUS_FIFO; }
+
+    /*!
+     * True if the cached status came from a read access, i.e. statusFifoBytes() counts the RX FIFO.
+     */
+    bool statusIsRxFifo() const { return m_bStatusRxFifo; }
+
+    /*!
+     * CHIP_RDYn of the cached chip status byte is low.
+     */
+    bool chipReady() const { return !(m_iChipStatus & CC2500_STATUS_CHIP_RDYn); }
+
+    /*!
+     * Refreshes the cached chip status with a one-byte SNOP.
+     *
+     * \param[in] bRxFifo Ask for the RX FIFO count (read access) rather than the TX FIFO free space.
+     * \return Chip status byte.
+     */
+    unsigned char updateStatus(bool bRxFifo);
+
+    /*!
+     * Writes bytes to the TX FIFO in one burst. The data buffer is not modified.
+     */
+    void writeTxFifo(const unsigned char* data, unsigned char length);
+
+    /*!
+     * Reads bytes from the RX FIFO in one burst.
+     */
+    void readRxFifo(unsigned char* data, unsigned char length);
+
+    /*!
+     * Sends a variable length packet (PKTCTRL0.LENGTH_CONFIG = 1). The length byte is added here.
+     * Packets longer than the FIFO are streamed: the TX FIFO is refilled every time it drains to
+     * the FIFOTHR threshold, so up to 255 payload bytes go out as one packet. Returns when the
+     * packet has left the air (MARCSTATE went through calibration and TX, and left TX).
+     *
+     * \param[in] data Payload, not modified.
+     * \param[in] length Payload length.
+     * \param[in] timeoutMs Give up after this long.
+     * \return PACKET_OK, PACKET_UNDERFLOW or PACKET_TIMEOUT.
+     */
+    PacketResult sendPacket(const unsigned char* data, unsigned char length, unsigned int timeoutMs = 100);
+
+    /*!
+     * Receives a variable length packet. The radio has to be in RX (see startReceive()). Returns
+     * PACKET_NONE right away if nothing has arrived. Once a packet has started, the RX FIFO is
+     * drained every time it fills to the FIFOTHR threshold, so packets longer than the FIFO stream
+     * through it. Per errata, the FIFO is never emptied before the whole packet is in.
+     *
+     * \param[out] data Payload.
+     * \param[in] maxLength Size of data.
+     * \param[out] length Payload length.
+     * \param[out] pStatus Appended RSSI/LQI/CRC status, may be NULL.
+     * \param[in] timeoutMs Give up if the rest of the packet doesn't arrive within this time.
+     * \return PACKET_OK, PACKET_NONE, PACKET_CRC_ERROR, PACKET_TOO_LONG, PACKET_OVERFLOW or PACKET_TIMEOUT.
+     */
+    PacketResult receivePacket(unsigned char* data, unsigned char maxLength, unsigned char& length,
+                               CC2500RxStatus* pStatus = 0, unsigned int timeoutMs = 100);
+
+    /*!
+     * Enters RX.
+     */
+    void startReceive() { sendStrobeCommand(CC2500_CMD_SRX); }
+
+    /*!
+     * Leaves RX/TX and flushes the RX FIFO.
+     */
+    void flushRx();
+
+    /*!
+     * Leaves RX/TX and flushes the TX FIFO.
+     */
+    void flushTx();
+
+	static const unsigned char NO_INTERRUPT = 0xFF;
+
+    /*!
+     * Starts interrupt-driven receive. GDO0 is set up to signal the end of a packet, GDO2 (optional)
+     * to signal the RX FIFO threshold, so that packets longer than the FIFO are drained while they
+     * arrive. The ISR drains the RX FIFO into the ring as records of
+     * [length][payload][RSSI][LQI] (the status bytes only with APPEND_STATUS). A record becomes
+     * visible to readPacket() only when the whole packet is in. The main loop reads the ring with
+     * readPacket() without disabling interrupts.
+     *
+     * A record has to fit in the ring as a whole, so the longest packet is ring.capacity() - 3 bytes
+     * with APPEND_STATUS, ring.capacity() - 1 without: 125 bytes with the largest ring of 128.
+     * Longer packets are dropped and counted in rxRingOverruns(). Use the pool overload below for
+     * packets up to 255 bytes.
+     *
+     * Configure MCSM1.RXOFF_MODE = RX, so that the radio stays in RX between packets.
+     *
+     * \param[in] ring Ring buffer for received packets.
+     * \param[in] iIntPacketEnd External interrupt number (attachInterrupt()) wired to GDO0.
+     * \param[in] iIntFifoThreshold External interrupt number wired to GDO2, or NO_INTERRUPT.
+     * \param[in] bInvertGdo Use active-low GDO outputs (CC2500_GDOx_INV).
+     */
+    void beginInterruptReceive(SPSCRing<unsigned char>& ring, unsigned char iIntPacketEnd,
+                               unsigned char iIntFifoThreshold = NO_INTERRUPT, bool bInvertGdo = false);
+
+    /*!
+     * Interrupt-driven receive without copies: the ISR reads each packet from the RX FIFO straight
+     * into a buffer of the pool, as [length][payload][RSSI][LQI], and passes its handle on through
+     * the handle ring. Take packets with takePacket(); readPacket() works too, with one copy.
+     * A packet is dropped, and counted in rxRingOverruns(), when it is longer than a pool buffer
+     * or the pool or the handle ring is full.
+     *
+     * \param[in] pool Buffers for received packets. May be shared with transmit.
+     * \param[in] handles Handles of received packets, oldest first.
+     */
+    void beginInterruptReceive(PacketPoolBase& pool, SPSCRing<unsigned char>& handles, unsigned char iIntPacketEnd,
+                               unsigned char iIntFifoThreshold = NO_INTERRUPT, bool bInvertGdo = false);
+
+    /*!
+     * Stops interrupt-driven receive and detaches the interrupts. With a pool, the handles not
+     * taken yet are released.
+     */
+    void endInterruptReceive();
+
+    /*!
+     * Takes the oldest packet of pool receive. Does not touch the SPI bus. The reference goes to
+     * the caller, who releases it when done with pool.payload(handle), pool.length(handle).
+     *
+     * \param[out] handle The packet, PacketPoolBase::NONE if there is none.
+     * \return PACKET_OK, PACKET_NONE or PACKET_CRC_ERROR.
+     */
+    PacketResult takePacket(PacketPoolBase::Handle& handle, CC2500RxStatus* pStatus = 0);
+
+    /*!
+     * Takes the oldest received packet out of the ring. Does not touch the SPI bus.
+     *
+     * \return PACKET_OK, PACKET_NONE, PACKET_CRC_ERROR or PACKET_TOO_LONG (the packet is dropped).
+     */
+    PacketResult readPacket(unsigned char* data, unsigned char maxLength, unsigned char& length, CC2500RxStatus* pStatus = 0);
+
+    /*!
+     * Completes an RX FIFO drain that the ISR had to defer because the SPI bus was in use when the
+     * GDO interrupt came. The deferred drain is posted as a bus request (see
+     * SPIExternalDevice::spiPostRequest()). It runs between asynchronous transactions, or here, or
+     * in SPIExternalDevice::spiServiceRequests(), never at the end of the transaction in the way.
+     * With interrupt receive, call this from the main loop at least once per FIFO threshold's worth
+     * of air time (about 1 ms for 32 bytes at 250 kbit/s), or the RX FIFO may overflow. Give the
+     * radio a higher bus priority (spiSetPriority()) than the other devices, so that it goes ahead
+     * of their queued transactions.
+     */
+    void serviceReceive();
+
+    /*!
+     * Services the GDO interrupts. Called from the ISR.
+     */
+    void rxInterruptHandler();
+
+    unsigned int rxRingOverruns();		//!< packets dropped because the ring was full
+    unsigned int rxFifoOverflows();		//!< RX FIFO overflows (the FIFO was flushed)
+
+    /*!
+     * Starts streaming transmit. Packets queued with queuePacket() go out back to back: TXOFF_MODE
+     * is set to TX, so after each packet the radio starts the next one right away instead of going
+     * through IDLE, and sends preamble while the FIFO is still empty. GDO2 is set up to signal the
+     * TX FIFO threshold and GDO0 the end of each packet; the ISR refills the FIFO from the ring on
+     * both. When the queue has run dry at the end of a packet, the radio goes to IDLE.
+     *
+     * The ring holds records of [length][payload], as the FIFO takes them (variable packet length).
+     * Uses the same GDOs as beginInterruptReceive() and beginWakeOnRadio(), so not together with them.
+     *
+     * \param[in] ring Ring buffer for packets to send.
+     * \param[in] iIntPacketEnd External interrupt number (attachInterrupt()) wired to GDO0.
+     * \param[in] iIntFifoThreshold External interrupt number wired to GDO2.
+     * \param[in] bInvertGdo Use active-low GDO outputs (CC2500_GDOx_INV).
+     */
+    void beginInterruptTransmit(SPSCRing<unsigned char>& ring, unsigned char iIntPacketEnd,
+                                unsigned char iIntFifoThreshold, bool bInvertGdo = false);
+
+    /*!
+     * Streaming transmit from pool buffers: the ISR writes the TX FIFO straight from the buffers
+     * queued with queuePacket(handle), and releases each one once it is all in the FIFO.
+     *
+     * \param[in] pool Buffers of the packets to send, filled in as [length][payload].
+     * \param[in] handles Queue of handles to send.
+     */
+    void beginInterruptTransmit(PacketPoolBase& pool, SPSCRing<unsigned char>& handles, unsigned char iIntPacketEnd,
+                                unsigned char iIntFifoThreshold, bool bInvertGdo = false);
+
+    /*!
+     * Stops streaming transmit: SIDLE, flushes the TX FIFO, restores MCSM1 and detaches the
+     * interrupts. Packets not sent yet are lost; wait for transmitBusy() to be false first.
+     * With a pool, their buffers are released.
+     */
+    void endInterruptTransmit();
+
+    /*!
+     * Queues a packet and starts the stream if it isn't running. With a ring, the record
+     * [length][payload] has to fit in it as a whole, so the longest packet is ring.capacity() - 1
+     * bytes: 127 with the largest ring of 128. With a pool, it is the pool's maxPayload().
+     *
+     * \return false if the packet doesn't fit in the ring or the pool now, or never, if it is
+     * longer than the maximum above.
+     */
+    bool queuePacket(const unsigned char* data, unsigned char length);
+
+    /*!
+     * Queues a pool buffer for pool transmit and starts the stream if it isn't running. The queue
+     * takes over the caller's reference; retain() first to keep the buffer after it is sent.
+     *
+     * \return false if the handle queue is full. The caller still holds the reference then.
+     */
+    bool queuePacket(PacketPoolBase::Handle handle);
+
+    /*!
+     * Packets are queued or on the air.
+     */
+    bool transmitBusy() const { return m_bTxActive || (m_pTxRing && m_pTxRing->available()); }
+
+    /*!
+     * Completes a refill that the ISR had to defer because the SPI bus was in use, as
+     * serviceReceive() does for receive. Call it from the main loop as often, or the TX FIFO may
+     * underflow.
+     */
+    void serviceTransmit();
+
+    /*!
+     * Services the GDO interrupts of streaming transmit. Called from the ISR.
+     */
+    void txInterruptHandler();
+
+    void txStats(CC2500TxStats& stats);	//!< counters since beginInterruptTransmit() or txStatsReset()
+    void txStatsReset();
+
+    /*!
+     * Enters Wake-on-Radio: the radio sleeps and listens for a short window every interval on its
+     * own, see cc2500WorTiming(). GDO0 is set up to signal the end of a packet; its ISR only sets a
+     * flag, so the MCU may sleep until then. When wakeOnRadioPending() is true, read the packet with
+     * receivePacket() and call resumeWakeOnRadio(). The radio must not be accessed otherwise: CS_n
+     * low wakes it up and ends WOR.
+     *
+     * RXOFF_MODE is set to IDLE and RX_TIME to the timeout while WOR runs, endWakeOnRadio() puts
+     * them back. With FS_AUTOCAL = 1 every window starts with a calibration (721 us more awake);
+     * otherwise calibrate with SCAL before, and again now and then. The edge interrupt wakes the
+     * ATmega328P from idle sleep, not from power-down.
+     *
+     * \param[in] timing From cc2500WorTiming().
+     * \param[in] iIntPacket External interrupt number (attachInterrupt()) wired to GDO0.
+     * \param[in] bInvertGdo Use an active-low GDO output (CC2500_GDOx_INV).
+     * \param[in] bCarrierSense End a window early when there is no carrier (MCSM2.RX_TIME_RSSI).
+     */
+    void beginWakeOnRadio(const CC2500WorTiming& timing, unsigned char iIntPacket, bool bInvertGdo = false, bool bCarrierSense = false);
+
+    /*!
+     * A packet has ended since WOR was (re)started. The radio is in IDLE with the packet in the RX FIFO.
+     */
+    bool wakeOnRadioPending() const { return m_bWorWake; }
+
+    /*!
+     * Flushes what is left in the RX FIFO and restarts WOR.
+     */
+    void resumeWakeOnRadio();
+
+    /*!
+     * Leaves WOR for IDLE, restores MCSM1/MCSM2, powers down the RC oscillator and detaches the interrupt.
+     */
+    void endWakeOnRadio();
+
+    /*!
+     * Starts frequency hopping over a hop set. Every channel is calibrated once (SCAL, 721 us each)
+     * and its FSCAL3/2/1 are kept in the array. Auto-calibration (MCSM0.FS_AUTOCAL) is turned off, so
+     * a hop only restores the cached values instead of calibrating again: RX or TX is reached in
+     * about 90 us instead of 810 us. Leaves the radio in IDLE on channel 0 of the set.
+     *
+     * The calibration drifts with temperature and supply voltage. Call serviceHopCalibration()
+     * from the main loop, or recalibrateHopChannel() when it suits the protocol.
+     *
+     * \param[in] pChannels Hop set, iChannel filled in. Has to stay valid until endHopping().
+     * \param[in] iCount Number of channels.
+     * \return false if a calibration didn't finish.
+     */
+    bool beginHopping(CC2500HopChannel* pChannels, unsigned char iCount);
+
+    /*!
+     * Moves to a channel of the hop set: SIDLE, CHANNR and the FSCAL3..1 burst in one transaction,
+     * then the strobe.
+     *
+     * \param[in] iIndex Index into the hop set.
+     * \param[in] strobe CC2500_CMD_SRX, CC2500_CMD_STX, CC2500_CMD_SFSTXON, or 0 to stay in IDLE.
+     */
+    void hop(unsigned char iIndex, unsigned char strobe = CC2500_CMD_SRX);
+
+    /*!
+     * Index of the current channel in the hop set.
+     */
+    unsigned char hopIndex() const { return m_iHopIndex; }
+
+    /*!
+     * Calibrates one channel of the hop set again and updates its cached values. Leaves the radio
+     * in IDLE on the current channel.
+     *
+     * \return false if the calibration didn't finish.
+     */
+    bool recalibrateHopChannel(unsigned char iIndex);
+
+    /*!
+     * Spreads recalibration over time: once iPeriodMs has passed since the last round started,
+     * each call recalibrates the next channel of the set until the round is done.
+     *
+     * \return true if a channel was recalibrated. The radio is then in IDLE on the current channel.
+     */
+    bool serviceHopCalibration(unsigned long iPeriodMs);
+
+    /*!
+     * Stops hopping and restores MCSM0. The radio stays on the current channel.
+     */
+    void endHopping();
+
+    /*!
+     * Builds a noise-floor map: enters RX on each channel iFirst, iFirst + iStep, ... in turn, waits
+     * iSettleMicros for the RSSI to settle and takes iSamples RSSI readings in one transaction. Each
+     * entry of aRssiDbm is raised to the highest reading, so several sweeps over the same array hold
+     * the peaks of bursty interferers; fill it with CC2500_RSSI_NONE before the first one.
+     *
+     * Every channel is calibrated on the way into RX (FS_AUTOCAL is set to "from IDLE" for the
+     * sweep), about 800 us per channel. Over a hop set, scanHopSet() is faster. Leaves the radio in
+     * IDLE on the channel it was on.
+     *
+     * \param[in] iFirst First CHANNR.
+     * \param[in] iStep CHANNR increment.
+     * \param[in] iCount Number of channels.
+     * \param[in,out] aRssiDbm iCount entries, dBm.
+     * \param[in] iSamples Readings per channel, 1 to RSSI_SAMPLES_MAX.
+     * \param[in] iSettleMicros Wait after RX is reached. The RSSI averages over AGCCTRL0.FILTER_LENGTH
+     *            channel filter samples; narrow filters and long averaging need more than the default.
+     * \return false if the radio didn't reach RX on a channel. Its entry is left as it was.
+     */
+    bool scanChannels(unsigned char iFirst, unsigned char iStep, unsigned char iCount, signed char* aRssiDbm,
+                      unsigned char iSamples = 4, unsigned int iSettleMicros = 100);
+
+    /*!
+     * As scanChannels(), over the hop set of beginHopping(). The cached calibrations are used, so a
+     * channel costs about 90 us plus the settle time. Leaves the radio in IDLE on the current hop channel.
+     */
+    bool scanHopSet(signed char* aRssiDbm, unsigned char iSamples = 4, unsigned int iSettleMicros = 100);
+
+	static const unsigned char RSSI_SAMPLES_MAX = 8;
+
+    /*!
+     * Converts a raw RSSI (register or appended status byte) to dBm with the offset of setRssiOffset().
+     */
+    signed char rssiDbm(signed char iRaw) const
+    {
+        int dbm = iRaw / 2 - m_iRssiOffset;
+        return (dbm < -128) ? -128 : (signed char)dbm;
+    }
+
+    /*!
+     * RSSI offset of the data rate in use, CC2500_RSSI_OFFSET by default. See "RSSI" in [1].
+     */
+    void setRssiOffset(unsigned char iOffset) { m_iRssiOffset = iOffset; }
+
+    /*!
+     * Current RSSI in dBm. Valid in RX once it has settled; frozen from the sync word to the end of a packet.
+     */
+    signed char readRssiDbm() { return rssiDbm((signed char)readStatusRegister(CC2500_REG_RSSI)); }
+
+    /*!
+     * LQI of the last packet, without the CRC_OK bit.
+     */
+    unsigned char readLqi() { return readStatusRegister(CC2500_REG_LQI) & ~CC2500_LQI_CRC_OK; }
+
+protected:
+    /*!
+     * Constructor for run-time configured devices.
+     *
+     * \param[in] pinCS_n Pin number of slave select.
+     * \param[in] iSPIClockDiv SPI clock divider.
+     */
+	CC2500xcvrT(unsigned char pinCS_n, SPIExternalDevice::SPIClockDiv iSPIClockDiv);
+
+	using Device::spiTransactionEnd;
+	using Device::spiTransfer;
+	using Device::spiWriteBlock;
+	using Device::spiReadBlock;
+	using Device::spiTransferBlock;
+	using Device::spiFlush;
+	using Device::csAssert;
+	using Device::csDeassert;
+
+	unsigned char sendHeader(unsigned char header);		// header byte of an access, captures the chip status byte
+	void writeBurstFromFlash(unsigned char address, const unsigned char* pData, unsigned char length);	// a PROGMEM table in one burst
+	void captureStatus(unsigned char header, unsigned char status);	// status byte of a header sent as part of a block
+	unsigned char beginRxFifoRead(unsigned short remaining, unsigned char drain);
+	unsigned char beginTxFifoWrite(unsigned char remaining, unsigned char refill);
+
+	volatile unsigned char	m_iChipStatus;		// chip status byte from the last access
+	volatile bool			m_bStatusRxFifo;	// the last access was a read, FIFO_BYTES_AVAILABLE counts the RX FIFO
+
+	unsigned char	m_iFifoThr;			// FIFOTHR.FIFO_THR as configured.  TX threshold is 61 - 4*n bytes, RX threshold is 4*(n+1) bytes.
+	bool			m_bAppendStatus;	// PKTCTRL1.APPEND_STATUS as configured
+
+	// interrupt-driven receive
+	void startInterruptReceive(SPSCRing<unsigned char>& ring, PacketPoolBase* pPool, unsigned char iIntPacketEnd,
+	                           unsigned char iIntFifoThreshold, bool bInvertGdo);
+	static void rxInterruptTrampoline();
+	static void rxRequestService(void* pContext);
+	static CC2500xcvrT*		s_pRxInstance;		// radio that owns the GDO interrupts
+
+	SPSCRing<unsigned char>*	m_pRxRing;
+	unsigned char			m_iIntPacketEnd;
+	unsigned char			m_iIntFifoThreshold;
+	unsigned short			m_iRxRemaining;		// bytes of the current packet (payload and status) still in the radio, 0 between packets
+	bool					m_bRxDiscard;		// current packet doesn't fit in the ring and is being dropped
+	volatile bool			m_bRxPending;		// a drain was deferred because the bus was busy
+	SPIExternalDevice::BusRequest	m_rxRequest;	// posts the deferred drain to the bus arbiter
+	volatile unsigned int	m_iRxRingOverruns;
+	volatile unsigned int	m_iRxFifoOverflows;
+	PacketPoolBase*			m_pRxPool;			// pool receive: m_pRxRing holds handles
+	PacketPoolBase::Handle	m_iRxHandle;		// buffer of the packet coming in
+	unsigned char			m_iRxOffset;		// where its next byte goes
+
+	// streaming transmit
+	void startInterruptTransmit(SPSCRing<unsigned char>& ring, PacketPoolBase* pPool, unsigned char iIntPacketEnd,
+	                            unsigned char iIntFifoThreshold, bool bInvertGdo);
+	unsigned char txLoadFromRing(unsigned char space);
+	unsigned char txLoadFromPool(unsigned char space);
+	static void txPacketEndTrampoline();
+	static void txThresholdTrampoline();
+	static void txRequestService(void* pContext);
+	void txStreamEnd();
+	static CC2500xcvrT*		s_pTxInstance;		// radio that owns the GDO interrupts
+	static const unsigned char TX_IN_FLIGHT = 16;	// packets in the FIFO at most.  Power of two.
+
+	SPSCRing<unsigned char>*	m_pTxRing;
+	PacketPoolBase*			m_pTxPool;			// pool transmit: m_pTxRing holds handles
+	unsigned char			m_iIntTxPacketEnd;
+	unsigned char			m_iIntTxFifoThreshold;
+	unsigned char			m_iTxSavedMcsm1;
+	unsigned char			m_iTxRecordLeft;	// bytes of the packet being loaded still in the ring, 0 between packets
+	unsigned char			m_aTxInFlight[TX_IN_FLIGHT];	// lengths of the packets in the FIFO, oldest first
+	unsigned char			m_iTxInFlightTail;
+	unsigned char			m_iTxInFlight;
+	volatile unsigned char	m_iTxPacketEnds;	// GDO0 edges not accounted for yet
+	volatile bool			m_bTxActive;		// a stream is on the air
+	volatile bool			m_bTxPending;		// a refill was deferred because the bus was busy
+	SPIExternalDevice::BusRequest	m_txRequest;
+	unsigned long			m_iTxBitRate;		// configured data rate, bit/s
+	unsigned long			m_iTxStreamStart;	// micros() at the STX of the current stream
+	CC2500TxStats			m_txStats;
+
+	// Wake-on-Radio
+	static void worInterruptTrampoline();
+	static CC2500xcvrT*		s_pWorInstance;		// radio that owns the WOR interrupt
+
+	unsigned char			m_iIntWor;
+	volatile bool			m_bWorWake;
+	unsigned char			m_iWorSavedMcsm1;
+	unsigned char			m_iWorSavedMcsm2;
+
+	// frequency hopping
+	bool calibrateHopChannel(unsigned char iIndex);
+
+	CC2500HopChannel*		m_pHopSet;
+	unsigned char			m_iHopCount;
+	unsigned char			m_iHopIndex;
+	unsigned char			m_iHopRecalNext;	// next channel of the recalibration round, m_iHopCount when the round is done
+	unsigned char			m_iHopSavedMcsm0;
+	unsigned long			m_iHopRoundStart;	// millis() when the last recalibration round started
+
+	// channel scan
+	bool sampleRssi(unsigned char iSamples, unsigned int iSettleMicros, signed char& iDbm);
+
+	unsigned char			m_iRssiOffset;
+
+	// resumable operations
+	enum Operation
+	{
+		OP_NONE = 0,
+		OP_RESET_HOLD,		// CS_n high for the reset pattern, then SRES
+		OP_RESET_READY,		// SRES sent, waiting for CHIP_RDYn
+		OP_STATE,			// strobe sent, waiting for m_iOpState
+		OP_HOP_CAL			// SCAL on m_iOpIndex, then read FSCAL3..1 and hop back
+	};
+
+	void startOperation(unsigned char iOp, unsigned long iTimeoutMicros);
+	SPIExternalDevice::PollStatus endOperation(SPIExternalDevice::PollStatus status) { m_iOp = OP_NONE; return status; }
+	bool chipReadyNow();	// CS_n asserted, MISO sampled, CS_n released: no waiting
+
+	unsigned char			m_iOp;
+	unsigned char			m_iOpState;		// OP_STATE: CC2500_STATE_xxx to wait for
+	unsigned char			m_iOpIndex;		// OP_HOP_CAL: hop channel
+	unsigned long			m_iOpStart;		// micros() when the operation started
+	unsigned long			m_iOpTimeout;
+	unsigned int			m_iReadyTimeouts;
+};
+
+
+/*! \brief CC2500 driver on a run-time configured SPIExternalDevice.
+ */
+class CC2500xcvr : public CC2500xcvrT<SPIExternalDevice>
+{
+public:
+    /*!
+     * Constructor.
+     *
+     * \param[in] pinCS_n Pin number of slave select.
+     * \param[in] iSPIClockDiv SPI clock divider.
+     */
+	CC2500xcvr(
+		unsigned char pinCS_n, 
+		SPIExternalDevice::SPIClockDiv iSPIClockDiv = SPIExternalDevice::DIV4);
+};
+
+
+template<class Device>
+const unsigned short CC2500xcvrT<Device>::FIFO_SIZE;
+
+template<class Device>
+const unsigned char CC2500xcvrT<Device>::NO_INTERRUPT;
+
+template<class Device>
+CC2500xcvrT<Device>* CC2500xcvrT<Device>::s_pRxInstance = 0;
+
+template<class Device>
+CC2500xcvrT<Device>* CC2500xcvrT<Device>::s_pWorInstance = 0;
+
+template<class Device>
+CC2500xcvrT<Device>* CC2500xcvrT<Device>::s_pTxInstance = 0;
+
+template<class Device>
+const unsigned char CC2500xcvrT<Device>::TX_IN_FLIGHT;
+
+template<class Device>
+const unsigned char CC2500xcvrT<Device>::RSSI_SAMPLES_MAX;
+
+template<class Device>
+const unsigned int CC2500xcvrT<Device>::READY_SPINS_MAX;
+
+template<class Device>
+CC2500xcvrT<Device>::CC2500xcvrT()
+	: Device()
+	, m_iChipStatus(CC2500_STATUS_CHIP_RDYn)
+	, m_bStatusRxFifo(false)
+	, m_iFifoThr(0x07)			// reset values
+	, m_bAppendStatus(true)
+	, m_pRxRing(0)
+	, m_iIntPacketEnd(NO_INTERRUPT)
+	, m_iIntFifoThreshold(NO_INTERRUPT)
+	, m_iRxRemaining(0)
+	, m_bRxDiscard(false)
+	, m_bRxPending(false)
+	, m_iRxRingOverruns(0)
+	, m_iRxFifoOverflows(0)
+	, m_pRxPool(0)
+	, m_iRxHandle(PacketPoolBase::NONE)
+	, m_iRxOffset(0)
+	, m_pTxRing(0)
+	, m_pTxPool(0)
+	, m_iIntTxPacketEnd(NO_INTERRUPT)
+	, m_iIntTxFifoThreshold(NO_INTERRUPT)
+	, m_iTxSavedMcsm1(0x30)		// reset value
+	, m_iTxRecordLeft(0)
+	, m_aTxInFlight()
+	, m_iTxInFlightTail(0)
+	, m_iTxInFlight(0)
+	, m_iTxPacketEnds(0)
+	, m_bTxActive(false)
+	, m_bTxPending(false)
+	, m_iTxBitRate(0)
+	, m_iTxStreamStart(0)
+	, m_txStats()
+	, m_iIntWor(NO_INTERRUPT)
+	, m_bWorWake(false)
+	, m_iWorSavedMcsm1(0x30)	// reset values
+	, m_iWorSavedMcsm2(0x07)
+	, m_pHopSet(0)
+	, m_iHopCount(0)
+	, m_iHopIndex(0)
+	, m_iHopRecalNext(0)
+	, m_iHopSavedMcsm0(0x04)
+	, m_iHopRoundStart(0)
+	, m_iRssiOffset(CC2500_RSSI_OFFSET)
+	, m_iOp(OP_NONE)
+	, m_iOpState(0)
+	, m_iOpIndex(0)
+	, m_iOpStart(0)
+	, m_iOpTimeout(0)
+	, m_iReadyTimeouts(0)
+{
+}
+
+template<class Device>
+CC2500xcvrT<Device>::CC2500xcvrT(unsigned char pinCS_n, SPIExternalDevice::SPIClockDiv iSPIClockDiv)
+	: Device(
+		pinCS_n, 
+		SPIExternalDevice::MODE0,		// sclk low when idle (CPOL=0), sample on rising edge of sclk (CPHA=0).  This is  SPI Mode 0.
+		iSPIClockDiv)
+	, m_iChipStatus(CC2500_STATUS_CHIP_RDYn)
+	, m_bStatusRxFifo(false)
+	, m_iFifoThr(0x07)			// reset values
+	, m_bAppendStatus(true)
+	, m_pRxRing(0)
+	, m_iIntPacketEnd(NO_INTERRUPT)
+	, m_iIntFifoThreshold(NO_INTERRUPT)
+	, m_iRxRemaining(0)
+	, m_bRxDiscard(false)
+	, m_bRxPending(false)
+	, m_iRxRingOverruns(0)
+	, m_iRxFifoOverflows(0)
+	, m_pRxPool(0)
+	, m_iRxHandle(PacketPoolBase::NONE)
+	, m_iRxOffset(0)
+	, m_pTxRing(0)
+	, m_pTxPool(0)
+	, m_iIntTxPacketEnd(NO_INTERRUPT)
+	, m_iIntTxFifoThreshold(NO_INTERRUPT)
+	, m_iTxSavedMcsm1(0x30)		// reset value
+	, m_iTxRecordLeft(0)
+	, m_aTxInFlight()
+	, m_iTxInFlightTail(0)
+	, m_iTxInFlight(0)
+	, m_iTxPacketEnds(0)
+	, m_bTxActive(false)
+	, m_bTxPending(false)
+	, m_iTxBitRate(0)
+	, m_iTxStreamStart(0)
+	, m_txStats()
+	, m_iIntWor(NO_INTERRUPT)
+	, m_bWorWake(false)
+	, m_iWorSavedMcsm1(0x30)	// reset values
+	, m_iWorSavedMcsm2(0x07)
+	, m_pHopSet(0)
+	, m_iHopCount(0)
+	, m_iHopIndex(0)
+	, m_iHopRecalNext(0)
+	, m_iHopSavedMcsm0(0x04)
+	, m_iHopRoundStart(0)
+	, m_iRssiOffset(CC2500_RSSI_OFFSET)
+	, m_iOp(OP_NONE)
+	, m_iOpState(0)
+	, m_iOpIndex(0)
+	, m_iOpStart(0)
+	, m_iOpTimeout(0)
+	, m_iReadyTimeouts(0)
+{
+}
+
+template<class Device>
+CC2500xcvrT<Device>::~CC2500xcvrT()
+{
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::reset()
+// REFERENCES:	19.1.2 "Manual Reset" in [1]
+{
+    // enable device
+    csAssert();
+    delayMicroseconds(1);
+
+    // disable device and wait at least 40 microseconds
+    csDeassert();
+    delayMicroseconds(41);
+    
+	spiTransactionBegin();	// enable device
+    spiTransfer(0x30);	// send reset command (SRES)
+    spiTransactionEnd(); 	// disable device
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::spiTransactionBegin()
+{
+	Device::spiTransactionBegin();
+	unsigned int iSpins = 0;
+	while ( Device::spiMisoHigh() )	// wait for device
+	{
+		if (++iSpins == READY_SPINS_MAX)
+		{
+			++m_iReadyTimeouts;
+			break;
+		}
+	}
+	Device::statsReadySpins(iSpins);
+}
+
+template<class Device>
+unsigned char CC2500xcvrT<Device>::sendByte(unsigned char data)
+{
+    spiTransactionBegin();	// enable device
+    unsigned char result = sendHeader(data);	// send byte
+    spiTransactionEnd(); 	// disable device
+    return result;
+}
+
+template<class Device>
+unsigned char CC2500xcvrT<Device>::sendCommand(unsigned char command, unsigned char data)
+{
+	unsigned char aBytes[2] = { command, data };
+
+	spiTransactionBegin();	// enable device
+    spiTransferBlock(aBytes, aBytes, 2);	// send command byte and data byte
+    spiTransactionEnd(); 	// disable device
+    captureStatus(command, aBytes[0]);
+    return aBytes[1];		// return result
+}
+
+template<class Device>
+unsigned char CC2500xcvrT<Device>::sendStrobeCommand(unsigned char command)
+{
+    return sendByte(command);	// send command
+}
+
+template<class Device>
+unsigned char CC2500xcvrT<Device>::sendBurstCommand(unsigned char command, unsigned char* data, unsigned char length)
+{
+    unsigned char status = command;
+
+    spiTransactionBegin();	// enable device
+
+    // send command byte
+    spiTransferBlock(&status, &status, 1);	// this is a burst command
+
+    // send/recv data bytes, received into the same buffer
+    spiTransferBlock(data, data, length);
+
+    spiTransactionEnd(); 	// disable device
+    captureStatus(command, status);
+    return (length) ? data[length - 1] : 0;	// return result
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::sendBurstCommand(unsigned char command, const unsigned char* txData, unsigned char* rxData, unsigned char length)
+{
+    unsigned char status = command;
+
+    spiTransactionBegin();	// enable device
+    spiTransferBlock(&status, &status, 1);
+    spiTransferBlock(txData, rxData, length);
+    spiTransactionEnd(); 	// disable device
+    captureStatus(command, status);
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::writeBurst(unsigned char address, const unsigned char* data, unsigned char length)
+{
+    unsigned char header = address | CC2500_OFF_WRITE_BURST;
+    unsigned char status = header;
+
+    spiTransactionBegin();	// enable device
+    spiTransferBlock(&status, &status, 1);	// header and data go out as one spidev message
+    spiWriteBlock(data, length);
+    spiTransactionEnd(); 	// disable device
+    captureStatus(header, status);
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::readBurst(unsigned char address, unsigned char* data, unsigned char length)
+{
+    unsigned char header = address | CC2500_OFF_READ_BURST;
+    unsigned char status = header;
+
+    spiTransactionBegin();	// enable device
+    spiTransferBlock(&status, &status, 1);
+    spiReadBlock(data, length, 0x00);
+    spiTransactionEnd(); 	// disable device
+    captureStatus(header, status);
+}
+
+template<class Device>
+bool CC2500xcvrT<Device>::configure(const CC2500Profile& profile, bool bVerify)
+// REFERENCES:	burst access, chapter 10 in [1]
+{
+    sendStrobeCommand(CC2500_CMD_SIDLE);	// most registers may only be written in IDLE
+
+    writeConfiguration(profile.pRegisters);
+    m_iFifoThr = pgm_read_byte(profile.pRegisters + CC2500_REG_FIFOTHR) & CC2500_FIFOTHR_MASK;
+    m_bAppendStatus = (pgm_read_byte(profile.pRegisters + CC2500_REG_PKTCTRL1) & CC2500_PKTCTRL1_APPEND_STATUS) != 0;
+
+    if (profile.pPATable)
+        writePATable(profile.pPATable, profile.iPATableLength);
+
+    return (bVerify) ? verifyConfiguration(profile.pRegisters) : true;
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::writeConfiguration(const unsigned char* pRegisters)
+{
+    writeBurstFromFlash(CC2500_REG_IOCFG2, pRegisters, CC2500_CONFIG_SIZE);
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::writePATable(const unsigned char* pPATable, unsigned char length)
+{
+    if (length > CC2500_PATABLE_SIZE)
+        length = CC2500_PATABLE_SIZE;
+    writeBurstFromFlash(CC2500_REG_PATABLE, pPATable, length);
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::writeBurstFromFlash(unsigned char address, const unsigned char* pData, unsigned char length)
+// The table is in flash, so it is copied to RAM a chunk at a time, and every chunk is one block transfer.
+{
+    unsigned char header = address | CC2500_OFF_WRITE_BURST;
+    unsigned char status = header;
+    unsigned char aChunk[CC2500_FLASH_CHUNK];
+
+    spiTransactionBegin();	// enable device
+    spiTransferBlock(&status, &status, 1);
+    for (unsigned char i = 0; i < length; i += sizeof(aChunk))
+    {
+        unsigned char n = length - i;
+        if (n > sizeof(aChunk))
+            n = sizeof(aChunk);
+        for (unsigned char k = 0; k < n; ++k)
+            aChunk[k] = pgm_read_byte(pData + i + k);
+        spiWriteBlock(aChunk, n);
+        spiFlush();		// aChunk is refilled next: the spidev backend has to send it first
+    }
+    spiTransactionEnd(); 	// disable device
+    captureStatus(header, status);
+}
+
+template<class Device>
+bool CC2500xcvrT<Device>::verifyConfiguration(const unsigned char* pRegisters)
+{
+    unsigned char header = CC2500_REG_IOCFG2 | CC2500_OFF_READ_BURST;
+    unsigned char status = header;
+    unsigned char aChunk[CC2500_FLASH_CHUNK];
+    bool bMatch = true;
+
+    spiTransactionBegin();	// enable device
+    spiTransferBlock(&status, &status, 1);
+    for (unsigned char i = 0; i < CC2500_CONFIG_SIZE; i += sizeof(aChunk))
+    {
+        unsigned char n = CC2500_CONFIG_SIZE - i;
+        if (n > sizeof(aChunk))
+            n = sizeof(aChunk);
+        spiReadBlock(aChunk, n, 0x00);
+        spiFlush();		// the spidev backend fills aChunk here
+        for (unsigned char k = 0; k < n; ++k)
+        {
+            if (aChunk[k] != pgm_read_byte(pRegisters + i + k))
+                bMatch = false;		// keep reading, the burst has to run to the end anyway
+        }
+    }
+    spiTransactionEnd(); 	// disable device
+    captureStatus(header, status);
+
+    return bMatch;
+}
+
+template<class Device>
+unsigned char CC2500xcvrT<Device>::readStatusRegister(unsigned char address)
+// REFERENCES:	SPI read synchronization issue, errata
+{
+    unsigned char header = address | CC2500_OFF_READ_BURST;
+    unsigned char aBytes[2] = { header, 0x00 };
+
+    spiTransactionBegin();	// enable device
+    spiTransferBlock(aBytes, aBytes, 2);
+    spiFlush();
+    captureStatus(header, aBytes[0]);
+    unsigned char value = aBytes[1];
+    unsigned char previous;
+    do
+    {
+        previous = value;
+        aBytes[0] = header;		// repeat the read in the same transaction
+        aBytes[1] = 0x00;
+        spiTransferBlock(aBytes, aBytes, 2);
+        spiFlush();
+        value = aBytes[1];
+    } while (value != previous);
+    spiTransactionEnd(); 	// disable device
+
+    return value;
+}
+
+template<class Device>
+unsigned char CC2500xcvrT<Device>::updateStatus(bool bRxFifo)
+{
+    return sendByte(CC2500_CMD_SNOP | ((bRxFifo) ? CC2500_OFF_READ_SINGLE : CC2500_OFF_WRITE_SINGLE));
+}
+
+template<class Device>
+unsigned char CC2500xcvrT<Device>::sendHeader(unsigned char header)
+{
+    unsigned char status = spiTransfer(header);
+    captureStatus(header, status);
+    return status;
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::captureStatus(unsigned char header, unsigned char status)
+{
+    m_iChipStatus = status;
+    m_bStatusRxFifo = (header & CC2500_OFF_READ_SINGLE) != 0;
+}
+
+template<class Device>
+unsigned char CC2500xcvrT<Device>::beginRxFifoRead(unsigned short remaining, unsigned char drain)
+// PURPOSE:		Opens an RX FIFO burst and works out from the chip status byte how many bytes may be read right now.
+//				Leaves the transaction open: the caller clocks the bytes out and calls spiTransactionEnd().
+// REFERENCES:	errata: the RX FIFO must not be emptied while the packet is still coming in
+{
+    spiTransactionBegin();	// enable device
+    sendHeader(CC2500_REG_RXFIFO | CC2500_OFF_READ_BURST);
+    if (statusState() == CC2500_STATE_RXFIFO_OVERFLOW)
+        return 0;
+
+    unsigned char available = statusFifoBytes();	// 15 means "15 or more"
+    if (available >= remaining)
+        return remaining;		// the rest of the packet is in, the FIFO may be emptied
+    if (available > 1 && (available >= drain || available == CC2500_STATUS_FIFO))
+        return available - 1;	// the packet is still coming in, leave one byte in the FIFO
+    return 0;
+}
+
+template<class Device>
+unsigned char CC2500xcvrT<Device>::beginTxFifoWrite(unsigned char remaining, unsigned char refill)
+// PURPOSE:		Opens a TX FIFO burst and works out from the chip status byte how many bytes to write right now.
+//				Leaves the transaction open: the caller clocks the bytes in and calls spiTransactionEnd().
+{
+    spiTransactionBegin();	// enable device
+    sendHeader(CC2500_REG_TXFIFO | CC2500_OFF_WRITE_BURST);
+    if (statusState() == CC2500_STATE_TXFIFO_UNDERFLOW)
+        return 0;
+
+    unsigned char space = statusFifoBytes();	// 15 means "15 or more"
+    if (space >= remaining)
+        return remaining;
+    if (space >= refill || space == CC2500_STATUS_FIFO)
+        return space;
+    return 0;
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::writeTxFifo(const unsigned char* data, unsigned char length)
+{
+    writeBurst(CC2500_REG_TXFIFO, data, length);
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::readRxFifo(unsigned char* data, unsigned char length)
+{
+    readBurst(CC2500_REG_RXFIFO, data, length);
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::flushRx()
+{
+    sendStrobeCommand(CC2500_CMD_SIDLE);	// SFRX is only allowed in IDLE or RXFIFO_OVERFLOW
+    sendStrobeCommand(CC2500_CMD_SFRX);
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::flushTx()
+{
+    sendStrobeCommand(CC2500_CMD_SIDLE);	// SFTX is only allowed in IDLE or TXFIFO_UNDERFLOW
+    sendStrobeCommand(CC2500_CMD_SFTX);
+}
+
+template<class Device>
+typename CC2500xcvrT<Device>::PacketResult CC2500xcvrT<Device>::sendPacket(const unsigned char* data, unsigned char length, unsigned int timeoutMs)
+{
+    flushTx();
+
+    // length byte and as much of the payload as fits, in one burst
+    unsigned char sent = (length < FIFO_SIZE - 1) ? length : (FIFO_SIZE - 1);
+    unsigned char aHeader[2] = { CC2500_REG_TXFIFO | CC2500_OFF_WRITE_BURST, length };
+    spiTransactionBegin();	// enable device
+    spiTransferBlock(aHeader, aHeader, 2);
+    spiWriteBlock(data, sent);
+    spiTransactionEnd(); 	// disable device
+    captureStatus(CC2500_REG_TXFIFO | CC2500_OFF_WRITE_BURST, aHeader[0]);
+
+    sendStrobeCommand(CC2500_CMD_STX);
+
+    // Stream the rest of the payload.  The status byte of each burst header says how much room there is,
+    // and a burst is only filled once the FIFO has drained to the threshold, so there are no TXBYTES reads.
+    const unsigned char refill = FIFO_SIZE - (61 - 4*m_iFifoThr);	// free bytes at the TX threshold
+    unsigned long start = millis();
+    while (sent < length)
+    {
+        unsigned char n = beginTxFifoWrite(length - sent, refill);
+        spiWriteBlock(data + sent, n);
+        spiTransactionEnd(); 	// disable device
+        sent += n;
+
+        if (statusState() == CC2500_STATE_TXFIFO_UNDERFLOW)
+        {
+            flushTx();
+            return PACKET_UNDERFLOW;
+        }
+        if (n == 0 && millis() - start > timeoutMs)
+        {
+            flushTx();
+            return PACKET_TIMEOUT;
+        }
+    }
+
+    // wait until the packet has left the air.  SNOP is a one-byte status poll.
+    for (;;)
+    {
+        updateStatus(false);
+        if (statusState() == CC2500_STATE_TXFIFO_UNDERFLOW)
+        {
+            flushTx();
+            return PACKET_UNDERFLOW;
+        }
+        unsigned char state = statusState();
+        if (state != CC2500_STATE_TX && state != CC2500_STATE_CALIBRATE && state != CC2500_STATE_SETTLING)
+            return PACKET_OK;	// on its way to TX it calibrates and settles first
+        if (millis() - start > timeoutMs)
+        {
+            flushTx();
+            return PACKET_TIMEOUT;
+        }
+    }
+}
+
+template<class Device>
+typename CC2500xcvrT<Device>::PacketResult CC2500xcvrT<Device>::receivePacket(unsigned char* data, unsigned char maxLength, unsigned char& length,
+                                                                               CC2500RxStatus* pStatus, unsigned int timeoutMs)
+{
+    updateStatus(true);	// one-byte SNOP instead of an RXBYTES read
+    if (statusState() != CC2500_STATE_RXFIFO_OVERFLOW && statusFifoBytes() == 0)
+        return PACKET_NONE;
+
+    // The length byte may only be read when it isn't the last byte in the FIFO (errata).
+    // Any packet has at least one more byte (payload or appended status) behind it.
+    unsigned long start = millis();
+    while (statusFifoBytes() < 2)
+    {
+        if (statusState() == CC2500_STATE_RXFIFO_OVERFLOW)
+        {
+            flushRx();
+            return PACKET_OVERFLOW;
+        }
+        if (millis() - start > timeoutMs)
+        {
+            flushRx();
+            return PACKET_TIMEOUT;
+        }
+        updateStatus(true);
+    }
+
+    length = sendCommand(CC2500_REG_RXFIFO | CC2500_OFF_READ_SINGLE, 0x00);
+    if (length > maxLength)
+    {
+        flushRx();
+        return PACKET_TOO_LONG;
+    }
+
+    // drain payload and appended status, one burst every time the FIFO fills to the threshold
+    const unsigned char drain = 4*(m_iFifoThr + 1);		// bytes in the FIFO at the RX threshold
+    const unsigned short total = length + ((m_bAppendStatus) ? 2 : 0);
+    unsigned char aStatus[2];
+    unsigned short received = 0;
+    while (received < total)
+    {
+        unsigned char n = beginRxFifoRead(total - received, drain);
+        unsigned char payload = 0;		// bytes of n that belong to the payload, the rest is appended status
+        if (received < length)
+            payload = (n < length - received) ? n : (length - received);
+        spiReadBlock(data + received, payload, 0x00);
+        if (n > payload)
+            spiReadBlock(aStatus + (received + payload - length), n - payload, 0x00);
+        spiTransactionEnd(); 	// disable device
+        received += n;
+
+        if (statusState() == CC2500_STATE_RXFIFO_OVERFLOW)
+        {
+            flushRx();
+            return PACKET_OVERFLOW;
+        }
+        if (n == 0 && millis() - start > timeoutMs)
+        {
+            flushRx();
+            return PACKET_TIMEOUT;
+        }
+    }
+
+    if (!m_bAppendStatus)
+        return PACKET_OK;
+
+    if (pStatus)
+    {
+        pStatus->iRSSI = (signed char)aStatus[0];
+        pStatus->iLQI = aStatus[1] & ~CC2500_LQI_CRC_OK;
+        pStatus->bCRCOK = (aStatus[1] & CC2500_LQI_CRC_OK) != 0;
+    }
+    return (aStatus[1] & CC2500_LQI_CRC_OK) ? PACKET_OK : PACKET_CRC_ERROR;
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::beginInterruptReceive(SPSCRing<unsigned char>& ring, unsigned char iIntPacketEnd,
+                                                unsigned char iIntFifoThreshold, bool bInvertGdo)
+{
+    startInterruptReceive(ring, 0, iIntPacketEnd, iIntFifoThreshold, bInvertGdo);
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::beginInterruptReceive(PacketPoolBase& pool, SPSCRing<unsigned char>& handles, unsigned char iIntPacketEnd,
+                                                unsigned char iIntFifoThreshold, bool bInvertGdo)
+{
+    startInterruptReceive(handles, &pool, iIntPacketEnd, iIntFifoThreshold, bInvertGdo);
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::startInterruptReceive(SPSCRing<unsigned char>& ring, PacketPoolBase* pPool, unsigned char iIntPacketEnd,
+                                                unsigned char iIntFifoThreshold, bool bInvertGdo)
+{
+    const unsigned char inv = (bInvertGdo) ? CC2500_GDOx_INV : 0;
+
+    flushRx();
+    ring.rollback();
+    m_pRxRing = &ring;
+    m_pRxPool = pPool;
+    m_iRxHandle = PacketPoolBase::NONE;
+    m_iRxRemaining = 0;
+    m_bRxPending = false;
+    m_iIntPacketEnd = iIntPacketEnd;
+    m_iIntFifoThreshold = iIntFifoThreshold;
+    s_pRxInstance = this;
+
+    // GDO0: packet end is the de-asserting edge of "sync word".  GDO2: threshold is the asserting edge.
+    sendCommand(CC2500_REG_IOCFG0, CC2500_GDO_SYNC_WORD | inv);
+    ::attachInterrupt(iIntPacketEnd, rxInterruptTrampoline, (bInvertGdo) ? RISING : FALLING);
+    if (iIntFifoThreshold != NO_INTERRUPT)
+    {
+        sendCommand(CC2500_REG_IOCFG2, CC2500_GDO_RX_FIFO_THR | inv);
+        ::attachInterrupt(iIntFifoThreshold, rxInterruptTrampoline, (bInvertGdo) ? FALLING : RISING);
+    }
+
+    startReceive();
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::endInterruptReceive()
+{
+    if (m_iIntPacketEnd != NO_INTERRUPT)
+        ::detachInterrupt(m_iIntPacketEnd);
+    if (m_iIntFifoThreshold != NO_INTERRUPT)
+        ::detachInterrupt(m_iIntFifoThreshold);
+    m_iIntPacketEnd = m_iIntFifoThreshold = NO_INTERRUPT;
+    s_pRxInstance = 0;
+
+    if (m_pRxPool)
+    {
+        m_pRxPool->release(m_iRxHandle);
+        m_iRxHandle = PacketPoolBase::NONE;
+        PacketPoolBase::Handle handle;
+        while (m_pRxRing->pop(handle))
+            m_pRxPool->release(handle);
+        m_pRxPool = 0;
+    }
+    m_pRxRing = 0;
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::rxInterruptTrampoline()
+{
+    if (s_pRxInstance)
+        s_pRxInstance->rxInterruptHandler();
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::rxRequestService(void* pContext)
+{
+    CC2500xcvrT* pRadio = static_cast<CC2500xcvrT*>(pContext);
+    if (pRadio->m_bRxPending)
+        pRadio->rxInterruptHandler();
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::serviceReceive()
+{
+    if (!m_bRxPending)
+        return;
+
+    byte oldSREG = SREG;
+    cli();	// the GDO ISR must not run the drain at the same time
+    rxInterruptHandler();
+    SREG = oldSREG;
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::rxInterruptHandler()
+// PRECONDITIONS:	interrupts disabled (ISR context)
+{
+    if (!m_pRxRing)
+        return;
+
+    if (Device::spiBusBusy())
+    {
+        m_bRxPending = true;	// the main loop is in the middle of a transaction.  The drain runs at the next service point.
+        this->spiPostRequest(&m_rxRequest, rxRequestService, this);
+        return;
+    }
+    m_bRxPending = false;
+
+    updateStatus(true);	// one-byte SNOP instead of an RXBYTES read
+    for (;;)	// there may be more than one packet in the FIFO
+    {
+        if (statusState() == CC2500_STATE_RXFIFO_OVERFLOW)
+        {
+            ++m_iRxFifoOverflows;
+            if (m_pRxPool)
+            {
+                m_pRxPool->release(m_iRxHandle);
+                m_iRxHandle = PacketPoolBase::NONE;
+            }
+            else
+                m_pRxRing->rollback();
+            m_iRxRemaining = 0;
+            flushRx();
+            startReceive();
+            return;
+        }
+
+        if (m_iRxRemaining == 0)
+        {
+            if (statusFifoBytes() < 2)
+                return;		// the length byte may not be read while it's the last byte in the FIFO (errata)
+
+            unsigned char length = sendCommand(CC2500_REG_RXFIFO | CC2500_OFF_READ_SINGLE, 0x00);
+            m_iRxRemaining = length + ((m_bAppendStatus) ? 2 : 0);
+            if (m_pRxPool)
+            {
+                if (1 + m_iRxRemaining <= m_pRxPool->size() && m_pRxRing->space() != 0)	// the handle must fit too
+                    m_iRxHandle = m_pRxPool->allocate();
+                m_bRxDiscard = (m_iRxHandle == PacketPoolBase::NONE);
+                if (!m_bRxDiscard)
+                    m_pRxPool->setLength(m_iRxHandle, length);
+                m_iRxOffset = 1;
+            }
+            else
+            {
+                m_bRxDiscard = (m_pRxRing->space() < 1 + m_iRxRemaining);	// the whole record must fit
+                if (!m_bRxDiscard)
+                    m_pRxRing->pushUncommitted(length);
+            }
+            if (m_bRxDiscard)
+                ++m_iRxRingOverruns;
+        }
+
+        // With a pool, straight into the packet's buffer.  Into the chunk to go into the ring, or to be dropped.
+        unsigned char aChunk[FIFO_SIZE];
+        bool bDirect = m_pRxPool && !m_bRxDiscard;
+        unsigned char* pData = (bDirect) ? m_pRxPool->buffer(m_iRxHandle) + m_iRxOffset : aChunk;
+        unsigned char n = beginRxFifoRead(m_iRxRemaining, 2);	// in the ISR, anything that may be read is read
+        spiReadBlock(pData, n, 0x00);
+        spiTransactionEnd(); 	// disable device
+        if (bDirect)
+            m_iRxOffset += n;
+        else if (!m_bRxDiscard)
+        {
+            for (unsigned char i = 0; i < n; ++i)
+                m_pRxRing->pushUncommitted(aChunk[i]);
+        }
+
+        if (n == 0)
+        {
+            if (statusState() == CC2500_STATE_RXFIFO_OVERFLOW)
+                continue;
+            return;					// wait for the next interrupt
+        }
+
+        m_iRxRemaining -= n;
+        if (m_iRxRemaining != 0)
+        {
+            if (statusFifoBytes() == CC2500_STATUS_FIFO)
+                continue;			// there may be more than the status byte could tell
+            return;					// the rest of the packet comes with the next interrupt
+        }
+
+        if (m_pRxPool)
+        {
+            if (!m_bRxDiscard)
+                m_pRxRing->push(m_iRxHandle);	// ownership goes to the main loop
+            m_iRxHandle = PacketPoolBase::NONE;
+        }
+        else if (!m_bRxDiscard)
+            m_pRxRing->commit();	// publish the whole packet at once
+        updateStatus(true);
+    }
+}
+
+template<class Device>
+typename CC2500xcvrT<Device>::PacketResult CC2500xcvrT<Device>::readPacket(unsigned char* data, unsigned char maxLength, unsigned char& length,
+                                                                            CC2500RxStatus* pStatus)
+{
+    if (m_pRxPool)
+    {
+        PacketPoolBase::Handle handle;
+        PacketResult result = takePacket(handle, pStatus);
+        if (result == PACKET_NONE)
+            return result;
+        length = m_pRxPool->length(handle);
+        if (length > maxLength)
+            result = PACKET_TOO_LONG;
+        else
+            memcpy(data, m_pRxPool->payload(handle), length);
+        m_pRxPool->release(handle);
+        return result;
+    }
+
+    if (!m_pRxRing || m_pRxRing->available() == 0)
+        return PACKET_NONE;
+
+    length = m_pRxRing->peek(0);
+    const unsigned char statusLength = (m_bAppendStatus) ? 2 : 0;
+    if (length > maxLength)
+    {
+        m_pRxRing->skip(1 + length + statusLength);
+        return PACKET_TOO_LONG;
+    }
+
+    m_pRxRing->skip(1);
+    m_pRxRing->pop(data, length);
+    if (!statusLength)
+        return PACKET_OK;
+
+    unsigned char aStatus[2];
+    m_pRxRing->pop(aStatus, 2);
+    if (pStatus)
+    {
+        pStatus->iRSSI = (signed char)aStatus[0];
+        pStatus->iLQI = aStatus[1] & ~CC2500_LQI_CRC_OK;
+        pStatus->bCRCOK = (aStatus[1] & CC2500_LQI_CRC_OK) != 0;
+    }
+    return (aStatus[1] & CC2500_LQI_CRC_OK) ? PACKET_OK : PACKET_CRC_ERROR;
+}
+
+template<class Device>
+typename CC2500xcvrT<Device>::PacketResult CC2500xcvrT<Device>::takePacket(PacketPoolBase::Handle& handle, CC2500RxStatus* pStatus)
+{
+    handle = PacketPoolBase::NONE;
+    if (!m_pRxPool || !m_pRxRing->pop(handle))
+        return PACKET_NONE;
+    if (!m_bAppendStatus)
+        return PACKET_OK;
+
+    const unsigned char* aStatus = m_pRxPool->payload(handle) + m_pRxPool->length(handle);
+    if (pStatus)
+    {
+        pStatus->iRSSI = (signed char)aStatus[0];
+        pStatus->iLQI = aStatus[1] & ~CC2500_LQI_CRC_OK;
+        pStatus->bCRCOK = (aStatus[1] & CC2500_LQI_CRC_OK) != 0;
+    }
+    return (aStatus[1] & CC2500_LQI_CRC_OK) ? PACKET_OK : PACKET_CRC_ERROR;
+}
+
+template<class Device>
+unsigned int CC2500xcvrT<Device>::rxRingOverruns()
+{
+    byte oldSREG = SREG;
+    cli();	// 16-bit counter written by the ISR
+    unsigned int count = m_iRxRingOverruns;
+    SREG = oldSREG;
+    return count;
+}
+
+template<class Device>
+unsigned int CC2500xcvrT<Device>::rxFifoOverflows()
+{
+    byte oldSREG = SREG;
+    cli();
+    unsigned int count = m_iRxFifoOverflows;
+    SREG = oldSREG;
+    return count;
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::beginWakeOnRadio(const CC2500WorTiming& timing, unsigned char iIntPacket, bool bInvertGdo, bool bCarrierSense)
+// REFERENCES:	19.5 "Wake On Radio (WOR)" in [1]
+{
+    const unsigned char inv = (bInvertGdo) ? CC2500_GDOx_INV : 0;
+
+    sendStrobeCommand(CC2500_CMD_SIDLE);
+    if (m_iIntWor == NO_INTERRUPT)
+    {
+        m_iWorSavedMcsm1 = sendCommand(CC2500_REG_MCSM1 | CC2500_OFF_READ_SINGLE, 0x00);
+        m_iWorSavedMcsm2 = sendCommand(CC2500_REG_MCSM2 | CC2500_OFF_READ_SINGLE, 0x00);
+    }
+    else
+        ::detachInterrupt(m_iIntWor);
+
+    // WOREVT1, WOREVT0, WORCTRL are consecutive.  RC oscillator on, longest crystal start-up (EVENT1 = 7).
+    unsigned char aWor[3] = { (unsigned char)(timing.iEvent0 >> 8), (unsigned char)timing.iEvent0,
+                              (unsigned char)(CC2500_WORCTRL_EVENT1 | CC2500_WORCTRL_RC_CAL | (timing.iWorRes & CC2500_WORCTRL_WOR_RES)) };
+    writeBurst(CC2500_REG_WOREVT1, aWor, sizeof(aWor));
+    sendCommand(CC2500_REG_MCSM2, ((bCarrierSense) ? CC2500_MCSM2_RX_TIME_RSSI : 0) | (timing.iRxTime & CC2500_MCSM2_RX_TIME));
+    sendCommand(CC2500_REG_MCSM1, m_iWorSavedMcsm1 & ~CC2500_MCSM1_RXOFF_MODE);	// IDLE after a packet, with the packet in the FIFO
+
+    // GDO0: end of packet is the de-asserting edge of "sync word"
+    sendCommand(CC2500_REG_IOCFG0, CC2500_GDO_SYNC_WORD | inv);
+    m_iIntWor = iIntPacket;
+    m_bWorWake = false;
+    s_pWorInstance = this;
+    ::attachInterrupt(iIntPacket, worInterruptTrampoline, (bInvertGdo) ? RISING : FALLING);
+
+    sendStrobeCommand(CC2500_CMD_SFRX);
+    sendStrobeCommand(CC2500_CMD_SWORRST);
+    sendStrobeCommand(CC2500_CMD_SWOR);		// takes effect when CS_n goes high
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::resumeWakeOnRadio()
+{
+    m_bWorWake = false;
+    flushRx();
+    sendStrobeCommand(CC2500_CMD_SWOR);
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::endWakeOnRadio()
+{
+    if (m_iIntWor == NO_INTERRUPT)
+        return;
+    ::detachInterrupt(m_iIntWor);
+    m_iIntWor = NO_INTERRUPT;
+    m_bWorWake = false;
+    s_pWorInstance = 0;
+
+    sendStrobeCommand(CC2500_CMD_SIDLE);	// the access itself wakes the radio, SIDLE ends WOR
+    sendCommand(CC2500_REG_MCSM2, m_iWorSavedMcsm2);
+    sendCommand(CC2500_REG_MCSM1, m_iWorSavedMcsm1);
+    unsigned char worctrl = sendCommand(CC2500_REG_WORCTRL | CC2500_OFF_READ_SINGLE, 0x00);
+    sendCommand(CC2500_REG_WORCTRL, worctrl | CC2500_WORCTRL_RC_PD);
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::worInterruptTrampoline()
+// No SPI here: the main loop may be in a transaction with another device, and the radio is read in the main loop anyway.
+{
+    if (s_pWorInstance)
+        s_pWorInstance->m_bWorWake = true;
+}
+
+template<class Device>
+bool CC2500xcvrT<Device>::beginHopping(CC2500HopChannel* pChannels, unsigned char iCount)
+// REFERENCES:	21.1 "Frequency Synthesizer Calibration" in [1]: FSCAL3..1 may be stored per channel and written back
+{
+    sendStrobeCommand(CC2500_CMD_SIDLE);
+    unsigned char mcsm0 = sendCommand(CC2500_REG_MCSM0 | CC2500_OFF_READ_SINGLE, 0x00);
+    if (!m_pHopSet)
+        m_iHopSavedMcsm0 = mcsm0;
+    sendCommand(CC2500_REG_MCSM0, mcsm0 & ~CC2500_MCSM0_FS_AUTOCAL);
+
+    m_pHopSet = pChannels;
+    m_iHopCount = iCount;
+    m_iHopIndex = 0;
+    m_iHopRecalNext = iCount;
+    m_iHopRoundStart = millis();
+
+    bool bOK = true;
+    for (unsigned char i = 0; i < iCount; ++i)
+    {
+        if (!calibrateHopChannel(i))
+            bOK = false;
+    }
+    hop(0, 0);
+    return bOK;
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::hop(unsigned char iIndex, unsigned char strobe)
+{
+    const CC2500HopChannel& channel = m_pHopSet[iIndex];
+    const unsigned char header = CC2500_REG_FSCAL3 | CC2500_OFF_WRITE_BURST;
+    unsigned char aBytes[7] = { CC2500_CMD_SIDLE,							// strobe
+                                CC2500_REG_CHANNR, channel.iChannel,		// single write
+                                header, channel.aFscal[0], channel.aFscal[1], channel.aFscal[2] };	// burst, ends the transaction
+
+    spiTransactionBegin();	// enable device
+    spiTransferBlock(aBytes, aBytes, sizeof(aBytes));
+    spiTransactionEnd(); 	// disable device
+    captureStatus(header, aBytes[3]);
+    m_iHopIndex = iIndex;
+
+    if (strobe)
+        sendStrobeCommand(strobe);
+}
+
+template<class Device>
+bool CC2500xcvrT<Device>::calibrateHopChannel(unsigned char iIndex)
+// PURPOSE:		SCAL on the channel and keep the result.  Leaves the radio in IDLE on that channel.
+{
+    CC2500HopChannel& channel = m_pHopSet[iIndex];
+
+    sendStrobeCommand(CC2500_CMD_SIDLE);
+    sendCommand(CC2500_REG_CHANNR, channel.iChannel);
+    sendStrobeCommand(CC2500_CMD_SCAL);
+
+    unsigned long start = micros();
+    do
+    {
+        if (micros() - start > 2000)	// 721 us nominal
+            return false;
+        updateStatus(false);
+    } while (statusState() != CC2500_STATE_IDLE);
+
+    readBurst(CC2500_REG_FSCAL3, channel.aFscal, sizeof(channel.aFscal));
+    return true;
+}
+
+template<class Device>
+bool CC2500xcvrT<Device>::recalibrateHopChannel(unsigned char iIndex)
+{
+    bool bOK = calibrateHopChannel(iIndex);
+    hop(m_iHopIndex, 0);
+    return bOK;
+}
+
+template<class Device>
+bool CC2500xcvrT<Device>::serviceHopCalibration(unsigned long iPeriodMs)
+{
+    if (!m_pHopSet)
+        return false;
+    if (m_iHopRecalNext == m_iHopCount)
+    {
+        if (millis() - m_iHopRoundStart < iPeriodMs)
+            return false;
+        m_iHopRoundStart = millis();
+        m_iHopRecalNext = 0;
+    }
+    recalibrateHopChannel(m_iHopRecalNext++);
+    return true;
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::endHopping()
+{
+    if (!m_pHopSet)
+        return;
+    sendCommand(CC2500_REG_MCSM0, m_iHopSavedMcsm0);
+    m_pHopSet = 0;
+    m_iHopCount = 0;
+}
+
+template<class Device>
+bool CC2500xcvrT<Device>::scanChannels(unsigned char iFirst, unsigned char iStep, unsigned char iCount, signed char* aRssiDbm,
+                                       unsigned char iSamples, unsigned int iSettleMicros)
+{
+    sendStrobeCommand(CC2500_CMD_SIDLE);
+    unsigned char mcsm0 = sendCommand(CC2500_REG_MCSM0 | CC2500_OFF_READ_SINGLE, 0x00);
+    unsigned char channel = sendCommand(CC2500_REG_CHANNR | CC2500_OFF_READ_SINGLE, 0x00);
+    sendCommand(CC2500_REG_MCSM0, (mcsm0 & ~CC2500_MCSM0_FS_AUTOCAL) | CC2500_AUTOCAL_FROM_IDLE);
+
+    bool bOK = true;
+    for (unsigned char i = 0; i < iCount; ++i)
+    {
+        unsigned char aBytes[4] = { CC2500_CMD_SIDLE, CC2500_REG_CHANNR, (unsigned char)(iFirst + i * iStep), CC2500_CMD_SRX };
+        spiTransactionBegin();	// enable device
+        spiTransferBlock(aBytes, aBytes, sizeof(aBytes));
+        spiTransactionEnd(); 	// disable device
+        captureStatus(CC2500_CMD_SRX, aBytes[3]);
+
+        signed char dbm;
+        if (!sampleRssi(iSamples, iSettleMicros, dbm))
+            bOK = false;
+        else if (dbm > aRssiDbm[i])
+            aRssiDbm[i] = dbm;
+    }
+
+    sendStrobeCommand(CC2500_CMD_SIDLE);
+    sendCommand(CC2500_REG_MCSM0, mcsm0);
+    if (m_pHopSet)
+        hop(m_iHopIndex, 0);	// the sweep calibrated over the cached FSCAL values
+    else
+        sendCommand(CC2500_REG_CHANNR, channel);
+    return bOK;
+}
+
+template<class Device>
+bool CC2500xcvrT<Device>::scanHopSet(signed char* aRssiDbm, unsigned char iSamples, unsigned int iSettleMicros)
+{
+    if (!m_pHopSet)
+        return false;
+
+    unsigned char current = m_iHopIndex;
+    bool bOK = true;
+    for (unsigned char i = 0; i < m_iHopCount; ++i)
+    {
+        hop(i, CC2500_CMD_SRX);
+        signed char dbm;
+        if (!sampleRssi(iSamples, iSettleMicros, dbm))
+            bOK = false;
+        else if (dbm > aRssiDbm[i])
+            aRssiDbm[i] = dbm;
+    }
+    hop(current, 0);
+    return bOK;
+}
+
+template<class Device>
+bool CC2500xcvrT<Device>::sampleRssi(unsigned char iSamples, unsigned int iSettleMicros, signed char& iDbm)
+// PURPOSE:		Waits for RX and the settle time, then reads RSSI iSamples times in one transaction.  Returns the highest reading.
+// REFERENCES:	SPI read synchronization issue, errata
+{
+    unsigned long start = micros();
+    do
+    {
+        if (micros() - start > 2000)	// calibration and settling, about 800 us
+            return false;
+        updateStatus(true);
+    } while (statusState() != CC2500_STATE_RX);
+    delayMicroseconds(iSettleMicros);
+
+    // Each reading is a pair of reads.  A status register may read wrong while it changes; a pair that agrees is good.
+    if (iSamples == 0)
+        iSamples = 1;
+    if (iSamples > RSSI_SAMPLES_MAX)
+        iSamples = RSSI_SAMPLES_MAX;
+    const unsigned char header = CC2500_REG_RSSI | CC2500_OFF_READ_BURST;
+    const unsigned char length = 4 * iSamples;
+    unsigned char aBytes[4 * RSSI_SAMPLES_MAX];
+    for (unsigned char i = 0; i < length; i += 2)
+    {
+        aBytes[i] = header;
+        aBytes[i + 1] = 0x00;
+    }
+    spiTransactionBegin();	// enable device
+    spiTransferBlock(aBytes, aBytes, length);
+    spiTransactionEnd(); 	// disable device
+    captureStatus(header, aBytes[0]);
+
+    signed char best = (signed char)aBytes[length - 1];	// if no pair agrees, the last read
+    bool bAgreed = false;
+    for (unsigned char i = 0; i < length; i += 4)
+    {
+        if (aBytes[i + 1] != aBytes[i + 3])
+            continue;
+        if (!bAgreed || (signed char)aBytes[i + 1] > best)
+            best = (signed char)aBytes[i + 1];
+        bAgreed = true;
+    }
+    iDbm = rssiDbm(best);
+    return true;
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::beginInterruptTransmit(SPSCRing<unsigned char>& ring, unsigned char iIntPacketEnd,
+                                                 unsigned char iIntFifoThreshold, bool bInvertGdo)
+{
+    startInterruptTransmit(ring, 0, iIntPacketEnd, iIntFifoThreshold, bInvertGdo);
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::beginInterruptTransmit(PacketPoolBase& pool, SPSCRing<unsigned char>& handles, unsigned char iIntPacketEnd,
+                                                 unsigned char iIntFifoThreshold, bool bInvertGdo)
+{
+    startInterruptTransmit(handles, &pool, iIntPacketEnd, iIntFifoThreshold, bInvertGdo);
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::startInterruptTransmit(SPSCRing<unsigned char>& ring, PacketPoolBase* pPool, unsigned char iIntPacketEnd,
+                                                 unsigned char iIntFifoThreshold, bool bInvertGdo)
+{
+    const unsigned char inv = (bInvertGdo) ? CC2500_GDOx_INV : 0;
+
+    flushTx();
+    if (m_iIntTxPacketEnd == NO_INTERRUPT)
+        m_iTxSavedMcsm1 = sendCommand(CC2500_REG_MCSM1 | CC2500_OFF_READ_SINGLE, 0x00);
+    else
+    {
+        ::detachInterrupt(m_iIntTxPacketEnd);
+        ::detachInterrupt(m_iIntTxFifoThreshold);
+    }
+    sendCommand(CC2500_REG_MCSM1, (m_iTxSavedMcsm1 & ~CC2500_MCSM1_TXOFF_MODE) | CC2500_TXOFF_TX);
+
+    // data rate for txStats(): (256 + DRATE_M) * 2^DRATE_E * fXOSC / 2^28.  See 12 "Data Rate Programming" in [1].
+    // fXOSC = 26 MHz = 406250 * 2^6, so that is (256 + DRATE_M) * 406250 / 2^(22 - DRATE_E), in 32 bits.
+    unsigned char aModem[3];	// MDMCFG4, MDMCFG3, MDMCFG2
+    readBurst(CC2500_REG_MDMCFG4, aModem, sizeof(aModem));
+    m_iTxBitRate = ((256 + aModem[1]) * 406250UL) >> (22 - (aModem[0] & 0x0F));
+    if (aModem[2] & CC2500_MDMCFG2_MANCHESTER_EN)
+        m_iTxBitRate /= 2;
+
+    m_pTxRing = &ring;
+    m_pTxPool = pPool;
+    m_iTxRecordLeft = 0;
+    m_iTxInFlight = 0;
+    m_iTxPacketEnds = 0;
+    m_bTxActive = false;
+    m_bTxPending = false;
+    txStatsReset();
+    m_iIntTxPacketEnd = iIntPacketEnd;
+    m_iIntTxFifoThreshold = iIntFifoThreshold;
+    s_pTxInstance = this;
+
+    // GDO0: packet end is the de-asserting edge of "sync word".  GDO2: refill is the de-asserting edge of the TX threshold.
+    sendCommand(CC2500_REG_IOCFG0, CC2500_GDO_SYNC_WORD | inv);
+    sendCommand(CC2500_REG_IOCFG2, CC2500_GDO_TX_FIFO_THR | inv);
+    ::attachInterrupt(iIntPacketEnd, txPacketEndTrampoline, (bInvertGdo) ? RISING : FALLING);
+    ::attachInterrupt(iIntFifoThreshold, txThresholdTrampoline, (bInvertGdo) ? RISING : FALLING);
+
+    byte oldSREG = SREG;
+    cli();
+    txInterruptHandler();	// packets may have been queued before
+    SREG = oldSREG;
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::endInterruptTransmit()
+{
+    if (m_iIntTxPacketEnd == NO_INTERRUPT)
+        return;
+    ::detachInterrupt(m_iIntTxPacketEnd);
+    ::detachInterrupt(m_iIntTxFifoThreshold);
+    m_iIntTxPacketEnd = m_iIntTxFifoThreshold = NO_INTERRUPT;
+    s_pTxInstance = 0;
+
+    if (m_bTxActive)
+        txStreamEnd();
+    if (m_pTxPool)
+    {
+        PacketPoolBase::Handle handle;
+        while (m_pTxRing->pop(handle))
+            m_pTxPool->release(handle);
+        m_pTxPool = 0;
+    }
+    m_pTxRing = 0;
+    flushTx();
+    sendCommand(CC2500_REG_MCSM1, m_iTxSavedMcsm1);
+}
+
+template<class Device>
+bool CC2500xcvrT<Device>::queuePacket(const unsigned char* data, unsigned char length)
+{
+    if (m_pTxPool)
+    {
+        if (length > m_pTxPool->maxPayload())
+            return false;
+        PacketPoolBase::Handle handle = m_pTxPool->allocate();
+        if (handle == PacketPoolBase::NONE)
+            return false;
+        m_pTxPool->setLength(handle, length);
+        memcpy(m_pTxPool->payload(handle), data, length);
+        if (queuePacket(handle))
+            return true;
+        m_pTxPool->release(handle);
+        return false;
+    }
+
+    if (!m_pTxRing || 1 + (unsigned short)length > m_pTxRing->capacity())
+        return false;	// would never fit
+    if (m_pTxRing->space() < 1 + (unsigned short)length)
+        return false;
+
+    m_pTxRing->pushUncommitted(length);
+    for (unsigned char i = 0; i < length; ++i)
+        m_pTxRing->pushUncommitted(data[i]);
+    m_pTxRing->commit();	// the ISR only ever sees whole packets
+
+    byte oldSREG = SREG;
+    cli();	// the GDO ISR must not refill at the same time
+    txInterruptHandler();	// starts the stream, or tops up the FIFO while the radio sends preamble
+    SREG = oldSREG;
+    return true;
+}
+
+template<class Device>
+bool CC2500xcvrT<Device>::queuePacket(PacketPoolBase::Handle handle)
+{
+    if (!m_pTxPool || handle == PacketPoolBase::NONE || !m_pTxRing->push(handle))
+        return false;
+
+    byte oldSREG = SREG;
+    cli();	// the GDO ISR must not refill at the same time
+    txInterruptHandler();
+    SREG = oldSREG;
+    return true;
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::serviceTransmit()
+{
+    if (!m_bTxPending)
+        return;
+
+    byte oldSREG = SREG;
+    cli();
+    txInterruptHandler();
+    SREG = oldSREG;
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::txPacketEndTrampoline()
+{
+    if (!s_pTxInstance)
+        return;
+    ++s_pTxInstance->m_iTxPacketEnds;	// counted here: the handler may be deferred
+    s_pTxInstance->txInterruptHandler();
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::txThresholdTrampoline()
+{
+    if (s_pTxInstance)
+        s_pTxInstance->txInterruptHandler();
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::txRequestService(void* pContext)
+{
+    CC2500xcvrT* pRadio = static_cast<CC2500xcvrT*>(pContext);
+    if (pRadio->m_bTxPending)
+        pRadio->txInterruptHandler();
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::txStreamEnd()
+{
+    m_txStats.iActiveMicros += micros() - m_iTxStreamStart;
+    m_bTxActive = false;
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::txInterruptHandler()
+// PRECONDITIONS:	interrupts disabled (ISR context)
+{
+    if (!m_pTxRing)
+        return;
+
+    if (Device::spiBusBusy())
+    {
+        m_bTxPending = true;	// the main loop is in the middle of a transaction.  The refill runs at the next service point.
+        this->spiPostRequest(&m_txRequest, txRequestService, this);
+        return;
+    }
+    m_bTxPending = false;
+
+    unsigned char txbytes = readStatusRegister(CC2500_REG_TXBYTES);
+    bool bUnderflow = (txbytes & CC2500_FIFO_UNDERFLOW) || statusState() == CC2500_STATE_TXFIFO_UNDERFLOW;
+
+    // packets that have left the air.  An underflow de-asserts GDO0 too, that edge isn't a packet.
+    unsigned char ends = m_iTxPacketEnds;
+    m_iTxPacketEnds = 0;
+    if (bUnderflow && ends)
+        --ends;
+    for (; ends && m_iTxInFlight; --ends, --m_iTxInFlight)
+    {
+        ++m_txStats.iPackets;
+        m_txStats.iBytes += 1 + m_aTxInFlight[m_iTxInFlightTail];
+        m_iTxInFlightTail = (m_iTxInFlightTail + 1) & (TX_IN_FLIGHT - 1);
+    }
+
+    if (bUnderflow)
+    {
+        ++m_txStats.iUnderflows;
+        m_txStats.iDropped += m_iTxInFlight;	// everything in the FIFO is lost
+        m_iTxInFlight = 0;
+        if (m_pTxPool && m_iTxRecordLeft)		// and so is the rest of the packet being loaded
+        {
+            m_pTxPool->release(m_pTxRing->peek(0));
+            m_pTxRing->skip(1);
+        }
+        else
+            m_pTxRing->skip(m_iTxRecordLeft);
+        m_iTxRecordLeft = 0;
+        if (m_bTxActive)
+            txStreamEnd();
+        flushTx();
+        txbytes = 0;
+    }
+    else if (m_bTxActive && m_iTxInFlight == 0 && m_pTxRing->available() == 0)
+    {
+        sendStrobeCommand(CC2500_CMD_SIDLE);	// the queue has run dry.  The radio was sending preamble for the next packet.
+        txStreamEnd();
+        return;
+    }
+
+    // as much as fits, packet boundaries don't matter to the FIFO
+    unsigned char space = FIFO_SIZE - (txbytes & CC2500_NUM_BYTES_MASK);
+    unsigned char n = (m_pTxPool) ? txLoadFromPool(space) : txLoadFromRing(space);
+    if (n == 0)
+        return;
+
+    if (!m_bTxActive)
+    {
+        sendStrobeCommand(CC2500_CMD_STX);
+        m_iTxStreamStart = micros();
+        m_bTxActive = true;
+    }
+}
+
+template<class Device>
+unsigned char CC2500xcvrT<Device>::txLoadFromRing(unsigned char space)
+// PURPOSE:		Writes up to space bytes of the ring's records to the TX FIFO, in one burst.  Returns the number written.
+{
+    unsigned char aChunk[FIFO_SIZE];
+    unsigned char n = 0;
+    while (n < space)
+    {
+        if (m_iTxRecordLeft == 0)
+        {
+            if (m_pTxRing->available() == 0 || m_iTxInFlight == TX_IN_FLIGHT)
+                break;
+            unsigned char length = m_pTxRing->peek(0);
+            m_aTxInFlight[(m_iTxInFlightTail + m_iTxInFlight) & (TX_IN_FLIGHT - 1)] = length;
+            ++m_iTxInFlight;
+            m_iTxRecordLeft = length + 1;
+        }
+        unsigned char count = space - n;
+        if (count > m_iTxRecordLeft)
+            count = m_iTxRecordLeft;
+        count = m_pTxRing->pop(aChunk + n, count);
+        n += count;
+        m_iTxRecordLeft -= count;
+    }
+    if (n)
+        writeBurst(CC2500_REG_TXFIFO, aChunk, n);
+    return n;
+}
+
+template<class Device>
+unsigned char CC2500xcvrT<Device>::txLoadFromPool(unsigned char space)
+// PURPOSE:		As txLoadFromRing(), straight from the queued pool buffers.  A buffer is released once it is all in
+//				the FIFO, after the transaction: on Linux boards the block is only sent when the transaction ends.
+{
+    unsigned char n = 0;
+    unsigned char loaded = 0;	// buffers at the head of the queue that are all in
+    while (n < space)
+    {
+        if (m_iTxRecordLeft == 0)
+        {
+            if (m_pTxRing->available() == loaded || m_iTxInFlight == TX_IN_FLIGHT)
+                break;
+            unsigned char length = m_pTxPool->length(m_pTxRing->peek(loaded));
+            m_aTxInFlight[(m_iTxInFlightTail + m_iTxInFlight) & (TX_IN_FLIGHT - 1)] = length;
+            ++m_iTxInFlight;
+            m_iTxRecordLeft = length + 1;
+        }
+        if (n == 0)
+        {
+            spiTransactionBegin();	// enable device
+            sendHeader(CC2500_REG_TXFIFO | CC2500_OFF_WRITE_BURST);
+        }
+
+        PacketPoolBase::Handle handle = m_pTxRing->peek(loaded);
+        unsigned char count = space - n;
+        if (count > m_iTxRecordLeft)
+            count = m_iTxRecordLeft;
+        spiWriteBlock(m_pTxPool->buffer(handle) + (m_pTxPool->length(handle) + 1 - m_iTxRecordLeft), count);
+        n += count;
+        m_iTxRecordLeft -= count;
+        if (m_iTxRecordLeft == 0)
+            ++loaded;
+    }
+    if (n == 0)
+        return 0;
+    spiTransactionEnd(); 	// disable device
+
+    for (; loaded; --loaded)
+    {
+        PacketPoolBase::Handle handle = m_pTxRing->peek(0);
+        m_pTxRing->skip(1);
+        m_pTxPool->release(handle);
+    }
+    return n;
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::txStats(CC2500TxStats& stats)
+{
+    byte oldSREG = SREG;
+    cli();	// written by the ISR
+    stats = m_txStats;
+    if (m_bTxActive)
+        stats.iActiveMicros += micros() - m_iTxStreamStart;
+    SREG = oldSREG;
+
+    // bits the data rate allows in iActiveMicros: seconds, milliseconds and microseconds apart, so that no product
+    // needs more than 32 bits (at 500 kbit/s, 999 ms is 5 * 10^8).
+    unsigned long iSeconds = stats.iActiveMicros / 1000000UL;
+    unsigned long iMicros = stats.iActiveMicros % 1000000UL;
+    unsigned long iCapacity = iSeconds * m_iTxBitRate + (iMicros / 1000) * m_iTxBitRate / 1000
+                            + (iMicros % 1000) * m_iTxBitRate / 1000000UL;
+    unsigned long iBits = stats.iBytes * 8;
+    while (iBits > 0xFFFFFFFFUL / 1000)
+    {
+        iBits >>= 1;
+        iCapacity >>= 1;
+    }
+    stats.iUtilizationPermille = (iCapacity > 0) ? (unsigned int)(iBits * 1000 / iCapacity) : 0;
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::txStatsReset()
+{
+    byte oldSREG = SREG;
+    cli();
+    memset(&m_txStats, 0, sizeof(m_txStats));
+    if (m_bTxActive)
+        m_iTxStreamStart = micros();
+    SREG = oldSREG;
+}
+
+template<class Device>
+bool CC2500xcvrT<Device>::beginReset(unsigned long iTimeoutMicros)
+// REFERENCES:	19.1.2 "Manual Reset" in [1]
+{
+    if (m_iOp != OP_NONE)
+        return false;
+
+    // CS_n isn't held between poll() calls: another device may use the bus meanwhile.  Only the high time is waited for.
+    csAssert();
+    delayMicroseconds(1);
+    csDeassert();
+    startOperation(OP_RESET_HOLD, iTimeoutMicros);
+    return true;
+}
+
+template<class Device>
+bool CC2500xcvrT<Device>::beginCalibrate(unsigned long iTimeoutMicros)
+{
+    if (m_iOp != OP_NONE)
+        return false;
+
+    sendStrobeCommand(CC2500_CMD_SIDLE);
+    sendStrobeCommand(CC2500_CMD_SCAL);
+    m_iOpState = CC2500_STATE_IDLE;
+    startOperation(OP_STATE, iTimeoutMicros);
+    return true;
+}
+
+template<class Device>
+bool CC2500xcvrT<Device>::beginStrobe(unsigned char command, unsigned char iState, unsigned long iTimeoutMicros)
+{
+    if (m_iOp != OP_NONE)
+        return false;
+
+    sendStrobeCommand(command);
+    m_iOpState = iState;
+    startOperation(OP_STATE, iTimeoutMicros);
+    return true;
+}
+
+template<class Device>
+bool CC2500xcvrT<Device>::beginRecalibrateHopChannel(unsigned char iIndex, unsigned long iTimeoutMicros)
+{
+    if (m_iOp != OP_NONE || !m_pHopSet || iIndex >= m_iHopCount)
+        return false;
+
+    unsigned char aBytes[4] = { CC2500_CMD_SIDLE, CC2500_REG_CHANNR, m_pHopSet[iIndex].iChannel, CC2500_CMD_SCAL };
+    spiTransactionBegin();	// enable device
+    spiTransferBlock(aBytes, aBytes, sizeof(aBytes));
+    spiTransactionEnd(); 	// disable device
+    captureStatus(CC2500_CMD_SCAL, aBytes[3]);
+
+    m_iOpIndex = iIndex;
+    startOperation(OP_HOP_CAL, iTimeoutMicros);
+    return true;
+}
+
+template<class Device>
+bool CC2500xcvrT<Device>::beginHopCalibrationService(unsigned long iPeriodMs)
+{
+    if (!m_pHopSet || m_iOp != OP_NONE)
+        return false;
+    if (m_iHopRecalNext == m_iHopCount)
+    {
+        if (millis() - m_iHopRoundStart < iPeriodMs)
+            return false;
+        m_iHopRoundStart = millis();
+        m_iHopRecalNext = 0;
+    }
+    return beginRecalibrateHopChannel(m_iHopRecalNext++);
+}
+
+template<class Device>
+SPIExternalDevice::PollStatus CC2500xcvrT<Device>::poll()
+{
+    if (m_iOp == OP_NONE)
+        return SPIExternalDevice::POLL_IDLE;
+
+    unsigned long elapsed = micros() - m_iOpStart;
+    switch (m_iOp)
+    {
+    case OP_RESET_HOLD:
+        if (elapsed < 45)	// CS_n high for at least 40 us.  micros() counts in steps of 4 us.
+            return SPIExternalDevice::POLL_BUSY;
+        if (!chipReadyNow())
+            break;
+        sendStrobeCommand(CC2500_CMD_SRES);
+        m_iOp = OP_RESET_READY;
+        return SPIExternalDevice::POLL_BUSY;
+
+    case OP_RESET_READY:
+        if (chipReadyNow())
+            return endOperation(SPIExternalDevice::POLL_DONE);
+        break;
+
+    case OP_STATE:
+        updateStatus(false);
+        if (statusState() == m_iOpState)
+            return endOperation(SPIExternalDevice::POLL_DONE);
+        break;
+
+    case OP_HOP_CAL:
+        updateStatus(false);
+        if (statusState() != CC2500_STATE_IDLE)
+            break;
+        readBurst(CC2500_REG_FSCAL3, m_pHopSet[m_iOpIndex].aFscal, sizeof(m_pHopSet[m_iOpIndex].aFscal));
+        hop(m_iHopIndex, 0);
+        return endOperation(SPIExternalDevice::POLL_DONE);
+    }
+
+    if (elapsed > m_iOpTimeout)
+        return endOperation(SPIExternalDevice::POLL_TIMEOUT);
+    return SPIExternalDevice::POLL_BUSY;
+}
+
+template<class Device>
+void CC2500xcvrT<Device>::startOperation(unsigned char iOp, unsigned long iTimeoutMicros)
+{
+    m_iOp = iOp;
+    m_iOpStart = micros();
+    m_iOpTimeout = iTimeoutMicros;
+}
+
+template<class Device>
+bool CC2500xcvrT<Device>::chipReadyNow()
+// PURPOSE:		The chip pulls SO low when it is ready, once CS_n is asserted.  Samples it once instead of waiting.
+{
+    Device::spiTransactionBegin();
+    bool bReady = !Device::spiMisoHigh();
+    spiTransactionEnd();
+    return bReady;
+}
 
 #endif
@@ -0,0 +1,179 @@
+/*
+\file	Arduino.h
+\version	1.0.0
+\purpose	Host build of the Arduino 1.0.1 core subset used by the libraries in this repository.  See HostSim.h.
+\compiler	g++ on Linux
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define F_CPU 16000000UL
+
+#include "HostSim.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef unsigned int word;
+
+#define HIGH	0x1
+#define LOW		0x0
+
+#define INPUT			0x0
+#define OUTPUT			0x1
+#define INPUT_PULLUP	0x2
+
+#define LSBFIRST	0
+#define MSBFIRST	1
+
+#define CHANGE	1
+#define FALLING	2
+#define RISING	3
+
+#ifndef M_PI
+#define M_PI	3.1415926535897932384626433832795
+#endif
+
+#define min(a,b)			((a)<(b)?(a):(b))
+#define max(a,b)			((a)>(b)?(a):(b))
+#define constrain(amt,low,high)	((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+#define lowByte(w)			((uint8_t) ((w) & 0xff))
+#define highByte(w)			((uint8_t) ((w) >> 8))
+#define bitRead(value, bit)	(((value) >> (bit)) & 0x01)
+#define _BV(bit)			(1 << (bit))
+
+// ATmega328P pins of the SPI master
+static const uint8_t SS   = 10;
+static const uint8_t MOSI = 11;
+static const uint8_t MISO = 12;
+static const uint8_t SCK  = 13;
+
+// register bits
+#define SPIE	7
+#define SPE		6
+#define DORD	5
+#define MSTR	4
+#define CPOL	3
+#define CPHA	2
+#define SPR1	1
+#define SPR0	0
+#define SPIF	7
+#define WCOL	6
+#define SPI2X	0
+#define WGM13	4
+#define WGM12	3
+#define CS12	2
+#define CS11	1
+#define CS10	0
+#define OCIE1A	1
+
+
+/*	An I/O register with side effects on read and write.  Only what the drivers do with SPCR/SPSR/SPDR/SREG is supported.	*/
+class SimRegister
+{
+public:
+	enum Id { ID_SPCR, ID_SPSR, ID_SPDR, ID_SREG };
+
+	explicit SimRegister(Id id) : m_id(id) {}
+
+	operator uint8_t() const;
+	SimRegister& operator=(uint8_t iValue);
+	SimRegister& operator=(const SimRegister& other)	{ return *this = (uint8_t)other; }
+	SimRegister& operator|=(int iBits)	{ return *this = (uint8_t)(*this | iBits); }	// int, so that ~_BV(n) goes in as on the AVR
+	SimRegister& operator&=(int iBits)	{ return *this = (uint8_t)(*this & iBits); }
+	SimRegister& operator^=(int iBits)	{ return *this = (uint8_t)(*this ^ iBits); }
+
+private:
+	const Id	m_id;
+};
+
+extern SimRegister SPCR, SPSR, SPDR, SREG;
+
+// plain registers.  The simulator reads them when it needs them.
+extern volatile uint8_t PORTB, PORTC, PORTD;
+extern volatile uint8_t DDRB, DDRC, DDRD;
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+extern volatile uint16_t OCR1A, TCNT1;
+
+// pin to port mapping, ATmega328P (Arduino Uno / Pro Mini)
+#define NOT_A_PIN	0
+#define NOT_A_PORT	0
+#define PB	2
+#define PC	3
+#define PD	4
+
+inline uint8_t digitalPinToPort(uint8_t pin)	{ return (pin < 8) ? PD : (pin < 14) ? PB : (pin < 20) ? PC : NOT_A_PIN; }
+inline uint8_t digitalPinToBitMask(uint8_t pin)	{ return (uint8_t)_BV((pin < 8) ? pin : (pin < 14) ? (pin - 8) : (pin - 14)); }
+inline volatile uint8_t* portOutputRegister(uint8_t port)	{ return (port == PB) ? &PORTB : (port == PC) ? &PORTC : (port == PD) ? &PORTD : 0; }
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode);
+void detachInterrupt(uint8_t interruptNum);
+
+void cli();
+void sei();
+#define interrupts()	sei()
+#define noInterrupts()	cli()
+
+// flash is ordinary memory on the host
+#define PROGMEM
+#define PSTR(s)					(s)
+#define F(s)					(s)
+#define pgm_read_byte(addr)		(*(const uint8_t*)(addr))
+#define pgm_read_word(addr)		(*(const uint16_t*)(addr))
+#define memcpy_P				memcpy
+
+// Interrupt vectors are plain functions.  The simulator calls the ones that are defined.
+#define ISR(vector)		extern "C" void vector(void); extern "C" void vector(void)
+
+
+class Print
+{
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t c) = 0;
+
+	size_t write(const char* str);
+	size_t print(const char* str)					{ return write(str); }
+	size_t print(char c)							{ return write((uint8_t)c); }
+	size_t print(unsigned char n, int base = 10)	{ return print((unsigned long)n, base); }
+	size_t print(int n, int base = 10)				{ return print((long)n, base); }
+	size_t print(unsigned int n, int base = 10)		{ return print((unsigned long)n, base); }
+	size_t print(long n, int base = 10);
+	size_t print(unsigned long n, int base = 10);
+	size_t print(double n, int digits = 2);
+	size_t println()								{ return write("\r\n"); }
+	template<class T> size_t println(T value)				{ size_t n = print(value);  return n + println(); }
+	template<class T> size_t println(T value, int format)	{ size_t n = print(value, format);  return n + println(); }
+};
+
+
+class HardwareSerial : public Print		// prints to stdout
+{
+public:
+	void begin(unsigned long baud)	{ (void)baud; }
+	virtual size_t write(uint8_t c);
+	using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,649 @@
+/*
+\file	HostSim.cpp
+\version	1.0.0
+\purpose	Host (Linux) stand-in for the ATmega328P SPI master, GPIO, Timer1, external interrupts and time.  See HostSim.h.
+\compiler	g++ on Linux
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+/* References
+[1]  ATmega48A/PA/88A/PA/168A/PA/328/P datasheet.  Atmel 8271.  Chapter 18 "SPI", chapter 12 "External Interrupts",
+	 chapter 16 "16-bit Timer/Counter1".
+*/
+
+#include <stdio.h>
+#include "Arduino.h"
+
+
+// Interrupt vectors of the sketch and libraries.  Weak, so that the ones nobody defines are NULL.
+extern "C" void INT0_vect(void) __attribute__((weak));
+extern "C" void INT1_vect(void) __attribute__((weak));
+extern "C" void TIMER1_COMPA_vect(void) __attribute__((weak));
+extern "C" void SPI_STC_vect(void) __attribute__((weak));
+
+unsigned char simSPIExchange(unsigned char iMOSI, unsigned char iSPCR, unsigned long iClockHz);
+
+
+SimRegister SPCR(SimRegister::ID_SPCR);
+SimRegister SPSR(SimRegister::ID_SPSR);
+SimRegister SPDR(SimRegister::ID_SPDR);
+SimRegister SREG(SimRegister::ID_SREG);
+
+volatile uint8_t PORTB, PORTC, PORTD;
+volatile uint8_t DDRB, DDRC, DDRD;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+volatile uint16_t OCR1A, TCNT1;
+
+HardwareSerial Serial;
+
+
+static const unsigned char SIM_NUM_PINS = 20;
+static const unsigned char SIM_MAX_SLAVES = 8;
+static const byte SREG_I = 0x80;
+
+static SimCycles		s_iNow = 0;
+
+// SPI master
+static byte				s_iSPCR = 0;
+static byte				s_iSPSR = 0;		// SPIF, WCOL, SPI2X
+static byte				s_iSPDRIn = 0;		// last byte received
+static bool				s_bSPIFRead = false;	// SPSR was read with SPIF set.  Accessing SPDR clears SPIF.
+static byte				s_iSREG = 0;
+static bool				s_bInISR = false;
+
+static SimSPISlave*		s_apSlaves[SIM_MAX_SLAVES];
+static unsigned char	s_iSlaves = 0;
+
+static unsigned long	s_iSPIBytes = 0;
+static SimCycles		s_iSPIBusyCycles = 0;
+static unsigned long	s_iSPIContentions = 0;
+
+// GPIO.  Outputs are in the PORTx registers, inputs are driven by the models.
+static bool				s_abDriven[SIM_NUM_PINS];	// level a model drives onto the pin
+static bool				s_abLastLevel[SIM_NUM_PINS];	// for edge detection on the interrupt pins
+
+// external interrupts.  INT0 is pin 2, INT1 is pin 3.
+static void				(*s_apfnExtInt[2])(void);
+static int				s_aiExtIntMode[2];
+static bool				s_abExtIntPending[2];
+
+// Timer1, CTC mode only
+static byte				s_iTimer1Config = 0;	// TCCR1B as seen when the timer was started
+static SimCycles		s_iTimer1Next = SIM_NEVER;
+static bool				s_bTimer1Pending = false;
+
+
+static volatile uint8_t* portOfPin(uint8_t pin)	{ return portOutputRegister(digitalPinToPort(pin)); }
+
+static bool outputLevel(uint8_t pin)
+{
+	volatile uint8_t* pPort = portOfPin(pin);
+	return pPort && (*pPort & digitalPinToBitMask(pin)) != 0;
+}
+
+
+static bool isOutput(uint8_t pin)
+{
+	if (pin >= SIM_NUM_PINS)
+		return false;
+	volatile uint8_t* pDDR = (pin < 8) ? &DDRD : (pin < 14) ? &DDRB : &DDRC;
+	return (*pDDR & digitalPinToBitMask(pin)) != 0;
+}
+
+
+static void dispatchInterrupts()
+// PURPOSE:		Run pending interrupts in vector priority order, as long as SREG.I is set.
+{
+	while (!s_bInISR && (s_iSREG & SREG_I))
+	{
+		void (*pfnVector)(void) = 0;
+		void (*pfnUser)(void) = 0;
+
+		if (s_abExtIntPending[0])
+		{
+			s_abExtIntPending[0] = false;
+			pfnUser = s_apfnExtInt[0];
+			pfnVector = INT0_vect;
+		}
+		else if (s_abExtIntPending[1])
+		{
+			s_abExtIntPending[1] = false;
+			pfnUser = s_apfnExtInt[1];
+			pfnVector = INT1_vect;
+		}
+		else if (s_bTimer1Pending)
+		{
+			s_bTimer1Pending = false;
+			pfnVector = TIMER1_COMPA_vect;
+		}
+		else if ((s_iSPSR & _BV(SPIF)) && (s_iSPCR & _BV(SPIE)))
+		{
+			s_iSPSR &= ~_BV(SPIF);		// cleared by hardware when the vector runs
+			pfnVector = SPI_STC_vect;
+		}
+		else
+			return;
+
+		// the AVR clears I on entry and sets it again with RETI
+		s_bInISR = true;
+		s_iSREG &= ~SREG_I;
+		if (pfnUser)
+			pfnUser();
+		else if (pfnVector)
+			pfnVector();
+		s_iSREG |= SREG_I;
+		s_bInISR = false;
+	}
+}
+
+
+static void pinChanged(uint8_t pin, bool bLevel)
+{
+	for (byte i = 0; i < 2; ++i)
+	{
+		if (pin != 2 + i || !s_apfnExtInt[i])
+			continue;
+
+		int mode = s_aiExtIntMode[i];
+		if (mode == CHANGE || (mode == RISING && bLevel) || (mode == FALLING && !bLevel))
+			s_abExtIntPending[i] = true;
+	}
+}
+
+
+static void updatePin(uint8_t pin)
+{
+	if (pin >= SIM_NUM_PINS)
+		return;
+
+	bool bLevel = simPinLevel(pin);
+	if (bLevel != s_abLastLevel[pin])
+	{
+		s_abLastLevel[pin] = bLevel;
+		pinChanged(pin, bLevel);
+	}
+}
+
+
+static void timer1Update()
+// PURPOSE:		Follows the Timer1 registers.  CTC with TOP = OCR1A and compare match A interrupt is all that's modeled.
+{
+	static const unsigned int aPrescalers[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+	byte iConfig = TCCR1B;
+	unsigned int iPrescaler = aPrescalers[iConfig & 0x07];
+	bool bRunning = (iConfig & _BV(WGM12)) && iPrescaler != 0;
+
+	if (!bRunning)
+	{
+		s_iTimer1Next = SIM_NEVER;
+		s_iTimer1Config = 0;
+		return;
+	}
+
+	SimCycles iPeriod = (SimCycles)(OCR1A + 1) * iPrescaler;
+	if (iConfig != s_iTimer1Config || s_iTimer1Next == SIM_NEVER)
+	{
+		s_iTimer1Config = iConfig;		// (re)started, counting from TCNT1 = 0
+		s_iTimer1Next = s_iNow + iPeriod;
+	}
+
+	while (s_iTimer1Next <= s_iNow)
+	{
+		if (TIMSK1 & _BV(OCIE1A))
+			s_bTimer1Pending = true;
+		s_iTimer1Next += iPeriod;
+	}
+}
+
+
+SimCycles simNow()
+{
+	return s_iNow;
+}
+
+
+SimCycles simMicrosToCycles(double fMicros)
+{
+	return (SimCycles)(fMicros * (F_CPU / 1000000UL) + 0.5);
+}
+
+
+void simAdvance(SimCycles iCycles)
+// PURPOSE:		Moves time forward, stopping at every model event and Timer1 match on the way to run it and its interrupts.
+//				ISRs may advance time themselves (SPI bytes), so the target is re-checked after each stop.
+{
+	SimCycles iTarget = s_iNow + iCycles;
+
+	for (;;)
+	{
+		timer1Update();
+
+		SimCycles iNext = iTarget;
+		if (s_iTimer1Next < iNext)
+			iNext = s_iTimer1Next;
+		for (byte i = 0; i < s_iSlaves; ++i)
+		{
+			SimCycles iEvent = s_apSlaves[i]->nextEvent();
+			if (iEvent < iNext)
+				iNext = iEvent;
+		}
+		if (iNext > s_iNow)
+			s_iNow = iNext;
+
+		for (byte i = 0; i < s_iSlaves; ++i)
+			s_apSlaves[i]->advance(s_iNow);
+		timer1Update();
+		dispatchInterrupts();
+
+		if (s_iNow >= iTarget)
+			return;
+	}
+}
+
+
+void simPollChipSelects()
+{
+	for (byte i = 0; i < s_iSlaves; ++i)
+	{
+		SimSPISlave* pSlave = s_apSlaves[i];
+		bool bSelected = !outputLevel(pSlave->m_pinCS_n);
+		if (bSelected == pSlave->m_bSelected)
+			continue;
+
+		pSlave->m_bSelected = bSelected;
+		if (bSelected)
+			++pSlave->m_iTransactions;
+		pSlave->csChanged(bSelected);
+	}
+}
+
+
+unsigned char simSPIExchange(unsigned char iMOSI, unsigned char iSPCR, unsigned long iClockHz)
+// PURPOSE:		One byte on the bus.  Every selected slave sees it, MISO is the wired AND of their outputs (open bus reads 0xFF).
+{
+	unsigned char iMode = (iSPCR & (_BV(CPOL) | _BV(CPHA))) >> CPHA;
+	bool bLSBFirst = (iSPCR & _BV(DORD)) != 0;
+	unsigned char iMISO = 0xFF;
+	unsigned char iSelected = 0;
+
+	for (byte i = 0; i < s_iSlaves; ++i)
+	{
+		SimSPISlave* pSlave = s_apSlaves[i];
+		if (!pSlave->m_bSelected)
+			continue;
+
+		++iSelected;
+		++pSlave->m_iBytes;
+		if (bLSBFirst || !(pSlave->m_iModeMask & _BV(iMode)))
+			++pSlave->m_iModeErrors;
+		if (iClockHz > pSlave->m_iMaxClockHz)
+			++pSlave->m_iClockErrors;
+		iMISO &= pSlave->exchange(iMOSI);
+	}
+
+	if (iSelected > 1)
+		++s_iSPIContentions;
+	return iMISO;
+}
+
+
+static void spiWrite(byte iData)
+// PURPOSE:		Writing SPDR starts a transfer.  The byte is exchanged, then the CPU waits 8 SCK periods.
+{
+	if (!(s_iSPCR & _BV(SPE)))
+		return;
+
+	if (s_iSPSR & _BV(SPIF))
+		s_iSPSR &= ~_BV(SPIF);		// the previous transfer wasn't acknowledged by an SPSR read, writing SPDR still clears it
+	s_bSPIFRead = false;
+
+	static const unsigned char aDividers[4] = { 4, 16, 64, 128 };
+	unsigned int iDivider = aDividers[s_iSPCR & (_BV(SPR1) | _BV(SPR0))];
+	if (s_iSPSR & _BV(SPI2X))
+		iDivider /= 2;
+
+	simPollChipSelects();
+	s_iSPDRIn = simSPIExchange(iData, s_iSPCR, F_CPU / iDivider);
+
+	SimCycles iCycles = 8 * iDivider;
+	++s_iSPIBytes;
+	s_iSPIBusyCycles += iCycles;
+
+	s_iSPSR |= _BV(SPIF);
+	simAdvance(iCycles);
+}
+
+
+SimRegister::operator uint8_t() const
+{
+	switch (m_id)
+	{
+	case ID_SPCR:
+		return s_iSPCR;
+	case ID_SPSR:
+		if (s_iSPSR & _BV(SPIF))
+			s_bSPIFRead = true;
+		return s_iSPSR;
+	case ID_SPDR:
+		if (s_bSPIFRead)
+		{
+			s_iSPSR &= ~_BV(SPIF);
+			s_bSPIFRead = false;
+		}
+		return s_iSPDRIn;
+	case ID_SREG:
+		return s_iSREG;
+	}
+	return 0;
+}
+
+
+SimRegister& SimRegister::operator=(uint8_t iValue)
+{
+	switch (m_id)
+	{
+	case ID_SPCR:
+		s_iSPCR = iValue;
+		dispatchInterrupts();		// SPIE with SPIF already set
+		break;
+	case ID_SPSR:
+		s_iSPSR = (s_iSPSR & ~_BV(SPI2X)) | (iValue & _BV(SPI2X));	// only SPI2X is writable
+		break;
+	case ID_SPDR:
+		spiWrite(iValue);
+		break;
+	case ID_SREG:
+		s_iSREG = iValue;
+		simPollChipSelects();		// CS_n port writes are bracketed by SREG save/restore
+		dispatchInterrupts();
+		break;
+	}
+	return *this;
+}
+
+
+SimSPISlave::SimSPISlave(unsigned char pinCS_n, unsigned char iModeMask, unsigned long iMaxClockHz)
+	: m_pinCS_n(pinCS_n)
+	, m_iModeMask(iModeMask)
+	, m_iMaxClockHz(iMaxClockHz)
+	, m_bSelected(false)
+{
+	resetStatistics();
+	if (s_iSlaves < SIM_MAX_SLAVES)
+		s_apSlaves[s_iSlaves++] = this;
+}
+
+
+SimSPISlave::~SimSPISlave()
+{
+	for (byte i = 0; i < s_iSlaves; ++i)
+	{
+		if (s_apSlaves[i] != this)
+			continue;
+		s_apSlaves[i] = s_apSlaves[--s_iSlaves];
+		break;
+	}
+}
+
+
+void SimSPISlave::resetStatistics()
+{
+	m_iTransactions = m_iBytes = m_iModeErrors = m_iClockErrors = 0;
+}
+
+
+void SimSPISlave::driveOutput(unsigned char pin, bool bLevel)
+{
+	simDrivePin(pin, bLevel);
+}
+
+
+unsigned long simSPIBytes()			{ return s_iSPIBytes; }
+SimCycles simSPIBusyCycles()		{ return s_iSPIBusyCycles; }
+unsigned long simSPIContentions()	{ return s_iSPIContentions; }
+
+
+void simResetStatistics()
+{
+	s_iSPIBytes = 0;
+	s_iSPIBusyCycles = 0;
+	s_iSPIContentions = 0;
+	for (byte i = 0; i < s_iSlaves; ++i)
+		s_apSlaves[i]->resetStatistics();
+}
+
+
+void simDrivePin(unsigned char pin, bool bLevel)
+{
+	if (pin >= SIM_NUM_PINS)
+		return;
+	s_abDriven[pin] = bLevel;
+	updatePin(pin);
+	dispatchInterrupts();
+}
+
+
+bool simPinLevel(unsigned char pin)
+{
+	if (pin >= SIM_NUM_PINS)
+		return false;
+	if (isOutput(pin))
+		return outputLevel(pin);
+	if (pin == MISO)
+	{
+		for (byte i = 0; i < s_iSlaves; ++i)
+		{
+			if (s_apSlaves[i]->selected())
+				return s_apSlaves[i]->misoLevel();
+		}
+		return true;		// nobody drives it
+	}
+	return s_abDriven[pin];
+}
+
+
+void simReset()
+{
+	s_iNow = 0;
+	s_iSPCR = s_iSPSR = s_iSPDRIn = 0;
+	s_bSPIFRead = false;
+	s_iSREG = SREG_I;	// the Arduino core enables interrupts before setup()
+	s_bInISR = false;
+
+	PORTB = PORTC = PORTD = 0;
+	DDRB = DDRC = DDRD = 0;
+	TCCR1A = TCCR1B = TIMSK1 = 0;
+	OCR1A = TCNT1 = 0;
+	s_iTimer1Config = 0;
+	s_iTimer1Next = SIM_NEVER;
+	s_bTimer1Pending = false;
+
+	for (byte i = 0; i < SIM_NUM_PINS; ++i)
+		s_abDriven[i] = s_abLastLevel[i] = false;
+	for (byte i = 0; i < 2; ++i)
+	{
+		s_apfnExtInt[i] = 0;
+		s_abExtIntPending[i] = false;
+	}
+
+	simResetStatistics();
+	simPollChipSelects();
+}
+
+
+static unsigned int s_iChecks = 0;
+static unsigned int s_iCheckFailures = 0;
+
+
+bool simCheck(bool bPassed, const char* szCondition, const char* szFile, int iLine)
+{
+	++s_iChecks;
+	if (!bPassed)
+	{
+		++s_iCheckFailures;
+		printf("%s:%d: check failed: %s\n", szFile, iLine, szCondition);
+	}
+	return bPassed;
+}
+
+
+int simCheckResult()
+{
+	printf("%u checks, %u failed\n", s_iChecks, s_iCheckFailures);
+	return (s_iCheckFailures == 0) ? 0 : 1;
+}
+
+
+// The Arduino core enables interrupts before setup().  Static initialization does the same here.
+static struct SimPowerOn { SimPowerOn() { s_iSREG = SREG_I; } } s_powerOn;
+
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+	if (pin >= SIM_NUM_PINS)
+		return;
+
+	volatile uint8_t* pDDR = (pin < 8) ? &DDRD : (pin < 14) ? &DDRB : &DDRC;
+	if (mode == OUTPUT)
+		*pDDR |= digitalPinToBitMask(pin);
+	else
+		*pDDR &= ~digitalPinToBitMask(pin);
+	updatePin(pin);
+	dispatchInterrupts();
+}
+
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+	volatile uint8_t* pPort = portOfPin(pin);
+	if (!pPort)
+		return;
+
+	if (val == LOW)
+		*pPort &= ~digitalPinToBitMask(pin);
+	else
+		*pPort |= digitalPinToBitMask(pin);
+	simPollChipSelects();
+	updatePin(pin);
+	dispatchInterrupts();
+}
+
+
+int digitalRead(uint8_t pin)
+{
+	simPollChipSelects();
+	simAdvance(SIM_CYCLES_DIGITALREAD);
+	return simPinLevel(pin) ? HIGH : LOW;
+}
+
+
+unsigned long micros()
+{
+	simAdvance(SIM_CYCLES_MICROS);
+	return (unsigned long)(s_iNow / (F_CPU / 1000000UL));
+}
+
+
+unsigned long millis()
+{
+	simAdvance(SIM_CYCLES_MILLIS);
+	return (unsigned long)(s_iNow / (F_CPU / 1000UL));
+}
+
+
+void delay(unsigned long ms)
+{
+	simAdvance((SimCycles)ms * (F_CPU / 1000UL));
+}
+
+
+void delayMicroseconds(unsigned int us)
+{
+	simAdvance((SimCycles)us * (F_CPU / 1000000UL));
+}
+
+
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode)
+{
+	if (interruptNum > 1)
+		return;
+
+	s_apfnExtInt[interruptNum] = userFunc;
+	s_aiExtIntMode[interruptNum] = mode;
+	s_abLastLevel[2 + interruptNum] = simPinLevel(2 + interruptNum);
+}
+
+
+void detachInterrupt(uint8_t interruptNum)
+{
+	if (interruptNum > 1)
+		return;
+
+	s_apfnExtInt[interruptNum] = 0;
+	s_abExtIntPending[interruptNum] = false;
+}
+
+
+void cli()
+{
+	s_iSREG &= ~SREG_I;
+}
+
+
+void sei()
+{
+	s_iSREG |= SREG_I;
+	dispatchInterrupts();
+}
+
+
+size_t Print::write(const char* str)
+{
+	size_t n = 0;
+	while (*str)
+		n += write((uint8_t)*str++);
+	return n;
+}
+
+
+size_t Print::print(long n, int base)
+{
+	if (n < 0 && base == 10)
+		return print('-') + print((unsigned long)-n, base);
+	return print((unsigned long)n, base);
+}
+
+
+size_t Print::print(unsigned long n, int base)
+{
+	char aBuffer[8 * sizeof(long) + 1];
+	char* p = aBuffer + sizeof(aBuffer) - 1;
+	*p = '\0';
+	if (base < 2)
+		base = 10;
+	do
+	{
+		unsigned long digit = n % base;
+		n /= base;
+		*--p = (char)((digit < 10) ? ('0' + digit) : ('A' + digit - 10));
+	} while (n);
+	return write(p);
+}
+
+
+size_t Print::print(double n, int digits)
+{
+	char aBuffer[32];
+	snprintf(aBuffer, sizeof(aBuffer), "%.*f", digits, n);
+	return write(aBuffer);
+}
+
+
+size_t HardwareSerial::write(uint8_t c)
+{
+	return (putchar(c) == EOF) ? 0 : 1;
+}
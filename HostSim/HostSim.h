@@ -0,0 +1,136 @@
+/*
+\file	HostSim.h
+\version	1.0.0
+\purpose	Host (Linux) stand-in for the ATmega328P SPI master, GPIO, Timer1, external interrupts and time, so that the
+			driver sources build and run unmodified on a PC against behavioral models of the external chips.
+\compiler	g++ on Linux
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+/*	How it fits together:
+	HostSim/Arduino.h replaces the Arduino core.  Put HostSim first on the include path, next to the library folders:
+
+		g++ -IHostSim -ISPIExternalDevice -IBMA180 -ICC2500 test.cpp HostSim/HostSim.cpp HostSim/SimBMA180.cpp \
+			HostSim/SimCC2500.cpp SPIExternalDevice/SPIExternalDevice.cpp BMA180/BMA180SPI.cpp CC2500/CC2500.cpp
+
+	SPCR, SPSR, SPDR and SREG are objects with side effects, the PORTx registers are plain bytes.
+	The chip models derive from SimSPISlave and are attached to their CS_n pin.  Writing SPDR exchanges one byte with
+	the slave whose CS_n is low and advances the virtual clock by exactly 8 SCK periods, as set by SPR1:0 and SPI2X.
+	CS_n edges are picked up when the drivers restore SREG after their port write, on digitalWrite() and before every
+	SPDR write.
+
+	Virtual time is counted in CPU cycles at F_CPU.  Only SPI bytes, delay()/delayMicroseconds() and a few core calls
+	(SIM_CYCLES_xxx below) consume time; plain code runs in zero time.  CPU and bus time are serialized: while a byte
+	is on the wire the CPU waits, even in the asynchronous engine.  Model events (e.g. a radio byte arriving, a new
+	accelerometer sample) and Timer1 compare matches happen at their exact cycle, and the interrupts they raise are
+	dispatched there, if SREG.I allows it, in AVR vector priority order.
+
+	Typical test:
+		SimCC2500 radio(10, 2);		// CS_n on pin 10, GDO0 on pin 2 (INT0)
+		CC2500xcvr xcvr(10, SPIExternalDevice::DIV4);
+		SPIExternalDevice::spiMasterInit();
+		...
+		radio.injectPacket(aPayload, sizeof(aPayload));
+		simRunMicros(2000);
+		SIM_CHECK(xcvr.readPacket(...) == CC2500xcvr::PACKET_OK);
+		printf("%lu SPI bytes, %lu us on the bus\n", simSPIBytes(), simCyclesToMicros(simSPIBusyCycles()));
+		return simCheckResult();
+
+	The regression tests are in HostSim/tests, built and run by the CMakeLists.txt at the top of the tree:
+		cmake -S . -B build && cmake --build build && ctest --test-dir build	*/
+
+#ifndef HOSTSIM_H_INCLUDED
+#define HOSTSIM_H_INCLUDED
+
+#include <stdint.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+typedef uint64_t SimCycles;
+
+static const SimCycles SIM_NEVER = ~(SimCycles)0;
+
+// Cost of core calls that the drivers spin on, in CPU cycles.  Roughly what Arduino 1.0.1 takes on a 16 MHz AVR.
+static const unsigned int SIM_CYCLES_DIGITALREAD = 60;
+static const unsigned int SIM_CYCLES_MICROS = 50;
+static const unsigned int SIM_CYCLES_MILLIS = 30;
+
+
+/*	Behavioral model of an SPI slave.  The core calls it on CS_n edges, for every byte, and whenever virtual time moves.	*/
+class SimSPISlave
+{
+public:
+	SimSPISlave(unsigned char pinCS_n, unsigned char iModeMask, unsigned long iMaxClockHz);
+	virtual ~SimSPISlave();
+
+	unsigned char pinCS_n() const	{ return m_pinCS_n; }
+	bool selected() const			{ return m_bSelected; }
+
+	virtual void csChanged(bool bSelected) = 0;		// CS_n fell (true) or rose (false)
+	virtual unsigned char exchange(unsigned char iMOSI) = 0;	// one byte, MSB first.  Returns the MISO byte.
+	virtual bool misoLevel() const	{ return true; }	// MISO while selected and idle (e.g. CC2500 CHIP_RDYn)
+	virtual SimCycles nextEvent() const	{ return SIM_NEVER; }	// cycle of the next internal event
+	virtual void advance(SimCycles iNow)	{ (void)iNow; }	// run internal events up to iNow
+
+	// bus statistics for this slave
+	unsigned long transactions() const	{ return m_iTransactions; }
+	unsigned long bytes() const			{ return m_iBytes; }
+	unsigned long modeErrors() const	{ return m_iModeErrors; }	// bytes clocked in an SPI mode or bit order the chip doesn't support
+	unsigned long clockErrors() const	{ return m_iClockErrors; }	// bytes clocked faster than the chip allows
+	void resetStatistics();
+
+protected:
+	void driveOutput(unsigned char pin, bool bLevel);	// drive a GPIO input of the AVR, e.g. an interrupt line
+
+	// clock limit of the byte in progress, for models with access-dependent limits (e.g. CC2500 burst access)
+	void setMaxClock(unsigned long iMaxClockHz)	{ m_iMaxClockHz = iMaxClockHz; }
+
+private:
+	friend void simPollChipSelects();
+	friend unsigned char simSPIExchange(unsigned char iMOSI, unsigned char iSPCR, unsigned long iClockHz);
+
+	unsigned char	m_pinCS_n;
+	unsigned char	m_iModeMask;		// bit n set: SPI mode n is supported
+	unsigned long	m_iMaxClockHz;
+	bool			m_bSelected;
+
+	unsigned long	m_iTransactions;
+	unsigned long	m_iBytes;
+	unsigned long	m_iModeErrors;
+	unsigned long	m_iClockErrors;
+};
+
+
+// time
+SimCycles simNow();
+void simAdvance(SimCycles iCycles);		// run time forward.  Model events and interrupts happen on the way.
+inline void simRunMicros(unsigned long iMicros)		{ simAdvance((SimCycles)iMicros * (F_CPU / 1000000UL)); }
+inline unsigned long simCyclesToMicros(SimCycles iCycles)	{ return (unsigned long)(iCycles / (F_CPU / 1000000UL)); }
+SimCycles simMicrosToCycles(double fMicros);
+
+// bus statistics, all slaves
+unsigned long simSPIBytes();
+SimCycles simSPIBusyCycles();			// SCK running
+unsigned long simSPIContentions();		// bytes clocked with more than one CS_n low
+void simResetStatistics();
+
+// GPIO
+void simDrivePin(unsigned char pin, bool bLevel);	// a model drives an AVR input.  Edges raise attached interrupts.
+bool simPinLevel(unsigned char pin);
+void simPollChipSelects();
+
+// back to power-on state: registers, pins, interrupts, time.  Attached slaves stay attached.
+void simReset();
+
+// test checks.  A failed check is reported with its file and line and the test goes on.
+// main() ends with  return simCheckResult();  which prints the tally and is 0 when every check passed.
+#define SIM_CHECK(bCondition)	simCheck((bCondition), #bCondition, __FILE__, __LINE__)
+bool simCheck(bool bPassed, const char* szCondition, const char* szFile, int iLine);
+int simCheckResult();
+
+#endif
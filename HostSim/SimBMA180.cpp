@@ -0,0 +1,234 @@
+/*
+\file	SimBMA180.cpp
+\version	1.0.0
+\purpose	Behavioral model of the BMA180 accelerometer on SPI, for HostSim.
+\compiler	g++ on Linux
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+/* References
+[1]  BMA180 datasheet.  Bosch Sensortec BST-BMA180-DS000-07.
+*/
+
+#include "Arduino.h"
+#include "SimBMA180.h"
+
+
+const unsigned char SimBMA180::NO_PIN;
+const unsigned char SimBMA180::CHIP_ID;
+const unsigned char SimBMA180::SOFT_RESET_CODE;
+const unsigned int SimBMA180::RESET_MICROS;
+const unsigned char SimBMA180::IMAGE_SIZE;
+
+
+SimBMA180::SimBMA180(unsigned char pinCS_n, unsigned char pinINT)
+	: SimSPISlave(pinCS_n, _BV(0) | _BV(3), 25000000UL)	// SPI modes 0 and 3, up to 25 MHz.  See 8.4.1 in [1].
+	, m_pinINT(pinINT)
+	, m_pfnSource(0)
+	, m_pSourceContext(0)
+	, m_iSamples(0)
+	, m_iMissedSamples(0)
+	, m_iLockedWrites(0)
+	, m_iAccessesDuringReset(0)
+	, m_iSoftResets(0)
+{
+	memset(m_aEeprom, 0, sizeof(m_aEeprom));
+	m_aEeprom[REG_BW_TCS - REG_IMAGE_FIRST] = 0x40;			// bw = 150 Hz
+	m_aEeprom[REG_OFFSET_LSB1 - REG_IMAGE_FIRST] = 0x04;	// range = +-2 g
+	m_aEeprom[REG_MODE_CONFIG - REG_IMAGE_FIRST] = 0x00;	// low noise mode
+
+	setAcceleration(0, 0, 0);
+	powerOn();
+}
+
+
+void SimBMA180::powerOn()
+{
+	memset(m_aReg, 0, sizeof(m_aReg));
+	m_aReg[REG_CHIP_ID] = CHIP_ID;
+	m_aReg[REG_VERSION] = 0x12;
+	loadImage();
+	memcpy(m_aReg + REG_EEPROM_FIRST, m_aEeprom, IMAGE_SIZE);
+
+	m_bHeader = true;
+	m_bRead = false;
+	m_iAddr = 0;
+	m_bUnread = false;
+	m_bINT = false;
+	m_iResetUntil = 0;
+	m_iNextSample = simNow() + samplePeriod();
+	if (m_pinINT != NO_PIN)
+		driveOutput(m_pinINT, false);
+}
+
+
+void SimBMA180::loadImage()
+{
+	memcpy(m_aReg + REG_IMAGE_FIRST, m_aEeprom, IMAGE_SIZE);
+}
+
+
+void SimBMA180::setAcceleration(int x, int y, int z, signed char temperature)
+{
+	m_sample.x = x;
+	m_sample.y = y;
+	m_sample.z = z;
+	m_sample.temperature = temperature;
+}
+
+
+SimCycles SimBMA180::samplePeriod() const
+// Data rate is twice the filter bandwidth.  See 7.7.1 in [1].
+{
+	static const unsigned int aBandwidthHz[16] = { 10, 20, 40, 75, 150, 300, 600, 1200, 1200, 1200, 1200, 1200, 1200, 1200, 1200, 1200 };
+	unsigned int iBandwidth = aBandwidthHz[m_aReg[REG_BW_TCS] >> 4];
+	return (SimCycles)F_CPU / (2 * iBandwidth);
+}
+
+
+void SimBMA180::advance(SimCycles iNow)
+{
+	while (m_iNextSample <= iNow)
+	{
+		SimCycles iAt = m_iNextSample;
+		m_iNextSample += samplePeriod();	// before the sample: its interrupt runs the ISR, which advances time again
+		newSample(iAt);
+	}
+}
+
+
+static unsigned char clamp14(int v, unsigned char* pMSB)
+// 14-bit two's complement, left-justified in MSB:LSB.  Returns the LSB with new_data set.
+{
+	if (v > 8191)	v = 8191;
+	if (v < -8192)	v = -8192;
+	unsigned int raw = ((unsigned int)v << 2) & 0xFFFC;
+	*pMSB = (unsigned char)(raw >> 8);
+	return (unsigned char)(raw & 0xFC) | 0x01;
+}
+
+
+void SimBMA180::newSample(SimCycles iAt)
+{
+	if (m_pfnSource)
+		m_sample = m_pfnSource(m_pSourceContext, iAt);
+
+	if (m_bUnread)
+		++m_iMissedSamples;
+	++m_iSamples;
+
+	m_aReg[REG_ACC_X_LSB + 0] = clamp14(m_sample.x, &m_aReg[REG_ACC_X_LSB + 1]);
+	m_aReg[REG_ACC_X_LSB + 2] = clamp14(m_sample.y, &m_aReg[REG_ACC_X_LSB + 3]);
+	m_aReg[REG_ACC_X_LSB + 4] = clamp14(m_sample.z, &m_aReg[REG_ACC_X_LSB + 5]);
+	m_aReg[REG_TEMP] = (unsigned char)m_sample.temperature;
+	m_bUnread = true;
+
+	if (m_aReg[REG_CTRL_REG3] & _BV(BIT_NEW_DATA_INT))
+		setInterrupt(true);
+}
+
+
+void SimBMA180::setInterrupt(bool bLevel)
+{
+	if (bLevel == m_bINT)
+		return;
+	m_bINT = bLevel;
+	if (m_pinINT != NO_PIN)
+		driveOutput(m_pinINT, bLevel);
+}
+
+
+void SimBMA180::csChanged(bool bSelected)
+{
+	m_bHeader = true;
+	if (bSelected)
+		memcpy(m_aLatched, m_aReg + REG_ACC_X_LSB, sizeof(m_aLatched));
+}
+
+
+unsigned char SimBMA180::exchange(unsigned char iMOSI)
+{
+	if (simNow() < m_iResetUntil)
+	{
+		++m_iAccessesDuringReset;
+		return 0;
+	}
+
+	if (m_bHeader)
+	{
+		m_bHeader = false;
+		m_bRead = (iMOSI & 0x80) != 0;
+		m_iAddr = iMOSI & 0x7F;
+		return 0xFF;
+	}
+
+	unsigned char iAddr = m_iAddr;
+	m_iAddr = (m_iAddr + 1) & 0x7F;
+
+	if (!m_bRead)
+	{
+		writeRegister(iAddr, iMOSI);
+		return 0xFF;
+	}
+
+	if (iAddr >= REG_ACC_X_LSB && iAddr <= REG_TEMP)
+	{
+		unsigned char iValue = m_aLatched[iAddr - REG_ACC_X_LSB];
+		if (iAddr <= REG_ACC_Z_MSB && ((iAddr - REG_ACC_X_LSB) & 1) == 0)
+		{
+			m_aReg[iAddr] &= ~0x01;		// new_data of this axis
+			m_bUnread = false;
+			setInterrupt(false);
+		}
+		return iValue;
+	}
+	return m_aReg[iAddr];
+}
+
+
+void SimBMA180::writeRegister(unsigned char iAddr, unsigned char iValue)
+{
+	bool bImage = (iAddr >= REG_IMAGE_FIRST && iAddr <= REG_IMAGE_LAST) || iAddr >= REG_EEPROM_FIRST;
+	if (bImage && !(m_aReg[REG_CTRL_REG0] & _BV(BIT_EE_W)))
+	{
+		++m_iLockedWrites;
+		return;
+	}
+
+	switch (iAddr)
+	{
+	case REG_CHIP_ID:
+	case REG_VERSION:
+		return;		// read-only
+
+	case REG_SOFT_RESET:
+		if (iValue == SOFT_RESET_CODE)
+		{
+			++m_iSoftResets;
+			SimCycles iNextSample = m_iNextSample;
+			powerOn();
+			m_iNextSample = iNextSample;
+			m_iResetUntil = simNow() + (SimCycles)RESET_MICROS * (F_CPU / 1000000UL);
+		}
+		return;
+
+	case REG_CTRL_REG0:
+		if (iValue & _BV(BIT_RESET_INT))
+			setInterrupt(false);
+		if (iValue & _BV(BIT_UPDATE_IMAGE))
+			loadImage();
+		m_aReg[REG_CTRL_REG0] = iValue & ~(_BV(BIT_RESET_INT) | _BV(BIT_UPDATE_IMAGE));	// self-clearing
+		return;
+
+	default:
+		if (iAddr >= REG_ACC_X_LSB && iAddr <= REG_TEMP)
+			return;		// read-only
+		m_aReg[iAddr] = iValue;
+		if (iAddr == REG_CTRL_REG3 && !(iValue & _BV(BIT_NEW_DATA_INT)))
+			setInterrupt(false);
+		return;
+	}
+}
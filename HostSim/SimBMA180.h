@@ -0,0 +1,117 @@
+/*
+\file	SimBMA180.h
+\version	1.0.0
+\purpose	Behavioral model of the BMA180 accelerometer on SPI, for HostSim.
+\compiler	g++ on Linux
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+/*	What is modeled:
+	- 128-byte register file.  The first header byte carries R/W# in bit 7, and the address auto-increments for as long
+	  as CS_n stays low, for reads and writes.
+	- Writes to the image block 0x20..0x3B are ignored unless CTRL_REG0.ee_w is set (counted in lockedWrites()).
+	- Soft reset (0xB6 to 0x10) reloads the image from the EEPROM defaults.  Accesses in the next 10 us are counted
+	  in accessesDuringReset() and return 0.
+	- New samples at 2x the bandwidth set in bw_tcs (2400 Hz for the high/band-pass settings), from setAcceleration()
+	  or from a signal callback.  The data registers are latched when CS_n falls, so a burst read is coherent.
+	  Reading an axis LSB clears its new_data flag.
+	- The INT pin goes high on a new sample when CTRL_REG3.new_data_int is set.  It goes low again when the data is
+	  read or CTRL_REG0.reset_int is written.
+	Not modeled: the EEPROM itself (writes to 0x40.. only land in the register file), offsets, the other interrupt
+	sources, the I2C interface.  Image defaults other than bw, range and mode_config are placeholders.	*/
+
+#ifndef SIMBMA180_H_INCLUDED
+#define SIMBMA180_H_INCLUDED
+
+#include "HostSim.h"
+
+
+class SimBMA180 : public SimSPISlave
+{
+public:
+	static const unsigned char NO_PIN = 0xFF;
+
+	struct Sample	// 14-bit signed acceleration, temperature register value
+	{
+		int			x;
+		int			y;
+		int			z;
+		signed char	temperature;
+	};
+	typedef Sample (*SignalSource)(void* pContext, SimCycles iNow);
+
+	SimBMA180(unsigned char pinCS_n, unsigned char pinINT = NO_PIN);
+
+	void setAcceleration(int x, int y, int z, signed char temperature = 0);
+	void setSignalSource(SignalSource pfnSource, void* pContext)	{ m_pfnSource = pfnSource;  m_pSourceContext = pContext; }
+
+	unsigned char reg(unsigned char iAddr) const	{ return m_aReg[iAddr & 0x7F]; }	// back door, no side effects
+	void setReg(unsigned char iAddr, unsigned char iValue)	{ m_aReg[iAddr & 0x7F] = iValue; }
+
+	SimCycles samplePeriod() const;				// in CPU cycles, from bw_tcs
+	unsigned long samples() const				{ return m_iSamples; }
+	unsigned long missedSamples() const			{ return m_iMissedSamples; }	// overwritten before any axis was read
+	unsigned long lockedWrites() const			{ return m_iLockedWrites; }
+	unsigned long accessesDuringReset() const	{ return m_iAccessesDuringReset; }
+	unsigned long softResets() const			{ return m_iSoftResets; }
+
+	static const unsigned char CHIP_ID = 0x03;
+
+	// SimSPISlave
+	virtual void csChanged(bool bSelected);
+	virtual unsigned char exchange(unsigned char iMOSI);
+	virtual SimCycles nextEvent() const		{ return m_iNextSample; }
+	virtual void advance(SimCycles iNow);
+
+private:
+	enum
+	{
+		REG_CHIP_ID = 0x00, REG_VERSION = 0x01, REG_ACC_X_LSB = 0x02, REG_ACC_Z_MSB = 0x07, REG_TEMP = 0x08,
+		REG_CTRL_REG0 = 0x0D, REG_SOFT_RESET = 0x10, REG_BW_TCS = 0x20, REG_CTRL_REG3 = 0x21,
+		REG_MODE_CONFIG = 0x30, REG_OFFSET_LSB1 = 0x35, REG_IMAGE_FIRST = 0x20, REG_IMAGE_LAST = 0x3B,
+		REG_EEPROM_FIRST = 0x40
+	};
+	enum
+	{
+		BIT_EE_W = 4, BIT_UPDATE_IMAGE = 5, BIT_RESET_INT = 6,		// CTRL_REG0
+		BIT_NEW_DATA_INT = 1										// CTRL_REG3
+	};
+	static const unsigned char SOFT_RESET_CODE = 0xB6;
+	static const unsigned int RESET_MICROS = 10;
+	static const unsigned char IMAGE_SIZE = REG_IMAGE_LAST - REG_IMAGE_FIRST + 1;
+
+	void powerOn();
+	void loadImage();
+	void writeRegister(unsigned char iAddr, unsigned char iValue);
+	void newSample(SimCycles iAt);
+	void setInterrupt(bool bLevel);
+
+	unsigned char	m_pinINT;
+	unsigned char	m_aReg[128];
+	unsigned char	m_aEeprom[IMAGE_SIZE];
+	unsigned char	m_aLatched[REG_TEMP - REG_ACC_X_LSB + 1];	// data registers as of CS_n falling
+
+	// access in progress
+	bool			m_bHeader;		// next byte is a header
+	bool			m_bRead;
+	unsigned char	m_iAddr;
+
+	Sample			m_sample;
+	SignalSource	m_pfnSource;
+	void*			m_pSourceContext;
+	SimCycles		m_iNextSample;
+	SimCycles		m_iResetUntil;
+	bool			m_bUnread;		// current sample not read yet
+	bool			m_bINT;
+
+	unsigned long	m_iSamples;
+	unsigned long	m_iMissedSamples;
+	unsigned long	m_iLockedWrites;
+	unsigned long	m_iAccessesDuringReset;
+	unsigned long	m_iSoftResets;
+};
+
+#endif
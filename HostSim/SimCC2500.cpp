@@ -0,0 +1,1012 @@
+/*
+\file	SimCC2500.cpp
+\version	1.0.0
+\purpose	Behavioral model of the CC2500 transceiver on SPI, for HostSim.
+\compiler	g++ on Linux
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+/* References
+[1]	CC2500 datasheet.  Texas Instruments SWRS040C.
+[2]	CC2500 errata.  Texas Instruments SWRZ002.
+*/
+
+#include "Arduino.h"
+#include "SimCC2500.h"
+
+
+const unsigned char SimCC2500::NO_PIN;
+const unsigned char SimCC2500::ANY_CHANNEL;
+const unsigned char SimCC2500::FIFO_SIZE;
+const unsigned char SimCC2500::MAX_AIR_PACKETS;
+
+// register addresses used by the model
+enum
+{
+	REG_IOCFG2 = 0x00, REG_IOCFG0 = 0x02, REG_FIFOTHR = 0x03, REG_PKTLEN = 0x06, REG_PKTCTRL1 = 0x07, REG_PKTCTRL0 = 0x08,
+	REG_CHANNR = 0x0A, REG_FREQ2 = 0x0D, REG_FREQ1 = 0x0E, REG_FREQ0 = 0x0F, REG_MDMCFG4 = 0x10, REG_MDMCFG3 = 0x11,
+	REG_MDMCFG2 = 0x12, REG_MDMCFG1 = 0x13, REG_MDMCFG0 = 0x14, REG_MCSM2 = 0x16, REG_MCSM1 = 0x17, REG_MCSM0 = 0x18,
+	REG_WOREVT1 = 0x1E, REG_WOREVT0 = 0x1F, REG_WORCTRL = 0x20,
+	REG_FSCAL3 = 0x23, REG_FSCAL2 = 0x24, REG_FSCAL1 = 0x25, REG_TEST0 = 0x2E,
+	REG_PARTNUM = 0x30, REG_VERSION = 0x31, REG_LQI = 0x33, REG_RSSI = 0x34, REG_MARCSTATE = 0x35, REG_PKTSTATUS = 0x38,
+	REG_VCO_VC_DAC = 0x39, REG_TXBYTES = 0x3A, REG_RXBYTES = 0x3B, REG_PATABLE = 0x3E, REG_FIFO = 0x3F
+};
+
+enum
+{
+	CMD_SRES = 0x30, CMD_SFSTXON, CMD_SXOFF, CMD_SCAL, CMD_SRX, CMD_STX, CMD_SIDLE, CMD_SRSVD, CMD_SWOR, CMD_SPWD,
+	CMD_SFRX, CMD_SFTX, CMD_SWORRST, CMD_SNOP
+};
+
+// register values after reset, IOCFG2..TEST0.  Table 36 in [1].
+static const unsigned char s_aResetValues[0x2F] =
+{
+	0x29, 0x2E, 0x3F, 0x07, 0xD3, 0x91, 0xFF, 0x04, 0x45, 0x00, 0x00, 0x0F, 0x00, 0x5E, 0xC4, 0xEC,
+	0x8C, 0x22, 0x02, 0x22, 0xF8, 0x47, 0x07, 0x30, 0x04, 0x36, 0x6C, 0x03, 0x40, 0x91, 0x87, 0x6B,
+	0xF8, 0x56, 0x10, 0xA9, 0x0A, 0x20, 0x0D, 0x41, 0x00, 0x59, 0x7F, 0x3F, 0x88, 0x31, 0x0B
+};
+
+// state transition timing, microseconds.  Table 34 in [1], 26 MHz crystal.
+static const double XOSC_START_MICROS = 150.0;
+static const double RESET_MICROS = 41.0;
+static const double CALIBRATE_MICROS = 721.0;
+static const double SETTLE_MICROS = 88.4;
+static const double TURNAROUND_MICROS = 21.5;
+
+static const double FXOSC = 26.0e6;
+
+static const unsigned long MAX_CLOCK_SINGLE = 10000000UL;	// SCLK, single access.  Table 22 in [1].
+static const unsigned long MAX_CLOCK_BURST = 6500000UL;		// SCLK, burst access
+
+
+bool SimCC2500::Fifo::push(unsigned char b)
+{
+	if (iCount == FIFO_SIZE)
+		return false;
+	aData[(iHead + iCount) % FIFO_SIZE] = b;
+	++iCount;
+	return true;
+}
+
+
+unsigned char SimCC2500::Fifo::pop()
+{
+	unsigned char b = aData[iHead];		// empty FIFO returns a stale byte, like the chip
+	if (iCount)
+	{
+		iHead = (iHead + 1) % FIFO_SIZE;
+		--iCount;
+	}
+	return b;
+}
+
+
+SimCC2500::SimCC2500(unsigned char pinCS_n, unsigned char pinGDO0, unsigned char pinGDO2)
+	: SimSPISlave(pinCS_n, _BV(0), MAX_CLOCK_SINGLE)	// SPI mode 0 only
+	, m_pinGDO0(pinGDO0)
+	, m_pinGDO2(pinGDO2)
+	, m_bGDO0(false)
+	, m_bGDO2(false)
+	, m_iLastTxLength(0)
+	, m_pfnTransmitHook(0)
+	, m_pTransmitContext(0)
+	, m_pPeer(0)
+	, m_iPacketsSent(0)
+	, m_iPacketsReceived(0)
+	, m_iPacketsMissed(0)
+	, m_iRxOverflows(0)
+	, m_iTxUnderflows(0)
+	, m_iCalibrations(0)
+	, m_iUncalibratedStarts(0)
+	, m_iAccessesNotReady(0)
+	, m_iRxFifoEmptiedEarly(0)
+	, m_iRxFifoUnderreads(0)
+	, m_iTxFifoOverwrites(0)
+	, m_iIllegalStrobes(0)
+	, m_iTxAirCycles(0)
+	, m_iWorWakeups(0)
+	, m_iWorAwakeCycles(0)
+{
+	for (unsigned int i = 0; i < 256; ++i)
+		m_aChannelRSSI[i] = -56;	// -100 dBm with the 72 dB offset, 0.5 dB steps
+	m_iAirHead = m_iAirCount = 0;
+	powerOn();
+	calibrate();	// so that a profile without autocalibration still works out of the box
+	m_iCalibrations = 0;
+}
+
+
+void SimCC2500::powerOn()
+{
+	resetRegisters();
+	m_eAccess = ACCESS_HEADER;
+	m_bRead = m_bBurst = false;
+	m_iAddr = 0;
+	m_iPendingPowerDown = 0;
+	m_iReadyAt = simNow();
+	m_bReadyPending = false;
+}
+
+
+void SimCC2500::resetRegisters()
+{
+	memcpy(m_aReg, s_aResetValues, sizeof(m_aReg));
+	memset(m_aPATable, 0, sizeof(m_aPATable));
+	m_aPATable[0] = 0xC6;
+	m_iPATableIndex = 0;
+	m_rxFifo.clear();
+	m_txFifo.clear();
+
+	m_iMarc = MARC_IDLE;
+	m_ePhase = PHASE_NONE;
+	m_iPhaseEnd = 0;
+	m_iTarget = MARC_IDLE;
+	m_fSettleMicros = 0;
+	m_iIdleCount = 0;
+
+	m_eWor = WOR_OFF;
+	m_iWorNext = SIM_NEVER;
+	m_iWorEvent0 = 0;
+
+	m_bReceiving = false;
+	m_bUncalibrated = false;
+	m_iRxTotal = m_iRxDone = 0;
+	m_iRxInFifo = 0;
+	m_iRxNext = SIM_NEVER;
+	m_iRSSI = m_aChannelRSSI[0];
+	m_iLQI = 0;
+	m_bCRCOK = false;
+	m_bCRCOKUnread = false;
+
+	m_iTxNext = SIM_NEVER;
+	m_iTxStart = 0;
+	m_iTxDataStart = 0;
+	m_iTxTotal = m_iTxDone = 0;
+	m_bTxEnding = false;
+
+	updateGdo();
+}
+
+
+double SimCC2500::byteMicros() const
+// Data rate R = (256 + DRATE_M) * 2^DRATE_E * fXOSC / 2^28.  See 12 in [1].
+{
+	unsigned int iMantissa = 256 + m_aReg[REG_MDMCFG3];
+	unsigned int iExponent = m_aReg[REG_MDMCFG4] & 0x0F;
+	double fBaud = iMantissa * (double)(1UL << iExponent) * FXOSC / 268435456.0;
+	double fMicros = 8.0e6 / fBaud;
+	if (m_aReg[REG_MDMCFG2] & 0x08)
+		fMicros *= 2;		// Manchester
+	return fMicros;
+}
+
+
+double SimCC2500::preambleSyncMicros() const
+{
+	static const unsigned char aPreamble[8] = { 2, 3, 4, 6, 8, 12, 16, 24 };
+	unsigned char iPreamble = aPreamble[(m_aReg[REG_MDMCFG1] >> 4) & 0x07];
+	unsigned char iSyncMode = m_aReg[REG_MDMCFG2] & 0x07;
+	unsigned char iSync = (iSyncMode == 0 || iSyncMode == 4) ? 0 : (iSyncMode == 3 || iSyncMode == 7) ? 4 : 2;
+	return (iPreamble + iSync) * byteMicros();
+}
+
+
+unsigned char SimCC2500::stateField() const
+{
+	switch (m_iMarc)
+	{
+	case MARC_IDLE:				return 0;
+	case MARC_RX:				return 1;
+	case MARC_TX:				return 2;
+	case MARC_FSTXON:			return 3;
+	case MARC_MANCAL:
+	case MARC_STARTCAL:			return 4;
+	case MARC_RXFIFO_OVERFLOW:	return 6;
+	case MARC_TXFIFO_UNDERFLOW:	return 7;
+	case MARC_FS_LOCK:			return 5;
+	default:					return 0;
+	}
+}
+
+
+unsigned char SimCC2500::statusByte(bool bRead) const
+// See 10.1 in [1]
+{
+	unsigned char iFifo = (bRead) ? m_rxFifo.iCount : (unsigned char)(FIFO_SIZE - m_txFifo.iCount);
+	if (iFifo > 15)
+		iFifo = 15;
+	return ((ready()) ? 0x00 : 0x80) | (stateField() << 4) | iFifo;
+}
+
+
+void SimCC2500::csChanged(bool bSelected)
+{
+	m_eAccess = ACCESS_HEADER;
+	setMaxClock(MAX_CLOCK_SINGLE);
+
+	if (bSelected)
+	{
+		if (m_iMarc == MARC_SLEEP || m_iMarc == MARC_XOFF)
+		{
+			m_eWor = WOR_OFF;
+			m_iWorNext = SIM_NEVER;
+			m_iMarc = MARC_IDLE;		// CS_n low wakes the chip, CHIP_RDYn goes low when the crystal runs
+			m_iReadyAt = simNow() + simMicrosToCycles(XOSC_START_MICROS);
+			m_bReadyPending = true;
+		}
+		return;
+	}
+
+	m_iPATableIndex = 0;
+	if (m_iPendingPowerDown)
+	{
+		unsigned char iCommand = m_iPendingPowerDown;
+		m_iPendingPowerDown = 0;
+		if (m_iMarc == MARC_IDLE)
+		{
+			m_iMarc = (iCommand == CMD_SXOFF) ? MARC_XOFF : MARC_SLEEP;
+			if (m_iMarc == MARC_SLEEP)
+			{
+				memset(m_aPATable + 1, 0, sizeof(m_aPATable) - 1);	// lost in SLEEP
+				m_rxFifo.clear();
+				m_txFifo.clear();
+				if (iCommand == CMD_SWOR && !(m_aReg[REG_WORCTRL] & 0x80))	// RC oscillator on
+				{
+					m_eWor = WOR_SLEEP;
+					m_iWorEvent0 = simNow();
+					m_iWorNext = simNow() + worEvent0Cycles();
+				}
+			}
+		}
+	}
+	updateGdo();
+}
+
+
+unsigned char SimCC2500::exchange(unsigned char iMOSI)
+{
+	if (!ready())
+	{
+		++m_iAccessesNotReady;
+		return statusByte(true);
+	}
+
+	unsigned char iMISO;
+	if (m_eAccess == ACCESS_HEADER)
+	{
+		m_bRead = (iMOSI & 0x80) != 0;
+		m_bBurst = (iMOSI & 0x40) != 0;
+		m_iAddr = iMOSI & 0x3F;
+		iMISO = statusByte(m_bRead);
+
+		if (m_iAddr == REG_FIFO)
+			m_eAccess = ACCESS_FIFO;
+		else if (m_iAddr == REG_PATABLE)
+			m_eAccess = ACCESS_PATABLE;
+		else if (m_iAddr >= 0x30)
+		{
+			if (m_bBurst)
+				m_eAccess = ACCESS_STATUS;
+			else
+				strobe(m_iAddr);	// stays in ACCESS_HEADER
+		}
+		else
+			m_eAccess = ACCESS_REGISTER;
+
+		setMaxClock((m_bBurst && m_eAccess != ACCESS_STATUS) ? MAX_CLOCK_BURST : MAX_CLOCK_SINGLE);
+		updateGdo();
+		return iMISO;
+	}
+
+	switch (m_eAccess)
+	{
+	case ACCESS_REGISTER:
+		if (m_bRead)
+			iMISO = (m_iAddr <= REG_TEST0) ? m_aReg[m_iAddr] : 0;
+		else
+		{
+			iMISO = statusByte(false);
+			writeRegister(m_iAddr, iMOSI);
+		}
+		++m_iAddr;
+		break;
+
+	case ACCESS_STATUS:
+		iMISO = readStatusRegister(m_iAddr);
+		m_bBurst = false;		// status registers are read one at a time
+		break;
+
+	case ACCESS_PATABLE:
+		if (m_bRead)
+			iMISO = m_aPATable[m_iPATableIndex];
+		else
+		{
+			iMISO = statusByte(false);
+			m_aPATable[m_iPATableIndex] = iMOSI;
+		}
+		m_iPATableIndex = (m_iPATableIndex + 1) & 0x07;
+		break;
+
+	case ACCESS_FIFO:
+	default:
+		if (m_bRead)
+		{
+			if (m_rxFifo.iCount == 0)
+				++m_iRxFifoUnderreads;
+			iMISO = m_rxFifo.pop();
+			m_bCRCOKUnread = false;
+			if (m_rxFifo.iCount == 0 && m_bReceiving && m_iRxDone < m_iRxTotal)
+				++m_iRxFifoEmptiedEarly;	// see [2]
+		}
+		else
+		{
+			iMISO = statusByte(false);
+			if (m_iMarc == MARC_TXFIFO_UNDERFLOW || !m_txFifo.push(iMOSI))
+				++m_iTxFifoOverwrites;
+		}
+		break;
+	}
+
+	if (!m_bBurst)
+		m_eAccess = ACCESS_HEADER;
+	updateGdo();
+	return iMISO;
+}
+
+
+void SimCC2500::writeRegister(unsigned char iAddr, unsigned char iValue)
+{
+	if (iAddr > REG_TEST0)
+		return;
+	m_aReg[iAddr] = iValue;
+}
+
+
+unsigned char SimCC2500::readStatusRegister(unsigned char iAddr)
+{
+	switch (iAddr)
+	{
+	case REG_PARTNUM:		return 0x80;
+	case REG_VERSION:		return 0x03;
+	case REG_LQI:			return (m_iLQI & 0x7F) | ((m_bCRCOK) ? 0x80 : 0);
+	case REG_RSSI:
+		if (m_iMarc == MARC_RX)
+			m_iRSSI = (m_bReceiving) ? m_iRSSI : m_aChannelRSSI[m_aReg[REG_CHANNR]];
+		return (unsigned char)m_iRSSI;
+	case REG_MARCSTATE:		return m_iMarc;
+	case REG_PKTSTATUS:
+		return ((m_bCRCOK) ? 0x80 : 0) | ((m_bReceiving) ? 0x48 : 0x10) | ((m_bGDO2) ? 0x04 : 0) | ((m_bGDO0) ? 0x01 : 0);
+	case REG_VCO_VC_DAC:	return 0x94;
+	case REG_TXBYTES:		return m_txFifo.iCount | ((m_iMarc == MARC_TXFIFO_UNDERFLOW) ? 0x80 : 0);
+	case REG_RXBYTES:		return m_rxFifo.iCount | ((m_iMarc == MARC_RXFIFO_OVERFLOW) ? 0x80 : 0);
+	default:				return 0;
+	}
+}
+
+
+void SimCC2500::strobe(unsigned char iCommand)
+// See 10.4 and 19 in [1]
+{
+	bool bActive = (m_iMarc == MARC_RX || m_iMarc == MARC_TX || m_iMarc == MARC_FSTXON);
+
+	switch (iCommand)
+	{
+	case CMD_SRES:
+		resetRegisters();
+		m_iReadyAt = simNow() + simMicrosToCycles(RESET_MICROS);
+		m_bReadyPending = true;
+		break;
+
+	case CMD_SFSTXON:
+		if (m_iMarc == MARC_IDLE)
+			startTransition(MARC_FSTXON, autoCalibrateFromIdle(), SETTLE_MICROS);
+		else if (m_iMarc == MARC_RX)
+			startTransition(MARC_FSTXON, false, TURNAROUND_MICROS);
+		break;
+
+	case CMD_SCAL:
+		if (m_iMarc == MARC_IDLE)
+		{
+			m_iMarc = MARC_MANCAL;
+			m_ePhase = PHASE_CALIBRATE;
+			m_iPhaseEnd = simNow() + simMicrosToCycles(CALIBRATE_MICROS);
+			m_iTarget = MARC_IDLE;
+			m_fSettleMicros = 0;
+		}
+		else
+			++m_iIllegalStrobes;
+		break;
+
+	case CMD_SRX:
+		if (m_iMarc == MARC_IDLE)
+			startTransition(MARC_RX, autoCalibrateFromIdle(), SETTLE_MICROS);
+		else if (m_iMarc == MARC_FSTXON || m_iMarc == MARC_TX)
+			startTransition(MARC_RX, false, TURNAROUND_MICROS);
+		break;
+
+	case CMD_STX:
+		if (m_iMarc == MARC_IDLE)
+			startTransition(MARC_TX, autoCalibrateFromIdle(), SETTLE_MICROS);
+		else if (m_iMarc == MARC_FSTXON)
+			startTransition(MARC_TX, false, TURNAROUND_MICROS);
+		else if (m_iMarc == MARC_RX)
+		{
+			if ((m_aReg[REG_MCSM1] & 0x30) && m_bReceiving)
+				break;		// CCA failed, stay in RX
+			m_bReceiving = false;
+			startTransition(MARC_TX, false, TURNAROUND_MICROS);
+		}
+		break;
+
+	case CMD_SIDLE:
+		if (m_eWor != WOR_OFF)
+			worEnd(simNow());
+		goIdle(bActive);
+		break;
+
+	case CMD_SXOFF:
+	case CMD_SPWD:
+	case CMD_SWOR:
+		m_iPendingPowerDown = iCommand;
+		break;
+
+	case CMD_SFRX:
+		if (m_iMarc == MARC_IDLE || m_iMarc == MARC_RXFIFO_OVERFLOW)
+		{
+			m_rxFifo.clear();
+			m_bCRCOKUnread = false;
+			if (m_iMarc == MARC_RXFIFO_OVERFLOW)
+				m_iMarc = MARC_IDLE;
+		}
+		else
+			++m_iIllegalStrobes;
+		break;
+
+	case CMD_SFTX:
+		if (m_iMarc == MARC_IDLE || m_iMarc == MARC_TXFIFO_UNDERFLOW)
+		{
+			m_txFifo.clear();
+			if (m_iMarc == MARC_TXFIFO_UNDERFLOW)
+				m_iMarc = MARC_IDLE;
+		}
+		else
+			++m_iIllegalStrobes;
+		break;
+
+	case CMD_SWORRST:
+		if (m_eWor == WOR_SLEEP)
+		{
+			m_iWorEvent0 = simNow();
+			m_iWorNext = simNow() + worEvent0Cycles();
+		}
+		break;
+
+	default:	// SNOP, reserved
+		break;
+	}
+}
+
+
+void SimCC2500::startTransition(unsigned char iTarget, bool bCalibrate, double fSettleMicros)
+{
+	m_iTarget = iTarget;
+	m_fSettleMicros = fSettleMicros;
+	m_iRxNext = m_iTxNext = SIM_NEVER;
+	m_bReceiving = false;
+
+	if (bCalibrate)
+	{
+		m_iMarc = MARC_STARTCAL;
+		m_ePhase = PHASE_CALIBRATE;
+		m_iPhaseEnd = simNow() + simMicrosToCycles(CALIBRATE_MICROS);
+	}
+	else
+	{
+		m_iMarc = MARC_FS_LOCK;
+		m_ePhase = PHASE_SETTLE;
+		m_iPhaseEnd = simNow() + simMicrosToCycles(fSettleMicros);
+	}
+}
+
+
+void SimCC2500::goIdle(bool bFromActive)
+// FS_AUTOCAL = 2 calibrates on every RX/TX -> IDLE, 3 on every 4th
+{
+	m_bReceiving = false;
+	m_iRxNext = m_iTxNext = SIM_NEVER;
+	m_ePhase = PHASE_NONE;
+
+	unsigned char iAutoCal = (m_aReg[REG_MCSM0] >> 4) & 0x03;
+	bool bCalibrate = bFromActive && (iAutoCal == 2 || (iAutoCal == 3 && (++m_iIdleCount & 0x03) == 0));
+	if (bCalibrate)
+	{
+		m_iMarc = MARC_STARTCAL;
+		m_ePhase = PHASE_CALIBRATE;
+		m_iPhaseEnd = simNow() + simMicrosToCycles(CALIBRATE_MICROS);
+		m_iTarget = MARC_IDLE;
+		m_fSettleMicros = 0;
+	}
+	else
+		m_iMarc = MARC_IDLE;
+	updateGdo();
+}
+
+
+unsigned char SimCC2500::calibratedFSCAL1() const
+// Stand-in for the VCO capacitor bank setting found by calibration: a function of the synthesizer frequency.  See 21.2 in [1].
+{
+	unsigned long iFreq = ((unsigned long)m_aReg[REG_FREQ2] << 16) | ((unsigned long)m_aReg[REG_FREQ1] << 8) | m_aReg[REG_FREQ0];
+	unsigned int iSpacingM = 256 + m_aReg[REG_MDMCFG0];
+	unsigned int iSpacingE = m_aReg[REG_MDMCFG1] & 0x03;
+	double fHz = FXOSC / 65536.0 * (iFreq + m_aReg[REG_CHANNR] * (iSpacingM * (double)(1UL << iSpacingE)) / 4.0);	// spacing is fXOSC / 2^18 * M * 2^E
+	return (unsigned char)((fHz - 2400.0e6) / 2.0e6) & 0x3F;
+}
+
+
+void SimCC2500::calibrate()
+{
+	++m_iCalibrations;
+	m_aReg[REG_FSCAL3] = (m_aReg[REG_FSCAL3] & 0xCF) | 0x20;
+	m_aReg[REG_FSCAL2] = 0x0A;
+	m_aReg[REG_FSCAL1] = calibratedFSCAL1();
+}
+
+
+void SimCC2500::enterState(unsigned char iTarget)
+{
+	m_ePhase = PHASE_NONE;
+	m_iMarc = iTarget;
+
+	if (iTarget == MARC_RX || iTarget == MARC_TX || iTarget == MARC_FSTXON)
+	{
+		m_bUncalibrated = (m_aReg[REG_FSCAL1] != calibratedFSCAL1());
+		if (m_bUncalibrated && iTarget != MARC_FSTXON)
+			++m_iUncalibratedStarts;
+	}
+
+	if (iTarget == MARC_TX)
+	{
+		m_iTxStart = simNow();
+		m_iTxTotal = m_iTxDone = 0;
+		m_bTxEnding = false;
+		m_iTxDataStart = simNow() + simMicrosToCycles(preambleSyncMicros());
+		m_iTxNext = m_iTxDataStart;
+	}
+	updateGdo();
+}
+
+
+bool SimCC2500::injectPacket(const unsigned char* pPayload, unsigned char iLength, signed char iRSSI, unsigned char iLQI,
+                             bool bCRCOK, unsigned char iChannel)
+{
+	if (m_iAirCount == MAX_AIR_PACKETS)
+		return false;
+
+	// on the air after the previous packet, if there still is one
+	SimCycles iStart = simNow();
+	if (m_iAirCount)
+	{
+		const AirPacket& last = m_aAir[(m_iAirHead + m_iAirCount - 1) % MAX_AIR_PACKETS];
+		SimCycles iLastEnd = last.iSyncEnd + simMicrosToCycles((last.iLength + 1 + crcBytes()) * byteMicros());
+		if (iLastEnd > iStart)
+			iStart = iLastEnd;
+	}
+	if (m_bReceiving && m_iRxNext != SIM_NEVER)
+	{
+		SimCycles iRxEnd = m_iRxNext + simMicrosToCycles((m_iRxTotal - m_iRxDone + crcBytes()) * byteMicros());
+		if (iRxEnd > iStart)
+			iStart = iRxEnd;
+	}
+
+	AirPacket& packet = m_aAir[(m_iAirHead + m_iAirCount) % MAX_AIR_PACKETS];
+	memcpy(packet.aPayload, pPayload, iLength);
+	packet.iLength = iLength;
+	packet.iRSSI = iRSSI;
+	packet.iLQI = iLQI;
+	packet.bCRCOK = bCRCOK;
+	packet.iChannel = iChannel;
+	packet.iSyncEnd = iStart + simMicrosToCycles(preambleSyncMicros());
+	++m_iAirCount;
+	return true;
+}
+
+
+void SimCC2500::startSync(SimCycles iNow)
+// PURPOSE:		Sync word of the oldest air packet has gone by.  Start receiving it if the radio is listening on its channel.
+{
+	AirPacket& packet = m_aAir[m_iAirHead];
+	m_iAirHead = (m_iAirHead + 1) % MAX_AIR_PACKETS;
+	--m_iAirCount;
+
+	bool bListening = (m_iMarc == MARC_RX) && !m_bReceiving && !m_bUncalibrated
+	                  && (packet.iChannel == ANY_CHANNEL || packet.iChannel == m_aReg[REG_CHANNR]);
+	if (!bListening)
+	{
+		++m_iPacketsMissed;
+		return;
+	}
+
+	// the packet as it comes out of the demodulator
+	unsigned short n = 0;
+	if (lengthConfig() == 0)		// fixed length
+	{
+		unsigned char iFixed = m_aReg[REG_PKTLEN];
+		for (unsigned short i = 0; i < iFixed; ++i)
+			m_aRxBytes[n++] = (i < packet.iLength) ? packet.aPayload[i] : 0;
+	}
+	else
+	{
+		m_aRxBytes[n++] = packet.iLength;
+		memcpy(m_aRxBytes + n, packet.aPayload, packet.iLength);
+		n += packet.iLength;
+	}
+
+	m_bReceiving = true;
+	m_iRxTotal = n;
+	m_iRxDone = 0;
+	m_iRxInFifo = 0;
+	m_iRSSI = packet.iRSSI;
+	m_iLQI = packet.iLQI;
+	m_bCRCOK = packet.bCRCOK;
+	m_iRxSyncEnd = iNow;
+	m_iRxNext = iNow + simMicrosToCycles(byteMicros());
+	updateGdo();
+}
+
+
+void SimCC2500::rxByte()
+{
+	if (m_iRxDone < m_iRxTotal)
+	{
+		if (!m_rxFifo.push(m_aRxBytes[m_iRxDone]))
+		{
+			rxOverflow();
+			return;
+		}
+		++m_iRxInFifo;
+		++m_iRxDone;
+
+		if (m_iRxDone == 1 && lengthConfig() == 1 && m_aRxBytes[0] > m_aReg[REG_PKTLEN])
+		{
+			m_rxFifo.dropNewest(m_iRxInFifo);	// longer than PKTLEN: discarded, RX goes on
+			m_bReceiving = false;
+			m_iRxNext = SIM_NEVER;
+			++m_iPacketsMissed;
+			updateGdo();
+			return;
+		}
+	}
+
+	if (m_iRxDone < m_iRxTotal)
+		m_iRxNext = m_iRxSyncEnd + simMicrosToCycles((m_iRxDone + 1) * byteMicros());
+	else if (crcBytes())
+		m_iRxNext = m_iRxSyncEnd + simMicrosToCycles((m_iRxTotal + crcBytes()) * byteMicros());	// end of the CRC
+	else
+		rxEnd();
+	updateGdo();
+}
+
+
+void SimCC2500::rxEnd()
+{
+	m_bReceiving = false;
+	m_iRxNext = SIM_NEVER;
+
+	if (!m_bCRCOK && (m_aReg[REG_PKTCTRL1] & 0x08))
+		m_rxFifo.dropNewest(m_iRxInFifo);	// CRC_AUTOFLUSH
+	else
+	{
+		if (m_aReg[REG_PKTCTRL1] & 0x04)	// APPEND_STATUS
+		{
+			if (!m_rxFifo.push((unsigned char)m_iRSSI) || !m_rxFifo.push((m_iLQI & 0x7F) | ((m_bCRCOK) ? 0x80 : 0)))
+			{
+				rxOverflow();
+				return;
+			}
+		}
+		m_bCRCOKUnread = m_bCRCOK;
+		++m_iPacketsReceived;
+	}
+
+	if (m_eWor != WOR_OFF)
+		worEnd(simNow());
+	offMode((m_aReg[REG_MCSM1] >> 2) & 0x03);
+}
+
+
+void SimCC2500::rxOverflow()
+{
+	++m_iRxOverflows;
+	m_bReceiving = false;
+	m_iRxNext = SIM_NEVER;
+	m_iMarc = MARC_RXFIFO_OVERFLOW;
+	updateGdo();
+}
+
+
+void SimCC2500::txByte()
+// PURPOSE:		Takes the next byte out of the TX FIFO when its slot on the air begins, or ends the packet after the CRC.
+{
+	if (m_bTxEnding)
+	{
+		txEnd();
+		return;
+	}
+
+	if (m_txFifo.iCount == 0 && m_iTxDone == 0)
+	{
+		// empty before the first byte: the modulator goes on sending preamble until something is written
+		m_iTxDataStart += simMicrosToCycles(byteMicros());
+		m_iTxNext = m_iTxDataStart;
+		updateGdo();
+		return;
+	}
+	if (m_txFifo.iCount == 0)
+	{
+		txUnderflow();
+		return;
+	}
+
+	unsigned char b = m_txFifo.pop();
+	if (m_iTxDone < sizeof(m_aTxBytes))
+		m_aTxBytes[m_iTxDone] = b;
+	if (++m_iTxDone == 1)
+		m_iTxTotal = (lengthConfig() == 0) ? m_aReg[REG_PKTLEN] : (lengthConfig() == 1) ? (unsigned short)(b + 1) : 0xFFFF;	// infinite: until the FIFO runs dry
+
+	if (m_iTxDone < m_iTxTotal)
+		m_iTxNext = m_iTxDataStart + simMicrosToCycles(m_iTxDone * byteMicros());
+	else
+	{
+		m_bTxEnding = true;
+		m_iTxNext = m_iTxDataStart + simMicrosToCycles((m_iTxTotal + crcBytes()) * byteMicros());
+	}
+	updateGdo();
+}
+
+
+void SimCC2500::txEnd()
+{
+	m_iTxNext = SIM_NEVER;
+	m_iTxAirCycles += simNow() - m_iTxStart;
+	++m_iPacketsSent;
+
+	const unsigned char* pPayload = m_aTxBytes;
+	unsigned char iLength = (unsigned char)m_iTxTotal;
+	if (lengthConfig() == 1)
+	{
+		++pPayload;
+		iLength = m_aTxBytes[0];
+	}
+	memcpy(m_aLastTx, pPayload, iLength);
+	m_iLastTxLength = iLength;
+
+	if (m_pfnTransmitHook)
+		m_pfnTransmitHook(m_pTransmitContext, m_aLastTx, iLength);
+	if (m_pPeer)
+		m_pPeer->injectPacket(m_aLastTx, iLength, 44, 20, !m_bUncalibrated, m_aReg[REG_CHANNR]);
+
+	offMode(m_aReg[REG_MCSM1] & 0x03);
+}
+
+
+void SimCC2500::txUnderflow()
+{
+	++m_iTxUnderflows;
+	m_iTxNext = SIM_NEVER;
+	m_iTxAirCycles += simNow() - m_iTxStart;
+	m_iMarc = MARC_TXFIFO_UNDERFLOW;
+	updateGdo();
+}
+
+
+void SimCC2500::offMode(unsigned char iOffMode)
+{
+	switch (iOffMode)
+	{
+	case 0:	goIdle(true);										break;
+	case 1:	startTransition(MARC_FSTXON, false, 0);				break;
+	case 2:	startTransition(MARC_TX, false, TURNAROUND_MICROS);	break;
+	case 3:	startTransition(MARC_RX, false, TURNAROUND_MICROS);	break;
+	}
+	updateGdo();
+}
+
+
+SimCycles SimCC2500::nextEvent() const
+{
+	SimCycles iNext = SIM_NEVER;
+	if (m_bReadyPending && m_iReadyAt < iNext)
+		iNext = m_iReadyAt;
+	if (m_ePhase != PHASE_NONE && m_iPhaseEnd < iNext)
+		iNext = m_iPhaseEnd;
+	if (m_iAirCount && !m_bReceiving && m_aAir[m_iAirHead].iSyncEnd < iNext)
+		iNext = m_aAir[m_iAirHead].iSyncEnd;
+	if (m_iRxNext < iNext)
+		iNext = m_iRxNext;
+	if (m_iTxNext < iNext)
+		iNext = m_iTxNext;
+	if (m_iWorNext < iNext)
+		iNext = m_iWorNext;
+	return iNext;
+}
+
+
+void SimCC2500::advance(SimCycles iNow)
+{
+	for (;;)
+	{
+		SimCycles iEvent = nextEvent();
+		if (iEvent > iNow)
+			return;
+
+		if (m_bReadyPending && m_iReadyAt == iEvent)
+		{
+			m_bReadyPending = false;
+			updateGdo();
+		}
+		else if (m_ePhase != PHASE_NONE && m_iPhaseEnd == iEvent)
+		{
+			if (m_ePhase == PHASE_CALIBRATE)
+			{
+				calibrate();
+				if (m_iTarget == MARC_IDLE)
+					enterState(MARC_IDLE);
+				else
+				{
+					m_iMarc = MARC_FS_LOCK;
+					m_ePhase = PHASE_SETTLE;
+					m_iPhaseEnd = iEvent + simMicrosToCycles(m_fSettleMicros);
+				}
+			}
+			else
+				enterState(m_iTarget);
+		}
+		else if (m_iRxNext == iEvent)
+		{
+			if (m_iRxDone == m_iRxTotal)
+				rxEnd();
+			else
+				rxByte();
+		}
+		else if (m_iTxNext == iEvent)
+			txByte();
+		else if (m_iWorNext == iEvent)
+			worEvent(iEvent);
+		else if (m_iAirCount)
+			startSync(iEvent);
+		else
+			return;
+	}
+}
+
+
+SimCycles SimCC2500::worEvent0Cycles() const
+// t_Event0 = 750 / fXOSC * EVENT0 * 2^(5 * WOR_RES).  See 19.5 in [1].
+{
+	unsigned int iEvent0 = ((unsigned int)m_aReg[REG_WOREVT1] << 8) | m_aReg[REG_WOREVT0];
+	unsigned char iWorRes = m_aReg[REG_WORCTRL] & 0x03;
+	return simMicrosToCycles(750.0e6 / FXOSC * iEvent0 * (double)(1UL << (5 * iWorRes)));
+}
+
+
+SimCycles SimCC2500::worEvent1Cycles() const
+{
+	static const unsigned char aPeriods[8] = { 4, 6, 8, 12, 16, 24, 32, 48 };	// WORCTRL.EVENT1, RC oscillator periods
+	return simMicrosToCycles(750.0e6 / FXOSC * aPeriods[(m_aReg[REG_WORCTRL] >> 4) & 0x07]);
+}
+
+
+SimCycles SimCC2500::worRxTimeoutCycles() const
+// EVENT0 * C(RX_TIME, WOR_RES) * 26 / fXOSC[MHz] microseconds, C(0, WOR_RES) = 3.6058, 18.0288, 32.4519, 46.8750,
+// halved for every step of RX_TIME.  MCSM2 in [1].
+{
+	unsigned char iRxTime = m_aReg[REG_MCSM2] & 0x07;
+	if (iRxTime == 7)
+		return SIM_NEVER;
+	unsigned int iEvent0 = ((unsigned int)m_aReg[REG_WOREVT1] << 8) | m_aReg[REG_WOREVT0];
+	unsigned char iWorRes = m_aReg[REG_WORCTRL] & 0x03;
+	return simMicrosToCycles(iEvent0 * (375.0 + 1500.0 * iWorRes) / 104.0 / (1 << iRxTime) * 26.0e6 / FXOSC);
+}
+
+
+void SimCC2500::worEvent(SimCycles iNow)
+{
+	switch (m_eWor)
+	{
+	case WOR_SLEEP:		// Event 0: start the crystal
+		++m_iWorWakeups;
+		m_iWorEvent0 = iNow;
+		m_iMarc = MARC_IDLE;
+		m_eWor = WOR_EVENT1;
+		m_iWorNext = iNow + worEvent1Cycles();
+		break;
+
+	case WOR_EVENT1:	// Event 1: RX
+		startTransition(MARC_RX, autoCalibrateFromIdle(), SETTLE_MICROS);
+		m_eWor = WOR_RX;
+		m_iWorNext = worRxTimeoutCycles();
+		if (m_iWorNext != SIM_NEVER)
+			m_iWorNext += iNow;
+		break;
+
+	case WOR_RX:		// RX timeout
+		if (m_bReceiving)
+		{
+			m_iWorNext = SIM_NEVER;		// sync word found, the packet ends WOR
+			break;
+		}
+		m_iWorAwakeCycles += iNow - m_iWorEvent0;
+		m_ePhase = PHASE_NONE;
+		m_iRxNext = m_iTxNext = SIM_NEVER;
+		m_iMarc = MARC_SLEEP;
+		m_rxFifo.clear();
+		m_txFifo.clear();
+		m_eWor = WOR_SLEEP;
+		m_iWorNext = m_iWorEvent0 + worEvent0Cycles();
+		if (m_iWorNext <= iNow)
+			m_iWorNext = iNow + worEvent0Cycles();
+		break;
+
+	default:
+		m_iWorNext = SIM_NEVER;
+		break;
+	}
+	updateGdo();
+}
+
+
+void SimCC2500::worEnd(SimCycles iNow)
+{
+	if (m_eWor != WOR_SLEEP)
+		m_iWorAwakeCycles += iNow - m_iWorEvent0;
+	m_eWor = WOR_OFF;
+	m_iWorNext = SIM_NEVER;
+}
+
+
+bool SimCC2500::gdoLevel(unsigned char iConfig) const
+// See table 33 in [1]
+{
+	unsigned char iRxThreshold = 4 * ((m_aReg[REG_FIFOTHR] & 0x0F) + 1);
+	unsigned char iTxThreshold = 61 - 4 * (m_aReg[REG_FIFOTHR] & 0x0F);
+	bool bLevel;
+
+	switch (iConfig & 0x3F)
+	{
+	case 0x00:	bLevel = m_rxFifo.iCount >= iRxThreshold;	break;
+	case 0x01:	bLevel = m_rxFifo.iCount >= iRxThreshold || (!m_bReceiving && m_rxFifo.iCount > 0);	break;
+	case 0x02:	bLevel = m_txFifo.iCount >= iTxThreshold;	break;
+	case 0x03:	bLevel = m_txFifo.iCount == FIFO_SIZE;		break;
+	case 0x04:	bLevel = m_iMarc == MARC_RXFIFO_OVERFLOW;	break;
+	case 0x05:	bLevel = m_iMarc == MARC_TXFIFO_UNDERFLOW;	break;
+	case 0x06:	bLevel = m_bReceiving || (m_iMarc == MARC_TX && m_iTxNext != SIM_NEVER
+	                                      && simNow() >= m_iTxDataStart);	break;
+	case 0x07:	bLevel = m_bCRCOKUnread;					break;
+	case 0x29:	bLevel = !ready();							break;
+	default:	bLevel = false;								break;
+	}
+	return (iConfig & 0x40) ? !bLevel : bLevel;
+}
+
+
+void SimCC2500::updateGdo()
+{
+	bool bGDO0 = gdoLevel(m_aReg[REG_IOCFG0]);
+	bool bGDO2 = gdoLevel(m_aReg[REG_IOCFG2]);
+
+	if (bGDO0 != m_bGDO0)
+	{
+		m_bGDO0 = bGDO0;
+		if (m_pinGDO0 != NO_PIN)
+			driveOutput(m_pinGDO0, bGDO0);
+	}
+	if (bGDO2 != m_bGDO2)
+	{
+		m_bGDO2 = bGDO2;
+		if (m_pinGDO2 != NO_PIN)
+			driveOutput(m_pinGDO2, bGDO2);
+	}
+}
@@ -0,0 +1,251 @@
+/*
+\file	SimCC2500.h
+\version	1.0.0
+\purpose	Behavioral model of the CC2500 transceiver on SPI, for HostSim.
+\compiler	g++ on Linux
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+/*	What is modeled:
+	- Header byte decoding: R/W, burst, register / status register / strobe / PATABLE / FIFO access.  Several accesses may
+	  share one CS_n low period.  The chip status byte (CHIP_RDYn, STATE, FIFO_BYTES_AVAILABLE) comes back on every header
+	  byte and on every data byte of a write access.
+	- CHIP_RDYn on MISO after SRES and when waking from SLEEP/XOFF.  Bytes clocked while it's high are counted in
+	  accessesNotReady().  Burst access faster than 6.5 MHz and single access faster than 10 MHz count as clock errors.
+	- The main radio control state machine: IDLE, RX, TX, FSTXON, the calibration and settling transients with their
+	  durations, FS_AUTOCAL, RXOFF_MODE/TXOFF_MODE, CCA on STX in RX, RXFIFO_OVERFLOW, TXFIFO_UNDERFLOW, SLEEP/XOFF.
+	- 64-byte RX and TX FIFOs, filled and drained at the configured data rate, with preamble and sync word air time.
+	  TX with an empty FIFO sends preamble until the first byte is written; running dry later is an underflow.
+	  Variable and fixed packet length, PKTLEN filtering, APPEND_STATUS, CRC_AUTOFLUSH.
+	- GDO0 and GDO2 for IOCFGx settings 0x00-0x07, 0x29 (CHIP_RDYn) and the INV bit.  The rest drive low.
+	- Frequency synthesizer calibration writes FSCAL3/2/1 for the current frequency.  RX or TX entered without calibration
+	  on a frequency that doesn't match FSCAL1 is counted in uncalibratedStarts(), and RX then hears nothing.
+	- RSSI per channel (setChannelRSSI()) and per packet, LQI, PKTSTATUS.
+	- Errata checks: reading the RX FIFO empty while a packet is still arriving is counted in rxFifoEmptiedEarly().
+	- Wake-on-Radio: SWOR with WORCTRL.RC_PD cleared sleeps until Event 0, starts the crystal for the Event 1 time,
+	  enters RX (calibrating per FS_AUTOCAL) and goes back to SLEEP after the MCSM2.RX_TIME timeout unless a sync word
+	  came.  A received packet ends WOR through RXOFF_MODE.  CS_n low or SIDLE ends it too.  The time from Event 0 to the
+	  return to SLEEP (or the end of the packet) is counted in worAwakeCycles().
+	Not modeled: RX_TIME_RSSI/RX_TIME_QUAL, RC oscillator calibration, address filtering, FEC, the CRC itself (the
+	injected packet says whether it's good), analog details.
+
+	Packets to receive are injected with injectPacket().  Their sync word ends after the preamble and sync air time,
+	counted from the later of "now" and the end of the previously injected packet.  If the radio is not in RX on that
+	channel by then, the packet is missed.  Transmitted packets are kept in lastTransmitted(), passed to the transmit
+	hook, and injected into a connected peer (one air time late, since the payload is only known at the end).	*/
+
+#ifndef SIMCC2500_H_INCLUDED
+#define SIMCC2500_H_INCLUDED
+
+#include "HostSim.h"
+
+
+class SimCC2500 : public SimSPISlave
+{
+public:
+	static const unsigned char NO_PIN = 0xFF;
+	static const unsigned char ANY_CHANNEL = 0xFF;
+	static const unsigned char FIFO_SIZE = 64;
+
+	typedef void (*TransmitHook)(void* pContext, const unsigned char* pPayload, unsigned char iLength);
+
+	SimCC2500(unsigned char pinCS_n, unsigned char pinGDO0 = NO_PIN, unsigned char pinGDO2 = NO_PIN);
+
+	// air side
+	bool injectPacket(const unsigned char* pPayload, unsigned char iLength, signed char iRSSI = 44, unsigned char iLQI = 20,
+	                  bool bCRCOK = true, unsigned char iChannel = ANY_CHANNEL);	// iRSSI is the raw register value
+	void setChannelRSSI(unsigned char iChannel, signed char iRSSI)	{ m_aChannelRSSI[iChannel] = iRSSI; }
+	void setTransmitHook(TransmitHook pfnHook, void* pContext)		{ m_pfnTransmitHook = pfnHook;  m_pTransmitContext = pContext; }
+	void connect(SimCC2500* pPeer)	{ m_pPeer = pPeer; }
+	const unsigned char* lastTransmitted(unsigned char& iLength) const	{ iLength = m_iLastTxLength;  return m_aLastTx; }
+
+	// back door, no side effects
+	unsigned char reg(unsigned char iAddr) const	{ return m_aReg[iAddr]; }
+	unsigned char marcState() const		{ return m_iMarc; }
+	unsigned char rxFifoBytes() const	{ return m_rxFifo.iCount; }
+	unsigned char txFifoBytes() const	{ return m_txFifo.iCount; }
+	double byteMicros() const;			// air time of one byte at the configured data rate
+
+	// statistics
+	unsigned long packetsSent() const			{ return m_iPacketsSent; }
+	unsigned long packetsReceived() const		{ return m_iPacketsReceived; }
+	unsigned long packetsMissed() const			{ return m_iPacketsMissed; }		// not in RX, wrong channel or uncalibrated
+	unsigned long rxOverflows() const			{ return m_iRxOverflows; }
+	unsigned long txUnderflows() const			{ return m_iTxUnderflows; }
+	unsigned long calibrations() const			{ return m_iCalibrations; }
+	unsigned long uncalibratedStarts() const	{ return m_iUncalibratedStarts; }
+	unsigned long accessesNotReady() const		{ return m_iAccessesNotReady; }
+	unsigned long rxFifoEmptiedEarly() const	{ return m_iRxFifoEmptiedEarly; }
+	unsigned long rxFifoUnderreads() const		{ return m_iRxFifoUnderreads; }
+	unsigned long txFifoOverwrites() const		{ return m_iTxFifoOverwrites; }	// bytes written to a full TX FIFO
+	unsigned long illegalStrobes() const		{ return m_iIllegalStrobes; }	// SFRX/SFTX/SCAL in the wrong state
+	SimCycles txAirCycles() const				{ return m_iTxAirCycles; }
+	unsigned long worWakeups() const			{ return m_iWorWakeups; }		// Event 0 wake-ups
+	SimCycles worAwakeCycles() const			{ return m_iWorAwakeCycles; }
+
+	// SimSPISlave
+	virtual void csChanged(bool bSelected);
+	virtual unsigned char exchange(unsigned char iMOSI);
+	virtual bool misoLevel() const	{ return !ready(); }
+	virtual SimCycles nextEvent() const;
+	virtual void advance(SimCycles iNow);
+
+private:
+	struct Fifo
+	{
+		unsigned char	aData[FIFO_SIZE];
+		unsigned char	iHead;		// oldest byte
+		unsigned char	iCount;
+
+		void clear()	{ iHead = iCount = 0; }
+		bool push(unsigned char b);
+		unsigned char pop();
+		void dropNewest(unsigned char n)	{ iCount = (n < iCount) ? (iCount - n) : 0; }
+	};
+
+	struct AirPacket
+	{
+		unsigned char	aPayload[256];
+		unsigned char	iLength;
+		signed char		iRSSI;
+		unsigned char	iLQI;
+		bool			bCRCOK;
+		unsigned char	iChannel;
+		SimCycles		iSyncEnd;	// sync word fully received
+	};
+
+	enum Access { ACCESS_HEADER, ACCESS_REGISTER, ACCESS_STATUS, ACCESS_PATABLE, ACCESS_FIFO };
+	enum Phase { PHASE_NONE, PHASE_CALIBRATE, PHASE_SETTLE };
+	enum WorPhase { WOR_OFF, WOR_SLEEP, WOR_EVENT1, WOR_RX };
+
+	static const unsigned char MAX_AIR_PACKETS = 8;
+	static const unsigned char MARC_SLEEP = 0x00, MARC_IDLE = 0x01, MARC_XOFF = 0x02, MARC_MANCAL = 0x05, MARC_STARTCAL = 0x08,
+	                           MARC_FS_LOCK = 0x0A, MARC_RX = 0x0D, MARC_RXFIFO_OVERFLOW = 0x11, MARC_FSTXON = 0x12,
+	                           MARC_TX = 0x13, MARC_TXFIFO_UNDERFLOW = 0x16;
+
+	void powerOn();
+	void resetRegisters();
+	bool ready() const		{ return simNow() >= m_iReadyAt && m_iMarc != MARC_SLEEP && m_iMarc != MARC_XOFF; }
+	unsigned char statusByte(bool bRead) const;
+	unsigned char stateField() const;
+	unsigned char readStatusRegister(unsigned char iAddr);
+	void writeRegister(unsigned char iAddr, unsigned char iValue);
+	void strobe(unsigned char iCommand);
+
+	// state machine
+	void startTransition(unsigned char iTarget, bool bCalibrate, double fSettleMicros);
+	void enterState(unsigned char iTarget);
+	void goIdle(bool bFromActive);
+	bool autoCalibrateFromIdle() const	{ return ((m_aReg[0x18] >> 4) & 0x03) == 1; }	// MCSM0.FS_AUTOCAL
+	void calibrate();
+	unsigned char calibratedFSCAL1() const;
+
+	// packet engine
+	double preambleSyncMicros() const;
+	unsigned char crcBytes() const	{ return (m_aReg[0x08] & 0x04) ? 2 : 0; }	// PKTCTRL0.CRC_EN
+	unsigned char lengthConfig() const	{ return m_aReg[0x08] & 0x03; }
+	void startSync(SimCycles iNow);
+	void rxByte();
+	void rxEnd();
+	void txByte();
+	void txEnd();
+	void offMode(unsigned char iOffMode);	// RXOFF_MODE/TXOFF_MODE: 0 IDLE, 1 FSTXON, 2 TX, 3 RX
+	void rxOverflow();
+	void txUnderflow();
+
+	// Wake-on-Radio
+	SimCycles worEvent0Cycles() const;
+	SimCycles worEvent1Cycles() const;
+	SimCycles worRxTimeoutCycles() const;	// SIM_NEVER for RX_TIME = 7
+	void worEvent(SimCycles iNow);
+	void worEnd(SimCycles iNow);
+
+	bool gdoLevel(unsigned char iConfig) const;
+	void updateGdo();
+
+	unsigned char	m_pinGDO0;
+	unsigned char	m_pinGDO2;
+	bool			m_bGDO0;
+	bool			m_bGDO2;
+
+	unsigned char	m_aReg[0x2F];
+	unsigned char	m_aPATable[8];
+	unsigned char	m_iPATableIndex;
+	Fifo			m_rxFifo;
+	Fifo			m_txFifo;
+	signed char		m_aChannelRSSI[256];
+
+	// SPI access in progress
+	Access			m_eAccess;
+	bool			m_bRead;
+	bool			m_bBurst;
+	unsigned char	m_iAddr;
+	unsigned char	m_iPendingPowerDown;	// SPWD/SWOR/SXOFF, executed when CS_n goes high
+
+	// state machine
+	unsigned char	m_iMarc;
+	SimCycles		m_iReadyAt;
+	bool			m_bReadyPending;	// CHIP_RDYn still has to go low
+	Phase			m_ePhase;
+	SimCycles		m_iPhaseEnd;
+	unsigned char	m_iTarget;
+	double			m_fSettleMicros;
+	unsigned char	m_iIdleCount;		// FS_AUTOCAL = 3 calibrates every 4th time
+
+	// Wake-on-Radio
+	WorPhase		m_eWor;
+	SimCycles		m_iWorNext;			// next Event 0, Event 1 or RX timeout
+	SimCycles		m_iWorEvent0;		// last Event 0
+
+	// receive
+	AirPacket		m_aAir[MAX_AIR_PACKETS];
+	unsigned char	m_iAirHead;
+	unsigned char	m_iAirCount;
+	bool			m_bReceiving;		// between sync word and end of packet
+	bool			m_bUncalibrated;	// in RX/TX on a frequency that wasn't calibrated
+	unsigned char	m_aRxBytes[257];	// bytes of the packet being received, as on the air (without CRC)
+	unsigned short	m_iRxTotal;
+	unsigned short	m_iRxDone;
+	unsigned char	m_iRxInFifo;		// bytes of this packet pushed into the FIFO
+	SimCycles		m_iRxSyncEnd;
+	SimCycles		m_iRxNext;
+	signed char		m_iRSSI;
+	unsigned char	m_iLQI;
+	bool			m_bCRCOK;			// last packet
+	bool			m_bCRCOKUnread;		// IOCFG 0x07: CRC OK packet in the FIFO, first byte not read yet
+
+	// transmit
+	SimCycles		m_iTxNext;
+	SimCycles		m_iTxStart;
+	SimCycles		m_iTxDataStart;		// end of the sync word.  Later than planned if the FIFO was empty.
+	unsigned short	m_iTxTotal;			// bytes of the packet, 0 until the length byte is known
+	unsigned short	m_iTxDone;
+	bool			m_bTxEnding;		// all bytes out, CRC on the air
+	unsigned char	m_aTxBytes[257];
+	unsigned char	m_aLastTx[256];
+	unsigned char	m_iLastTxLength;
+	TransmitHook	m_pfnTransmitHook;
+	void*			m_pTransmitContext;
+	SimCC2500*		m_pPeer;
+
+	unsigned long	m_iPacketsSent;
+	unsigned long	m_iPacketsReceived;
+	unsigned long	m_iPacketsMissed;
+	unsigned long	m_iRxOverflows;
+	unsigned long	m_iTxUnderflows;
+	unsigned long	m_iCalibrations;
+	unsigned long	m_iUncalibratedStarts;
+	unsigned long	m_iAccessesNotReady;
+	unsigned long	m_iRxFifoEmptiedEarly;
+	unsigned long	m_iRxFifoUnderreads;
+	unsigned long	m_iTxFifoOverwrites;
+	unsigned long	m_iIllegalStrobes;
+	SimCycles		m_iTxAirCycles;
+	unsigned long	m_iWorWakeups;
+	SimCycles		m_iWorAwakeCycles;
+};
+
+#endif
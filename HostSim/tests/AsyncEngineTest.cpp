@@ -0,0 +1,251 @@
+/*
+\file	AsyncEngineTest.cpp
+\version	1.0.0
+\purpose	The interrupt-driven asynchronous SPI engine of SPIExternalDevice against the simulated SPI registers:
+			one byte per SPI_STC interrupt, CS_n framing, completion callbacks, queue order and priorities, and
+			where deferred bus requests run.
+\compiler	g++ on Linux, with HostSim
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+#include <SimBMA180.h>
+#include <SPIExternalDevice.h>
+
+
+// a device whose synchronous transactions the test opens itself
+class TestDevice : public SPIExternalDevice
+{
+public:
+	TestDevice(unsigned char pinCS_n) : SPIExternalDevice(pinCS_n, MODE0, DIV4) {}
+	using SPIExternalDevice::spiTransactionBegin;
+	using SPIExternalDevice::spiTransactionEnd;
+	using SPIExternalDevice::spiTransfer;
+};
+
+SimBMA180 g_simAccel(9);
+SimBMA180 g_simOther(8);
+TestDevice g_accel(9);
+TestDevice g_other(8);
+SPIExternalDevice g_nobody(7, SPIExternalDevice::MODE0, SPIExternalDevice::DIV4);	// no slave: MISO floats high
+
+static char g_aOrder[8];
+static unsigned char g_iOrder = 0;
+
+static void recordRequest(void* pContext)
+{
+	if (g_iOrder < sizeof(g_aOrder) - 1)
+		g_aOrder[g_iOrder++] = *(const char*)pContext;
+	g_aOrder[g_iOrder] = '\0';
+}
+
+static void recordCompletion(SPIExternalDevice::AsyncTransaction* pTransaction)
+{
+	recordRequest(pTransaction->pContext);
+}
+
+static void resetOrder()
+{
+	g_iOrder = 0;
+	g_aOrder[0] = '\0';
+}
+
+
+static SPIExternalDevice::AsyncTransaction g_chained;
+static byte g_aChainedTx[2] = { 0x80, 0x00 };		// read CHIP_ID
+static byte g_aChainedRx[2];
+
+static void queueFromCallback(SPIExternalDevice::AsyncTransaction* pTransaction)
+{
+	recordCompletion(pTransaction);
+	g_chained.pContext = (void*)"c";
+	g_accel.spiQueueTransaction(&g_chained, g_aChainedTx, g_aChainedRx, sizeof(g_aChainedTx), recordCompletion);
+}
+
+
+static void testSingle()
+{
+	// CHIP_ID and ACC_X: the register address with the read flag, then dummies
+	byte aTx[3] = { 0x80, 0x00, 0x00 };
+	byte aRx[3];
+	SPIExternalDevice::AsyncTransaction t;
+	t.iStatus = SPIExternalDevice::ASYNC_IDLE;
+	t.pContext = (void*)"a";
+	unsigned long iBytes = simSPIBytes();
+	unsigned long iFrames = g_simAccel.transactions();
+
+	resetOrder();
+	SIM_CHECK(g_accel.spiQueueTransaction(&t, aTx, aRx, sizeof(aTx), recordCompletion));
+	SPIExternalDevice::spiAsyncWait();
+	SIM_CHECK(t.iStatus == SPIExternalDevice::ASYNC_DONE);
+	SIM_CHECK(t.pDevice == &g_accel);
+	SIM_CHECK(aRx[1] == SimBMA180::CHIP_ID);
+	SIM_CHECK(strcmp(g_aOrder, "a") == 0);
+	SIM_CHECK(simSPIBytes() - iBytes == 3);
+	SIM_CHECK(g_simAccel.transactions() - iFrames == 1);		// CS_n low for the whole transaction, once
+	SIM_CHECK(simPinLevel(9));								// and high again
+	SIM_CHECK(!(SPCR & _BV(SPIE)));							// engine idle, interrupt off
+}
+
+
+static void testNullBuffers()
+{
+	SPIExternalDevice::AsyncTransaction t;
+	t.iStatus = SPIExternalDevice::ASYNC_IDLE;
+
+	byte aRx[4] = { 0, 0, 0, 0 };
+	SIM_CHECK(g_nobody.spiQueueTransaction(&t, 0, aRx, sizeof(aRx)));	// ASYNC_DUMMY bytes out
+	SPIExternalDevice::spiAsyncWait();
+	SIM_CHECK(t.iStatus == SPIExternalDevice::ASYNC_DONE);
+	SIM_CHECK(aRx[0] == 0xFF && aRx[3] == 0xFF);
+
+	byte aTx[2] = { 0x80, 0x00 };
+	SIM_CHECK(g_accel.spiQueueTransaction(&t, aTx, 0, sizeof(aTx)));	// received bytes dropped
+	SPIExternalDevice::spiAsyncWait();
+	SIM_CHECK(t.iStatus == SPIExternalDevice::ASYNC_DONE);
+
+	byte aBoth[2] = { 0x80, 0x00 };		// same buffer for both directions
+	SIM_CHECK(g_accel.spiQueueTransaction(&t, aBoth, aBoth, sizeof(aBoth)));
+	SPIExternalDevice::spiAsyncWait();
+	SIM_CHECK(aBoth[1] == SimBMA180::CHIP_ID);
+}
+
+
+static void testRefused()
+{
+	SPIExternalDevice::AsyncTransaction t;
+	t.iStatus = SPIExternalDevice::ASYNC_IDLE;
+	byte aTx[8] = { 0x80 };
+
+	SIM_CHECK(!g_accel.spiQueueTransaction(&t, aTx, 0, 0));
+	g_accel.spiSetMaxLength(4);
+	SIM_CHECK(!g_accel.spiQueueTransaction(&t, aTx, 0, 8));
+	g_accel.spiSetMaxLength(0xFF);
+
+	byte oldSREG = SREG;
+	cli();		// keeps the transaction queued
+	SIM_CHECK(g_accel.spiQueueTransaction(&t, aTx, 0, 8));
+	SIM_CHECK(t.iStatus == SPIExternalDevice::ASYNC_IN_PROGRESS);
+	SIM_CHECK(SPIExternalDevice::spiAsyncBusy());
+	SIM_CHECK(!g_accel.spiQueueTransaction(&t, aTx, 0, 8));	// still in use
+	SREG = oldSREG;
+	SPIExternalDevice::spiAsyncWait();
+	SIM_CHECK(t.iStatus == SPIExternalDevice::ASYNC_DONE);
+}
+
+
+static void testQueueOrder()
+{
+	SPIExternalDevice::AsyncTransaction a, b, c, d;
+	a.iStatus = b.iStatus = c.iStatus = d.iStatus = SPIExternalDevice::ASYNC_IDLE;
+	a.pContext = (void*)"a";
+	b.pContext = (void*)"b";
+	c.pContext = (void*)"c";
+	d.pContext = (void*)"d";
+	byte aTxA[7] = { 0x82 }, aRxA[7];
+	byte aTxB[7] = { 0x82 }, aRxB[7];
+	byte aTxC[2] = { 0x80 }, aRxC[2];
+	byte aTxD[2] = { 0x80 }, aRxD[2];
+	g_simAccel.setAcceleration(100, 200, 300);
+	g_simOther.setAcceleration(-1, -2, -3);
+	delay(10);
+
+	// first come, first served
+	resetOrder();
+	byte oldSREG = SREG;
+	cli();
+	g_accel.spiQueueTransaction(&a, aTxA, aRxA, sizeof(aTxA), recordCompletion);
+	g_other.spiQueueTransaction(&b, aTxB, aRxB, sizeof(aTxB), recordCompletion);
+	g_accel.spiQueueTransaction(&c, aTxC, aRxC, sizeof(aTxC), recordCompletion);
+	SREG = oldSREG;
+	SPIExternalDevice::spiAsyncWait();
+	SIM_CHECK(strcmp(g_aOrder, "abc") == 0);
+	SIM_CHECK((int16_t)((aRxA[2] << 8) | aRxA[1]) >> 2 == 100);
+	SIM_CHECK((int16_t)((aRxB[6] << 8) | aRxB[5]) >> 2 == -3);
+	SIM_CHECK(aRxC[1] == SimBMA180::CHIP_ID);
+	SIM_CHECK(simSPIContentions() == 0);
+
+	// the more urgent device goes ahead of what is queued, not of what is on the wire
+	resetOrder();
+	g_other.spiSetPriority(1);
+	cli();
+	g_accel.spiQueueTransaction(&a, aTxA, aRxA, sizeof(aTxA), recordCompletion);
+	g_accel.spiQueueTransaction(&b, aTxB, aRxB, sizeof(aTxB), recordCompletion);
+	g_other.spiQueueTransaction(&c, aTxC, aRxC, sizeof(aTxC), recordCompletion);
+	g_other.spiQueueTransaction(&d, aTxD, aRxD, sizeof(aTxD), recordCompletion);
+	SREG = oldSREG;
+	SPIExternalDevice::spiAsyncWait();
+	SIM_CHECK(strcmp(g_aOrder, "acdb") == 0);
+	g_other.spiSetPriority(0);
+
+	// a callback may queue the next transaction
+	resetOrder();
+	g_chained.iStatus = SPIExternalDevice::ASYNC_IDLE;
+	g_accel.spiQueueTransaction(&a, aTxA, aRxA, sizeof(aTxA), queueFromCallback);
+	SPIExternalDevice::spiAsyncWait();
+	SIM_CHECK(strcmp(g_aOrder, "ac") == 0);
+	SIM_CHECK(g_aChainedRx[1] == SimBMA180::CHIP_ID);
+}
+
+
+static void testRequests()
+{
+	SPIExternalDevice::BusRequest low, high;
+	byte aTx[2] = { 0x80 };
+	g_other.spiSetPriority(1);
+
+	// posted while a synchronous transaction is open: not run when it ends, but at the next service point
+	resetOrder();
+	g_accel.spiTransactionBegin();
+	g_accel.spiTransfer(0x80);
+	byte oldSREG = SREG;
+	cli();
+	g_accel.spiPostRequest(&low, recordRequest, (void*)"l");
+	g_other.spiPostRequest(&high, recordRequest, (void*)"H");
+	g_accel.spiPostRequest(&low, recordRequest, (void*)"l");		// still pending, not listed twice
+	SREG = oldSREG;
+	g_accel.spiTransactionEnd();
+	SIM_CHECK(g_iOrder == 0);
+	SIM_CHECK(low.bPending && high.bPending);
+	SPIExternalDevice::spiServiceRequests();
+	SIM_CHECK(strcmp(g_aOrder, "Hl") == 0);
+	SIM_CHECK(!low.bPending && !high.bPending);
+	SPIExternalDevice::spiServiceRequests();
+	SIM_CHECK(strcmp(g_aOrder, "Hl") == 0);
+
+	// posted while asynchronous transactions are queued: the SPI interrupt runs them between two transactions
+	SPIExternalDevice::AsyncTransaction a, b;
+	a.iStatus = b.iStatus = SPIExternalDevice::ASYNC_IDLE;
+	a.pContext = (void*)"a";
+	b.pContext = (void*)"b";
+	resetOrder();
+	cli();
+	g_accel.spiQueueTransaction(&a, aTx, 0, sizeof(aTx), recordCompletion);
+	g_accel.spiQueueTransaction(&b, aTx, 0, sizeof(aTx), recordCompletion);
+	g_accel.spiPostRequest(&low, recordRequest, (void*)"l");
+	g_other.spiPostRequest(&high, recordRequest, (void*)"H");
+	SREG = oldSREG;
+	SPIExternalDevice::spiAsyncWait();
+	SIM_CHECK(strcmp(g_aOrder, "aHlb") == 0);
+	g_other.spiSetPriority(0);
+}
+
+
+int main()
+{
+	SPIExternalDevice::spiMasterInit();
+	testSingle();
+	testNullBuffers();
+	testRefused();
+	testQueueOrder();
+	testRequests();
+
+	SIM_CHECK(!SPIExternalDevice::spiAsyncBusy());
+	SIM_CHECK(g_simAccel.modeErrors() == 0 && g_simAccel.clockErrors() == 0);
+	return simCheckResult();
+}
@@ -0,0 +1,189 @@
+/*
+\file	BMA180CodecTest.cpp
+\version	1.0.0
+\purpose	BMA180SampleEncoder and BMA180SampleDecoder round trips: packed and delta coding of smooth and full-range
+			samples, the size of the packets against the payload, timestamps, clamping and lost packets.
+\compiler	g++ on Linux, with HostSim
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <BMA180Codec.h>
+
+
+static const int COUNT = 2000;
+static const unsigned int PERIOD = 833;		// us, 1200 Hz
+static const unsigned long FIRST = 0xFFFF0000UL;	// micros() wraps during the stream
+static BMA180AccelerationXYZ g_aInput[COUNT];
+
+
+// a different sine on each axis plus iNoise of noise, or samples anywhere in the 14-bit range
+static void makeInput(int iAmplitude, int iNoise)
+{
+	unsigned long iSeed = 12345;
+	for (int n = 0; n < COUNT; ++n)
+	{
+		int a[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			iSeed = iSeed * 1103515245UL + 12345UL;
+			int iRandom = (int)((iSeed >> 16) & 0x3FFF) - 8192;
+			if (iAmplitude)
+				a[i] = (int)floor(iAmplitude * sin(2.0 * M_PI * n * (i + 1) / 240.0) + 0.5) + iRandom * iNoise / 8192;
+			else
+				a[i] = iRandom;
+		}
+		g_aInput[n].x = a[0];
+		g_aInput[n].y = a[1];
+		g_aInput[n].z = a[2];
+	}
+}
+
+
+struct RoundTrip
+{
+	unsigned int	iPackets;
+	unsigned long	iBytes;
+	unsigned char	iMaxLength;
+	int				iDecoded;
+	int				iWrong;			// samples, timestamps or headers that don't match the input
+	unsigned long	iLost;
+};
+
+static void check(const BMA180PacketInfo& info, const BMA180AccelerationXYZ* aSamples, unsigned char n, RoundTrip& result)
+{
+	unsigned char i = 0;
+	for ( ; i < n && result.iDecoded < COUNT; ++i, ++result.iDecoded)
+	{
+		const BMA180AccelerationXYZ& in = g_aInput[result.iDecoded];
+		if (aSamples[i].x != in.x || aSamples[i].y != in.y || aSamples[i].z != in.z
+		    || (uint32_t)(info.iFirstMicros + (unsigned long)i * info.iPeriodMicros) != (uint32_t)(FIRST + (unsigned long)result.iDecoded * PERIOD))
+			++result.iWrong;
+	}
+	result.iWrong += n - i;		// more samples than were encoded
+}
+
+// the input through an encoder and a decoder, iChunk samples at a time, as in the usage of BMA180Codec.h
+template<unsigned char SIZE>
+static RoundTrip roundTrip(BMA180SampleEncoder::Coding iCoding, unsigned char iChunk, int iDrop = -1)
+{
+	BMA180SampleEncoderBuffer<SIZE> encoder(3, iCoding);
+	BMA180SampleDecoder decoder;
+	BMA180PacketInfo info;
+	BMA180AccelerationXYZ aSamples[BMA180SampleDecoder::MAX_SAMPLES];
+	RoundTrip result;
+	memset(&result, 0, sizeof(result));
+	encoder.setSamplePeriod(PERIOD);
+
+	int n = 0;
+	bool bEnd = false;
+	while (!bEnd)
+	{
+		if (n < COUNT)
+		{
+			unsigned char iCount = (COUNT - n < iChunk) ? (unsigned char)(COUNT - n) : iChunk;
+			n += encoder.add(g_aInput + n, iCount, FIRST + (unsigned long)n * PERIOD);
+		}
+		else
+			bEnd = !encoder.flush();
+
+		if (encoder.packetReady())
+		{
+			if ((int)result.iPackets != iDrop)
+			{
+				unsigned char iOut = decoder.decode(encoder.packet(), encoder.packetLength(), info, aSamples, sizeof(aSamples) / sizeof(aSamples[0]));
+				if (iOut != info.iCount || info.iStream != 3 || info.iCoding != iCoding)
+					++result.iWrong;
+				check(info, aSamples, iOut, result);
+			}
+			else
+				result.iDecoded += encoder.packet()[9];		// skipped, as if lost on the air
+			++result.iPackets;
+			result.iBytes += encoder.packetLength();
+			if (encoder.packetLength() > result.iMaxLength)
+				result.iMaxLength = encoder.packetLength();
+			encoder.nextPacket();
+		}
+	}
+	SIM_CHECK(encoder.samplesEncoded() == COUNT && encoder.bytesEncoded() == result.iBytes);
+	SIM_CHECK(decoder.badPackets() == 0);
+	result.iLost = decoder.lostPackets();
+	return result;
+}
+
+
+static void testSmooth()
+{
+	// small differences: delta coding carries many more samples per packet
+	makeInput(1000, 16);
+	RoundTrip packed = roundTrip<61>(BMA180SampleEncoder::CODING_PACKED, 13);
+	RoundTrip delta = roundTrip<61>(BMA180SampleEncoder::CODING_DELTA, 13);
+	SIM_CHECK(packed.iDecoded == COUNT && packed.iWrong == 0);
+	SIM_CHECK(delta.iDecoded == COUNT && delta.iWrong == 0);
+	SIM_CHECK(packed.iMaxLength <= 61 && delta.iMaxLength <= 61);
+	SIM_CHECK(delta.iBytes * 5 < packed.iBytes * 3);		// differences of about 8 bits instead of 14-bit values
+	SIM_CHECK(delta.iPackets * 5 < packed.iPackets * 3);
+}
+
+
+static void testFullRange()
+{
+	// differences as wide as the samples: a group is cut to what fits instead of closing the packet early
+	makeInput(0, 0);
+	RoundTrip packed = roundTrip<61>(BMA180SampleEncoder::CODING_PACKED, 255);
+	RoundTrip delta = roundTrip<61>(BMA180SampleEncoder::CODING_DELTA, 255);
+	SIM_CHECK(packed.iDecoded == COUNT && packed.iWrong == 0);
+	SIM_CHECK(delta.iDecoded == COUNT && delta.iWrong == 0);
+	SIM_CHECK(packed.iMaxLength <= 61 && delta.iMaxLength <= 61);
+	SIM_CHECK(packed.iPackets == (COUNT + 8) / 9);			// 9 samples of 42 bits after the header
+	SIM_CHECK(delta.iPackets * 8 <= packed.iPackets * 9);	// 8: the first sample and a group of 7
+	SIM_CHECK(delta.iBytes * 8 <= packed.iBytes * 9);
+
+	// payloads of other sizes, up to the 255 samples a packet counts
+	RoundTrip small = roundTrip<BMA180SampleEncoder::HEADER_SIZE + 6>(BMA180SampleEncoder::CODING_DELTA, 1);
+	SIM_CHECK(small.iDecoded == COUNT && small.iWrong == 0 && small.iPackets == COUNT);
+	makeInput(1, 0);
+	RoundTrip large = roundTrip<255>(BMA180SampleEncoder::CODING_DELTA, 7);
+	SIM_CHECK(large.iDecoded == COUNT && large.iWrong == 0);
+	SIM_CHECK(large.iPackets == (COUNT + 254) / 255);
+}
+
+
+static void testClampAndLoss()
+{
+	makeInput(3000, 40);
+	g_aInput[5].x = 9000;
+	g_aInput[6].y = -20000;
+	RoundTrip lost = roundTrip<61>(BMA180SampleEncoder::CODING_DELTA, 50, 2);
+	SIM_CHECK(lost.iLost == 1);
+	SIM_CHECK(lost.iWrong == 2);		// the clamped samples
+	g_aInput[5].x = 8191;
+	g_aInput[6].y = -8192;
+	lost = roundTrip<61>(BMA180SampleEncoder::CODING_DELTA, 50, 2);
+	SIM_CHECK(lost.iDecoded == COUNT && lost.iWrong == 0 && lost.iLost == 1);
+
+	// malformed
+	BMA180SampleDecoder decoder;
+	BMA180PacketInfo info;
+	BMA180AccelerationXYZ aSamples[4];
+	unsigned char aPacket[16] = { 3, 0x11, 0, 0, 0, 0, 0, 0, 0, 2 };		// two samples, but room for one
+	SIM_CHECK(decoder.decode(aPacket, sizeof(aPacket), info, aSamples, 4) == 0);
+	aPacket[1] = 0x21;		// version 2
+	SIM_CHECK(decoder.decode(aPacket, sizeof(aPacket), info, aSamples, 4) == 0);
+	SIM_CHECK(decoder.badPackets() == 2 && decoder.packets() == 0);
+}
+
+
+int main()
+{
+	testSmooth();
+	testFullRange();
+	testClampAndLoss();
+	return simCheckResult();
+}
@@ -0,0 +1,226 @@
+/*
+\file	BMA180FiltersTest.cpp
+\version	1.0.0
+\purpose	The fixed-point stages of BMA180Filters against double-precision references of the same filters: moving
+			average, low- and high-pass biquads, CIC decimators, window RMS/peak and a chain of stages.
+\compiler	g++ on Linux, with HostSim
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <BMA180Filters.h>
+
+
+static const int COUNT = 240;			// a multiple of every decimation and window below
+static BMA180AccelerationXYZ g_aInput[COUNT];
+static double g_aReference[COUNT][3];
+
+
+// 14-bit samples: a different sine on each axis, plus noise from a fixed LCG, within iAmplitude
+static void makeInput(int iAmplitude)
+{
+	unsigned long iSeed = 12345;
+	for (int n = 0; n < COUNT; ++n)
+	{
+		int a[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			iSeed = iSeed * 1103515245UL + 12345UL;
+			double noise = (double)((iSeed >> 16) & 0x3FF) / 1023.0 - 0.5;
+			a[i] = (int)floor(iAmplitude * (0.8 * sin(2.0 * M_PI * n * (i + 1) / 48.0) + 0.4 * noise) + 0.5);
+		}
+		bma180Pack(a, g_aInput[n]);
+	}
+}
+
+static double input(int n, int i)
+{
+	int a[3];
+	bma180Unpack(g_aInput[n], a);
+	return a[i];
+}
+
+// largest difference between the first iCount outputs and the reference
+static double maxError(const BMA180AccelerationXYZ* pOut, int iCount)
+{
+	double err = 0.0;
+	for (int n = 0; n < iCount; ++n)
+	{
+		int a[3];
+		bma180Unpack(pOut[n], a);
+		for (int i = 0; i < 3; ++i)
+			err = fmax(err, fabs(a[i] - g_aReference[n][i]));
+	}
+	return err;
+}
+
+
+static void testMovingAverage()
+{
+	BMA180MovingAverage<8> average;
+	BMA180AccelerationXYZ aOut[COUNT];
+	makeInput(8000);
+
+	// in blocks of 7, so that blocks don't line up with the window
+	int n = 0;
+	while (n < COUNT)
+	{
+		unsigned char iBlock = (COUNT - n < 7) ? (unsigned char)(COUNT - n) : 7;
+		SIM_CHECK(average.process(g_aInput + n, iBlock, aOut + n) == iBlock);
+		n += iBlock;
+	}
+
+	for (n = 0; n < COUNT; ++n)
+		for (int i = 0; i < 3; ++i)
+		{
+			double sum = 0.0;
+			for (int k = n - 7; k <= n; ++k)
+				sum += (k >= 0) ? input(k, i) : 0.0;		// starts from zero history
+			g_aReference[n][i] = sum / 8.0;
+		}
+	SIM_CHECK(maxError(aOut, COUNT) < 1.0);		// the shift rounds down
+}
+
+
+static void referenceBiquad(double b0, double b1, double b2, double a0, double a1, double a2)
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		double x1 = 0.0, x2 = 0.0, y1 = 0.0, y2 = 0.0;
+		for (int n = 0; n < COUNT; ++n)
+		{
+			double x = input(n, i);
+			double y = (b0 * x + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2) / a0;
+			x2 = x1;	x1 = x;
+			y2 = y1;	y1 = y;
+			g_aReference[n][i] = y;
+		}
+	}
+}
+
+static void testBiquad()
+{
+	BMA180Biquad biquad;
+	BMA180AccelerationXYZ aOut[COUNT];
+	makeInput(4000);
+
+	// the RBJ cookbook low-pass and high-pass, 100 Hz at 1200 Hz, Q = 1/sqrt(2)
+	double w0 = 2.0 * M_PI * 100.0 / 1200.0;
+	double alpha = sin(w0) / (2.0 * 0.7071);
+
+	biquad.designLowPass(100.0f, 1200.0f);
+	SIM_CHECK(biquad.process(g_aInput, COUNT, aOut) == COUNT);
+	referenceBiquad((1.0 - cos(w0)) / 2.0, 1.0 - cos(w0), (1.0 - cos(w0)) / 2.0, 1.0 + alpha, -2.0 * cos(w0), 1.0 - alpha);
+	SIM_CHECK(maxError(aOut, COUNT) <= 4.0);		// Q14 coefficients and the rounding of y, fed back
+
+	biquad.designHighPass(100.0f, 1200.0f);
+	SIM_CHECK(biquad.process(g_aInput, COUNT, aOut) == COUNT);
+	referenceBiquad((1.0 + cos(w0)) / 2.0, -(1.0 + cos(w0)), (1.0 + cos(w0)) / 2.0, 1.0 + alpha, -2.0 * cos(w0), 1.0 - alpha);
+	SIM_CHECK(maxError(aOut, COUNT) <= 4.0);
+
+	// the same buffer in and out
+	BMA180AccelerationXYZ aInPlace[COUNT];
+	memcpy(aInPlace, g_aInput, sizeof(aInPlace));
+	biquad.reset();
+	biquad.process(aInPlace, COUNT, aInPlace);
+	SIM_CHECK(memcmp(aInPlace, aOut, sizeof(aOut)) == 0);
+}
+
+
+// A CIC filter is a cascade of STAGES moving sums of R samples, followed by keeping every R-th sample
+template<unsigned char R, unsigned char STAGES>
+static void testCIC(int iAmplitude)
+{
+	BMA180CICDecimator<R, STAGES> cic;
+	BMA180AccelerationXYZ aOut[COUNT];
+	makeInput(iAmplitude);
+
+	int iOut = 0;
+	for (int n = 0; n < COUNT; n += 5)		// blocks that don't line up with R
+		iOut += cic.process(g_aInput + n, 5, aOut + iOut);
+	SIM_CHECK(iOut == COUNT / R);
+
+	double aStage[COUNT];
+	for (int i = 0; i < 3; ++i)
+	{
+		for (int n = 0; n < COUNT; ++n)
+			aStage[n] = input(n, i);
+		for (int s = 0; s < STAGES; ++s)
+			for (int n = COUNT - 1; n >= 0; --n)
+			{
+				double sum = 0.0;
+				for (int k = n - R + 1; k <= n; ++k)
+					sum += (k >= 0) ? aStage[k] : 0.0;
+				aStage[n] = sum;
+			}
+		for (int m = 0; m < iOut; ++m)
+			g_aReference[m][i] = aStage[(m + 1) * R - 1] / pow((double)R, STAGES);
+	}
+	SIM_CHECK(maxError(aOut, iOut) < 1.0);		// the shift rounds down
+}
+
+
+static void testWindowStats()
+{
+	BMA180WindowStats<32> stats;
+	BMA180WindowStatsResult aResults[COUNT / 32];
+	makeInput(8000);
+
+	unsigned char iResults = stats.process(g_aInput, COUNT, aResults);
+	SIM_CHECK(iResults == COUNT / 32);
+	for (int w = 0; w < iResults; ++w)
+	{
+		int rms[3], peak[3];
+		bma180Unpack(aResults[w].rms, rms);
+		bma180Unpack(aResults[w].peak, peak);
+		for (int i = 0; i < 3; ++i)
+		{
+			double sumSquares = 0.0, maxMagnitude = 0.0;
+			for (int n = w * 32; n < (w + 1) * 32; ++n)
+			{
+				sumSquares += input(n, i) * input(n, i);
+				maxMagnitude = fmax(maxMagnitude, fabs(input(n, i)));
+			}
+			SIM_CHECK(fabs(rms[i] - sqrt(sumSquares / 32.0)) < 1.0);	// the integer root and mean round down
+			SIM_CHECK(peak[i] == maxMagnitude);
+		}
+	}
+}
+
+
+static void testChain()
+{
+	BMA180Biquad lowPass, lowPassAlone;
+	BMA180CICDecimator<4, 2> decimate, decimateAlone;
+	BMA180FilterChain<BMA180Biquad, BMA180CICDecimator<4, 2> > chain(lowPass, decimate);
+	lowPass.designLowPass(100.0f, 1200.0f);
+	lowPassAlone.designLowPass(100.0f, 1200.0f);
+	makeInput(4000);
+
+	BMA180AccelerationXYZ aChained[COUNT], aAlone[COUNT];
+	memcpy(aChained, g_aInput, sizeof(aChained));
+	unsigned char n = chain.process(aChained, COUNT, aChained);
+	lowPassAlone.process(g_aInput, COUNT, aAlone);
+	SIM_CHECK(n == COUNT / 4);
+	SIM_CHECK(decimateAlone.process(aAlone, COUNT, aAlone) == n);
+	SIM_CHECK(memcmp(aChained, aAlone, n * sizeof(BMA180AccelerationXYZ)) == 0);
+}
+
+
+int main()
+{
+	testMovingAverage();
+	testBiquad();
+	testCIC<4, 2>(8000);
+	testCIC<16, 4>(8000);
+	testCIC<64, 3>(8000);
+	testWindowStats();
+	testChain();
+	return simCheckResult();
+}
@@ -0,0 +1,293 @@
+/*
+\file	CC2500StreamingTest.cpp
+\version	1.0.0
+\purpose	Packets longer than the 64-byte FIFOs, up to 255 bytes, through SimCC2500: RX FIFO drain and TX FIFO
+			refill, polled and interrupt-driven, recovery from RX FIFO overflow and TX FIFO underflow, and the
+			longest packets a ring takes.
+\compiler	g++ on Linux, with HostSim
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <SimCC2500.h>
+#include <CC2500.h>
+
+
+SimCC2500 g_simRadio(10, 2, 3);		// GDO0 on pin 2 (INT0), GDO2 on pin 3 (INT1)
+SimCC2500 g_simPeer(8);
+CC2500xcvr g_radio(10, SPIExternalDevice::DIV4);
+CC2500xcvr g_peer(8, SPIExternalDevice::DIV4);
+
+// a pool buffer holds [length][payload][RSSI][LQI] in at most 255 bytes
+PacketPool<3, 255> g_pool;
+SPSCRingBuffer<unsigned char, 4> g_rxHandles;
+SPSCRingBuffer<unsigned char, 4> g_txHandles;
+SPSCRingBuffer<unsigned char, 128> g_ring;
+static const unsigned char MAX_POOL_PAYLOAD = 255 - 1 - 2;
+
+// 250 kbit/s, variable length packets, CRC, appended status, FIFOTHR = 33 bytes in the TX FIFO / 32 in the RX FIFO
+const unsigned char PROGMEM g_aRegs[CC2500_CONFIG_SIZE] = {
+	0x29, 0x2E, 0x06, 0x07, 0xD3, 0x91, 0xFF, 0x04, 0x05, 0x00, 0x00, 0x0A, 0x00, 0x5D, 0x93, 0xB1,
+	0x2D, 0x3B, 0x73, 0x22, 0xF8, 0x01, 0x07, 0x3C, 0x18, 0x1D, 0x1C, 0xC7, 0x00, 0xB0, 0x87, 0x6B,
+	0xF8, 0xB6, 0x10, 0xEA, 0x0A, 0x00, 0x11, 0x41, 0x00, 0x59, 0x7F, 0x3F, 0x88, 0x31, 0x0B };
+const unsigned char PROGMEM g_aPA[] = { 0xFF };
+const CC2500Profile g_profile = { g_aRegs, g_aPA, sizeof(g_aPA) };
+
+static unsigned char g_aPayload[255];
+
+static void fillPayload(unsigned char iSeed)
+{
+	for (int i = 0; i < 255; ++i)
+		g_aPayload[i] = (unsigned char)(iSeed + i * 7);
+}
+
+
+// what g_simRadio put on the air, checked against g_aPayload
+static int g_iAirPackets = 0;
+static int g_iAirBad = 0;
+static unsigned char g_iAirExpected = 0;
+
+static void checkAir(void*, const unsigned char* pPayload, unsigned char iLength)
+{
+	++g_iAirPackets;
+	if (iLength != g_iAirExpected || memcmp(pPayload, g_aPayload, iLength) != 0)
+		++g_iAirBad;
+}
+
+
+static CC2500xcvr::PacketResult receive(unsigned char* pBuffer, unsigned char& length)
+{
+	CC2500RxStatus status;
+	CC2500xcvr::PacketResult result;
+	unsigned long start = millis();
+	do
+	{
+		result = g_radio.receivePacket(pBuffer, 255, length, &status);
+	} while (result == CC2500xcvr::PACKET_NONE && millis() - start < 50);
+	return result;
+}
+
+
+static void testPolled()
+{
+	static const unsigned char aLengths[] = { 65, 128, 200, 255 };
+	unsigned char aBuffer[255], length = 0;
+
+	for (unsigned char k = 0; k < sizeof(aLengths); ++k)
+	{
+		unsigned long iRxOverflows = g_simRadio.rxOverflows();
+		unsigned long iTxUnderflows = g_simPeer.txUnderflows();
+		fillPayload(k);
+		g_radio.startReceive();
+		SIM_CHECK(g_peer.sendPacket(g_aPayload, aLengths[k]) == CC2500xcvr::PACKET_OK);	// TX refill
+		SIM_CHECK(receive(aBuffer, length) == CC2500xcvr::PACKET_OK);						// RX drain
+		SIM_CHECK(length == aLengths[k] && memcmp(aBuffer, g_aPayload, length) == 0);
+		SIM_CHECK(g_simRadio.rxOverflows() == iRxOverflows && g_simPeer.txUnderflows() == iTxUnderflows);
+	}
+	SIM_CHECK(g_simRadio.rxFifoEmptiedEarly() == 0 && g_simRadio.rxFifoUnderreads() == 0);
+	SIM_CHECK(g_simPeer.txFifoOverwrites() == 0 && g_simPeer.accessesNotReady() == 0);
+
+	// nobody drains the RX FIFO while 255 bytes arrive
+	unsigned long iRxOverflows = g_simRadio.rxOverflows();
+	g_radio.startReceive();
+	delay(1);
+	g_simRadio.injectPacket(g_aPayload, 255);
+	delay(15);
+	SIM_CHECK(g_radio.receivePacket(aBuffer, sizeof(aBuffer), length) == CC2500xcvr::PACKET_OVERFLOW);
+	SIM_CHECK(g_simRadio.rxOverflows() == iRxOverflows + 1);
+	SIM_CHECK(g_simRadio.rxFifoBytes() == 0);
+
+	// and the next packet comes through
+	fillPayload(10);
+	g_radio.startReceive();
+	SIM_CHECK(g_peer.sendPacket(g_aPayload, 150) == CC2500xcvr::PACKET_OK);
+	SIM_CHECK(receive(aBuffer, length) == CC2500xcvr::PACKET_OK);
+	SIM_CHECK(length == 150 && memcmp(aBuffer, g_aPayload, length) == 0);
+	g_radio.flushRx();
+}
+
+
+static void testInterruptReceive()
+{
+	PacketPoolBase::Handle h;
+	CC2500RxStatus status;
+
+	g_radio.beginInterruptReceive(g_pool, g_rxHandles, 0, 1);
+	delay(1);		// calibrating on the way into RX
+
+	// the GDO2 threshold interrupt drains the FIFO while the packet arrives
+	fillPayload(20);
+	g_simRadio.injectPacket(g_aPayload, MAX_POOL_PAYLOAD);
+	delay(12);
+	SIM_CHECK(g_radio.takePacket(h, &status) == CC2500xcvr::PACKET_OK);
+	SIM_CHECK(g_pool.length(h) == MAX_POOL_PAYLOAD && memcmp(g_pool.payload(h), g_aPayload, MAX_POOL_PAYLOAD) == 0);
+	SIM_CHECK(status.bCRCOK);
+	g_pool.release(h);
+
+	g_simRadio.injectPacket(g_aPayload, 65);
+	delay(5);
+	SIM_CHECK(g_radio.takePacket(h, &status) == CC2500xcvr::PACKET_OK);
+	SIM_CHECK(g_pool.length(h) == 65 && memcmp(g_pool.payload(h), g_aPayload, 65) == 0);
+	g_pool.release(h);
+	SIM_CHECK(g_radio.rxFifoOverflows() == 0 && g_radio.rxRingOverruns() == 0);
+
+	// interrupts held off while 200 bytes arrive: the FIFO overflows, and is flushed
+	unsigned long iRxOverflows = g_simRadio.rxOverflows();
+	g_simRadio.injectPacket(g_aPayload, 200);
+	byte oldSREG = SREG;
+	cli();
+	delayMicroseconds(5000);
+	SREG = oldSREG;
+	delay(5);
+	SIM_CHECK(g_simRadio.rxOverflows() == iRxOverflows + 1);
+	SIM_CHECK(g_radio.rxFifoOverflows() == 1);
+	SIM_CHECK(g_radio.takePacket(h) == CC2500xcvr::PACKET_NONE);
+
+	// back in RX for the next one
+	fillPayload(30);
+	g_simRadio.injectPacket(g_aPayload, 100);
+	delay(6);
+	SIM_CHECK(g_radio.takePacket(h) == CC2500xcvr::PACKET_OK);
+	SIM_CHECK(g_pool.length(h) == 100 && memcmp(g_pool.payload(h), g_aPayload, 100) == 0);
+	g_pool.release(h);
+
+	g_radio.endInterruptReceive();
+	SIM_CHECK(g_pool.freeCount() == 3);
+}
+
+
+static bool queue(unsigned char iLength)
+{
+	PacketPoolBase::Handle h = g_pool.allocate();
+	if (h == PacketPoolBase::NONE)
+		return false;
+	memcpy(g_pool.payload(h), g_aPayload, iLength);
+	g_pool.setLength(h, iLength);
+	return g_radio.queuePacket(h);
+}
+
+static void waitTransmit()
+{
+	unsigned long start = millis();
+	while (g_radio.transmitBusy() && millis() - start < 100)
+	{
+		g_radio.serviceTransmit();
+		delayMicroseconds(10);
+	}
+}
+
+static void testInterruptTransmit()
+{
+	CC2500TxStats stats;
+	g_simRadio.setTransmitHook(checkAir, 0);
+	g_radio.sendStrobeCommand(CC2500_CMD_SIDLE);
+	g_radio.beginInterruptTransmit(g_pool, g_txHandles, 0, 1);
+
+	// the GDO2 threshold interrupt refills the FIFO while the packet goes out
+	static const unsigned char aLengths[] = { 65, 180, MAX_POOL_PAYLOAD + 1 };
+	for (unsigned char k = 0; k < sizeof(aLengths); ++k)
+	{
+		fillPayload(40 + k);
+		g_iAirExpected = aLengths[k];
+		g_iAirPackets = g_iAirBad = 0;
+		SIM_CHECK(queue(aLengths[k]));
+		waitTransmit();
+		SIM_CHECK(g_iAirPackets == 1 && g_iAirBad == 0);
+	}
+	g_radio.txStats(stats);
+	SIM_CHECK(stats.iPackets == sizeof(aLengths) && stats.iUnderflows == 0 && stats.iDropped == 0);
+	double capacity = stats.iActiveMicros * 1.0e-6 * (256 + 0x3B) * 8192 * 26.0e6 / 268435456.0;	// MDMCFG4/3, 250 kbit/s
+	SIM_CHECK(fabs(stats.iUtilizationPermille - stats.iBytes * 8000.0 / capacity) < 1.0);
+	SIM_CHECK(g_simRadio.txUnderflows() == 0 && g_simRadio.txFifoOverwrites() == 0);
+
+	// interrupts held off while the packet goes out: the FIFO runs dry, the packet is lost
+	fillPayload(50);
+	g_iAirExpected = 200;
+	g_iAirPackets = g_iAirBad = 0;
+	SIM_CHECK(queue(200));
+	delay(1);
+	byte oldSREG = SREG;
+	cli();
+	delayMicroseconds(3000);
+	SREG = oldSREG;
+	waitTransmit();
+	g_radio.txStats(stats);
+	SIM_CHECK(g_simRadio.txUnderflows() == 1);
+	SIM_CHECK(stats.iUnderflows == 1);
+	SIM_CHECK(g_iAirPackets == 0);
+
+	// and the stream recovers
+	g_radio.txStatsReset();
+	fillPayload(60);
+	g_iAirExpected = 120;
+	SIM_CHECK(queue(120));
+	waitTransmit();
+	g_radio.txStats(stats);
+	SIM_CHECK(g_iAirPackets == 1 && g_iAirBad == 0);
+	SIM_CHECK(stats.iPackets == 1 && stats.iUnderflows == 0);
+
+	g_radio.endInterruptTransmit();
+	g_simRadio.setTransmitHook(0, 0);
+	SIM_CHECK(g_pool.freeCount() == 3);
+}
+
+
+// records must fit in a ring as a whole
+static void testRingLimits()
+{
+	unsigned char aBuffer[255], length = 0;
+
+	g_radio.beginInterruptReceive(g_ring, 0, 1);
+	delay(1);
+	fillPayload(70);
+	g_simRadio.injectPacket(g_aPayload, 126);
+	delay(6);
+	SIM_CHECK(g_radio.readPacket(aBuffer, sizeof(aBuffer), length) == CC2500xcvr::PACKET_NONE);
+	SIM_CHECK(g_radio.rxRingOverruns() == 1);
+	g_simRadio.injectPacket(g_aPayload, 125);
+	delay(6);
+	SIM_CHECK(g_radio.readPacket(aBuffer, sizeof(aBuffer), length) == CC2500xcvr::PACKET_OK);
+	SIM_CHECK(length == 125 && memcmp(aBuffer, g_aPayload, length) == 0);
+	g_radio.endInterruptReceive();
+
+	g_simRadio.setTransmitHook(checkAir, 0);
+	g_radio.sendStrobeCommand(CC2500_CMD_SIDLE);
+	g_radio.beginInterruptTransmit(g_ring, 0, 1);
+	SIM_CHECK(!g_radio.queuePacket(g_aPayload, 128));
+	SIM_CHECK(!g_radio.transmitBusy());
+	g_iAirExpected = 127;
+	g_iAirPackets = g_iAirBad = 0;
+	SIM_CHECK(g_radio.queuePacket(g_aPayload, 127));
+	waitTransmit();
+	SIM_CHECK(g_iAirPackets == 1 && g_iAirBad == 0);
+	g_radio.endInterruptTransmit();
+	g_simRadio.setTransmitHook(0, 0);
+}
+
+
+int main()
+{
+	SPIExternalDevice::spiMasterInit();
+	g_radio.reset();
+	g_peer.reset();
+	SIM_CHECK(g_radio.configure(g_profile));
+	SIM_CHECK(g_peer.configure(g_profile));
+	g_simPeer.connect(&g_simRadio);
+
+	testPolled();
+	testInterruptReceive();
+	testInterruptTransmit();
+	testRingLimits();
+
+	SIM_CHECK(g_simRadio.modeErrors() == 0 && g_simPeer.modeErrors() == 0);
+	SIM_CHECK(g_simRadio.clockErrors() == 0 && g_simPeer.clockErrors() == 0);
+	SIM_CHECK(g_simRadio.accessesNotReady() == 0);
+	SIM_CHECK(simSPIContentions() == 0);
+	return simCheckResult();
+}
@@ -0,0 +1,177 @@
+/*
+\file	DriversTest.cpp
+\version	1.0.0
+\purpose	The unmodified BMA180 and CC2500 drivers against SimBMA180 and SimCC2500: chip access, bursts, interrupt-paced
+			and Timer1-paced acquisition, a 200-byte packet between two radios and interrupt-driven receive.
+\compiler	g++ on Linux, with HostSim
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+#include <SimBMA180.h>
+#include <SimCC2500.h>
+#include <BMA180SPI.h>
+#include <BMA180Acquisition.h>
+#include <BMA180Timer1.h>
+#include <CC2500.h>
+
+
+SimBMA180 g_simAccel(9, 3);		// INT on pin 3 (INT1)
+SimCC2500 g_simRadio(10, 2);	// GDO0 on pin 2 (INT0)
+SimCC2500 g_simPeer(8);
+BMA180AccelerometerSPI g_accel(9, SPIExternalDevice::DIV4);
+CC2500xcvr g_radio(10, SPIExternalDevice::DIV4);
+CC2500xcvr g_peer(8, SPIExternalDevice::DIV4);
+
+// the main loop's transactions on another device, that acquisition has to wait for
+class TestDevice : public SPIExternalDevice
+{
+public:
+	TestDevice(unsigned char pinCS_n) : SPIExternalDevice(pinCS_n, MODE0, DIV4) {}
+	using SPIExternalDevice::spiTransactionBegin;
+	using SPIExternalDevice::spiTransactionEnd;
+};
+
+TestDevice g_other(7);
+
+// 250 kbit/s, variable length packets, CRC, appended status, GDO0 = sync word/end of packet
+const unsigned char PROGMEM g_aRegs[CC2500_CONFIG_SIZE] = {
+	0x29, 0x2E, 0x06, 0x07, 0xD3, 0x91, 0xFF, 0x04, 0x05, 0x00, 0x00, 0x0A, 0x00, 0x5D, 0x93, 0xB1,
+	0x2D, 0x3B, 0x73, 0x22, 0xF8, 0x01, 0x07, 0x3C, 0x18, 0x1D, 0x1C, 0xC7, 0x00, 0xB0, 0x87, 0x6B,
+	0xF8, 0xB6, 0x10, 0xEA, 0x0A, 0x00, 0x11, 0x41, 0x00, 0x59, 0x7F, 0x3F, 0x88, 0x31, 0x0B };
+const unsigned char PROGMEM g_aPA[] = { 0xFF };
+const CC2500Profile g_profile = { g_aRegs, g_aPA, sizeof(g_aPA) };
+
+
+static void testAccelerometer()
+{
+	SIM_CHECK(g_accel.readByte(BMA180AccelerometerSPI::REG_CHIP_MODEL_ID) == BMA180AccelerometerSPI::CHIP_MODEL_ID);
+	g_accel.softReset();
+	SIM_CHECK(g_simAccel.accessesDuringReset() == 0);
+
+	g_simAccel.setAcceleration(100, -200, 8000, 25);
+	delay(20);
+	BMA180AccelerationXYZT a = g_accel.readAccelerationXYZT();
+	SIM_CHECK(a.x == 100 && a.y == -200 && a.z == 8000 && a.temperature == 25);
+
+	g_accel.enableNewDataInterrupt(true);
+	SIM_CHECK(g_simAccel.lockedWrites() == 0);
+
+	SPSCRingBuffer<BMA180Sample, 32> ring;
+	BMA180AcquisitionT<BMA180AccelerometerSPI> acq(g_accel, ring);
+	unsigned long iMissed = g_simAccel.missedSamples();		// nobody read them while the test waited
+	acq.beginDataReadyInterrupt(1);
+	delay(10);
+	BMA180Sample aSamples[32];
+	unsigned char n = acq.read(aSamples, 32);
+	acq.end();
+	SIM_CHECK(n == 3);		// 300 Hz at the default bandwidth
+	SIM_CHECK(g_simAccel.missedSamples() == iMissed);
+	SIM_CHECK(acq.overruns() == 0);
+	for (unsigned char i = 1; i < n; ++i)
+		SIM_CHECK(aSamples[i].iMicros > aSamples[i - 1].iMicros && aSamples[i].accel.z == 8000);
+
+	// paced by Timer1 instead
+	SIM_CHECK(acq.beginTimer(1000));
+	delay(10);
+	n = acq.read(aSamples, 32);
+	acq.end();
+	SIM_CHECK(n >= 9 && n <= 10);
+	SIM_CHECK(!(TIMSK1 & _BV(OCIE1A)));
+	for (unsigned char i = 1; i < n; ++i)
+		SIM_CHECK(aSamples[i].iMicros - aSamples[i - 1].iMicros >= 990 && aSamples[i].iMicros - aSamples[i - 1].iMicros <= 1010);
+
+	// deferred by a transaction of the main loop: stamped when the interrupt came, not when the sample was read
+	SIM_CHECK(acq.beginTimer(1000));
+	delay(3);
+	SIM_CHECK(acq.read(aSamples, 32) >= 2);
+	while (acq.available() == 0)
+		delayMicroseconds(10);
+	acq.read(aSamples, 1);
+	unsigned long iTick = aSamples[0].iMicros;	// the next tick is 1000 us away
+	g_other.spiTransactionBegin();
+	while ((long)(micros() - iTick) < 1500) {;}
+	g_other.spiTransactionEnd();
+	SIM_CHECK(acq.available() == 0 && acq.deferrals() == 0);
+	acq.service();
+	SIM_CHECK(acq.read(aSamples, 32) == 1);
+	SIM_CHECK(acq.deferrals() == 1 && acq.missed() == 0);
+	SIM_CHECK(aSamples[0].iMicros - iTick >= 990 && aSamples[0].iMicros - iTick <= 1010);
+
+	// two ticks during one transaction: one sample, with the later time, and one missed
+	g_other.spiTransactionBegin();
+	while ((long)(micros() - iTick) < 3500) {;}
+	g_other.spiTransactionEnd();
+	acq.service();
+	SIM_CHECK(acq.read(aSamples, 32) == 1);
+	SIM_CHECK(acq.deferrals() == 2 && acq.missed() == 1);
+	SIM_CHECK(aSamples[0].iMicros - iTick >= 2990 && aSamples[0].iMicros - iTick <= 3010);
+	acq.end();
+	SIM_CHECK(acq.overruns() == 0);
+}
+
+
+static void testRadio()
+{
+	g_radio.reset();
+	g_peer.reset();
+	SIM_CHECK(g_radio.configure(g_profile));
+	SIM_CHECK(g_peer.configure(g_profile));
+	g_simPeer.connect(&g_simRadio);
+
+	unsigned char aPayload[200];
+	for (int i = 0; i < 200; ++i)
+		aPayload[i] = (unsigned char)i;
+
+	// longer than the FIFOs: streamed on both sides
+	g_radio.startReceive();
+	SIM_CHECK(g_peer.sendPacket(aPayload, 200) == CC2500xcvr::PACKET_OK);
+	SIM_CHECK(g_simPeer.txUnderflows() == 0 && g_simPeer.accessesNotReady() == 0);
+
+	unsigned char aBuffer[255], length = 0;
+	CC2500RxStatus status;
+	int result;
+	unsigned long start = millis();
+	do
+	{
+		result = g_radio.receivePacket(aBuffer, sizeof(aBuffer), length, &status);
+	} while (result == CC2500xcvr::PACKET_NONE && millis() - start < 50);
+	SIM_CHECK(result == CC2500xcvr::PACKET_OK);
+	SIM_CHECK(length == 200 && memcmp(aBuffer, aPayload, 200) == 0);
+	SIM_CHECK(status.bCRCOK);
+	SIM_CHECK(g_simRadio.rxOverflows() == 0 && g_simRadio.packetsMissed() == 0);
+
+	// interrupt-driven receive
+	SPSCRingBuffer<unsigned char, 128> ring;
+	g_radio.beginInterruptReceive(ring, 0);
+	delay(1);		// calibrating on the way into RX
+	for (int k = 0; k < 3; ++k)
+		g_simRadio.injectPacket(aPayload + k, 30);
+	delay(20);
+	int iPackets = 0;
+	while ((result = g_radio.readPacket(aBuffer, sizeof(aBuffer), length, &status)) != CC2500xcvr::PACKET_NONE)
+	{
+		SIM_CHECK(result == CC2500xcvr::PACKET_OK && length == 30 && aBuffer[0] == iPackets);
+		++iPackets;
+	}
+	g_radio.endInterruptReceive();
+	SIM_CHECK(iPackets == 3);
+}
+
+
+int main()
+{
+	SPIExternalDevice::spiMasterInit();
+	testAccelerometer();
+	testRadio();
+
+	SIM_CHECK(g_simRadio.modeErrors() == 0 && g_simPeer.modeErrors() == 0 && g_simAccel.modeErrors() == 0);
+	SIM_CHECK(g_simRadio.clockErrors() == 0 && g_simPeer.clockErrors() == 0 && g_simAccel.clockErrors() == 0);
+	SIM_CHECK(simSPIContentions() == 0);
+	return simCheckResult();
+}
@@ -0,0 +1,150 @@
+/*
+\file	Arduino.h
+\version	1.0.0
+\purpose	Arduino 1.0.1 core subset for Linux boards (gateways), so that the libraries in this repository run on a
+			Linux SBC with the SPI bus on /dev/spidevX.Y and the other pins on sysfs GPIO.
+\compiler	g++ on Linux
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+/*	How it fits together:
+	Put LinuxCore first on the include path, next to the library folders:
+
+		g++ -ILinuxCore -ISPIExternalDevice -IBMA180 -ICC2500 gateway.cpp LinuxCore/LinuxCore.cpp \
+			SPIExternalDevice/SPIExternalDevice.cpp SPIExternalDevice/SPIExternalDeviceSpidev.cpp \
+			BMA180/BMA180SPI.cpp CC2500/CC2500.cpp -lpthread
+
+	This core defines SPIDEVICE_SPIDEV, which switches SPIExternalDevice to its spidev backend (SPIExternalDeviceSpidev.h).
+	The drivers are the same sources as on the AVR.
+
+	Pins are Linux GPIO numbers, offset by linuxSetGpioBase() (e.g. 512 on recent Raspberry Pi kernels), and go through
+	/sys/class/gpio.  Interrupt numbers for attachInterrupt() are pin numbers too.  Each attached interrupt gets a thread
+	that waits for the edge with poll().
+
+	"Interrupts disabled" is a process-wide lock.  cli() takes it, sei() releases it, and SREG saves and restores it,
+	so the  byte oldSREG = SREG;  cli();  ...  SREG = oldSREG;  sections of the drivers exclude the interrupt threads
+	as they exclude ISRs on the AVR.  An interrupt handler runs with the lock held.
+
+	Not available: the AVR registers (SPCR/SPSR/SPDR, PORTx, Timer1), so the BMA180Timer1 library isn't built
+	here.  BMA180AcquisitionT with the data ready interrupt works.	*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define SPIDEVICE_SPIDEV 1		// SPIExternalDevice runs over /dev/spidevX.Y
+
+#ifndef F_CPU
+#define F_CPU 16000000UL		// reference clock for the SPI clock dividers: DIV2 is 8 MHz, DIV4 is 4 MHz, ...
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef unsigned int word;
+
+#define HIGH	0x1
+#define LOW		0x0
+
+#define INPUT			0x0
+#define OUTPUT			0x1
+#define INPUT_PULLUP	0x2
+
+#define LSBFIRST	0
+#define MSBFIRST	1
+
+#define CHANGE	1
+#define FALLING	2
+#define RISING	3
+
+#ifndef M_PI
+#define M_PI	3.1415926535897932384626433832795
+#endif
+
+#define min(a,b)			((a)<(b)?(a):(b))
+#define max(a,b)			((a)>(b)?(a):(b))
+#define constrain(amt,low,high)	((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+#define lowByte(w)			((uint8_t) ((w) & 0xff))
+#define highByte(w)			((uint8_t) ((w) >> 8))
+#define bitRead(value, bit)	(((value) >> (bit)) & 0x01)
+#define _BV(bit)			(1 << (bit))
+
+
+void linuxSetGpioBase(unsigned int iBase);	// GPIO number of pin 0.  0 by default.
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode);	// interruptNum is a pin number
+void detachInterrupt(uint8_t interruptNum);
+
+
+/*	SREG stand-in.  Only the I bit means anything: set when this thread doesn't hold the interrupt lock.	*/
+class InterruptFlag
+{
+public:
+	operator uint8_t() const;
+	InterruptFlag& operator=(uint8_t iValue);
+};
+
+extern InterruptFlag SREG;
+
+void cli();
+void sei();
+#define interrupts()	sei()
+#define noInterrupts()	cli()
+
+// flash is ordinary memory on Linux
+#define PROGMEM
+#define PSTR(s)					(s)
+#define F(s)					(s)
+#define pgm_read_byte(addr)		(*(const uint8_t*)(addr))
+#define pgm_read_word(addr)		(*(const uint16_t*)(addr))
+#define memcpy_P				memcpy
+
+
+class Print
+{
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t c) = 0;
+
+	size_t write(const char* str);
+	size_t print(const char* str)					{ return write(str); }
+	size_t print(char c)							{ return write((uint8_t)c); }
+	size_t print(unsigned char n, int base = 10)	{ return print((unsigned long)n, base); }
+	size_t print(int n, int base = 10)				{ return print((long)n, base); }
+	size_t print(unsigned int n, int base = 10)		{ return print((unsigned long)n, base); }
+	size_t print(long n, int base = 10);
+	size_t print(unsigned long n, int base = 10);
+	size_t print(double n, int digits = 2);
+	size_t println()								{ return write("\r\n"); }
+	template<class T> size_t println(T value)				{ size_t n = print(value);  return n + println(); }
+	template<class T> size_t println(T value, int format)	{ size_t n = print(value, format);  return n + println(); }
+};
+
+
+class HardwareSerial : public Print		// stdout
+{
+public:
+	void begin(unsigned long baud)	{ (void)baud; }
+	virtual size_t write(uint8_t c);
+	using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,362 @@
+/*
+\file	LinuxCore.cpp
+\version	1.0.0
+\purpose	Arduino 1.0.1 core subset for Linux boards.  See Arduino.h in this folder.
+\compiler	g++ on Linux
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+#include "Arduino.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+
+
+InterruptFlag SREG;
+HardwareSerial Serial;
+
+#ifndef LINUXCORE_GPIO_SYSFS
+#define LINUXCORE_GPIO_SYSFS	"/sys/class/gpio"
+#endif
+
+static const unsigned short PIN_COUNT = 256;
+
+static unsigned int s_iGpioBase = 0;
+static int s_aValueFd[PIN_COUNT];		// open /sys/class/gpio/gpioN/value, -1 if the pin isn't set up
+static bool s_bValueFdInit = false;
+
+
+//	--- interrupt lock ---
+
+static pthread_mutex_t s_interruptLock = PTHREAD_MUTEX_INITIALIZER;
+static __thread bool t_bInterruptsOff = false;	// this thread holds s_interruptLock
+
+
+void cli()
+{
+	if (t_bInterruptsOff)
+		return;
+	pthread_mutex_lock(&s_interruptLock);
+	t_bInterruptsOff = true;
+}
+
+
+void sei()
+{
+	if (!t_bInterruptsOff)
+		return;
+	t_bInterruptsOff = false;
+	pthread_mutex_unlock(&s_interruptLock);
+}
+
+
+InterruptFlag::operator uint8_t() const
+{
+	return (t_bInterruptsOff) ? 0x00 : 0x80;
+}
+
+
+InterruptFlag& InterruptFlag::operator=(uint8_t iValue)
+{
+	if (iValue & 0x80)
+		sei();
+	else
+		cli();
+	return *this;
+}
+
+
+//	--- time ---
+
+static unsigned long long nowMicros()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static const unsigned long long s_iStartMicros = nowMicros();
+
+
+unsigned long micros()
+{
+	return (unsigned long)(nowMicros() - s_iStartMicros);	// wraps like on the AVR when long is 32 bits
+}
+
+
+unsigned long millis()
+{
+	return (unsigned long)((nowMicros() - s_iStartMicros) / 1000);
+}
+
+
+void delay(unsigned long ms)
+{
+	struct timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR) { ; }
+}
+
+
+void delayMicroseconds(unsigned int us)
+// Short delays spin.  The scheduler's wakeup latency would make them much longer than asked.
+{
+	if (us >= 100)
+	{
+		struct timespec ts;
+		ts.tv_sec = us / 1000000;
+		ts.tv_nsec = (us % 1000000) * 1000L;
+		while (nanosleep(&ts, &ts) != 0 && errno == EINTR) { ; }
+		return;
+	}
+	unsigned long long iEnd = nowMicros() + us;
+	while (nowMicros() < iEnd) { ; }
+}
+
+
+//	--- GPIO ---
+
+void linuxSetGpioBase(unsigned int iBase)
+{
+	s_iGpioBase = iBase;
+}
+
+
+static bool writeFile(const char* szPath, const char* szValue)
+{
+	int fd = open(szPath, O_WRONLY);
+	if (fd < 0)
+		return false;
+	ssize_t n = write(fd, szValue, strlen(szValue));
+	close(fd);
+	return n == (ssize_t)strlen(szValue);
+}
+
+
+static bool exportPin(uint8_t pin, char* szDir, size_t iDirSize)
+// PURPOSE:		Exports the GPIO and returns its sysfs directory.  Waits a little for udev to fix the permissions.
+{
+	unsigned int iGpio = s_iGpioBase + pin;
+	snprintf(szDir, iDirSize, LINUXCORE_GPIO_SYSFS "/gpio%u", iGpio);
+
+	char szPath[96];
+	snprintf(szPath, sizeof(szPath), "%s/value", szDir);
+	if (access(szPath, W_OK) == 0)
+		return true;	// already exported
+
+	char szNumber[16];
+	snprintf(szNumber, sizeof(szNumber), "%u", iGpio);
+	writeFile(LINUXCORE_GPIO_SYSFS "/export", szNumber);
+	for (int i = 0; i < 100; ++i)
+	{
+		if (access(szPath, W_OK) == 0)
+			return true;
+		delay(1);
+	}
+	fprintf(stderr, "LinuxCore: GPIO %u could not be exported\n", iGpio);
+	return false;
+}
+
+
+static int valueFd(uint8_t pin)
+{
+	if (!s_bValueFdInit)
+	{
+		for (unsigned short i = 0; i < PIN_COUNT; ++i)
+			s_aValueFd[i] = -1;
+		s_bValueFdInit = true;
+	}
+	return s_aValueFd[pin];
+}
+
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+	char szDir[64], szPath[96];
+	if (!exportPin(pin, szDir, sizeof(szDir)))
+		return;
+
+	snprintf(szPath, sizeof(szPath), "%s/direction", szDir);
+	writeFile(szPath, (mode == OUTPUT) ? "out" : "in");		// INPUT_PULLUP: sysfs has no pull-ups, set them in the device tree
+
+	if (valueFd(pin) < 0)
+	{
+		snprintf(szPath, sizeof(szPath), "%s/value", szDir);
+		s_aValueFd[pin] = open(szPath, O_RDWR);
+	}
+}
+
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+	int fd = valueFd(pin);
+	if (fd >= 0)
+		pwrite(fd, (val == LOW) ? "0" : "1", 1, 0);
+}
+
+
+int digitalRead(uint8_t pin)
+{
+	int fd = valueFd(pin);
+	char c = '0';
+	if (fd >= 0)
+		pread(fd, &c, 1, 0);
+	return (c == '1') ? HIGH : LOW;
+}
+
+
+//	--- external interrupts ---
+
+struct InterruptThread
+{
+	pthread_t		thread;
+	void			(*pfnHandler)();
+	int				fdValue;
+	int				aStopPipe[2];
+	bool			bRunning;
+};
+
+static InterruptThread s_aInterrupts[PIN_COUNT];
+
+
+static void* interruptThread(void* pArg)
+// PURPOSE:		Waits for the edges of one pin and runs the handler with the interrupt lock held, like an ISR.
+{
+	InterruptThread* pInterrupt = (InterruptThread*)pArg;
+	struct pollfd aPoll[2];
+	aPoll[0].fd = pInterrupt->fdValue;
+	aPoll[0].events = POLLPRI | POLLERR;
+	aPoll[1].fd = pInterrupt->aStopPipe[0];
+	aPoll[1].events = POLLIN;
+
+	for (;;)
+	{
+		if (poll(aPoll, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (aPoll[1].revents)
+			break;
+		if (aPoll[0].revents)
+		{
+			char c;
+			pread(pInterrupt->fdValue, &c, 1, 0);	// acknowledges the edge
+
+			cli();
+			pInterrupt->pfnHandler();
+			sei();
+		}
+	}
+	return 0;
+}
+
+
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode)
+{
+	detachInterrupt(interruptNum);
+
+	char szDir[64], szPath[96];
+	if (!exportPin(interruptNum, szDir, sizeof(szDir)))
+		return;
+	snprintf(szPath, sizeof(szPath), "%s/direction", szDir);
+	writeFile(szPath, "in");
+	snprintf(szPath, sizeof(szPath), "%s/edge", szDir);
+	writeFile(szPath, (mode == RISING) ? "rising" : (mode == FALLING) ? "falling" : "both");
+
+	InterruptThread* pInterrupt = &s_aInterrupts[interruptNum];
+	snprintf(szPath, sizeof(szPath), "%s/value", szDir);
+	pInterrupt->fdValue = open(szPath, O_RDONLY);
+	if (pInterrupt->fdValue < 0)
+		return;
+	if (pipe(pInterrupt->aStopPipe) != 0)
+	{
+		close(pInterrupt->fdValue);
+		return;
+	}
+
+	char c;
+	pread(pInterrupt->fdValue, &c, 1, 0);	// an edge before this point doesn't count
+	pInterrupt->pfnHandler = userFunc;
+	pInterrupt->bRunning = (pthread_create(&pInterrupt->thread, 0, interruptThread, pInterrupt) == 0);
+}
+
+
+void detachInterrupt(uint8_t interruptNum)
+{
+	InterruptThread* pInterrupt = &s_aInterrupts[interruptNum];
+	if (!pInterrupt->bRunning)
+		return;
+
+	bool bLocked = t_bInterruptsOff;
+	sei();	// the thread may be waiting for the lock to run the handler
+	write(pInterrupt->aStopPipe[1], "", 1);
+	pthread_join(pInterrupt->thread, 0);
+	if (bLocked)
+		cli();
+
+	close(pInterrupt->aStopPipe[0]);
+	close(pInterrupt->aStopPipe[1]);
+	close(pInterrupt->fdValue);
+	pInterrupt->bRunning = false;
+}
+
+
+//	--- Print ---
+
+size_t Print::write(const char* str)
+{
+	size_t n = 0;
+	while (*str)
+		n += write((uint8_t)*str++);
+	return n;
+}
+
+
+size_t Print::print(long n, int base)
+{
+	if (n < 0 && base == 10)
+		return print('-') + print((unsigned long)-n, base);
+	return print((unsigned long)n, base);
+}
+
+
+size_t Print::print(unsigned long n, int base)
+{
+	char aBuffer[8 * sizeof(long) + 1];
+	char* p = aBuffer + sizeof(aBuffer) - 1;
+	*p = '\0';
+	if (base < 2)
+		base = 10;
+	do
+	{
+		unsigned long digit = n % base;
+		n /= base;
+		*--p = (char)((digit < 10) ? ('0' + digit) : ('A' + digit - 10));
+	} while (n);
+	return write(p);
+}
+
+
+size_t Print::print(double n, int digits)
+{
+	char aBuffer[32];
+	snprintf(aBuffer, sizeof(aBuffer), "%.*f", digits, n);
+	return write(aBuffer);
+}
+
+
+size_t HardwareSerial::write(uint8_t c)
+{
+	return (putchar(c) == EOF) ? 0 : 1;
+}
@@ -0,0 +1,225 @@
+/*
+\file	SpidevLoopbackTest.cpp
+\version	1.0.0
+\purpose	The spidev backend of SPIExternalDevice against an interposed ioctl(): one SPI_IOC_MESSAGE per transaction,
+			the segments it is made of, and the RX buffers of spiReadBlock()/spiTransferBlock(), which are only filled
+			when spiTransactionEnd() sends the message.
+\compiler	g++ on Linux, with LinuxCore
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+/*	The test defines ioctl() itself, so the backend's calls end up here instead of in the C library.  Every
+	SPI_IOC_MESSAGE(n) is recorded and answered as a loopback that inverts the bits: each byte received is the
+	complement of the byte sent (0xFF for the zeros sent when tx_buf is NULL).  The bus device is /dev/null; the
+	GPIOs for CS_n don't have to exist.	*/
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+#include <CC2500.h>
+#include <BMA180SPI.h>
+
+
+// the last message
+static int g_iMessages = 0;
+static unsigned int g_iSegments = 0;
+static unsigned int g_aLengths[64];
+static unsigned long g_aSpeeds[64];
+
+extern "C" int ioctl(int, unsigned long iRequest, ...)
+{
+	va_list args;
+	va_start(args, iRequest);
+	void* pArg = va_arg(args, void*);
+	va_end(args);
+
+	if (_IOC_TYPE(iRequest) != SPI_IOC_MAGIC || _IOC_NR(iRequest) != 0 || _IOC_DIR(iRequest) != _IOC_WRITE)
+		return 0;		// mode and speed settings are accepted
+
+	const spi_ioc_transfer* aSegments = (const spi_ioc_transfer*)pArg;
+	++g_iMessages;
+	g_iSegments = _IOC_SIZE(iRequest) / sizeof(spi_ioc_transfer);
+	for (unsigned int i = 0; i < g_iSegments && i < 64; ++i)
+	{
+		const unsigned char* pTx = (const unsigned char*)(unsigned long)aSegments[i].tx_buf;
+		unsigned char* pRx = (unsigned char*)(unsigned long)aSegments[i].rx_buf;
+		g_aLengths[i] = aSegments[i].len;
+		g_aSpeeds[i] = aSegments[i].speed_hz;
+		for (unsigned int j = 0; pRx && j < aSegments[i].len; ++j)
+			pRx[j] = (unsigned char)~(pTx ? pTx[j] : 0x00);
+	}
+	return 0;
+}
+
+
+static unsigned int s_iChecks = 0;
+static unsigned int s_iCheckFailures = 0;
+
+#define CHECK(bCondition)	check((bCondition), #bCondition, __LINE__)
+
+static bool check(bool bPassed, const char* szCondition, int iLine)
+{
+	++s_iChecks;
+	if (!bPassed)
+	{
+		++s_iCheckFailures;
+		printf("%s:%d: check failed: %s\n", __FILE__, iLine, szCondition);
+	}
+	return bPassed;
+}
+
+
+// a device whose transactions the test opens itself
+class TestDevice : public SPIExternalDevice
+{
+public:
+	TestDevice(unsigned char pinCS_n, SPIClockDiv iSPIClockDiv) : SPIExternalDevice(pinCS_n, MODE0, iSPIClockDiv) {}
+	using SPIExternalDevice::spiTransactionBegin;
+	using SPIExternalDevice::spiTransactionEnd;
+	using SPIExternalDevice::spiTransfer;
+	using SPIExternalDevice::spiWriteBlock;
+	using SPIExternalDevice::spiReadBlock;
+	using SPIExternalDevice::spiTransferBlock;
+};
+
+TestDevice g_device(20, SPIExternalDevice::DIV4);
+CC2500xcvr g_radio(21, SPIExternalDevice::DIV2);
+BMA180AccelerometerSPI g_accel(22, SPIExternalDevice::DIV4);
+
+
+static bool allEqual(const byte* pData, unsigned int iLength, byte bValue)
+{
+	for (unsigned int i = 0; i < iLength; ++i)
+		if (pData[i] != bValue)
+			return false;
+	return true;
+}
+
+
+static void testOneMessage()
+{
+	byte bHeader = 0xC0;
+	byte aRead[8], aTx[4], aRx[4], aDummies[4];
+	memset(aRead, 0xEE, sizeof(aRead));
+	memset(aRx, 0xEE, sizeof(aRx));
+	memset(aDummies, 0xEE, sizeof(aDummies));
+	for (byte i = 0; i < sizeof(aTx); ++i)
+		aTx[i] = (byte)(0x10 + i);
+
+	int iMessages = g_iMessages;
+	g_device.spiTransactionBegin();
+	g_device.spiWriteBlock(&bHeader, 1);
+	g_device.spiReadBlock(aRead, sizeof(aRead), 0x00);
+	g_device.spiTransferBlock(aTx, aRx, sizeof(aTx));
+	g_device.spiReadBlock(aDummies, sizeof(aDummies), 0xA5);
+
+	// collected, not sent: the RX buffers are untouched until the transaction ends
+	CHECK(g_iMessages == iMessages);
+	CHECK(allEqual(aRead, sizeof(aRead), 0xEE) && allEqual(aRx, sizeof(aRx), 0xEE));
+
+	g_device.spiTransactionEnd();
+	CHECK(g_iMessages == iMessages + 1);
+	CHECK(g_iSegments == 4);
+	CHECK(g_aLengths[0] == 1 && g_aLengths[1] == 8 && g_aLengths[2] == 4 && g_aLengths[3] == 4);
+	CHECK(g_aSpeeds[0] == 4000000UL && g_aSpeeds[3] == 4000000UL);
+	CHECK(allEqual(aRead, sizeof(aRead), 0xFF));
+	CHECK(aRx[0] == (byte)~0x10 && aRx[3] == (byte)~0x13);
+	CHECK(allEqual(aDummies, sizeof(aDummies), (byte)~0xA5));
+
+	// in place
+	byte aBoth[3] = { 0x01, 0x02, 0x03 };
+	g_device.spiTransactionBegin();
+	g_device.spiTransferBlock(aBoth, aBoth, sizeof(aBoth));
+	g_device.spiTransactionEnd();
+	CHECK(aBoth[0] == 0xFE && aBoth[2] == 0xFC);
+
+	// an empty transaction sends nothing
+	iMessages = g_iMessages;
+	g_device.spiTransactionBegin();
+	g_device.spiTransactionEnd();
+	CHECK(g_iMessages == iMessages);
+}
+
+
+static void testFlushes()
+{
+	// spiTransfer() returns the byte received, so it sends what has been collected with it
+	byte aTx[4] = { 1, 2, 3, 4 };
+	int iMessages = g_iMessages;
+	g_device.spiTransactionBegin();
+	g_device.spiWriteBlock(aTx, sizeof(aTx));
+	CHECK(g_device.spiTransfer(0x12) == (byte)~0x12);
+	CHECK(g_iMessages == iMessages + 1 && g_iSegments == 2);
+	g_device.spiTransactionEnd();
+	CHECK(g_iMessages == iMessages + 1);
+
+	// more segments than a message takes: CS_n is a GPIO, so the transaction spans two messages
+	iMessages = g_iMessages;
+	byte aBytes[40];
+	g_device.spiTransactionBegin();
+	for (byte i = 0; i < sizeof(aBytes); ++i)
+		g_device.spiReadBlock(&aBytes[i], 1, i);
+	g_device.spiTransactionEnd();
+	CHECK(g_iMessages == iMessages + 2);
+	CHECK(g_iSegments == sizeof(aBytes) - 32);
+	CHECK(aBytes[0] == 0xFF && aBytes[39] == (byte)~39);
+}
+
+
+static void testDrivers()
+{
+	// a CC2500 FIFO burst: header and payload in one message, at the radio's clock
+	byte aFifo[64];
+	memset(aFifo, 0xEE, sizeof(aFifo));
+	int iMessages = g_iMessages;
+	g_radio.readRxFifo(aFifo, sizeof(aFifo));
+	CHECK(g_iMessages == iMessages + 1);
+	CHECK(g_iSegments == 2 && g_aLengths[0] == 1 && g_aLengths[1] == 64);
+	CHECK(g_aSpeeds[0] == 8000000UL && g_aSpeeds[1] == 8000000UL);
+	CHECK(allEqual(aFifo, sizeof(aFifo), 0xFF));
+
+	iMessages = g_iMessages;
+	g_radio.writeTxFifo(aFifo, 10);
+	CHECK(g_iMessages == iMessages + 1 && g_iSegments == 2 && g_aLengths[1] == 10);
+
+	// a radio profile: the tables go out as blocks, not a message per byte
+	static const unsigned char aRegs[CC2500_CONFIG_SIZE] = { 0x29, 0x2E, 0x06 };
+	static const unsigned char aPA[] = { 0xFF };
+	CC2500Profile profile = { aRegs, aPA, sizeof(aPA) };
+	iMessages = g_iMessages;
+	CHECK(!g_radio.configure(profile));		// the loopback inverts what is read back
+	CHECK(g_iMessages - iMessages == 6);	// SIDLE, IOCFG2..TEST0 in two chunks, the PA table, the read back in two chunks
+	iMessages = g_iMessages;
+	g_radio.configure(profile, false);
+	CHECK(g_iMessages - iMessages == 4);
+
+	// a BMA180 burst read, right after the radio: back to the accelerometer's clock
+	byte aXYZ[6];
+	memset(aXYZ, 0xEE, sizeof(aXYZ));
+	iMessages = g_iMessages;
+	g_accel.readBurst(BMA180AccelerometerSPI::REG_ACC_LSB, aXYZ, sizeof(aXYZ));
+	CHECK(g_iMessages == iMessages + 1);
+	CHECK(g_iSegments == 2 && g_aLengths[1] == 6);
+	CHECK(g_aSpeeds[0] == 4000000UL);
+	CHECK(allEqual(aXYZ, sizeof(aXYZ), (byte)~0x55));	// the dummy byte of readBurst()
+}
+
+
+int main()
+{
+	if (!CHECK(SPIExternalDevice::spiMasterInit("/dev/null")))
+		return 1;
+	testOneMessage();
+	testFlushes();
+	testDrivers();
+	SPIExternalDevice::spiMasterStop();
+
+	printf("%u checks, %u failed\n", s_iChecks, s_iCheckFailures);
+	return (s_iCheckFailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+/*
+\file	PacketPool.h
+\version	1.0.0
+\purpose	Fixed pool of packet buffers with reference-counted handles, for handing packets between an ISR and the main
+			loop without copying them.
+\compiler	Arduino 1.0.1
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+/*	How it works:
+	A buffer is a packet image as the radio has it in its FIFO: byte 0 is the payload length, the payload follows,
+	then whatever the radio appends (e.g. RSSI and LQI).  A handle is the index of a buffer, one byte, so handles
+	go through an SPSCRing<unsigned char> from the ISR to the main loop (or back) the way bytes do.
+
+	allocate() hands out a free buffer with one reference.  retain() adds one, release() drops one and puts the
+	buffer back when none are left.  Whoever holds a reference may read the buffer; only the one that allocated it
+	writes it, before passing it on.  allocate(), retain() and release() may be called from ISRs and from the main
+	loop; the free list is changed with interrupts disabled for a few instructions.
+
+	PacketPoolBase is the non-template-size interface that drivers take by reference.
+	PacketPool<COUNT, SIZE> adds the storage.  SIZE counts the length byte and the appended bytes:
+		PacketPool<6, 1 + 32 + 2>				g_pool;		// 6 packets of up to 32 bytes, with RSSI/LQI
+		SPSCRingBuffer<unsigned char, 8>		g_rxHandles;
+		radio.beginInterruptReceive(g_pool, g_rxHandles, 0, 1);
+
+		PacketPoolBase::Handle h;
+		if (radio.takePacket(h) == CC2500xcvr::PACKET_OK)
+			use(g_pool.payload(h), g_pool.length(h));
+		g_pool.release(h);		*/
+
+#ifndef PACKETPOOL_H_INCLUDED
+#define PACKETPOOL_H_INCLUDED
+
+#include <Arduino.h>
+
+
+class PacketPoolBase
+{
+public:
+	typedef unsigned char Handle;
+	static const Handle NONE = 0xFF;
+
+	Handle allocate();				// one reference, length 0.  NONE if the pool is empty.
+	void retain(Handle h);
+	void release(Handle h);			// the buffer is free again when the last reference is released.  NONE is ignored.
+
+	unsigned char* buffer(Handle h)				{ return m_pData + (unsigned short)h * m_iSize; }	// length byte first
+	const unsigned char* buffer(Handle h) const	{ return m_pData + (unsigned short)h * m_iSize; }
+	unsigned char* payload(Handle h)			{ return buffer(h) + 1; }
+	const unsigned char* payload(Handle h) const	{ return buffer(h) + 1; }
+	unsigned char length(Handle h) const		{ return buffer(h)[0]; }
+	void setLength(Handle h, unsigned char iLength)	{ buffer(h)[0] = iLength; }
+
+	unsigned char size() const			{ return m_iSize; }		// of a buffer, length byte included
+	unsigned char maxPayload() const	{ return m_iSize - 1; }
+	unsigned char count() const			{ return m_iCount; }
+	unsigned char freeCount() const		{ return m_iFree; }
+	unsigned char minFree() const		{ return m_iMinFree; }	// low-water mark, for sizing COUNT
+	unsigned int failures() const;		// allocate() calls that found the pool empty
+
+protected:
+	PacketPoolBase(unsigned char* pData, unsigned char* pRefs, unsigned char* pNext, unsigned char iCount, unsigned char iSize);
+
+	unsigned char*				m_pData;
+	volatile unsigned char*		m_pRefs;	// references per buffer, 0 when free
+	unsigned char*				m_pNext;	// free list links
+	const unsigned char			m_iCount;
+	const unsigned char			m_iSize;
+	volatile Handle				m_iFreeHead;
+	volatile unsigned char		m_iFree;
+	unsigned char				m_iMinFree;
+	volatile unsigned int		m_iFailures;
+};
+
+
+template<unsigned char COUNT, unsigned char SIZE>
+class PacketPool : public PacketPoolBase
+{
+public:
+	PacketPool() : PacketPoolBase(&m_aData[0][0], m_aRefs, m_aNext, COUNT, SIZE) {}
+
+private:
+	typedef char CountMustBe1To254[(COUNT != 0 && COUNT < NONE) ? 1 : -1];
+	typedef char SizeMustHoldTheLengthByteAndPayload[(SIZE >= 2) ? 1 : -1];
+
+	unsigned char	m_aData[COUNT][SIZE];
+	unsigned char	m_aRefs[COUNT];
+	unsigned char	m_aNext[COUNT];
+};
+
+
+inline PacketPoolBase::PacketPoolBase(unsigned char* pData, unsigned char* pRefs, unsigned char* pNext, unsigned char iCount, unsigned char iSize)
+	: m_pData(pData), m_pRefs(pRefs), m_pNext(pNext), m_iCount(iCount), m_iSize(iSize)
+	, m_iFreeHead(0), m_iFree(iCount), m_iMinFree(iCount), m_iFailures(0)
+{
+	for (unsigned char i = 0; i < iCount; ++i)
+	{
+		pRefs[i] = 0;
+		pNext[i] = (i + 1 < iCount) ? i + 1 : NONE;
+	}
+}
+
+
+inline PacketPoolBase::Handle PacketPoolBase::allocate()
+{
+	byte oldSREG = SREG;
+	cli();
+	Handle h = m_iFreeHead;
+	if (h == NONE)
+		++m_iFailures;
+	else
+	{
+		m_iFreeHead = m_pNext[h];
+		m_pRefs[h] = 1;
+		if (--m_iFree < m_iMinFree)
+			m_iMinFree = m_iFree;
+	}
+	SREG = oldSREG;
+
+	if (h != NONE)
+		setLength(h, 0);
+	return h;
+}
+
+
+inline void PacketPoolBase::retain(Handle h)
+{
+	byte oldSREG = SREG;
+	cli();	// a read-modify-write, and the other side may release at the same time
+	++m_pRefs[h];
+	SREG = oldSREG;
+}
+
+
+inline void PacketPoolBase::release(Handle h)
+{
+	if (h == NONE)
+		return;
+
+	byte oldSREG = SREG;
+	cli();
+	if (m_pRefs[h] != 0 && --m_pRefs[h] == 0)
+	{
+		m_pNext[h] = m_iFreeHead;
+		m_iFreeHead = h;
+		++m_iFree;
+	}
+	SREG = oldSREG;
+}
+
+
+inline unsigned int PacketPoolBase::failures() const
+{
+	byte oldSREG = SREG;
+	cli();	// 16-bit counter written by ISRs
+	unsigned int count = m_iFailures;
+	SREG = oldSREG;
+	return count;
+}
+
+
+#endif
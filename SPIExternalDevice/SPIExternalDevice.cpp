@@ -17,15 +17,48 @@ published by the Free Software Foundation.
 #include <Arduino.h>
 #include "SPIExternalDevice.h"
 
+#ifndef SPIDEVICE_SPIDEV		// SPIExternalDeviceSpidev.cpp on Linux boards
+
+
+const byte SPIExternalDevice::ASYNC_DUMMY;
+
+const SPIExternalDevice* volatile SPIExternalDevice::s_pBusOwner = 0;
+volatile bool SPIExternalDevice::s_bTransactionOpen = false;
+
+SPIExternalDevice::AsyncTransaction* volatile SPIExternalDevice::s_pAsyncCurrent = 0;
+SPIExternalDevice::AsyncTransaction* volatile SPIExternalDevice::s_pAsyncHead = 0;
+SPIExternalDevice::AsyncTransaction* volatile SPIExternalDevice::s_pAsyncTail = 0;
+
+SPIExternalDevice::BusRequest* volatile SPIExternalDevice::s_pRequestHead = 0;
+volatile bool SPIExternalDevice::s_bRunningRequests = false;
+
+#if SPIDEVICE_INSTRUMENTATION
+SPIExternalDevice::BusStats* volatile SPIExternalDevice::s_pActiveStats = 0;
+#endif
+
 
 SPIExternalDevice::SPIExternalDevice(unsigned char pinCS_n, SPIMode iSPIMode, SPIClockDiv iSPIClockDiv, unsigned char uiBitOrder)
 {
 	m_pinCS_n = pinCS_n;
 	pinMode(m_pinCS_n, OUTPUT);  digitalWrite(m_pinCS_n, HIGH);
 
-	m_iSPIMode = iSPIMode;
-	m_iSPIClockDiv = iSPIClockDiv;
-	m_iBitOrder = uiBitOrder;
+	// SPI register images.  spiTransactionBegin() writes them as they are.
+	m_iSPCR = _BV(SPE) | _BV(MSTR) | (iSPIMode & MODE) | (iSPIClockDiv & CLOCK);
+	if (uiBitOrder == LSBFIRST)
+		m_iSPCR |= _BV(DORD);
+	m_iSPSR = (iSPIClockDiv >> 2) & X2CLOCK;
+
+	// CS_n port and bit for direct port writes
+	m_pCSPort = portOutputRegister(digitalPinToPort(m_pinCS_n));
+	m_iCSMask = digitalPinToBitMask(m_pinCS_n);
+
+	m_iPriority = 0;
+	m_iMaxLength = 0xFF;
+
+#if SPIDEVICE_INSTRUMENTATION
+	memset(&m_stats, 0, sizeof(m_stats));
+	m_iCSAssertedAt = 0;
+#endif
 }
 
 
@@ -50,38 +83,250 @@ void SPIExternalDevice::spiMasterInit()
   // clear data registers
   byte b = SPSR;
   b = SPDR;
+  (void)b;	// used.  A bare (void)SPSR wouldn't read HostSim's register objects.
+
+  spiBusInvalidate();
 }
 
 
 void SPIExternalDevice::spiMasterStop()
 {
   SPCR &= ~_BV(SPE);
+  spiBusInvalidate();
+}
+
+
+bool SPIExternalDevice::spiQueueTransaction(AsyncTransaction* pTransaction, const byte* pTxData, byte* pRxData, unsigned char iLength, AsyncCallback pfnComplete)
+// PURPOSE:		Append a transaction to the asynchronous queue.  Starts it right away if the bus is idle.
+// PRECONDITIONS:	SPI master on the AVR has been initialized
+// RETURNS:		false if the transaction is empty, longer than spiSetMaxLength() allows, or is still queued/in progress
+{
+	if (iLength == 0 || iLength > m_iMaxLength || pTransaction->iStatus == ASYNC_QUEUED || pTransaction->iStatus == ASYNC_IN_PROGRESS)
+		return false;
+
+	pTransaction->pDevice = this;
+	pTransaction->pTxData = pTxData;
+	pTransaction->pRxData = pRxData;
+	pTransaction->iLength = iLength;
+	pTransaction->pfnComplete = pfnComplete;
+	pTransaction->iIndex = 0;
+	pTransaction->pNext = 0;
+
+	byte oldSREG = SREG;
+	cli();
+
+#if SPIDEVICE_INSTRUMENTATION
+	pTransaction->iQueuedAt = micros();
+#endif
+	pTransaction->iStatus = ASYNC_QUEUED;
+	if (!s_pAsyncTail || s_pAsyncTail->pDevice->m_iPriority >= m_iPriority)
+	{
+		if (s_pAsyncTail)
+			s_pAsyncTail->pNext = pTransaction;
+		else
+			s_pAsyncHead = pTransaction;
+		s_pAsyncTail = pTransaction;
+	}
+	else
+	{
+		// ahead of the first transaction of lower priority.  There is one, the tail.
+		AsyncTransaction* pPrevious = 0;
+		AsyncTransaction* pNext = s_pAsyncHead;
+		while (pNext->pDevice->m_iPriority >= m_iPriority)
+		{
+			pPrevious = pNext;
+			pNext = pNext->pNext;
+		}
+		pTransaction->pNext = pNext;
+		if (pPrevious)
+			pPrevious->pNext = pTransaction;
+		else
+			s_pAsyncHead = pTransaction;
+	}
+
+	if (!s_pAsyncCurrent)
+		spiAsyncStartNext();
+
+	SREG = oldSREG;
+	return true;
+}
+
+
+void SPIExternalDevice::spiAsyncStartNext()
+{
+	AsyncTransaction* pTransaction = s_pAsyncHead;
+	if (s_pRequestHead)
+	{
+		// The bus is free for a moment.  Requests at least as urgent as the next transaction go first.
+		spiRunRequests((pTransaction) ? pTransaction->pDevice->m_iPriority : 0);
+		if (s_pAsyncCurrent)
+			return;		// a request queued a transaction, and it has been started
+		pTransaction = s_pAsyncHead;
+	}
+	if (!pTransaction)
+	{
+		detachInterrupt();
+		return;
+	}
+
+	s_pAsyncHead = pTransaction->pNext;
+	if (!s_pAsyncHead)
+		s_pAsyncTail = 0;
+
+	s_pAsyncCurrent = pTransaction;
+	pTransaction->iStatus = ASYNC_IN_PROGRESS;
+#if SPIDEVICE_INSTRUMENTATION
+	pTransaction->pDevice->statsQueueWait(pTransaction->iQueuedAt);
+#endif
+	pTransaction->pDevice->spiTransactionBegin();	// the base class version.  CC2500 chip-ready wait is not done here.
+	attachInterrupt();
+	SPDR = pTransaction->pTxData ? pTransaction->pTxData[0] : ASYNC_DUMMY;
+}
+
+
+void SPIExternalDevice::spiInterruptHandler()
+// PURPOSE:		State machine of the asynchronous engine.  One call per byte clocked out.
+{
+	AsyncTransaction* pTransaction = s_pAsyncCurrent;
+	if (!pTransaction)
+	{
+		detachInterrupt();	// stray interrupt, nothing is queued
+		return;
+	}
+
+	byte bData = SPDR;
+	statsBytes(1);
+	if (pTransaction->pRxData)
+		pTransaction->pRxData[pTransaction->iIndex] = bData;
+
+	if (++pTransaction->iIndex < pTransaction->iLength)
+	{
+		SPDR = pTransaction->pTxData ? pTransaction->pTxData[pTransaction->iIndex] : ASYNC_DUMMY;
+		return;
+	}
+
+	pTransaction->pDevice->spiTransactionEnd();
+	pTransaction->iStatus = ASYNC_DONE;
+
+	// s_pAsyncCurrent stays set during the callback, so that a transaction queued from the callback is appended rather than started.
+	if (pTransaction->pfnComplete)
+		pTransaction->pfnComplete(pTransaction);
+
+	s_pAsyncCurrent = 0;
+	spiAsyncStartNext();
 }
 
 
-void SPIExternalDevice::spiTransactionBegin()
+void SPIExternalDevice::spiPostRequest(BusRequest* pRequest, BusRequestService pfnService, void* pContext)
+// PURPOSE:		Called by an ISR that found the bus busy.  pfnService(pContext) will run at the next service point.
+//				The request list is kept most urgent first, in posting order within a priority.
 {
-	// 1. make sure that SPI parameters are set for this particular external device (i.e. instance of a subclass)
-	
-	// 1.a SPI mode
-	SPCR = (SPCR & ~MODE) | m_iSPIMode;
-
-	// 1.b order of bits
-	if(m_iBitOrder == LSBFIRST)
-		SPCR |= _BV(DORD);
+	if (pRequest->bPending)
+		return;
+
+	pRequest->pfnService = pfnService;
+	pRequest->pContext = pContext;
+	pRequest->pDevice = this;
+	pRequest->bPending = true;
+#if SPIDEVICE_INSTRUMENTATION
+	pRequest->iPostedAt = micros();
+#endif
+
+	BusRequest* pPrevious = 0;
+	BusRequest* pNext = s_pRequestHead;
+	while (pNext && pNext->pDevice->m_iPriority >= m_iPriority)
+	{
+		pPrevious = pNext;
+		pNext = pNext->pNext;
+	}
+	pRequest->pNext = pNext;
+	if (pPrevious)
+		pPrevious->pNext = pRequest;
 	else
-		SPCR &= ~(_BV(DORD)); //*/
+		s_pRequestHead = pRequest;
+}
+
+
+void SPIExternalDevice::spiServiceRequests()
+{
+	byte oldSREG = SREG;
+	cli();
+	if (!s_pAsyncCurrent)		// otherwise the asynchronous engine runs them between its transactions
+		spiRunRequests(0);
+	SREG = oldSREG;
+}
+
+
+void SPIExternalDevice::spiRunRequests(unsigned char iMinPriority)
+// PRECONDITIONS:	interrupts disabled
+{
+	if (s_bRunningRequests)
+		return;		// the transactions of a request end here too
+	s_bRunningRequests = true;
+
+	BusRequest* pRequest;
+	while (!s_bTransactionOpen && !s_pAsyncCurrent && (pRequest = s_pRequestHead) != 0 && pRequest->pDevice->m_iPriority >= iMinPriority)
+	{
+		s_pRequestHead = pRequest->pNext;
+		pRequest->bPending = false;
+#if SPIDEVICE_INSTRUMENTATION
+		pRequest->pDevice->statsQueueWait(pRequest->iPostedAt);
+#endif
+		pRequest->pfnService(pRequest->pContext);
+	}
+
+	s_bRunningRequests = false;
+}
 
-	// 1.c SPI clock divider
-	SPCR = (SPCR & ~CLOCK)	| ( m_iSPIClockDiv & CLOCK);
-	SPSR = (SPSR & ~X2CLOCK) | ((m_iSPIClockDiv >> 2) & X2CLOCK);
 
-	// 2. assert CS_n
-	digitalWrite(m_pinCS_n, LOW);
+void SPIExternalDevice::spiStats(BusStats& stats) const
+{
+#if SPIDEVICE_INSTRUMENTATION
+	byte oldSREG = SREG;
+	cli();	// the counters are also updated by ISRs that use the bus
+	stats = m_stats;
+	SREG = oldSREG;
+#else
+	memset(&stats, 0, sizeof(stats));
+#endif
 }
 
 
-void SPIExternalDevice::spiTransactionEnd()
+void SPIExternalDevice::spiStatsReset()
 {
-	digitalWrite(m_pinCS_n, HIGH);	// de-assert CS_n
-}
\ No newline at end of file
+#if SPIDEVICE_INSTRUMENTATION
+	byte oldSREG = SREG;
+	cli();
+	memset(&m_stats, 0, sizeof(m_stats));
+	SREG = oldSREG;
+#endif
+}
+
+
+void SPIExternalDevice::spiStatsPrint(Print& out, const char* szName) const
+{
+	out.print(szName);
+#if SPIDEVICE_INSTRUMENTATION
+	BusStats stats;
+	spiStats(stats);
+	out.print(F(": transactions "));	out.print(stats.iTransactions);
+	out.print(F(", bytes "));			out.print(stats.iBytes);
+	out.print(F(", reconfigurations "));	out.print(stats.iReconfigurations);
+	out.print(F(", CS us "));			out.print(stats.iCSMicros);
+	out.print(F(", SPIF spins "));		out.print(stats.iSPIFSpins);
+	out.print(F(", ready spins "));		out.print(stats.iReadySpins);
+	out.print(F(", queue waits "));		out.print(stats.iQueueWaits);
+	out.print(F(", wait us "));			out.print(stats.iQueueWaitMicros);
+	out.print(F(", max wait us "));		out.println(stats.iQueueWaitMaxMicros);
+#else
+	out.println(F(": SPI instrumentation not compiled in"));
+#endif
+}
+
+
+ISR(SPI_STC_vect)
+{
+	SPIExternalDevice::spiInterruptHandler();
+}
+
+#endif // SPIDEVICE_SPIDEV
@@ -19,6 +19,19 @@ published by the Free Software Foundation.
 #include <Arduino.h>
 
 
+// Bus instrumentation: per-device counts of transactions, bytes, bus reconfigurations, CS_n time and busy-wait spins.
+// Off by default.  To turn it on, change the 0 below to 1 (or pass -DSPIDEVICE_INSTRUMENTATION=1 to every translation unit,
+// the library included).  When it is 0, the counters and the code that updates them aren't compiled at all.
+#ifndef SPIDEVICE_INSTRUMENTATION
+#define SPIDEVICE_INSTRUMENTATION 0
+#endif
+
+
+#ifdef SPIDEVICE_SPIDEV		// Linux board, see LinuxCore/Arduino.h
+#include "SPIExternalDeviceSpidev.h"
+#else
+
+
 class SPIExternalDevice
 {
 public:
@@ -29,6 +42,99 @@ public:
 
 	static void spiMasterInit();	// initialize the master SPI peripheral on Atmega
 	static void spiMasterStop();	// uninitialize
+	inline static void spiBusInvalidate() { s_pBusOwner = 0; }	// Call after foreign code has touched SPCR/SPSR.  Next transaction reconfigures the bus.
+	inline static bool spiBusBusy() { return s_bTransactionOpen; }	// A transaction is open.  An ISR that wants the bus must defer its work.
+	// Same SPI mode, clock and bit order.  A transaction of this device after one of the other leaves SPCR/SPSR as they are.
+	bool spiSameConfiguration(const SPIExternalDevice& other) const	{ return m_iSPCR == other.m_iSPCR && m_iSPSR == other.m_iSPSR; }
+
+	// Result of poll() of the resumable driver operations (CC2500xcvr::beginReset(), BMA180 beginSoftReset(), ...).
+	// A driver runs one at a time.  poll() never waits: it does at most a short transaction and returns POLL_BUSY until
+	// the operation ends, with POLL_DONE or POLL_TIMEOUT once.  POLL_IDLE when nothing is running.
+	enum PollStatus		{ POLL_IDLE = 0, POLL_BUSY, POLL_DONE, POLL_TIMEOUT };
+
+	// Asynchronous (interrupt-driven) transactions.
+	// The caller owns the AsyncTransaction and must keep it, and its buffers, alive until iStatus becomes ASYNC_DONE.
+	// The SPI ISR clocks the bytes out one at a time, asserting CS_n before the first byte and de-asserting it after the last.
+	// The main loop must not start a synchronous transaction while spiAsyncBusy() is true.
+	enum AsyncStatus	{ ASYNC_IDLE = 0, ASYNC_QUEUED, ASYNC_IN_PROGRESS, ASYNC_DONE };
+
+	struct AsyncTransaction;
+	typedef void (*AsyncCallback)(AsyncTransaction* pTransaction);	// called from the ISR, keep it short
+
+	struct AsyncTransaction
+	{
+		SPIExternalDevice*		pDevice;		// filled in by spiQueueTransaction()
+		const byte*				pTxData;		// bytes to send.  NULL sends ASYNC_DUMMY bytes.
+		byte*					pRxData;		// received bytes.  NULL discards them.  May be the same buffer as pTxData.
+		unsigned char			iLength;		// number of bytes in the transaction
+		AsyncCallback			pfnComplete;	// completion callback, may be NULL
+		void*					pContext;		// free for the caller's use
+		volatile unsigned char	iStatus;		// AsyncStatus
+		unsigned char			iIndex;			// private to the engine: byte currently on the wire
+		AsyncTransaction*		pNext;			// private to the engine: queue link
+#if SPIDEVICE_INSTRUMENTATION
+		unsigned long			iQueuedAt;		// private to the engine: micros() when queued
+#endif
+	};
+
+	static const byte ASYNC_DUMMY = 0x00;	// sent when pTxData is NULL
+
+	bool spiQueueTransaction(AsyncTransaction* pTransaction, const byte* pTxData, byte* pRxData, unsigned char iLength, AsyncCallback pfnComplete = 0);
+	static bool spiAsyncBusy()	{ return s_pAsyncCurrent != 0; }
+	static void spiAsyncWait()	{ while (spiAsyncBusy()) { ; } }	// PRECONDITIONS: interrupts enabled
+	static void spiInterruptHandler();	// Called from ISR(SPI_STC_vect).  Advances the asynchronous transaction by one byte.
+
+	// Bus arbitration.  Every device has a priority, higher is more urgent.  Set the priorities before using the bus.
+	// - The asynchronous queue is kept in priority order.  A transaction of an urgent device goes ahead of the queued
+	//   transactions of less urgent devices.  The transaction on the wire is never cut short.
+	// - An ISR that finds the bus busy posts a BusRequest.  Pending requests run, most urgent first, at two service
+	//   points only: in the SPI interrupt between asynchronous transactions, ahead of queued transactions of lower
+	//   priority, and in spiServiceRequests() (or the drivers' service calls) from the main loop.  They never run
+	//   inside spiTransactionEnd(): that would stretch a synchronous transaction of one device by the work of another,
+	//   with interrupts disabled, and run it before the caller has picked up the results of its own transaction.
+	//   So the main loop has to reach a service point within the deadline of the posting ISR, e.g. before a CC2500
+	//   RX FIFO that has reached its threshold fills up.
+	// - spiSetMaxLength() bounds the asynchronous transactions of a device, and with it how long a request may wait.
+	void spiSetPriority(unsigned char iPriority)	{ m_iPriority = iPriority; }
+	unsigned char spiPriority() const				{ return m_iPriority; }
+	void spiSetMaxLength(unsigned char iMaxLength)	{ m_iMaxLength = iMaxLength; }	// spiQueueTransaction() refuses longer transactions
+
+	typedef void (*BusRequestService)(void* pContext);	// called with interrupts disabled and the bus idle, keep it short
+
+	struct BusRequest
+	{
+		BusRequest() : pfnService(0), pContext(0), pDevice(0), bPending(false), pNext(0) {}
+
+		BusRequestService	pfnService;		// filled in by spiPostRequest()
+		void*				pContext;		// filled in by spiPostRequest()
+		SPIExternalDevice*	pDevice;		// filled in by spiPostRequest()
+		volatile bool		bPending;		// posted and not serviced yet
+		BusRequest*			pNext;			// private to the arbiter: list link
+#if SPIDEVICE_INSTRUMENTATION
+		unsigned long		iPostedAt;		// private to the arbiter: micros() when posted
+#endif
+	};
+
+	void spiPostRequest(BusRequest* pRequest, BusRequestService pfnService, void* pContext);	// PRECONDITIONS: interrupts disabled
+	static void spiServiceRequests();	// Runs the pending requests now if the bus is idle.  Call it from the main loop.
+
+	// Bus instrumentation (SPIDEVICE_INSTRUMENTATION).  The counters wrap around; take differences of snapshots.
+	struct BusStats
+	{
+		unsigned long	iTransactions;		// spiTransactionBegin() calls, synchronous and asynchronous
+		unsigned long	iBytes;				// bytes clocked
+		unsigned long	iReconfigurations;	// transactions that had to rewrite SPCR/SPSR
+		unsigned long	iCSMicros;			// time with CS_n asserted, us.  micros() has 4 us resolution at 16 MHz.
+		unsigned long	iSPIFSpins;			// iterations of the SPIF wait in spiTransfer()
+		unsigned long	iReadySpins;		// iterations of the chip ready wait (CC2500: MISO low)
+		unsigned long	iQueueWaits;		// asynchronous transactions started and bus requests serviced
+		unsigned long	iQueueWaitMicros;	// their total time in the queue, us
+		unsigned long	iQueueWaitMaxMicros;	// the longest of them, us
+	};
+
+	void spiStats(BusStats& stats) const;	// consistent snapshot.  All zeros when the instrumentation is compiled out.
+	void spiStatsReset();
+	void spiStatsPrint(Print& out, const char* szName) const;	// one line, e.g. over Serial
 
 protected:
 	inline static void attachInterrupt() { SPCR |= _BV(SPIE); }
@@ -36,8 +142,33 @@ protected:
 
 	inline static byte spiTransfer(byte bData);
 
-	void spiTransactionBegin();	// Actions needed for beginning a transaction (e.g. assert CS_n)
-	void spiTransactionEnd();	// Actions needed for ending a transaction (e.g. deassert CS_n)
+	// Block transfers inside an open transaction.  The next byte is fetched and the previous one stored while the
+	// current byte is on the wire, so SPDR is reloaded right after SPIF sets.  At DIV2 the gap between bytes is a few
+	// cycles instead of the loop overhead of spiTransfer() calls.
+	inline static void spiWriteBlock(const byte* pTxData, unsigned char iLength);	// received bytes are discarded
+	inline static void spiReadBlock(byte* pRxData, unsigned char iLength, byte bDummy);	// bDummy is sent for every byte
+	inline static void spiTransferBlock(const byte* pTxData, byte* pRxData, unsigned char iLength);	// pRxData may equal pTxData
+	inline static void spiWaitTransfer();	// SPIF wait, counted by the instrumentation
+
+	// The spidev backend collects block transfers and fills their RX buffers on spiFlush() or spiTransactionEnd().
+	// Here every transfer is finished when it returns, so there is nothing to flush.
+	inline static void spiFlush() {}
+	inline static bool spiMisoHigh() { return digitalRead(MISO) == HIGH; }	// CS_n asserted: the slave drives MISO
+
+	inline void spiTransactionBegin();	// Actions needed for beginning a transaction (e.g. assert CS_n)
+	inline void spiTransactionEnd();	// Actions needed for ending a transaction (e.g. deassert CS_n)
+
+	inline void csAssert();		// Drive CS_n low with a direct port write
+	inline void csDeassert();	// Drive CS_n high with a direct port write
+
+	// Instrumentation hooks.  Empty when SPIDEVICE_INSTRUMENTATION is 0.
+	inline void statsTransactionBegin(bool bReconfigured);	// after CS_n is asserted
+	inline void statsTransactionEnd();						// before CS_n is de-asserted
+	inline static void statsBytes(unsigned char iCount);
+	inline static void statsReadySpins(unsigned int iSpins);
+#if SPIDEVICE_INSTRUMENTATION
+	inline void statsQueueWait(unsigned long iSince);		// iSince is the micros() stamp of queuing/posting
+#endif
 
 	enum Mask
 	{
@@ -47,18 +178,291 @@ protected:
 	};
 
 	unsigned char	m_pinCS_n;		// Number of the active-low slave select pin (CS#).
-	SPIMode			m_iSPIMode;		// SPI mode (this external device)
-	SPIClockDiv		m_iSPIClockDiv;	// SPI clock divider (this external device)
-	unsigned char	m_iBitOrder;	// LSBFIRST of MSBFIRST
+
+	// Worked out once in the constructor from SPI mode, clock divider and bit order of this external device
+	byte				m_iSPCR;	// SPCR image: SPE, MSTR, DORD, CPOL, CPHA, SPR1:0
+	byte				m_iSPSR;	// SPSR image: SPI2X
+	volatile uint8_t*	m_pCSPort;	// output register of the port that has CS_n
+	byte				m_iCSMask;	// bit of CS_n in that port
+
+	static const SPIExternalDevice* volatile s_pBusOwner;	// device that configured SPCR/SPSR last, NULL if unknown
+	static volatile bool s_bTransactionOpen;	// between spiTransactionBegin() and spiTransactionEnd()
+
+	unsigned char	m_iPriority;	// bus arbitration, higher is more urgent.  0 by default.
+	unsigned char	m_iMaxLength;	// longest asynchronous transaction accepted.  255 by default.
+
+	static BusRequest* volatile	s_pRequestHead;		// pending bus requests, most urgent first
+
+#if SPIDEVICE_INSTRUMENTATION
+	BusStats			m_stats;
+	unsigned long		m_iCSAssertedAt;	// micros() when CS_n went low
+	static BusStats* volatile	s_pActiveStats;	// counters of the device in the open transaction, NULL outside transactions
+#endif
+
+private:
+	static void spiAsyncStartNext();	// PRECONDITIONS: interrupts disabled, no transaction on the wire
+	static void spiRunRequests(unsigned char iMinPriority);	// runs pending requests of at least this priority
+	static volatile bool s_bRunningRequests;
+
+	static AsyncTransaction* volatile	s_pAsyncCurrent;	// transaction on the wire, NULL when the engine is idle
+	static AsyncTransaction* volatile	s_pAsyncHead;		// queued transactions, oldest first
+	static AsyncTransaction* volatile	s_pAsyncTail;
 };
 
 
+void SPIExternalDevice::spiTransactionBegin()
+{
+	s_bTransactionOpen = true;
+
+	// 1. make sure that SPI parameters are set for this particular external device (i.e. instance of a subclass)
+	const SPIExternalDevice* pOwner = s_pBusOwner;
+	bool bReconfigure = (pOwner != this) && !(pOwner && pOwner->spiSameConfiguration(*this));
+	if (bReconfigure)
+	{
+		SPCR = m_iSPCR;
+		SPSR = m_iSPSR;
+		s_pBusOwner = this;
+	}
+
+	// 2. assert CS_n
+	csAssert();
+	statsTransactionBegin(bReconfigure);
+}
+
+
+void SPIExternalDevice::spiTransactionEnd()
+{
+	statsTransactionEnd();
+	csDeassert();	// de-assert CS_n
+	s_bTransactionOpen = false;	// a request posted meanwhile waits for a service point, see spiServiceRequests()
+}
+
+
+void SPIExternalDevice::csAssert()
+{
+	byte oldSREG = SREG;	// read-modify-write of the port must not race with an ISR writing the same port
+	cli();
+	*m_pCSPort &= ~m_iCSMask;
+	SREG = oldSREG;
+}
+
+
+void SPIExternalDevice::csDeassert()
+{
+	byte oldSREG = SREG;
+	cli();
+	*m_pCSPort |= m_iCSMask;
+	SREG = oldSREG;
+}
+
+
 byte SPIExternalDevice::spiTransfer(byte bData)
 {
   SPDR = bData;
-  while ( !(SPSR & _BV(SPIF)) ) { ; }
+  spiWaitTransfer();
+  statsBytes(1);
   return SPDR;
 }
 
 
-#endif
\ No newline at end of file
+void SPIExternalDevice::spiWaitTransfer()
+{
+#if SPIDEVICE_INSTRUMENTATION
+	unsigned int iSpins = 0;
+	while ( !(SPSR & _BV(SPIF)) ) { ++iSpins; }
+	if (s_pActiveStats)
+		s_pActiveStats->iSPIFSpins += iSpins;
+#else
+	while ( !(SPSR & _BV(SPIF)) ) { ; }
+#endif
+}
+
+
+void SPIExternalDevice::spiWriteBlock(const byte* pTxData, unsigned char iLength)
+{
+	if (iLength == 0)
+		return;
+
+	statsBytes(iLength);
+	SPDR = *pTxData++;
+	while (--iLength)
+	{
+		byte bNext = *pTxData++;	// fetched while the previous byte shifts out
+		spiWaitTransfer();
+		SPDR = bNext;				// the SPDR access also clears SPIF
+	}
+	spiWaitTransfer();
+	(void)SPDR;		// clears SPIF
+}
+
+
+void SPIExternalDevice::spiReadBlock(byte* pRxData, unsigned char iLength, byte bDummy)
+{
+	if (iLength == 0)
+		return;
+
+	statsBytes(iLength);
+	SPDR = bDummy;
+	while (--iLength)
+	{
+		spiWaitTransfer();
+		byte bData = SPDR;
+		SPDR = bDummy;
+		*pRxData++ = bData;			// stored while the next byte shifts in
+	}
+	spiWaitTransfer();
+	*pRxData = SPDR;
+}
+
+
+void SPIExternalDevice::spiTransferBlock(const byte* pTxData, byte* pRxData, unsigned char iLength)
+// The TX pointer runs one byte ahead of the RX pointer, so the same buffer may be used for both.
+{
+	if (iLength == 0)
+		return;
+
+	statsBytes(iLength);
+	SPDR = *pTxData++;
+	while (--iLength)
+	{
+		byte bNext = *pTxData++;
+		spiWaitTransfer();
+		byte bData = SPDR;
+		SPDR = bNext;
+		*pRxData++ = bData;
+	}
+	spiWaitTransfer();
+	*pRxData = SPDR;
+}
+
+
+#if SPIDEVICE_INSTRUMENTATION
+
+void SPIExternalDevice::statsTransactionBegin(bool bReconfigured)
+{
+	++m_stats.iTransactions;
+	if (bReconfigured)
+		++m_stats.iReconfigurations;
+	m_iCSAssertedAt = micros();
+	s_pActiveStats = &m_stats;
+}
+
+
+void SPIExternalDevice::statsTransactionEnd()
+{
+	m_stats.iCSMicros += micros() - m_iCSAssertedAt;
+	s_pActiveStats = 0;
+}
+
+
+void SPIExternalDevice::statsBytes(unsigned char iCount)
+{
+	if (s_pActiveStats)
+		s_pActiveStats->iBytes += iCount;
+}
+
+
+void SPIExternalDevice::statsReadySpins(unsigned int iSpins)
+{
+	if (s_pActiveStats)
+		s_pActiveStats->iReadySpins += iSpins;
+}
+
+
+void SPIExternalDevice::statsQueueWait(unsigned long iSince)
+{
+	unsigned long iWait = micros() - iSince;
+	++m_stats.iQueueWaits;
+	m_stats.iQueueWaitMicros += iWait;
+	if (iWait > m_stats.iQueueWaitMaxMicros)
+		m_stats.iQueueWaitMaxMicros = iWait;
+}
+
+#else
+
+void SPIExternalDevice::statsTransactionBegin(bool)	{}
+void SPIExternalDevice::statsTransactionEnd()	{}
+void SPIExternalDevice::statsBytes(unsigned char)	{}
+void SPIExternalDevice::statsReadySpins(unsigned int)	{}
+
+#endif
+
+
+// On ATmega168/328 boards the Arduino pin numbering maps to ports at compile time:  0-7 PORTD, 8-13 PORTB, 14-19 PORTC.
+#if defined(__AVR_ATmega168__) || defined(__AVR_ATmega168P__) || defined(__AVR_ATmega328__) || defined(__AVR_ATmega328P__)
+#define SPIDEVICE_CONSTANT_CS_PORT
+#endif
+
+
+/*	Compile-time specialized SPI external device, for boards with fixed wiring.
+	CS_n pin, SPI mode, clock divider and bit order are template parameters, so the SPCR/SPSR images and the CS_n port/bit
+	are constants.  spiTransactionBegin()/spiTransactionEnd() compile to a few fixed register writes (CS_n is a single cbi/sbi).
+	Drivers are instantiated on top of it, e.g.
+		CC2500xcvrT< SPIDevice<10, SPIExternalDevice::MODE0, SPIExternalDevice::DIV2> > radio;
+	It still is an SPIExternalDevice, so it works with the asynchronous queue and the bus owner tracking.
+
+	What is compile-time and what isn't: only the synchronous path of the driver (spiTransactionBegin/End, csAssert/csDeassert
+	below) uses the constants.  The base class is still constructed with the same parameters and keeps its run-time images
+	(m_iSPCR, m_iSPSR, m_pCSPort, m_iCSMask, 5 bytes of RAM per device), because code that only has an SPIExternalDevice*
+	needs them: the asynchronous engine begins and ends transactions through the base class, and spiSameConfiguration()
+	compares the images of the bus owner and of the next device.  The base constructor also sets CS_n as an output, high.
+	So the template saves the work per transaction, not the configuration state.  */
+template<unsigned char pinCS_n, SPIExternalDevice::SPIMode iSPIMode, SPIExternalDevice::SPIClockDiv iSPIClockDiv = SPIExternalDevice::DIV4, unsigned char uiBitOrder = MSBFIRST>
+class SPIDevice : public SPIExternalDevice
+{
+public:
+	SPIDevice() : SPIExternalDevice(pinCS_n, iSPIMode, iSPIClockDiv, uiBitOrder) {}
+
+	static const byte SPCR_IMAGE = _BV(SPE) | _BV(MSTR) | (iSPIMode & MODE) | (iSPIClockDiv & CLOCK) | ((uiBitOrder == LSBFIRST) ? _BV(DORD) : 0);
+	static const byte SPSR_IMAGE = (iSPIClockDiv >> 2) & X2CLOCK;
+
+protected:
+	inline void spiTransactionBegin()
+	{
+		s_bTransactionOpen = true;
+		const SPIExternalDevice* pOwner = s_pBusOwner;
+		bool bReconfigure = (pOwner != this) && !(pOwner && pOwner->spiSameConfiguration(*this));
+		if (bReconfigure)
+		{
+			SPCR = SPCR_IMAGE;
+			SPSR = SPSR_IMAGE;
+			s_pBusOwner = this;
+		}
+		csAssert();
+		statsTransactionBegin(bReconfigure);
+	}
+
+	inline void spiTransactionEnd()
+	{
+		statsTransactionEnd();
+		csDeassert();
+		s_bTransactionOpen = false;
+	}
+
+#ifdef SPIDEVICE_CONSTANT_CS_PORT
+	static const byte CS_MASK = _BV((pinCS_n < 8) ? pinCS_n : (pinCS_n < 14) ? (pinCS_n - 8) : (pinCS_n - 14));
+	inline static volatile uint8_t& csPort()	{ return (pinCS_n < 8) ? PORTD : (pinCS_n < 14) ? PORTB : PORTC; }
+
+	inline void csAssert()		{ csPort() &= ~CS_MASK; }	// single cbi, atomic
+	inline void csDeassert()	{ csPort() |= CS_MASK; }	// single sbi, atomic
+#else
+	using SPIExternalDevice::csAssert;
+	using SPIExternalDevice::csDeassert;
+#endif
+};
+
+template<unsigned char pinCS_n, SPIExternalDevice::SPIMode iSPIMode, SPIExternalDevice::SPIClockDiv iSPIClockDiv, unsigned char uiBitOrder>
+const byte SPIDevice<pinCS_n, iSPIMode, iSPIClockDiv, uiBitOrder>::SPCR_IMAGE;
+
+template<unsigned char pinCS_n, SPIExternalDevice::SPIMode iSPIMode, SPIExternalDevice::SPIClockDiv iSPIClockDiv, unsigned char uiBitOrder>
+const byte SPIDevice<pinCS_n, iSPIMode, iSPIClockDiv, uiBitOrder>::SPSR_IMAGE;
+
+#ifdef SPIDEVICE_CONSTANT_CS_PORT
+template<unsigned char pinCS_n, SPIExternalDevice::SPIMode iSPIMode, SPIExternalDevice::SPIClockDiv iSPIClockDiv, unsigned char uiBitOrder>
+const byte SPIDevice<pinCS_n, iSPIMode, iSPIClockDiv, uiBitOrder>::CS_MASK;
+#endif
+
+
+#endif // SPIDEVICE_SPIDEV
+
+#endif
@@ -0,0 +1,373 @@
+/*
+\file	SPIExternalDeviceSpidev.cpp
+\version	1.0.0
+\purpose	SPIExternalDevice for Linux boards, over /dev/spidevX.Y.  See SPIExternalDeviceSpidev.h.
+\compiler	g++ on Linux
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+#include <Arduino.h>
+#include "SPIExternalDevice.h"
+
+#ifdef SPIDEVICE_SPIDEV		// the AVR build compiles this file to nothing
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+
+const byte SPIExternalDevice::ASYNC_DUMMY;
+const unsigned char SPIExternalDevice::NO_PIN;
+
+const SPIExternalDevice* volatile SPIExternalDevice::s_pBusOwner = 0;
+volatile bool SPIExternalDevice::s_bTransactionOpen = false;
+SPIExternalDevice::BusRequest* volatile SPIExternalDevice::s_pRequestHead = 0;
+volatile bool SPIExternalDevice::s_bRunningRequests = false;
+unsigned char SPIExternalDevice::s_pinMisoSense = SPIExternalDevice::NO_PIN;
+
+#if SPIDEVICE_INSTRUMENTATION
+SPIExternalDevice::BusStats* volatile SPIExternalDevice::s_pActiveStats = 0;
+#endif
+
+
+// Segments collected for the next SPI_IOC_MESSAGE.  The limits are those of the spidev driver with default
+// parameters: 4096 bytes per message (module parameter bufsiz).
+static const unsigned char MAX_SEGMENTS = 32;
+static const unsigned short MAX_MESSAGE_BYTES = 4096;
+
+static int s_fdBus = -1;
+static struct spi_ioc_transfer s_aSegments[MAX_SEGMENTS];
+static unsigned char s_iSegments = 0;
+static unsigned short s_iMessageBytes = 0;
+static unsigned long s_iSpeedHz = 0;		// of the bus owner, put into every segment
+static bool s_bNoCS = true;					// the controller accepted SPI_NO_CS
+
+// Dummy bytes for spiReadBlock() and the byte of spiTransfer(), reset by every flush.  Never more than the message bytes.
+static byte s_aScratch[MAX_MESSAGE_BYTES];
+static unsigned short s_iScratchUsed = 0;
+
+
+SPIExternalDevice::SPIExternalDevice(unsigned char pinCS_n, SPIMode iSPIMode, SPIClockDiv iSPIClockDiv, unsigned char uiBitOrder)
+{
+	m_pinCS_n = pinCS_n;
+	pinMode(m_pinCS_n, OUTPUT);  digitalWrite(m_pinCS_n, HIGH);
+
+	// SPCR.CPOL/CPHA are bits 3:2, SPI_CPOL/SPI_CPHA are bits 1:0
+	m_iSpidevMode = (unsigned char)(iSPIMode >> 2);
+	if (uiBitOrder == LSBFIRST)
+		m_iSpidevMode |= SPI_LSB_FIRST;
+
+	// same divider encoding as SPR1:0 and SPI2X on the AVR
+	static const unsigned char aDivider[] = { 4, 16, 64, 128, 2, 8, 32 };
+	m_iSpeedHz = F_CPU / aDivider[iSPIClockDiv];
+
+	m_iPriority = 0;
+	m_iMaxLength = 0xFF;
+
+#if SPIDEVICE_INSTRUMENTATION
+	memset(&m_stats, 0, sizeof(m_stats));
+	m_iCSAssertedAt = 0;
+#endif
+}
+
+
+bool SPIExternalDevice::spiMasterInit(const char* szDevice)
+{
+	spiMasterStop();
+	s_fdBus = open(szDevice, O_RDWR);
+	if (s_fdBus < 0)
+	{
+		perror(szDevice);
+		return false;
+	}
+	s_bNoCS = true;
+	spiBusInvalidate();
+	return true;
+}
+
+
+void SPIExternalDevice::spiMasterStop()
+{
+	if (s_fdBus >= 0)
+		close(s_fdBus);
+	s_fdBus = -1;
+	s_iSegments = 0;
+	s_iMessageBytes = 0;
+	s_iScratchUsed = 0;
+	spiBusInvalidate();
+}
+
+
+void SPIExternalDevice::spiTransactionBegin()
+{
+	byte oldSREG = SREG;
+	cli();	// an interrupt thread checks the flag with the lock held, and then uses the bus
+	s_bTransactionOpen = true;
+	SREG = oldSREG;
+
+	const SPIExternalDevice* pOwner = s_pBusOwner;
+	bool bReconfigure = (pOwner != this) && !(pOwner && pOwner->spiSameConfiguration(*this));
+	if (bReconfigure)
+	{
+		unsigned char iMode = m_iSpidevMode | ((s_bNoCS) ? SPI_NO_CS : 0);
+		if (s_bNoCS && ioctl(s_fdBus, SPI_IOC_WR_MODE, &iMode) < 0)
+		{
+			s_bNoCS = false;	// not supported by this controller.  Its own chip select toggles, unconnected.
+			iMode = m_iSpidevMode;
+		}
+		if (!s_bNoCS && ioctl(s_fdBus, SPI_IOC_WR_MODE, &iMode) < 0)
+			perror("SPI_IOC_WR_MODE");
+		s_iSpeedHz = m_iSpeedHz;
+		s_pBusOwner = this;
+	}
+
+	csAssert();
+	statsTransactionBegin(bReconfigure);
+}
+
+
+void SPIExternalDevice::spiTransactionEnd()
+{
+	spiFlush();
+	statsTransactionEnd();
+	csDeassert();
+
+	byte oldSREG = SREG;
+	cli();
+	s_bTransactionOpen = false;	// a request posted meanwhile waits for spiServiceRequests(), as on the AVR
+	SREG = oldSREG;
+}
+
+
+void SPIExternalDevice::spiMakeRoom(unsigned char iLength)
+// PURPOSE:		Sends the collected segments if one more of iLength bytes doesn't fit.  CS_n is a GPIO, so a transaction
+//				may span several messages.
+{
+	if (s_iSegments == MAX_SEGMENTS || s_iMessageBytes + iLength > MAX_MESSAGE_BYTES)
+		spiFlush();
+}
+
+
+void SPIExternalDevice::spiAddSegment(const byte* pTxData, byte* pRxData, unsigned char iLength)
+// PRECONDITIONS:	spiMakeRoom(iLength) called since the last use of the scratch bytes
+{
+	if (iLength == 0)
+		return;
+
+	struct spi_ioc_transfer& segment = s_aSegments[s_iSegments++];
+	memset(&segment, 0, sizeof(segment));
+	segment.tx_buf = (unsigned long)pTxData;	// NULL sends zeros
+	segment.rx_buf = (unsigned long)pRxData;	// NULL discards
+	segment.len = iLength;
+	segment.speed_hz = s_iSpeedHz;
+	segment.bits_per_word = 8;
+	s_iMessageBytes += iLength;
+	statsBytes(iLength);
+}
+
+
+void SPIExternalDevice::spiFlush()
+{
+	if (s_iSegments == 0)
+		return;
+
+	if (ioctl(s_fdBus, SPI_IOC_MESSAGE(s_iSegments), s_aSegments) < 0)
+	{
+		perror("SPI_IOC_MESSAGE");
+		for (unsigned char i = 0; i < s_iSegments; ++i)	// reads as a slave that doesn't answer
+			if (s_aSegments[i].rx_buf)
+				memset((void*)(unsigned long)s_aSegments[i].rx_buf, 0xFF, s_aSegments[i].len);
+	}
+#if SPIDEVICE_INSTRUMENTATION
+	if (s_pActiveStats)
+		++s_pActiveStats->iMessages;
+#endif
+
+	s_iSegments = 0;
+	s_iMessageBytes = 0;
+	s_iScratchUsed = 0;
+}
+
+
+byte SPIExternalDevice::spiTransfer(byte bData)
+{
+	spiMakeRoom(1);
+	byte* pByte = &s_aScratch[s_iScratchUsed++];
+	*pByte = bData;
+	spiAddSegment(pByte, pByte, 1);
+	spiFlush();
+	return *pByte;
+}
+
+
+void SPIExternalDevice::spiWriteBlock(const byte* pTxData, unsigned char iLength)
+{
+	spiMakeRoom(iLength);
+	spiAddSegment(pTxData, 0, iLength);
+}
+
+
+void SPIExternalDevice::spiReadBlock(byte* pRxData, unsigned char iLength, byte bDummy)
+{
+	spiMakeRoom(iLength);
+	if (bDummy == 0x00)
+	{
+		spiAddSegment(0, pRxData, iLength);
+		return;
+	}
+	byte* pDummies = &s_aScratch[s_iScratchUsed];
+	memset(pDummies, bDummy, iLength);
+	s_iScratchUsed += iLength;
+	spiAddSegment(pDummies, pRxData, iLength);
+}
+
+
+void SPIExternalDevice::spiTransferBlock(const byte* pTxData, byte* pRxData, unsigned char iLength)
+{
+	spiMakeRoom(iLength);
+	spiAddSegment(pTxData, pRxData, iLength);
+}
+
+
+bool SPIExternalDevice::spiMisoHigh()
+{
+	return s_pinMisoSense != NO_PIN && digitalRead(s_pinMisoSense) == HIGH;
+}
+
+
+bool SPIExternalDevice::spiQueueTransaction(AsyncTransaction* pTransaction, const byte* pTxData, byte* pRxData, unsigned char iLength, AsyncCallback pfnComplete)
+// PURPOSE:		Runs the transaction right away.  The callback is called before returning.
+{
+	if (iLength == 0 || iLength > m_iMaxLength || pTransaction->iStatus == ASYNC_QUEUED || pTransaction->iStatus == ASYNC_IN_PROGRESS)
+		return false;
+
+	pTransaction->pDevice = this;
+	pTransaction->pTxData = pTxData;
+	pTransaction->pRxData = pRxData;
+	pTransaction->iLength = iLength;
+	pTransaction->pfnComplete = pfnComplete;
+	pTransaction->iIndex = 0;
+	pTransaction->pNext = 0;
+	pTransaction->iStatus = ASYNC_IN_PROGRESS;
+
+	spiTransactionBegin();
+	spiTransferBlock(pTxData, pRxData, iLength);	// NULL TX sends zeros, which is ASYNC_DUMMY
+	spiTransactionEnd();
+
+	pTransaction->iIndex = iLength;
+	pTransaction->iStatus = ASYNC_DONE;
+	if (pfnComplete)
+		pfnComplete(pTransaction);
+	return true;
+}
+
+
+void SPIExternalDevice::spiPostRequest(BusRequest* pRequest, BusRequestService pfnService, void* pContext)
+{
+	if (pRequest->bPending)
+		return;
+
+	pRequest->pfnService = pfnService;
+	pRequest->pContext = pContext;
+	pRequest->pDevice = this;
+	pRequest->bPending = true;
+#if SPIDEVICE_INSTRUMENTATION
+	pRequest->iPostedAt = micros();
+#endif
+
+	BusRequest* pPrevious = 0;
+	BusRequest* pNext = s_pRequestHead;
+	while (pNext && pNext->pDevice->m_iPriority >= m_iPriority)
+	{
+		pPrevious = pNext;
+		pNext = pNext->pNext;
+	}
+	pRequest->pNext = pNext;
+	if (pPrevious)
+		pPrevious->pNext = pRequest;
+	else
+		s_pRequestHead = pRequest;
+}
+
+
+void SPIExternalDevice::spiServiceRequests()
+{
+	byte oldSREG = SREG;
+	cli();
+	spiRunRequests(0);
+	SREG = oldSREG;
+}
+
+
+void SPIExternalDevice::spiRunRequests(unsigned char iMinPriority)
+// PRECONDITIONS:	interrupts disabled
+{
+	if (s_bRunningRequests)
+		return;
+	s_bRunningRequests = true;
+
+	BusRequest* pRequest;
+	while (!s_bTransactionOpen && (pRequest = s_pRequestHead) != 0 && pRequest->pDevice->m_iPriority >= iMinPriority)
+	{
+		s_pRequestHead = pRequest->pNext;
+		pRequest->bPending = false;
+#if SPIDEVICE_INSTRUMENTATION
+		pRequest->pDevice->statsQueueWait(pRequest->iPostedAt);
+#endif
+		pRequest->pfnService(pRequest->pContext);
+	}
+
+	s_bRunningRequests = false;
+}
+
+
+void SPIExternalDevice::spiStats(BusStats& stats) const
+{
+#if SPIDEVICE_INSTRUMENTATION
+	byte oldSREG = SREG;
+	cli();
+	stats = m_stats;
+	SREG = oldSREG;
+#else
+	memset(&stats, 0, sizeof(stats));
+#endif
+}
+
+
+void SPIExternalDevice::spiStatsReset()
+{
+#if SPIDEVICE_INSTRUMENTATION
+	byte oldSREG = SREG;
+	cli();
+	memset(&m_stats, 0, sizeof(m_stats));
+	SREG = oldSREG;
+#endif
+}
+
+
+void SPIExternalDevice::spiStatsPrint(Print& out, const char* szName) const
+{
+	out.print(szName);
+#if SPIDEVICE_INSTRUMENTATION
+	BusStats stats;
+	spiStats(stats);
+	out.print(F(": transactions "));	out.print(stats.iTransactions);
+	out.print(F(", bytes "));			out.print(stats.iBytes);
+	out.print(F(", ioctls "));			out.print(stats.iMessages);
+	out.print(F(", reconfigurations "));	out.print(stats.iReconfigurations);
+	out.print(F(", CS us "));			out.print(stats.iCSMicros);
+	out.print(F(", ready spins "));		out.print(stats.iReadySpins);
+	out.print(F(", queue waits "));		out.print(stats.iQueueWaits);
+	out.print(F(", wait us "));			out.print(stats.iQueueWaitMicros);
+	out.print(F(", max wait us "));		out.println(stats.iQueueWaitMaxMicros);
+#else
+	out.println(F(": SPI instrumentation not compiled in"));
+#endif
+}
+
+#endif
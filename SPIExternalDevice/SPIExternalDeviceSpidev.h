@@ -0,0 +1,236 @@
+/*
+\file	SPIExternalDeviceSpidev.h
+\version	1.0.0
+\purpose	SPIExternalDevice for Linux boards: the bus is /dev/spidevX.Y, CS_n is a GPIO.  Included by SPIExternalDevice.h
+			when the Linux core (LinuxCore/Arduino.h) is used.  Don't include it directly.
+\compiler	g++ on Linux
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+/*	Same interface as the AVR SPIExternalDevice, so CC2500xcvr, BMA180AccelerometerSPI and the other drivers build
+	unchanged.  What's different:
+	- Each transfer is a segment (struct spi_ioc_transfer).  Segments are collected and go to the kernel together as
+	  one SPI_IOC_MESSAGE(n) ioctl.  spiTransfer() needs its answer right away, so it sends everything collected so
+	  far, itself included.  The block transfers are only collected: the RX buffer of spiReadBlock()/spiTransferBlock()
+	  is filled by the next spiTransfer(), spiFlush() or spiTransactionEnd(), and the TX buffer must stay unchanged
+	  until then.  A header byte sent as a one-byte block plus a burst is a single ioctl.
+	- CS_n is a GPIO, driven by the library.  The chip select of the spidev device itself shouldn't be wired to a slave;
+	  SPI_NO_CS is requested where the controller supports it.
+	- The clock dividers are relative to F_CPU of the core (16 MHz): DIV2 is 8 MHz, DIV4 is 4 MHz, and so on.
+	- MISO can't be read while the controller owns it.  spiMisoHigh(), which the CC2500 chip ready wait uses, reads the
+	  GPIO set with spiSetMisoSense() (a spare input wired to MISO).  Without it the wait is skipped.
+	- Asynchronous transactions run to completion inside spiQueueTransaction(), callback included.
+	- BusStats::iSPIFSpins stays 0.  BusStats::iMessages counts the ioctls.	*/
+
+#ifndef SPIEXTERNALDEVICESPIDEV_H_INCLUDED
+#define SPIEXTERNALDEVICESPIDEV_H_INCLUDED
+
+#ifndef __linux__
+#error "SPIExternalDeviceSpidev.h needs Linux (spidev).  On the AVR, SPIExternalDevice.h uses the SPI peripheral."
+#endif
+
+
+class SPIExternalDevice
+{
+public:
+	enum SPIMode		{ MODE0 = 0x00, MODE1 = 0x04, MODE2 = 0x08, MODE3 = 0x0C };
+	enum SPIClockDiv	{ DIV4 = 0x00, DIV16 = 0x01, DIV64 = 0x02, DIV128 = 0x03, DIV2 = 0x04, DIV8 = 0x05, DIV32 = 0x06 };
+
+	SPIExternalDevice(unsigned char pinCS_n, SPIMode iSPIMode, SPIClockDiv iSPIClockDiv = DIV4, unsigned char uiBitOrder = MSBFIRST);
+
+	static bool spiMasterInit(const char* szDevice = "/dev/spidev0.0");	// open the bus.  false (and a message on stderr) if it can't.
+	static void spiMasterStop();
+	inline static void spiBusInvalidate() { s_pBusOwner = 0; }
+	inline static bool spiBusBusy() { return s_bTransactionOpen; }
+	bool spiSameConfiguration(const SPIExternalDevice& other) const
+		{ return m_iSpidevMode == other.m_iSpidevMode && m_iSpeedHz == other.m_iSpeedHz; }
+
+	// Result of poll() of the resumable driver operations, as on the AVR.
+	enum PollStatus		{ POLL_IDLE = 0, POLL_BUSY, POLL_DONE, POLL_TIMEOUT };
+
+	static const unsigned char NO_PIN = 0xFF;
+	static void spiSetMisoSense(unsigned char pin)	{ s_pinMisoSense = pin; }	// GPIO wired to MISO, or NO_PIN
+
+	// Asynchronous transactions.  Here they complete before spiQueueTransaction() returns.
+	enum AsyncStatus	{ ASYNC_IDLE = 0, ASYNC_QUEUED, ASYNC_IN_PROGRESS, ASYNC_DONE };
+
+	struct AsyncTransaction;
+	typedef void (*AsyncCallback)(AsyncTransaction* pTransaction);
+
+	struct AsyncTransaction
+	{
+		SPIExternalDevice*		pDevice;
+		const byte*				pTxData;
+		byte*					pRxData;
+		unsigned char			iLength;
+		AsyncCallback			pfnComplete;
+		void*					pContext;
+		volatile unsigned char	iStatus;
+		unsigned char			iIndex;
+		AsyncTransaction*		pNext;
+	};
+
+	static const byte ASYNC_DUMMY = 0x00;
+
+	bool spiQueueTransaction(AsyncTransaction* pTransaction, const byte* pTxData, byte* pRxData, unsigned char iLength, AsyncCallback pfnComplete = 0);
+	static bool spiAsyncBusy()	{ return false; }
+	static void spiAsyncWait()	{}
+	static void spiInterruptHandler()	{}
+
+	// Bus arbitration, as on the AVR.  There is no queue to reorder, but bus requests work the same way, except that
+	// spiServiceRequests() from the main loop is their only service point.
+	void spiSetPriority(unsigned char iPriority)	{ m_iPriority = iPriority; }
+	unsigned char spiPriority() const				{ return m_iPriority; }
+	void spiSetMaxLength(unsigned char iMaxLength)	{ m_iMaxLength = iMaxLength; }
+
+	typedef void (*BusRequestService)(void* pContext);
+
+	struct BusRequest
+	{
+		BusRequest() : pfnService(0), pContext(0), pDevice(0), bPending(false), pNext(0) {}
+
+		BusRequestService	pfnService;
+		void*				pContext;
+		SPIExternalDevice*	pDevice;
+		volatile bool		bPending;
+		BusRequest*			pNext;
+#if SPIDEVICE_INSTRUMENTATION
+		unsigned long		iPostedAt;
+#endif
+	};
+
+	void spiPostRequest(BusRequest* pRequest, BusRequestService pfnService, void* pContext);	// PRECONDITIONS: interrupts disabled
+	static void spiServiceRequests();
+
+	// Bus instrumentation (SPIDEVICE_INSTRUMENTATION)
+	struct BusStats
+	{
+		unsigned long	iTransactions;
+		unsigned long	iBytes;
+		unsigned long	iReconfigurations;	// transactions that had to set the spidev mode
+		unsigned long	iCSMicros;
+		unsigned long	iSPIFSpins;			// always 0 here
+		unsigned long	iReadySpins;
+		unsigned long	iQueueWaits;		// bus requests serviced
+		unsigned long	iQueueWaitMicros;
+		unsigned long	iQueueWaitMaxMicros;
+		unsigned long	iMessages;			// SPI_IOC_MESSAGE ioctls
+	};
+
+	void spiStats(BusStats& stats) const;
+	void spiStatsReset();
+	void spiStatsPrint(Print& out, const char* szName) const;
+
+protected:
+	static byte spiTransfer(byte bData);	// sends what has been collected, and this byte
+	static void spiWriteBlock(const byte* pTxData, unsigned char iLength);
+	static void spiReadBlock(byte* pRxData, unsigned char iLength, byte bDummy);
+	static void spiTransferBlock(const byte* pTxData, byte* pRxData, unsigned char iLength);
+	static void spiFlush();					// sends what has been collected.  The RX buffers are filled after this.
+	static bool spiMisoHigh();
+
+	void spiTransactionBegin();
+	void spiTransactionEnd();				// flushes
+
+	void csAssert()		{ digitalWrite(m_pinCS_n, LOW); }
+	void csDeassert()	{ digitalWrite(m_pinCS_n, HIGH); }
+
+	inline void statsTransactionBegin(bool bReconfigured);
+	inline void statsTransactionEnd();
+	inline static void statsBytes(unsigned char iCount);
+	inline static void statsReadySpins(unsigned int iSpins);
+#if SPIDEVICE_INSTRUMENTATION
+	inline void statsQueueWait(unsigned long iSince);
+#endif
+
+	unsigned char	m_pinCS_n;
+	unsigned char	m_iSpidevMode;		// SPI_MODE_x, SPI_LSB_FIRST
+	unsigned long	m_iSpeedHz;
+
+	unsigned char	m_iPriority;
+	unsigned char	m_iMaxLength;
+
+	static const SPIExternalDevice* volatile s_pBusOwner;
+	static volatile bool s_bTransactionOpen;
+	static BusRequest* volatile	s_pRequestHead;
+	static unsigned char s_pinMisoSense;
+
+#if SPIDEVICE_INSTRUMENTATION
+	BusStats			m_stats;
+	unsigned long		m_iCSAssertedAt;
+	static BusStats* volatile	s_pActiveStats;
+#endif
+
+private:
+	static void spiMakeRoom(unsigned char iLength);
+	static void spiAddSegment(const byte* pTxData, byte* pRxData, unsigned char iLength);
+	static void spiRunRequests(unsigned char iMinPriority);
+	static volatile bool s_bRunningRequests;
+};
+
+
+#if SPIDEVICE_INSTRUMENTATION
+
+void SPIExternalDevice::statsTransactionBegin(bool bReconfigured)
+{
+	++m_stats.iTransactions;
+	if (bReconfigured)
+		++m_stats.iReconfigurations;
+	m_iCSAssertedAt = micros();
+	s_pActiveStats = &m_stats;
+}
+
+
+void SPIExternalDevice::statsTransactionEnd()
+{
+	m_stats.iCSMicros += micros() - m_iCSAssertedAt;
+	s_pActiveStats = 0;
+}
+
+
+void SPIExternalDevice::statsBytes(unsigned char iCount)
+{
+	if (s_pActiveStats)
+		s_pActiveStats->iBytes += iCount;
+}
+
+
+void SPIExternalDevice::statsReadySpins(unsigned int iSpins)
+{
+	if (s_pActiveStats)
+		s_pActiveStats->iReadySpins += iSpins;
+}
+
+
+void SPIExternalDevice::statsQueueWait(unsigned long iSince)
+{
+	unsigned long iWait = micros() - iSince;
+	++m_stats.iQueueWaits;
+	m_stats.iQueueWaitMicros += iWait;
+	if (iWait > m_stats.iQueueWaitMaxMicros)
+		m_stats.iQueueWaitMaxMicros = iWait;
+}
+
+#else
+
+void SPIExternalDevice::statsTransactionBegin(bool)	{}
+void SPIExternalDevice::statsTransactionEnd()	{}
+void SPIExternalDevice::statsBytes(unsigned char)	{}
+void SPIExternalDevice::statsReadySpins(unsigned int)	{}
+
+#endif
+
+
+// Compile-time device.  On Linux it only carries the configuration; there is nothing to gain from constant registers.
+template<unsigned char pinCS_n, SPIExternalDevice::SPIMode iSPIMode, SPIExternalDevice::SPIClockDiv iSPIClockDiv = SPIExternalDevice::DIV4, unsigned char uiBitOrder = MSBFIRST>
+class SPIDevice : public SPIExternalDevice
+{
+public:
+	SPIDevice() : SPIExternalDevice(pinCS_n, iSPIMode, iSPIClockDiv, uiBitOrder) {}
+};
+
+
+#endif
@@ -0,0 +1,129 @@
+/*
+\file	SPSCRingBuffer.h
+\version	1.0.0
+\purpose	Single-producer/single-consumer ring buffer for handing data from an ISR to the main loop (or back)
+			without disabling interrupts.
+\compiler	Arduino 1.0.1
+
+This file is free software; you can redistribute it and/or modify it under the terms of either the
+GNU General Public License version 2 or the GNU Lesser General Public License version 2.1, both as
+published by the Free Software Foundation.
+*/
+
+/*	How it works:
+	The producer only writes m_iHead, the consumer only writes m_iTail.  Both are free-running 8-bit counters, so
+	they are read and written atomically on AVR, and head - tail is the number of elements in the buffer.
+	That is why the capacity is a power of two no larger than 128.
+	A compiler barrier keeps the element copy ahead of the index update that publishes it.
+
+	The producer can also stage elements (pushUncommitted) and publish them all at once (commit), so that the
+	consumer never sees a half-written record, e.g. a radio packet that is still being drained from the FIFO.
+
+	SPSCRing<T> is the non-template-size interface that drivers take by reference.
+	SPSCRingBuffer<T, SIZE> adds the storage:
+		SPSCRingBuffer<unsigned char, 128>  g_rxRing;
+		radio.beginInterruptReceive(g_rxRing, 0);		*/
+
+#ifndef SPSCRINGBUFFER_H_INCLUDED
+#define SPSCRINGBUFFER_H_INCLUDED
+
+#define SPSC_BARRIER()	__asm__ __volatile__ ("" ::: "memory")
+
+
+template<class T>
+class SPSCRing
+{
+public:
+	// consumer side
+	unsigned char available() const	{ return (unsigned char)(m_iHead - m_iTail); }
+	bool pop(T& element);
+	unsigned char pop(T* pElements, unsigned char iCount);	// Up to iCount elements.  Returns the number popped.
+	const T& peek(unsigned char iOffset = 0) const	{ return m_pData[(unsigned char)(m_iTail + iOffset) & m_iMask]; }	// PRECONDITIONS: iOffset < available()
+	void skip(unsigned char iCount)	{ SPSC_BARRIER();  m_iTail += iCount; }	// PRECONDITIONS: iCount <= available()
+
+	// producer side
+	unsigned char space() const		{ return (unsigned char)(m_iMask + 1 - (m_iHeadPending - m_iTail)); }
+	bool push(const T& element);				// false if full
+	bool pushUncommitted(const T& element);		// staged, invisible to the consumer until commit()
+	void commit()					{ SPSC_BARRIER();  m_iHead = m_iHeadPending; }
+	void rollback()					{ m_iHeadPending = m_iHead; }
+
+	unsigned char capacity() const	{ return m_iMask + 1; }
+
+protected:
+	SPSCRing(T* pData, unsigned char iMask) : m_pData(pData), m_iMask(iMask), m_iHead(0), m_iHeadPending(0), m_iTail(0) {}
+
+	T*						m_pData;
+	const unsigned char		m_iMask;		// capacity - 1
+	volatile unsigned char	m_iHead;		// written by the producer only
+	unsigned char			m_iHeadPending;	// producer's private write position
+	volatile unsigned char	m_iTail;		// written by the consumer only
+};
+
+
+template<class T, unsigned char SIZE>
+class SPSCRingBuffer : public SPSCRing<T>
+{
+public:
+	SPSCRingBuffer() : SPSCRing<T>(m_aStorage, SIZE - 1) {}
+
+private:
+	typedef char SizeMustBeAPowerOfTwoUpTo128[(SIZE != 0 && SIZE <= 128 && (SIZE & (SIZE - 1)) == 0) ? 1 : -1];
+
+	T	m_aStorage[SIZE];
+};
+
+
+template<class T>
+bool SPSCRing<T>::pop(T& element)
+{
+	if (m_iHead == m_iTail)
+		return false;
+
+	element = m_pData[m_iTail & m_iMask];
+	SPSC_BARRIER();
+	++m_iTail;
+	return true;
+}
+
+
+template<class T>
+unsigned char SPSCRing<T>::pop(T* pElements, unsigned char iCount)
+{
+	unsigned char iAvailable = available();
+	if (iCount > iAvailable)
+		iCount = iAvailable;
+
+	unsigned char iTail = m_iTail;
+	for (unsigned char i = 0; i < iCount; ++i)
+		pElements[i] = m_pData[(unsigned char)(iTail + i) & m_iMask];
+
+	SPSC_BARRIER();
+	m_iTail = iTail + iCount;
+	return iCount;
+}
+
+
+template<class T>
+bool SPSCRing<T>::push(const T& element)
+{
+	if (!pushUncommitted(element))
+		return false;
+	commit();
+	return true;
+}
+
+
+template<class T>
+bool SPSCRing<T>::pushUncommitted(const T& element)
+{
+	if (space() == 0)
+		return false;
+
+	m_pData[m_iHeadPending & m_iMask] = element;
+	++m_iHeadPending;
+	return true;
+}
+
+
+#endif